@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INCLUDE_PERFETTO_BASE_LZ4_H_
+#define INCLUDE_PERFETTO_BASE_LZ4_H_
+
+#include <stddef.h>
+
+namespace perfetto {
+namespace base {
+
+// A self-contained codec for the LZ4 block format (see
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md). It trades
+// compression ratio for speed, so that traces can be compressed while they are
+// being recorded.
+
+// Returns the maximum size of |size| bytes once compressed.
+size_t Lz4CompressBound(size_t size);
+
+// Compresses the |size| bytes at |src| into |dst|, which must be at least
+// Lz4CompressBound(size) bytes long. Returns the size of the compressed data.
+size_t Lz4Compress(const void* src, size_t size, void* dst);
+
+// Decompresses the |size| bytes at |src| into the |dst_size| bytes at |dst|.
+// Returns false if |src| is not a valid block or doesn't decompress to exactly
+// |dst_size| bytes.
+bool Lz4Decompress(const void* src, size_t size, void* dst, size_t dst_size);
+
+}  // namespace base
+}  // namespace perfetto
+
+#endif  // INCLUDE_PERFETTO_BASE_LZ4_H_
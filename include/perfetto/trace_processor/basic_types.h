@@ -25,6 +25,31 @@ namespace trace_processor {
 
 struct Config {
   uint64_t window_size_ns = 180 * 1000 * 1000 * 1000ULL;  // 3 minutes.
+
+  // Number of threads used to load proto traces. With more than one thread,
+  // the tokenization of the trace packets is offloaded to worker threads while
+  // the insertion into storage stays on the thread calling Parse(). Ignored
+  // (always 1) on platforms without threads, e.g. WASM.
+  uint32_t num_ingestion_threads = 1;
+
+  // When true, the events are parsed as soon as the trace has moved past them
+  // on every cpu (and for the non-ftrace data), rather than once they are
+  // |window_size_ns| behind the latest event. This keeps the memory used to
+  // sort the events low on long traces. If a cpu stops producing events, the
+  // window still applies. Events which are later than this allows for are
+  // dropped and counted in the sorter_out_of_order_dropped stat.
+  bool streaming_sort = false;
+
+  // If non-zero, the oldest events are parsed, regardless of the window, when
+  // the events waiting to be sorted add up to more than this many bytes.
+  // Late events are dropped as above.
+  uint64_t max_sorter_buffered_bytes = 0;
+
+  // When true, the calls made to the virtual tables by each query run through
+  // the RawQuery interface, and the time spent in them, are recorded in the
+  // sql_profile table (see RawQueryResult.query_id), unless the query sets
+  // RawQueryArgs.disable_profiling. This slows down the queries.
+  bool profile_queries = false;
 };
 
 // Represents a dynamically typed value returned by SQL.
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_PERFETTO_TRACE_PROCESSOR_TRACE_BLOB_H_
+#define INCLUDE_PERFETTO_TRACE_PROCESSOR_TRACE_BLOB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+namespace perfetto {
+namespace trace_processor {
+
+// A read-only chunk of trace data passed to TraceProcessor::Parse(). The
+// events parsed from the chunk point straight into its memory, so the
+// TraceProcessor keeps it alive until all of them have been processed, which
+// can be well after Parse() returns.
+class TraceBlob {
+ public:
+  // Takes ownership of a heap allocated buffer of |size| bytes.
+  static std::unique_ptr<TraceBlob> FromHeapBuffer(std::unique_ptr<uint8_t[]>,
+                                                   size_t size);
+
+  virtual ~TraceBlob();
+
+  virtual const uint8_t* data() const = 0;
+  virtual size_t size() const = 0;
+};
+
+// A read-only memory mapping of a trace file. Slice() returns TraceBlobs
+// pointing straight into the mapping, which allows to load a trace without
+// reading it into heap buffers first. The pages of a slice are given back to
+// the kernel as soon as the TraceProcessor is done with the slice, so that
+// the whole file doesn't end up resident at the same time.
+// The mapping is kept alive until this object and all its slices have been
+// destroyed.
+class MmappedTraceFile {
+ public:
+  // Returns nullptr if the file can't be opened or mapped, or if memory mapped
+  // files are not supported on this platform.
+  static std::unique_ptr<MmappedTraceFile> Open(const std::string& path);
+
+  ~MmappedTraceFile();
+
+  size_t size() const;
+
+  // Returns a blob for the |size| bytes starting at |offset|. For the pages to
+  // be released while loading, slices should not overlap.
+  std::unique_ptr<TraceBlob> Slice(size_t offset, size_t size) const;
+
+ private:
+  class Mapping;
+  class MappedSlice;
+
+  explicit MmappedTraceFile(std::shared_ptr<Mapping>);
+
+  std::shared_ptr<Mapping> mapping_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // INCLUDE_PERFETTO_TRACE_PROCESSOR_TRACE_BLOB_H_
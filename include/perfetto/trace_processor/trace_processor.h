@@ -19,10 +19,13 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "perfetto/base/optional.h"
 #include "perfetto/base/string_view.h"
 #include "perfetto/trace_processor/basic_types.h"
+#include "perfetto/trace_processor/trace_blob.h"
 
 namespace perfetto {
 
@@ -44,6 +47,33 @@ class TraceProcessor {
    public:
     enum NextResult { kEOF = 0, kError = -1, kHasNext = 1 };
 
+    // A batch of rows of the result, stored column by column to avoid the
+    // per-cell overhead of Get() when reading large results.
+    struct Batch {
+      struct Column {
+        // The type of the value in each row, as a SqlValue::Type.
+        std::vector<uint8_t> types;
+
+        // The value in each row. Only the entry of the array matching the
+        // type of the row is set.
+        std::vector<int64_t> long_values;
+        std::vector<double> double_values;
+
+        // Offset of the (null terminated) string in Batch::string_data.
+        std::vector<uint32_t> string_offsets;
+      };
+
+      const char* GetString(const Column& col, uint32_t row) const {
+        return string_data.data() + col.string_offsets[row];
+      }
+
+      uint32_t num_rows = 0;
+      std::vector<Column> columns;
+
+      // The contents of the strings of all the columns.
+      std::string string_data;
+    };
+
     Iterator(std::unique_ptr<IteratorImpl> iterator);
     ~Iterator();
 
@@ -62,10 +92,21 @@ class TraceProcessor {
     // kHasNext. |col| must be less than the number returned by |ColumnCount()|.
     SqlValue Get(uint32_t col);
 
+    // Reads up to |max_rows| rows following the current one into |batch|,
+    // replacing its contents. Returns kHasNext if |max_rows| rows were read,
+    // kEOF if the end of the result was reached (the batch then holds the
+    // remaining rows, if any) and kError on error. The buffers of |batch| are
+    // reused, so passing the same batch to every call avoids allocations.
+    NextResult NextBatch(uint32_t max_rows, Batch* batch);
+
     // Returns the number of columns in this iterator's query. Can be called
     // even before calling |Next()|.
     uint32_t ColumnCount();
 
+    // Returns the name of the column at index |col|. Can be called even before
+    // calling |Next()|.
+    std::string GetColumnName(uint32_t col);
+
     // Returns the error indicated by the last |Next()| call. If no error
     // occurred, the returned value will be base::nullopt.
     base::Optional<std::string> GetLastError();
@@ -88,7 +129,12 @@ class TraceProcessor {
   // Returns true if parsing has been succeeding so far, false if some
   // unrecoverable error happened. If this happens, the TraceProcessor will
   // ignore the following Parse() requests and drop data on the floor.
-  virtual bool Parse(std::unique_ptr<uint8_t[]>, size_t) = 0;
+  // The blob is kept alive until all the events it contains have been parsed:
+  // passing slices of a MmappedTraceFile avoids copying the trace in memory.
+  virtual bool Parse(std::unique_ptr<TraceBlob>) = 0;
+
+  // Same as above, for a heap allocated buffer of |size| bytes.
+  bool Parse(std::unique_ptr<uint8_t[]>, size_t size);
 
   // When parsing a bounded file (as opposite to streaming from a device) this
   // function should be called when the last chunk of the file has been passed
@@ -96,6 +142,23 @@ class TraceProcessor {
   // without having to wait for their time window to expire.
   virtual void NotifyEndOfFile() = 0;
 
+  // Saves the parsed contents of the trace to a snapshot file at |path|,
+  // which can be loaded back with LoadSnapshot() much faster than parsing the
+  // trace again. Should be called after NotifyEndOfFile(). Returns false on
+  // failure or if snapshots are not supported on this platform.
+  virtual bool SaveSnapshot(const std::string& path) = 0;
+
+  // Loads the snapshot at |path| instead of parsing a trace. Must be called
+  // before any Parse() call, which will then fail. Returns false if |path| is
+  // not a snapshot or couldn't be loaded, in which case nothing is loaded.
+  // Unlike traces, snapshots are trusted: only the layout of the file is
+  // validated, so only load snapshots saved by SaveSnapshot().
+  virtual bool LoadSnapshot(const std::string& path) = 0;
+
+  // Returns true if |path| is a snapshot file, regardless of whether it can be
+  // loaded. A snapshot which fails to load must not be parsed as a trace.
+  static bool IsSnapshot(const std::string& path);
+
   // Executes a SQLite query on the loaded portion of the trace. |result| will
   // be invoked once after the result of the query is available.
   virtual void ExecuteQuery(
@@ -106,8 +169,31 @@ class TraceProcessor {
   // iterator can be used to load rows from the result.
   virtual Iterator ExecuteQuery(base::StringView sql) = 0;
 
+  // As above, binding |args| in order to the parameters (e.g. "?") of |sql|.
+  // The statements of the recently run queries are kept prepared, so running
+  // the same |sql| with different |args| doesn't plan the query again.
+  virtual Iterator ExecuteQuery(base::StringView sql,
+                                const std::vector<SqlValue>& args) = 0;
+
   // Interrupts the current query. Typically used by Ctrl-C handler.
   virtual void InterruptQuery() = 0;
+
+  // Returns a new TraceProcessor running queries on the trace loaded by this
+  // one with its own SQLite connection, or nullptr if the trace isn't fully
+  // loaded yet (i.e. before NotifyEndOfFile() or LoadSnapshot()). Each
+  // connection, this TraceProcessor included, can run queries on a different
+  // thread at the same time. The connections can't parse traces and Parse()
+  // fails on this TraceProcessor while any of them is alive. Tables and views
+  // created by a query are only visible to the connection which ran it and
+  // the sqlstats table only records the queries of this TraceProcessor. This
+  // TraceProcessor must outlive the connections.
+  virtual std::unique_ptr<TraceProcessor> CreateReadOnlyConnection() = 0;
+
+  // Returns true if |sql|, a single statement, only reads the database and
+  // returns rows, as reported by SQLite once it is prepared on this
+  // connection, and so can run on any connection without the others needing to
+  // see its effects. Returns false if |sql| doesn't compile.
+  virtual bool IsReadOnlyQuery(base::StringView sql) = 0;
 };
 
 // When set, logs SQLite actions on the console.
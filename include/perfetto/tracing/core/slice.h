@@ -39,6 +39,7 @@ struct Slice {
       : start(&(*str)[0]), size(str->size()), moved_str_data_(std::move(str)) {}
 
   Slice(Slice&& other) noexcept = default;
+  Slice& operator=(Slice&& other) noexcept = default;
 
   // Create a Slice which owns |size| bytes of memory.
   static Slice Allocate(size_t size) {
@@ -358,6 +358,11 @@ class PERFETTO_EXPORT TraceConfig {
     std::string unknown_fields_;
   };
 
+  enum CompressionType {
+    COMPRESSION_TYPE_UNSPECIFIED = 0,
+    COMPRESSION_TYPE_LZ4 = 1,
+  };
+
   TraceConfig();
   ~TraceConfig();
   TraceConfig(TraceConfig&&) noexcept;
@@ -456,6 +461,11 @@ class PERFETTO_EXPORT TraceConfig {
   const TriggerConfig& trigger_config() const { return trigger_config_; }
   TriggerConfig* mutable_trigger_config() { return &trigger_config_; }
 
+  CompressionType compression_type() const { return compression_type_; }
+  void set_compression_type(CompressionType value) {
+    compression_type_ = value;
+  }
+
  private:
   std::vector<BufferConfig> buffers_;
   std::vector<DataSource> data_sources_;
@@ -474,6 +484,7 @@ class PERFETTO_EXPORT TraceConfig {
   bool disable_clock_snapshotting_ = {};
   bool notify_traceur_ = {};
   TriggerConfig trigger_config_ = {};
+  CompressionType compression_type_ = {};
 
   // Allows to preserve unknown protobuf fields for compatibility
   // with future versions of .proto files.
@@ -78,6 +78,10 @@ class PERFETTO_EXPORT TracePacket {
   // will be valid only as long as the original buffer is valid.
   void AddSlice(const void* start, size_t size);
 
+  // Replaces the slices that point into [|begin|, |end|) with copies owning
+  // their memory, so that the packet stays valid once that memory is reused.
+  void CopySlicesInRange(const void* begin, const void* end);
+
   // Total size of all slices.
   size_t size() const { return size_; }
 
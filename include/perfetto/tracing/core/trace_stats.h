@@ -203,6 +203,23 @@ class PERFETTO_EXPORT TraceStats {
   uint64_t patches_discarded() const { return patches_discarded_; }
   void set_patches_discarded(uint64_t value) { patches_discarded_ = value; }
 
+  uint64_t compression_input_bytes() const { return compression_input_bytes_; }
+  void set_compression_input_bytes(uint64_t value) {
+    compression_input_bytes_ = value;
+  }
+
+  uint64_t compression_output_bytes() const {
+    return compression_output_bytes_;
+  }
+  void set_compression_output_bytes(uint64_t value) {
+    compression_output_bytes_ = value;
+  }
+
+  uint64_t compression_cpu_time_ns() const { return compression_cpu_time_ns_; }
+  void set_compression_cpu_time_ns(uint64_t value) {
+    compression_cpu_time_ns_ = value;
+  }
+
  private:
   std::vector<BufferStats> buffer_stats_;
   uint32_t producers_connected_ = {};
@@ -213,6 +230,9 @@ class PERFETTO_EXPORT TraceStats {
   uint32_t total_buffers_ = {};
   uint64_t chunks_discarded_ = {};
   uint64_t patches_discarded_ = {};
+  uint64_t compression_input_bytes_ = {};
+  uint64_t compression_output_bytes_ = {};
+  uint64_t compression_cpu_time_ns_ = {};
 
   // Allows to preserve unknown protobuf fields for compatibility
   // with future versions of .proto files.
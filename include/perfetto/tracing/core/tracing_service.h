@@ -258,6 +258,14 @@ class PERFETTO_EXPORT TracingService {
   //
   // This feature is currently used by Chrome.
   virtual void SetSMBScrapingEnabled(bool enabled) = 0;
+
+  // Sets the number of threads copying the chunks committed by the producers
+  // into the trace buffers. With 0 (the default) the chunks are copied on the
+  // service's task runner, together with all the other work. Otherwise the
+  // buffers are split between |num_threads| worker threads, which copy chunks
+  // into different buffers in parallel, while the control plane (e.g.
+  // connections, flushes, reading the buffers) stays on the task runner.
+  virtual void SetDataPathThreads(uint32_t num_threads) = 0;
 };
 
 }  // namespace perfetto
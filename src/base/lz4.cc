@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "perfetto/base/lz4.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <limits>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace base {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+
+// The last match must start at least this many bytes before the end of the
+// block, and the last bytes of the block are always literals.
+constexpr size_t kMatchStartLimit = 12;
+constexpr size_t kLastLiterals = 5;
+
+constexpr size_t kMaxOffset = 65535;
+
+// Lengths >= this value are continued in the following bytes.
+constexpr size_t kRunMask = 15;
+
+// The hash table maps the hash of 4 bytes to the last position they were
+// seen at. 4K entries keep it in the L1 cache.
+constexpr uint32_t kHashLog = 12;
+
+// When no match is found for a while the data is likely incompressible, and
+// the step between the positions looked up grows by one every
+// 2^kSkipTrigger positions.
+constexpr uint32_t kSkipTrigger = 6;
+
+inline uint32_t Read32(const uint8_t* ptr) {
+  uint32_t value;
+  memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+inline uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashLog);
+}
+
+inline uint8_t* WriteLength(size_t length, uint8_t* op) {
+  for (; length >= 255; length -= 255)
+    *op++ = 255;
+  *op++ = static_cast<uint8_t>(length);
+  return op;
+}
+
+// Writes the literals of a sequence, preceded by its token (with an empty
+// match). Returns the position of the token.
+inline uint8_t* WriteLiterals(const uint8_t* literals,
+                              size_t length,
+                              uint8_t** op) {
+  uint8_t* token = (*op)++;
+  if (length >= kRunMask) {
+    *token = kRunMask << 4;
+    *op = WriteLength(length - kRunMask, *op);
+  } else {
+    *token = static_cast<uint8_t>(length << 4);
+  }
+  memcpy(*op, literals, length);
+  *op += length;
+  return token;
+}
+
+inline bool ReadLength(const uint8_t** ip,
+                       const uint8_t* ip_end,
+                       size_t* length) {
+  uint8_t byte;
+  do {
+    if (*ip == ip_end)
+      return false;
+    byte = *(*ip)++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+}  // namespace
+
+size_t Lz4CompressBound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+size_t Lz4Compress(const void* src, size_t size, void* dst) {
+  PERFETTO_CHECK(size <= std::numeric_limits<uint32_t>::max());
+  const uint8_t* const in = static_cast<const uint8_t*>(src);
+  uint8_t* op = static_cast<uint8_t*>(dst);
+  size_t anchor = 0;
+
+  if (size > kMatchStartLimit) {
+    const size_t match_start_limit = size - kMatchStartLimit;
+    const size_t match_end_limit = size - kLastLiterals;
+    uint32_t table[1 << kHashLog] = {};
+    size_t searches = 1 << kSkipTrigger;
+    size_t ip = 1;
+    while (ip <= match_start_limit) {
+      uint32_t sequence = Read32(in + ip);
+      uint32_t hash = Hash(sequence);
+      size_t ref = table[hash];
+      table[hash] = static_cast<uint32_t>(ip);
+      if (ip - ref > kMaxOffset || Read32(in + ref) != sequence) {
+        ip += searches++ >> kSkipTrigger;
+        continue;
+      }
+      searches = 1 << kSkipTrigger;
+
+      // Extend the match backwards over the pending literals, then forwards.
+      while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1]) {
+        ip--;
+        ref--;
+      }
+      size_t match_length = kMinMatch;
+      while (ip + match_length < match_end_limit &&
+             in[ip + match_length] == in[ref + match_length]) {
+        match_length++;
+      }
+
+      uint8_t* token = WriteLiterals(in + anchor, ip - anchor, &op);
+      size_t offset = ip - ref;
+      *op++ = static_cast<uint8_t>(offset);
+      *op++ = static_cast<uint8_t>(offset >> 8);
+      size_t length = match_length - kMinMatch;
+      if (length >= kRunMask) {
+        *token |= kRunMask;
+        op = WriteLength(length - kRunMask, op);
+      } else {
+        *token |= static_cast<uint8_t>(length);
+      }
+
+      ip += match_length;
+      anchor = ip;
+
+      // Index a position within the match, which is likely to be repeated.
+      if (ip <= match_start_limit)
+        table[Hash(Read32(in + ip - 2))] = static_cast<uint32_t>(ip - 2);
+    }
+  }
+
+  // The block ends with a sequence made only of literals.
+  WriteLiterals(in + anchor, size - anchor, &op);
+  return static_cast<size_t>(op - static_cast<uint8_t*>(dst));
+}
+
+bool Lz4Decompress(const void* src, size_t size, void* dst, size_t dst_size) {
+  const uint8_t* ip = static_cast<const uint8_t*>(src);
+  const uint8_t* const ip_end = ip + size;
+  uint8_t* const out = static_cast<uint8_t*>(dst);
+  uint8_t* op = out;
+  uint8_t* const op_end = op + dst_size;
+
+  for (;;) {
+    if (ip == ip_end)
+      return false;
+    const uint8_t token = *ip++;
+
+    size_t literal_length = token >> 4;
+    if (literal_length == kRunMask && !ReadLength(&ip, ip_end, &literal_length))
+      return false;
+    if (literal_length > static_cast<size_t>(ip_end - ip) ||
+        literal_length > static_cast<size_t>(op_end - op)) {
+      return false;
+    }
+    memcpy(op, ip, literal_length);
+    ip += literal_length;
+    op += literal_length;
+
+    // Only the last sequence has no match.
+    if (ip == ip_end)
+      return op == op_end;
+
+    if (ip_end - ip < 2)
+      return false;
+    size_t offset = static_cast<size_t>(ip[0] | (ip[1] << 8));
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - out))
+      return false;
+
+    size_t match_length = token & kRunMask;
+    if (match_length == kRunMask && !ReadLength(&ip, ip_end, &match_length))
+      return false;
+    match_length += kMinMatch;
+    if (match_length > static_cast<size_t>(op_end - op))
+      return false;
+
+    // The match can overlap the bytes it produces, repeating them.
+    const uint8_t* match = op - offset;
+    if (offset >= match_length) {
+      memcpy(op, match, match_length);
+      op += match_length;
+    } else {
+      for (size_t i = 0; i < match_length; i++)
+        *op++ = *match++;
+    }
+  }
+}
+
+}  // namespace base
+}  // namespace perfetto
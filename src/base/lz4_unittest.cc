@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "perfetto/base/lz4.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace base {
+namespace {
+
+std::vector<uint8_t> Compress(const std::string& data) {
+  std::vector<uint8_t> compressed(Lz4CompressBound(data.size()));
+  compressed.resize(Lz4Compress(data.data(), data.size(), compressed.data()));
+  return compressed;
+}
+
+bool Decompress(const std::vector<uint8_t>& compressed,
+                size_t size,
+                std::string* data) {
+  data->assign(size, '\0');
+  return Lz4Decompress(compressed.data(), compressed.size(), &(*data)[0],
+                       size);
+}
+
+void CheckRoundTrip(const std::string& data) {
+  std::vector<uint8_t> compressed = Compress(data);
+  EXPECT_LE(compressed.size(), Lz4CompressBound(data.size()));
+  std::string decompressed;
+  ASSERT_TRUE(Decompress(compressed, data.size(), &decompressed));
+  ASSERT_EQ(data, decompressed);
+}
+
+std::string RandomString(std::minstd_rand* rnd, size_t size, int alphabet) {
+  std::string str(size, '\0');
+  for (char& c : str)
+    c = static_cast<char>('a' + (*rnd)() % static_cast<uint32_t>(alphabet));
+  return str;
+}
+
+TEST(Lz4Test, Empty) {
+  std::vector<uint8_t> compressed = Compress("");
+  EXPECT_EQ(compressed, std::vector<uint8_t>({0}));
+  CheckRoundTrip("");
+}
+
+TEST(Lz4Test, ShortInputIsLiterals) {
+  // Inputs too short to hold a match are stored as they are.
+  std::string data = "aaaaaaaaaaaa";
+  std::vector<uint8_t> compressed = Compress(data);
+  ASSERT_EQ(compressed.size(), data.size() + 1);
+  EXPECT_EQ(compressed[0], data.size() << 4);
+  CheckRoundTrip(data);
+}
+
+TEST(Lz4Test, Repetitions) {
+  CheckRoundTrip(std::string(13, 'a'));
+  CheckRoundTrip(std::string(100000, 'a'));
+  std::string pattern;
+  for (int i = 0; i < 10000; i++)
+    pattern += "perfetto" + std::to_string(i % 7);
+  CheckRoundTrip(pattern);
+  EXPECT_LT(Compress(std::string(100000, 'a')).size(), 500u);
+}
+
+TEST(Lz4Test, RandomData) {
+  std::minstd_rand rnd(0);
+  for (size_t size : {13u, 14u, 17u, 100u, 270u, 4096u, 100000u, 300000u}) {
+    for (int alphabet : {2, 4, 26, 256}) {
+      SCOPED_TRACE(std::to_string(size) + " " + std::to_string(alphabet));
+      CheckRoundTrip(RandomString(&rnd, size, alphabet));
+    }
+  }
+}
+
+TEST(Lz4Test, DistantMatches) {
+  // The second copy of the block is beyond the 64KB window.
+  std::minstd_rand rnd(1);
+  std::string block = RandomString(&rnd, 70000, 256);
+  CheckRoundTrip(block + block + block);
+}
+
+TEST(Lz4Test, RejectsWrongSize) {
+  std::string data(1000, 'a');
+  std::vector<uint8_t> compressed = Compress(data);
+  std::string decompressed;
+  EXPECT_FALSE(Decompress(compressed, data.size() - 1, &decompressed));
+  EXPECT_FALSE(Decompress(compressed, data.size() + 1, &decompressed));
+}
+
+TEST(Lz4Test, RejectsTruncatedInput) {
+  std::minstd_rand rnd(2);
+  std::string data = RandomString(&rnd, 1000, 4);
+  std::vector<uint8_t> compressed = Compress(data);
+  std::string decompressed;
+  for (size_t size = 0; size < compressed.size(); size++) {
+    std::vector<uint8_t> truncated(compressed.begin(),
+                                   compressed.begin() +
+                                       static_cast<ptrdiff_t>(size));
+    EXPECT_FALSE(Decompress(truncated, data.size(), &decompressed));
+  }
+}
+
+TEST(Lz4Test, RejectsInvalidOffset) {
+  std::string decompressed;
+
+  // 1 literal followed by a match 2 bytes back.
+  EXPECT_FALSE(Decompress({0x10, 'a', 2, 0, 0x00}, 5, &decompressed));
+
+  // A match at offset 0.
+  EXPECT_FALSE(Decompress({0x10, 'a', 0, 0, 0x00}, 5, &decompressed));
+
+  // The valid version of the above: 'a' repeated by a match at offset 1.
+  ASSERT_TRUE(Decompress({0x10, 'a', 1, 0, 0x00}, 5, &decompressed));
+  EXPECT_EQ(decompressed, "aaaaa");
+}
+
+TEST(Lz4Test, RandomInputDoesNotCrash) {
+  std::minstd_rand rnd(3);
+  std::string decompressed;
+  for (int i = 0; i < 1000; i++) {
+    std::vector<uint8_t> input(rnd() % 64);
+    for (uint8_t& byte : input)
+      byte = static_cast<uint8_t>(rnd());
+    Decompress(input, rnd() % 256, &decompressed);
+  }
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace perfetto
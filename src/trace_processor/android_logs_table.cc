@@ -22,8 +22,10 @@ namespace trace_processor {
 AndroidLogsTable::AndroidLogsTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
-void AndroidLogsTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<AndroidLogsTable>(db, storage, "android_logs");
+void AndroidLogsTable::RegisterTable(sqlite3* db,
+                                     const TraceStorage* storage,
+                                     const QueryContext* context) {
+  Table::Register<AndroidLogsTable>(db, storage, context, "android_logs");
 }
 
 StorageSchema AndroidLogsTable::CreateStorageSchema() {
@@ -35,8 +37,8 @@ StorageSchema AndroidLogsTable::CreateStorageSchema() {
       .AddNumericColumn("ts", &alog.timestamps())
       .AddNumericColumn("utid", &alog.utids())
       .AddNumericColumn("prio", &alog.prios())
-      .AddStringColumn("tag", &alog.tag_ids(), &storage_->string_pool())
-      .AddStringColumn("msg", &alog.msg_ids(), &storage_->string_pool())
+      .AddStringColumn("tag", &alog.tag_ids(), storage_)
+      .AddStringColumn("msg", &alog.msg_ids(), storage_)
       .Build({"ts", "utid", "msg"});
 }
 
@@ -49,15 +51,7 @@ int AndroidLogsTable::BestIndex(const QueryConstraints& qc,
   info->estimated_cost = static_cast<uint32_t>(storage_->android_logs().size());
 
   info->order_by_consumed = true;
-
-  // Only the string columns are handled by SQLite.
-  size_t tag_index = schema().ColumnIndexFromName("tag");
-  size_t msg_index = schema().ColumnIndexFromName("msg");
-  for (size_t i = 0; i < qc.constraints().size(); i++) {
-    info->omit[i] =
-        qc.constraints()[i].iColumn != static_cast<int>(tag_index) &&
-        qc.constraints()[i].iColumn != static_cast<int>(msg_index);
-  }
+  SetOmittedConstraints(qc, info);
 
   return SQLITE_OK;
 }
@@ -25,7 +25,9 @@ namespace trace_processor {
 
 class AndroidLogsTable : public StorageTable {
  public:
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   AndroidLogsTable(sqlite3*, const TraceStorage*);
 
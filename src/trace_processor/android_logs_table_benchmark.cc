@@ -0,0 +1,128 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <string>
+
+#include "benchmark/benchmark.h"
+
+#include "src/trace_processor/android_logs_table.h"
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace {
+
+using perfetto::trace_processor::AndroidLogsTable;
+using perfetto::trace_processor::ScopedDb;
+using perfetto::trace_processor::ScopedStmt;
+using perfetto::trace_processor::TraceStorage;
+
+// Filters the messages of 1M android log lines (drawn from 100k distinct
+// messages) with string constraints. The "Unindexed" variants prefix the
+// column with a unary + so that SQLite does not pass the constraint to the
+// table and instead evaluates it on each row, as it used to before string
+// columns implemented filtering.
+
+constexpr uint32_t kNumLogs = 1 << 20;
+constexpr uint32_t kNumDistinctMsgs = 100000;
+
+class LogsFixture {
+ public:
+  LogsFixture() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    static const char* const kWords[] = {"binder", "sched", "activity",
+                                         "input", "surfaceflinger", "gc"};
+    std::minstd_rand0 rnd(0);
+    for (uint32_t i = 0; i < kNumLogs; i++) {
+      uint32_t msg_idx = rnd() % kNumDistinctMsgs;
+      std::string msg = std::string(kWords[msg_idx % 6]) + " message " +
+                        std::to_string(msg_idx);
+      storage_.mutable_android_log()->AddLogEvent(
+          i, 0 /* utid */, 4 /* prio */,
+          storage_.InternString(kWords[rnd() % 6]),
+          storage_.InternString(perfetto::base::StringView(msg)));
+    }
+    AndroidLogsTable::RegisterTable(db_.get(), &storage_, nullptr);
+  }
+
+  int64_t Count(const char* sql) {
+    sqlite3_stmt* stmt;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql, -1, &stmt, nullptr) ==
+                   SQLITE_OK);
+    ScopedStmt scoped_stmt(stmt);
+    PERFETTO_CHECK(sqlite3_step(stmt) == SQLITE_ROW);
+    return sqlite3_column_int64(stmt, 0);
+  }
+
+ private:
+  TraceStorage storage_;
+  ScopedDb db_;
+};
+
+LogsFixture* GetFixture() {
+  static LogsFixture* fixture = new LogsFixture();
+  return fixture;
+}
+
+void RunCountQuery(benchmark::State& state, const char* sql) {
+  LogsFixture* fixture = GetFixture();
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(fixture->Count(sql));
+  state.SetItemsProcessed(state.iterations() * kNumLogs);
+}
+
+}  // namespace
+
+static void BM_AndroidLogsMsgEq(benchmark::State& state) {
+  RunCountQuery(state,
+                "SELECT COUNT(*) FROM android_logs "
+                "WHERE msg = 'surfaceflinger message 1234'");
+}
+BENCHMARK(BM_AndroidLogsMsgEq);
+
+static void BM_AndroidLogsMsgEqUnindexed(benchmark::State& state) {
+  RunCountQuery(state,
+                "SELECT COUNT(*) FROM android_logs "
+                "WHERE +msg = 'surfaceflinger message 1234'");
+}
+BENCHMARK(BM_AndroidLogsMsgEqUnindexed);
+
+static void BM_AndroidLogsMsgGlob(benchmark::State& state) {
+  RunCountQuery(state,
+                "SELECT COUNT(*) FROM android_logs "
+                "WHERE msg GLOB '*message 12*'");
+}
+BENCHMARK(BM_AndroidLogsMsgGlob);
+
+static void BM_AndroidLogsMsgGlobUnindexed(benchmark::State& state) {
+  RunCountQuery(state,
+                "SELECT COUNT(*) FROM android_logs "
+                "WHERE +msg GLOB '*message 12*'");
+}
+BENCHMARK(BM_AndroidLogsMsgGlobUnindexed);
+
+static void BM_AndroidLogsMsgLike(benchmark::State& state) {
+  RunCountQuery(state,
+                "SELECT COUNT(*) FROM android_logs WHERE msg LIKE 'binder%'");
+}
+BENCHMARK(BM_AndroidLogsMsgLike);
+
+static void BM_AndroidLogsMsgLikeUnindexed(benchmark::State& state) {
+  RunCountQuery(state,
+                "SELECT COUNT(*) FROM android_logs WHERE +msg LIKE 'binder%'");
+}
+BENCHMARK(BM_AndroidLogsMsgLikeUnindexed);
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/android_logs_table.h"
+
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/trace_storage.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+class AndroidLogsTableTest : public ::testing::Test {
+ public:
+  AndroidLogsTableTest() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    AndroidLogsTable::RegisterTable(db_.get(), &storage_, nullptr);
+  }
+
+  void AddLog(int64_t ts, const char* tag, const char* msg) {
+    storage_.mutable_android_log()->AddLogEvent(
+        ts, 0 /* utid */, 4 /* prio */, storage_.InternString(tag),
+        storage_.InternString(msg));
+  }
+
+  // Runs |sql|, which should select a single integer column, and returns the
+  // values of all the rows.
+  std::vector<int64_t> QueryInts(const std::string& sql) {
+    sqlite3_stmt* stmt;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &stmt, nullptr) ==
+                   SQLITE_OK);
+    ScopedStmt scoped_stmt(stmt);
+
+    std::vector<int64_t> values;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+      values.emplace_back(sqlite3_column_int64(stmt, 0));
+    return values;
+  }
+
+ protected:
+  TraceStorage storage_;
+  ScopedDb db_;
+};
+
+TEST_F(AndroidLogsTableTest, FilterStringEq) {
+  AddLog(1, "tag1", "hello");
+  AddLog(2, "tag2", "world");
+  AddLog(3, "tag1", "hello world");
+
+  ASSERT_THAT(QueryInts("SELECT ts FROM android_logs WHERE msg = 'hello'"),
+              ElementsAre(1));
+  ASSERT_THAT(QueryInts("SELECT ts FROM android_logs WHERE tag = 'tag1' "
+                        "ORDER BY ts"),
+              ElementsAre(1, 3));
+
+  // Strings which were never interned never match.
+  ASSERT_THAT(QueryInts("SELECT ts FROM android_logs WHERE msg = 'foo'"),
+              IsEmpty());
+}
+
+TEST_F(AndroidLogsTableTest, FilterStringNe) {
+  AddLog(1, "tag1", "hello");
+  AddLog(2, "tag2", "world");
+  AddLog(3, "", "hello");
+
+  // The empty tag is NULL so should not be returned for !=.
+  ASSERT_THAT(QueryInts("SELECT ts FROM android_logs WHERE tag != 'tag1' "
+                        "ORDER BY ts"),
+              ElementsAre(2));
+  ASSERT_THAT(QueryInts("SELECT ts FROM android_logs WHERE tag IS NULL"),
+              ElementsAre(3));
+  ASSERT_THAT(QueryInts("SELECT ts FROM android_logs WHERE tag IS NOT NULL "
+                        "ORDER BY ts"),
+              ElementsAre(1, 2));
+}
+
+TEST_F(AndroidLogsTableTest, FilterStringGlobAndLike) {
+  AddLog(1, "tag1", "binder transaction");
+  AddLog(2, "tag2", "Binder reply");
+  AddLog(3, "tag1", "sched");
+  AddLog(4, "tag1", "binder reply");
+
+  ASSERT_THAT(QueryInts("SELECT ts FROM android_logs WHERE msg GLOB 'binder*' "
+                        "ORDER BY ts"),
+              ElementsAre(1, 4));
+
+  // LIKE is case insensitive.
+  ASSERT_THAT(QueryInts("SELECT ts FROM android_logs WHERE msg LIKE '%reply' "
+                        "ORDER BY ts"),
+              ElementsAre(2, 4));
+
+  ASSERT_THAT(QueryInts("SELECT ts FROM android_logs WHERE msg GLOB 'b*' AND "
+                        "tag = 'tag1' ORDER BY ts"),
+              ElementsAre(1, 4));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -24,16 +24,18 @@ namespace trace_processor {
 ArgsTable::ArgsTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
-void ArgsTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<ArgsTable>(db, storage, "args");
+void ArgsTable::RegisterTable(sqlite3* db,
+                              const TraceStorage* storage,
+                              const QueryContext* context) {
+  Table::Register<ArgsTable>(db, storage, context, "args");
 }
 
 StorageSchema ArgsTable::CreateStorageSchema() {
   const auto& args = storage_->args();
   return StorageSchema::Builder()
       .AddNumericColumn("arg_set_id", &args.set_ids())
-      .AddStringColumn("flat_key", &args.flat_keys(), &storage_->string_pool())
-      .AddStringColumn("key", &args.keys(), &storage_->string_pool())
+      .AddStringColumn("flat_key", &args.flat_keys(), storage_)
+      .AddStringColumn("key", &args.keys(), storage_)
       .AddColumn<ValueColumn>("int_value", VariadicType::kInt, storage_)
       .AddColumn<ValueColumn>("string_value", VariadicType::kString, storage_)
       .AddColumn<ValueColumn>("real_value", VariadicType::kReal, storage_)
@@ -27,7 +27,9 @@ class ArgsTable : public StorageTable {
  public:
   using VariadicType = TraceStorage::Args::Variadic::Type;
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   ArgsTable(sqlite3*, const TraceStorage*);
 
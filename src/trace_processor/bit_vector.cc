@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/bit_vector.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+BitVector::BitVector() = default;
+
+BitVector::BitVector(uint32_t size, bool value)
+    : words_((size + kBitsInWord - 1) / kBitsInWord, value ? ~0ull : 0ull),
+      size_(size) {
+  if (value && !words_.empty())
+    words_.back() &= LastWordMask(word_count() - 1);
+}
+
+BitVector::~BitVector() = default;
+
+BitVector::BitVector(BitVector&&) noexcept = default;
+BitVector& BitVector::operator=(BitVector&&) = default;
+
+BitVector::BitVector(const BitVector&) = default;
+BitVector& BitVector::operator=(const BitVector&) = default;
+
+void BitVector::ClearRange(uint32_t start, uint32_t end) {
+  PERFETTO_DCHECK(start <= end && end <= size_);
+  if (start == end)
+    return;
+
+  uint32_t start_word = start / kBitsInWord;
+  uint32_t end_word = (end - 1) / kBitsInWord;
+
+  // Mask of the bits to keep in the first and last word respectively.
+  uint64_t start_keep = (1ull << (start % kBitsInWord)) - 1;
+  uint32_t end_bit = end % kBitsInWord;
+  uint64_t end_keep = end_bit == 0 ? 0 : ~((1ull << end_bit) - 1);
+
+  if (start_word == end_word) {
+    words_[start_word] &= start_keep | end_keep;
+    return;
+  }
+  words_[start_word] &= start_keep;
+  for (uint32_t w = start_word + 1; w < end_word; w++)
+    words_[w] = 0;
+  words_[end_word] &= end_keep;
+}
+
+uint32_t BitVector::GetNumBitsSet() const {
+  uint32_t count = 0;
+  for (uint64_t word : words_)
+    count += static_cast<uint32_t>(__builtin_popcountll(word));
+  return count;
+}
+
+uint32_t BitVector::NextSetBit(uint32_t idx) const {
+  if (idx >= size_)
+    return size_;
+
+  uint32_t w = idx / kBitsInWord;
+  // Mask off the bits before |idx| in the first word.
+  uint64_t word = words_[w] & (~0ull << (idx % kBitsInWord));
+  while (word == 0) {
+    if (++w == word_count())
+      return size_;
+    word = words_[w];
+  }
+  return w * kBitsInWord + static_cast<uint32_t>(__builtin_ctzll(word));
+}
+
+uint32_t BitVector::PrevSetBit(uint32_t idx) const {
+  if (idx >= size_)
+    return size_;
+
+  uint32_t w = idx / kBitsInWord;
+  // Mask off the bits after |idx| in the first word.
+  uint32_t shift = kBitsInWord - 1 - idx % kBitsInWord;
+  uint64_t word = words_[w] & (~0ull >> shift);
+  while (word == 0) {
+    if (w-- == 0)
+      return size_;
+    word = words_[w];
+  }
+  return w * kBitsInWord + kBitsInWord - 1 -
+         static_cast<uint32_t>(__builtin_clzll(word));
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_BIT_VECTOR_H_
+#define SRC_TRACE_PROCESSOR_BIT_VECTOR_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// A fixed-size vector of bits stored as packed 64-bit words.
+//
+// Unlike std::vector<bool>, the words are exposed directly so that filters can
+// compute (and AND together) the result for 64 rows at a time, and set bits
+// can be counted and found using popcount/ctz rather than testing each bit.
+//
+// Bits past |size()| in the last word are always zero.
+class BitVector {
+ public:
+  static constexpr uint32_t kBitsInWord = 64;
+
+  BitVector();
+  BitVector(uint32_t size, bool value);
+  ~BitVector();
+
+  BitVector(BitVector&&) noexcept;
+  BitVector& operator=(BitVector&&);
+
+  BitVector(const BitVector&);
+  BitVector& operator=(const BitVector&);
+
+  bool IsSet(uint32_t idx) const {
+    PERFETTO_DCHECK(idx < size_);
+    return (words_[idx / kBitsInWord] >> (idx % kBitsInWord)) & 1u;
+  }
+
+  void Set(uint32_t idx) {
+    PERFETTO_DCHECK(idx < size_);
+    words_[idx / kBitsInWord] |= 1ull << (idx % kBitsInWord);
+  }
+
+  void Clear(uint32_t idx) {
+    PERFETTO_DCHECK(idx < size_);
+    words_[idx / kBitsInWord] &= ~(1ull << (idx % kBitsInWord));
+  }
+
+  // Clears all the bits in the range [start, end).
+  void ClearRange(uint32_t start, uint32_t end);
+
+  // Returns the number of set bits in the vector.
+  uint32_t GetNumBitsSet() const;
+
+  // Returns the index of the first set bit at or after |idx| or |size()| if
+  // there is no such bit.
+  uint32_t NextSetBit(uint32_t idx) const;
+
+  // Returns the index of the last set bit at or before |idx| or |size()| if
+  // there is no such bit.
+  uint32_t PrevSetBit(uint32_t idx) const;
+
+  // Returns the word containing the bits [w * 64, (w + 1) * 64).
+  uint64_t word(uint32_t w) const { return words_[w]; }
+
+  // Replaces the word containing the bits [w * 64, (w + 1) * 64). Any bits of
+  // |value| past |size()| must be zero.
+  void set_word(uint32_t w, uint64_t value) {
+    PERFETTO_DCHECK((value & ~LastWordMask(w)) == 0);
+    words_[w] = value;
+  }
+
+  uint32_t word_count() const { return static_cast<uint32_t>(words_.size()); }
+  uint32_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  // Returns the mask of the bits of word |w| which are inside the vector.
+  uint64_t LastWordMask(uint32_t w) const {
+    uint32_t bits = size_ - w * kBitsInWord;
+    return bits >= kBitsInWord ? ~0ull : (1ull << bits) - 1;
+  }
+
+  std::vector<uint64_t> words_;
+  uint32_t size_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_BIT_VECTOR_H_
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/bit_vector.h"
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(BitVectorUnittest, CreateAllSet) {
+  BitVector bv(130, true);
+  ASSERT_EQ(bv.size(), 130u);
+  ASSERT_EQ(bv.word_count(), 3u);
+  ASSERT_EQ(bv.GetNumBitsSet(), 130u);
+  ASSERT_TRUE(bv.IsSet(0));
+  ASSERT_TRUE(bv.IsSet(129));
+
+  // Bits past the end of the vector should not be set.
+  ASSERT_EQ(bv.word(2), 0x3ull);
+}
+
+TEST(BitVectorUnittest, SetAndClear) {
+  BitVector bv(100, false);
+  ASSERT_EQ(bv.GetNumBitsSet(), 0u);
+
+  bv.Set(3);
+  bv.Set(64);
+  bv.Set(99);
+  ASSERT_TRUE(bv.IsSet(3));
+  ASSERT_TRUE(bv.IsSet(64));
+  ASSERT_TRUE(bv.IsSet(99));
+  ASSERT_FALSE(bv.IsSet(4));
+  ASSERT_EQ(bv.GetNumBitsSet(), 3u);
+
+  bv.Clear(64);
+  ASSERT_FALSE(bv.IsSet(64));
+  ASSERT_EQ(bv.GetNumBitsSet(), 2u);
+}
+
+TEST(BitVectorUnittest, ClearRange) {
+  BitVector bv(200, true);
+
+  bv.ClearRange(10, 20);
+  ASSERT_TRUE(bv.IsSet(9));
+  ASSERT_FALSE(bv.IsSet(10));
+  ASSERT_FALSE(bv.IsSet(19));
+  ASSERT_TRUE(bv.IsSet(20));
+
+  // Across multiple words.
+  bv.ClearRange(60, 140);
+  ASSERT_TRUE(bv.IsSet(59));
+  ASSERT_FALSE(bv.IsSet(60));
+  ASSERT_FALSE(bv.IsSet(128));
+  ASSERT_TRUE(bv.IsSet(140));
+
+  // Ending exactly on a word boundary.
+  bv.ClearRange(150, 192);
+  ASSERT_FALSE(bv.IsSet(191));
+  ASSERT_TRUE(bv.IsSet(192));
+
+  ASSERT_EQ(bv.GetNumBitsSet(), 200u - 10u - 80u - 42u);
+}
+
+TEST(BitVectorUnittest, NextSetBit) {
+  BitVector bv(300, false);
+  bv.Set(5);
+  bv.Set(200);
+
+  ASSERT_EQ(bv.NextSetBit(0), 5u);
+  ASSERT_EQ(bv.NextSetBit(5), 5u);
+  ASSERT_EQ(bv.NextSetBit(6), 200u);
+  ASSERT_EQ(bv.NextSetBit(201), 300u);
+  ASSERT_EQ(bv.NextSetBit(300), 300u);
+}
+
+TEST(BitVectorUnittest, PrevSetBit) {
+  BitVector bv(300, false);
+  bv.Set(5);
+  bv.Set(200);
+
+  ASSERT_EQ(bv.PrevSetBit(299), 200u);
+  ASSERT_EQ(bv.PrevSetBit(200), 200u);
+  ASSERT_EQ(bv.PrevSetBit(199), 5u);
+  ASSERT_EQ(bv.PrevSetBit(4), 300u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
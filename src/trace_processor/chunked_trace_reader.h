@@ -22,6 +22,8 @@
 
 #include <memory>
 
+#include "perfetto/trace_processor/trace_blob.h"
+
 namespace perfetto {
 namespace trace_processor {
 
@@ -34,10 +36,14 @@ class ChunkedTraceReader {
   // Pushes more data into the trace parser. There is no requirement for the
   // caller to match line/protos boundaries. The parser class has to deal with
   // intermediate buffering lines/protos that span across different chunks.
-  // The buffer size is guaranteed to be > 0.
+  // The blob size is guaranteed to be > 0.
   // Returns true if the data has been succesfully parsed, false if some
   // unrecoverable parsing error happened and no more chunks should be pushed.
-  virtual bool Parse(std::unique_ptr<uint8_t[]>, size_t) = 0;
+  virtual bool Parse(std::unique_ptr<TraceBlob>) = 0;
+
+  // Called after the last chunk has been pushed. When this returns, all the
+  // data passed to Parse() must have been handed to the next pipeline stage.
+  virtual void NotifyEndOfFile() {}
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CHUNKED_VECTOR_H_
+#define SRC_TRACE_PROCESSOR_CHUNKED_VECTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/base/paged_memory.h"
+#include "perfetto/base/utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Append-only container used to store the columns of the tables in
+// TraceStorage.
+//
+// Elements are stored in chunks of |kChunkSize| elements, each backed by its
+// own page-aligned mmap. Unlike std::deque (which uses blocks of a few hundred
+// bytes), this means that:
+// 1. Appending never moves existing elements, so pointers and references to
+//    them remain valid for the lifetime of the container.
+// 2. Scans over a column see long contiguous runs of elements (see
+//    ForEachSpan()) which the compiler is able to vectorize.
+// 3. Looking up a row is a shift and a mask rather than a division.
+//
+// As many columns only hold a handful of rows, the first |kChunkSize| elements
+// are stored in smaller chunks growing geometrically from |kFirstChunkSize|
+// elements, where rows are looked up with a bit scan.
+//
+// Only trivially destructible types are supported as elements are never
+// destroyed individually.
+template <typename T>
+class ChunkedVector {
+ public:
+  static_assert(std::is_trivially_destructible<T>::value,
+                "ChunkedVector only supports trivially destructible types");
+
+  // Each full chunk holds 2^16 elements: between 64KB (for uint8_t) and 1MB
+  // (for 16 byte types) of memory.
+  static constexpr uint32_t kChunkShift = 16;
+  static constexpr uint32_t kChunkSize = 1u << kChunkShift;
+  static constexpr uint32_t kChunkMask = kChunkSize - 1;
+
+  // The first chunk holds 2^12 elements (i.e. at least a page), followed by
+  // chunks of 2^12, 2^13, 2^14 and 2^15 elements and then by full chunks.
+  static constexpr uint32_t kFirstChunkShift = kChunkShift - 4;
+  static constexpr uint32_t kFirstChunkSize = 1u << kFirstChunkShift;
+  static constexpr uint32_t kNumSmallChunks =
+      kChunkShift - kFirstChunkShift + 1;
+
+  static_assert(kFirstChunkSize * sizeof(T) % base::kPageSize == 0,
+                "Chunks must be a multiple of the page size");
+
+  // Random access iterator over the elements of the vector. Only a const
+  // version is provided as the vector is only mutated through operator[].
+  class const_iterator {
+   public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_iterator() = default;
+    const_iterator(const ChunkedVector* vector, size_t idx)
+        : vector_(vector), idx_(idx) {}
+
+    reference operator*() const { return (*vector_)[idx_]; }
+    pointer operator->() const { return &(*vector_)[idx_]; }
+    reference operator[](difference_type n) const {
+      return (*vector_)[static_cast<size_t>(static_cast<difference_type>(idx_) +
+                                            n)];
+    }
+
+    const_iterator& operator++() {
+      idx_++;
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator it = *this;
+      idx_++;
+      return it;
+    }
+    const_iterator& operator--() {
+      idx_--;
+      return *this;
+    }
+    const_iterator operator--(int) {
+      const_iterator it = *this;
+      idx_--;
+      return it;
+    }
+    const_iterator& operator+=(difference_type n) {
+      idx_ = static_cast<size_t>(static_cast<difference_type>(idx_) + n);
+      return *this;
+    }
+    const_iterator& operator-=(difference_type n) { return *this += -n; }
+
+    friend const_iterator operator+(const_iterator it, difference_type n) {
+      return it += n;
+    }
+    friend const_iterator operator+(difference_type n, const_iterator it) {
+      return it += n;
+    }
+    friend const_iterator operator-(const_iterator it, difference_type n) {
+      return it -= n;
+    }
+    friend difference_type operator-(const const_iterator& a,
+                                     const const_iterator& b) {
+      return static_cast<difference_type>(a.idx_) -
+             static_cast<difference_type>(b.idx_);
+    }
+
+    friend bool operator==(const const_iterator& a, const const_iterator& b) {
+      return a.idx_ == b.idx_;
+    }
+    friend bool operator!=(const const_iterator& a, const const_iterator& b) {
+      return a.idx_ != b.idx_;
+    }
+    friend bool operator<(const const_iterator& a, const const_iterator& b) {
+      return a.idx_ < b.idx_;
+    }
+    friend bool operator>(const const_iterator& a, const const_iterator& b) {
+      return a.idx_ > b.idx_;
+    }
+    friend bool operator<=(const const_iterator& a, const const_iterator& b) {
+      return a.idx_ <= b.idx_;
+    }
+    friend bool operator>=(const const_iterator& a, const const_iterator& b) {
+      return a.idx_ >= b.idx_;
+    }
+
+   private:
+    const ChunkedVector* vector_ = nullptr;
+    size_t idx_ = 0;
+  };
+
+  ChunkedVector() = default;
+  ~ChunkedVector() = default;
+
+  // Allow std::move().
+  ChunkedVector(ChunkedVector&&) noexcept = default;
+  ChunkedVector& operator=(ChunkedVector&&) = default;
+
+  // Disable implicit copy.
+  ChunkedVector(const ChunkedVector&) = delete;
+  ChunkedVector& operator=(const ChunkedVector&) = delete;
+
+  template <typename... Args>
+  void emplace_back(Args&&... args) {
+    if (PERFETTO_UNLIKELY(size_ == capacity_))
+      AddChunk();
+    new (end_) T(std::forward<Args>(args)...);
+    end_++;
+    size_++;
+  }
+
+  void push_back(const T& value) { emplace_back(value); }
+
+  T& operator[](size_t idx) { return *Slot(idx); }
+  const T& operator[](size_t idx) const { return *Slot(idx); }
+
+  T& back() { return (*this)[size_ - 1]; }
+  const T& back() const { return (*this)[size_ - 1]; }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, size_); }
+
+  // Calls |fn(const T* data, uint32_t first_row, uint32_t count)| for each
+  // contiguous run of elements in the range [start, end). Each run is at most
+  // |kChunkSize| elements long.
+  template <typename Fn>
+  void ForEachSpan(uint32_t start, uint32_t end, Fn fn) const {
+    PERFETTO_DCHECK(start <= end && end <= size_);
+    for (uint32_t row = start; row < end;) {
+      size_t chunk = ChunkIndex(row);
+      auto chunk_start = static_cast<uint32_t>(ChunkStart(chunk));
+      auto chunk_end = static_cast<uint32_t>(chunk_start + ChunkSize(chunk));
+      uint32_t count = std::min(chunk_end, end) - row;
+      fn(chunk_ptrs_[chunk] + (row - chunk_start), row, count);
+      row += count;
+    }
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Returns the number of elements of the chunks needed to hold |size|
+  // elements.
+  static size_t CapacityFor(size_t size) {
+    if (size == 0)
+      return 0;
+    size_t chunk = ChunkIndex(size - 1);
+    return ChunkStart(chunk) + ChunkSize(chunk);
+  }
+
+  // Makes the (empty) vector use the |size| elements at |data| instead of
+  // copying them into chunks of its own. |data| must be followed by enough
+  // writable memory to fill up its last chunk, so that elements can still be
+  // appended, and is kept alive by |keep_alive|. Used to load storage
+  // snapshots (see storage_snapshot.h) straight from the mmap of the file.
+  void AdoptChunks(T* data, size_t size, std::shared_ptr<void> keep_alive) {
+    PERFETTO_CHECK(empty());
+    for (size_t chunk = 0; ChunkStart(chunk) < size; chunk++) {
+      chunks_.emplace_back();
+      chunk_ptrs_.emplace_back(data + ChunkStart(chunk));
+    }
+    size_ = size;
+    capacity_ = CapacityFor(size);
+    end_ = data + size;
+    adopted_memory_ = std::move(keep_alive);
+  }
+
+ private:
+  static uint32_t FloorLog2(uint32_t value) {
+    return 31u - static_cast<uint32_t>(__builtin_clz(value));
+  }
+
+  T* Slot(size_t idx) const {
+    PERFETTO_DCHECK(idx < size_);
+    if (PERFETTO_LIKELY(idx >= kChunkSize)) {
+      return chunk_ptrs_[(idx >> kChunkShift) + kNumSmallChunks - 1] +
+             (idx & kChunkMask);
+    }
+    if (idx < kFirstChunkSize)
+      return chunk_ptrs_[0] + idx;
+    // The other small chunks start at the power of two below |idx|.
+    uint32_t log = FloorLog2(static_cast<uint32_t>(idx));
+    return chunk_ptrs_[log - kFirstChunkShift + 1] + (idx & ((1u << log) - 1));
+  }
+
+  // Returns the index of the chunk holding the element at |idx|.
+  static size_t ChunkIndex(size_t idx) {
+    if (idx >= kChunkSize)
+      return (idx >> kChunkShift) + kNumSmallChunks - 1;
+    if (idx < kFirstChunkSize)
+      return 0;
+    return FloorLog2(static_cast<uint32_t>(idx)) - kFirstChunkShift + 1;
+  }
+
+  // Returns the index of the first element of |chunk|.
+  static size_t ChunkStart(size_t chunk) {
+    if (chunk >= kNumSmallChunks)
+      return (chunk - kNumSmallChunks + 1) << kChunkShift;
+    return chunk == 0 ? 0 : kFirstChunkSize << (chunk - 1);
+  }
+
+  // Returns the number of elements of |chunk|.
+  static size_t ChunkSize(size_t chunk) {
+    if (chunk >= kNumSmallChunks)
+      return kChunkSize;
+    return chunk == 0 ? kFirstChunkSize : kFirstChunkSize << (chunk - 1);
+  }
+
+  void AddChunk() {
+    size_t chunk = chunk_ptrs_.size();
+    size_t size = ChunkSize(chunk);
+    chunks_.emplace_back(base::PagedMemory::Allocate(size * sizeof(T)));
+    chunk_ptrs_.emplace_back(static_cast<T*>(chunks_.back().Get()));
+    capacity_ += size;
+    end_ = chunk_ptrs_.back();
+  }
+
+  // The memory backing each chunk. Invalid for the chunks pointing to
+  // |adopted_memory_|.
+  std::vector<base::PagedMemory> chunks_;
+
+  // Cached pointers to the start of each chunk in |chunks_|. Kept separately
+  // so that lookups only require a single indirection.
+  std::vector<T*> chunk_ptrs_;
+
+  size_t size_ = 0;
+
+  // The number of elements of the chunks allocated so far and the slot of the
+  // next element appended.
+  size_t capacity_ = 0;
+  T* end_ = nullptr;
+
+  // Keeps alive the memory of the chunks passed to AdoptChunks(), if any.
+  std::shared_ptr<void> adopted_memory_;
+};
+
+// static
+template <typename T>
+constexpr uint32_t ChunkedVector<T>::kChunkSize;
+
+// static
+template <typename T>
+constexpr uint32_t ChunkedVector<T>::kFirstChunkSize;
+
+// static
+template <typename T>
+constexpr uint32_t ChunkedVector<T>::kNumSmallChunks;
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CHUNKED_VECTOR_H_
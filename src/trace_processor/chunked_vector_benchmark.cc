@@ -0,0 +1,111 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <deque>
+#include <random>
+
+#include "benchmark/benchmark.h"
+
+#include "src/trace_processor/chunked_vector.h"
+
+namespace {
+
+using perfetto::trace_processor::ChunkedVector;
+
+// Scans a column of timestamps counting the rows greater than a threshold.
+// This mirrors what NumericColumn::Filter does for "WHERE col > X" on tables
+// which used to be backed by std::deque.
+
+template <typename Column>
+void FillColumn(Column* column, size_t size) {
+  std::minstd_rand0 rnd(0);
+  for (size_t i = 0; i < size; i++)
+    column->emplace_back(static_cast<int64_t>(rnd()));
+}
+
+void ScanArgs(benchmark::internal::Benchmark* b) {
+  b->Arg(1 << 16)->Arg(1 << 20)->Arg(1 << 24);
+}
+
+}  // namespace
+
+static void BM_ScanDeque(benchmark::State& state) {
+  std::deque<int64_t> column;
+  FillColumn(&column, static_cast<size_t>(state.range(0)));
+
+  const int64_t threshold = std::minstd_rand0::max() / 2;
+  while (state.KeepRunning()) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < column.size(); i++)
+      count += column[i] > threshold;
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ScanDeque)->Apply(ScanArgs);
+
+static void BM_ScanChunkedVectorIndexed(benchmark::State& state) {
+  ChunkedVector<int64_t> column;
+  FillColumn(&column, static_cast<size_t>(state.range(0)));
+
+  const int64_t threshold = std::minstd_rand0::max() / 2;
+  while (state.KeepRunning()) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < column.size(); i++)
+      count += column[i] > threshold;
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ScanChunkedVectorIndexed)->Apply(ScanArgs);
+
+static void BM_ScanChunkedVectorSpans(benchmark::State& state) {
+  ChunkedVector<int64_t> column;
+  FillColumn(&column, static_cast<size_t>(state.range(0)));
+
+  const int64_t threshold = std::minstd_rand0::max() / 2;
+  const auto size = static_cast<uint32_t>(column.size());
+  while (state.KeepRunning()) {
+    uint32_t count = 0;
+    column.ForEachSpan(0, size,
+                       [&count, threshold](const int64_t* data, uint32_t,
+                                           uint32_t n) {
+                         for (uint32_t i = 0; i < n; i++)
+                           count += data[i] > threshold;
+                       });
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ScanChunkedVectorSpans)->Apply(ScanArgs);
+
+static void BM_AppendDeque(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    std::deque<int64_t> column;
+    FillColumn(&column, static_cast<size_t>(state.range(0)));
+    benchmark::DoNotOptimize(column.back());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AppendDeque)->Apply(ScanArgs);
+
+static void BM_AppendChunkedVector(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    ChunkedVector<int64_t> column;
+    FillColumn(&column, static_cast<size_t>(state.range(0)));
+    benchmark::DoNotOptimize(column.back());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AppendChunkedVector)->Apply(ScanArgs);
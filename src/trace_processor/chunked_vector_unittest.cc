@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/chunked_vector.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(ChunkedVectorTest, Empty) {
+  ChunkedVector<int64_t> vector;
+  ASSERT_TRUE(vector.empty());
+  ASSERT_EQ(vector.size(), 0u);
+  ASSERT_EQ(vector.begin(), vector.end());
+}
+
+TEST(ChunkedVectorTest, AppendAndRetrieve) {
+  ChunkedVector<int64_t> vector;
+  vector.emplace_back(10);
+  vector.push_back(20);
+
+  ASSERT_EQ(vector.size(), 2u);
+  ASSERT_EQ(vector[0], 10);
+  ASSERT_EQ(vector[1], 20);
+  ASSERT_EQ(vector.back(), 20);
+
+  vector[0] = 15;
+  ASSERT_EQ(vector[0], 15);
+}
+
+TEST(ChunkedVectorTest, AcrossChunks) {
+  using Vector = ChunkedVector<uint32_t>;
+  const uint32_t kSize = Vector::kChunkSize * 3 + 5;
+
+  Vector vector;
+  for (uint32_t i = 0; i < kSize; i++)
+    vector.emplace_back(i);
+
+  ASSERT_EQ(vector.size(), kSize);
+  for (uint32_t i = 0; i < kSize; i++)
+    ASSERT_EQ(vector[i], i);
+
+  // Elements are never moved after being appended.
+  const uint32_t* first = &vector[0];
+  vector.emplace_back(kSize);
+  ASSERT_EQ(first, &vector[0]);
+}
+
+TEST(ChunkedVectorTest, Iterator) {
+  using Vector = ChunkedVector<int64_t>;
+  const uint32_t kSize = Vector::kChunkSize + 10;
+
+  Vector vector;
+  for (uint32_t i = 0; i < kSize; i++)
+    vector.emplace_back(i * 2);
+
+  ASSERT_EQ(static_cast<uint32_t>(vector.end() - vector.begin()), kSize);
+
+  auto it = std::lower_bound(vector.begin(), vector.end(), 2 * kSize - 4);
+  ASSERT_EQ(static_cast<uint32_t>(std::distance(vector.begin(), it)),
+            kSize - 2);
+
+  auto minmax = std::minmax_element(vector.begin(), vector.end());
+  ASSERT_EQ(*minmax.first, 0);
+  ASSERT_EQ(*minmax.second, 2 * (kSize - 1));
+}
+
+TEST(ChunkedVectorTest, ForEachSpan) {
+  using Vector = ChunkedVector<uint32_t>;
+  const uint32_t kSize = Vector::kChunkSize * 2 + 100;
+
+  Vector vector;
+  for (uint32_t i = 0; i < kSize; i++)
+    vector.emplace_back(i);
+
+  const uint32_t kStart = 50;
+  const uint32_t kEnd = Vector::kChunkSize * 2 + 10;
+
+  uint32_t spans = 0;
+  uint32_t next_row = kStart;
+  vector.ForEachSpan(kStart, kEnd,
+                     [&spans, &next_row](const uint32_t* data, uint32_t row,
+                                         uint32_t count) {
+                       ASSERT_EQ(row, next_row);
+                       for (uint32_t i = 0; i < count; i++)
+                         ASSERT_EQ(data[i], row + i);
+                       next_row += count;
+                       spans++;
+                     });
+  ASSERT_EQ(next_row, kEnd);
+  // The small chunks within the first kChunkSize elements, then two full ones.
+  ASSERT_EQ(spans, Vector::kNumSmallChunks + 2);
+}
+
+TEST(ChunkedVectorTest, SmallChunks) {
+  using Vector = ChunkedVector<int64_t>;
+  ASSERT_EQ(Vector::CapacityFor(0), 0u);
+  ASSERT_EQ(Vector::CapacityFor(1), Vector::kFirstChunkSize);
+  ASSERT_EQ(Vector::CapacityFor(Vector::kFirstChunkSize),
+            Vector::kFirstChunkSize);
+  ASSERT_EQ(Vector::CapacityFor(Vector::kFirstChunkSize + 1),
+            2 * Vector::kFirstChunkSize);
+  ASSERT_EQ(Vector::CapacityFor(2 * Vector::kFirstChunkSize + 1),
+            4 * Vector::kFirstChunkSize);
+  ASSERT_EQ(Vector::CapacityFor(Vector::kChunkSize), Vector::kChunkSize);
+  ASSERT_EQ(Vector::CapacityFor(Vector::kChunkSize + 1),
+            2 * Vector::kChunkSize);
+
+  // Elements in the small chunks are never moved either.
+  Vector vector;
+  std::vector<const int64_t*> ptrs;
+  for (uint32_t i = 0; i < Vector::kChunkSize + 1; i++) {
+    vector.emplace_back(i);
+    ptrs.push_back(&vector[i]);
+  }
+  for (uint32_t i = 0; i < Vector::kChunkSize + 1; i++) {
+    ASSERT_EQ(&vector[i], ptrs[i]);
+    ASSERT_EQ(vector[i], i);
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/counter_buckets_table.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "src/trace_processor/sqlite_utils.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+using namespace sqlite_utils;
+}  // namespace
+
+CounterBucketsTable::CounterBucketsTable(sqlite3*, const TraceStorage* storage)
+    : storage_(storage) {}
+
+void CounterBucketsTable::RegisterTable(sqlite3* db,
+                                        const TraceStorage* storage,
+                                        const QueryContext* context) {
+  Table::Register<CounterBucketsTable>(db, storage, context, "counter_buckets");
+}
+
+base::Optional<Table::Schema> CounterBucketsTable::Init(int,
+                                                        const char* const*) {
+  const bool kHidden = true;
+  return Schema(
+      {
+          // These are the operator columns:
+          Table::Column(Column::kCounterId, "counter_id", ColumnType::kUint,
+                        kHidden),
+          Table::Column(Column::kTsStart, "ts_start", ColumnType::kLong,
+                        kHidden),
+          Table::Column(Column::kTsEnd, "ts_end", ColumnType::kLong, kHidden),
+          Table::Column(Column::kBucketCount, "bucket_count",
+                        ColumnType::kLong, kHidden),
+          // These are the ouput columns:
+          Table::Column(Column::kTs, "ts", ColumnType::kLong),
+          Table::Column(Column::kDur, "dur", ColumnType::kLong),
+          Table::Column(Column::kCount, "count", ColumnType::kUint),
+          Table::Column(Column::kMinValue, "min_value", ColumnType::kDouble),
+          Table::Column(Column::kMaxValue, "max_value", ColumnType::kDouble),
+          Table::Column(Column::kAvgValue, "avg_value", ColumnType::kDouble),
+          Table::Column(Column::kLastValue, "last_value", ColumnType::kDouble),
+      },
+      {Column::kTs});
+}
+
+std::unique_ptr<Table::Cursor> CounterBucketsTable::CreateCursor(
+    const QueryConstraints& qc,
+    sqlite3_value** argv) {
+  base::Optional<int64_t> args[4];
+  for (size_t i = 0; i < qc.constraints().size(); i++) {
+    const auto& cs = qc.constraints()[i];
+    if (IsOpEq(cs.op) && cs.iColumn <= Column::kBucketCount)
+      args[cs.iColumn] = sqlite3_value_int64(argv[i]);
+  }
+  for (const auto& arg : args) {
+    if (!arg.has_value()) {
+      SetErrorMessage(sqlite3_mprintf(
+          "counter_buckets requires equality constraints on counter_id, "
+          "ts_start, ts_end and bucket_count"));
+      return nullptr;
+    }
+  }
+  int64_t bucket_count = *args[Column::kBucketCount];
+  if (bucket_count <= 0) {
+    SetErrorMessage(sqlite3_mprintf(
+        "counter_buckets requires a positive bucket_count"));
+    return nullptr;
+  }
+  return std::unique_ptr<Table::Cursor>(
+      new Cursor(storage_, static_cast<uint32_t>(*args[Column::kCounterId]),
+                 *args[Column::kTsStart], *args[Column::kTsEnd],
+                 bucket_count));
+}
+
+int CounterBucketsTable::BestIndex(const QueryConstraints& qc,
+                                   BestIndexInfo* info) {
+  uint32_t num_args = 0;
+  for (size_t i = 0; i < qc.constraints().size(); i++) {
+    const auto& cs = qc.constraints()[i];
+    if (IsOpEq(cs.op) && cs.iColumn <= Column::kBucketCount) {
+      num_args++;
+      info->omit[i] = true;
+    }
+  }
+
+  // Make the plans which don't constrain all the arguments, and so fail in
+  // CreateCursor(), as unattractive as possible.
+  info->estimated_cost =
+      num_args == 4 ? 1000 : std::numeric_limits<uint32_t>::max();
+
+  // Buckets are returned by ascending ts.
+  info->order_by_consumed = qc.order_by().size() == 1 &&
+                            qc.order_by()[0].iColumn == Column::kTs &&
+                            !qc.order_by()[0].desc;
+  return SQLITE_OK;
+}
+
+CounterBucketsTable::Cursor::Cursor(const TraceStorage* storage,
+                                    uint32_t counter_id,
+                                    int64_t ts_start,
+                                    int64_t ts_end,
+                                    int64_t bucket_count)
+    : storage_(storage),
+      counter_id_(counter_id),
+      ts_start_(ts_start),
+      ts_end_(ts_end),
+      bucket_count_(bucket_count) {
+  const auto& pyramids = storage_->counter_pyramids();
+  if (counter_id_ >= pyramids.size() || ts_end_ <= ts_start_) {
+    eof_ = true;
+    return;
+  }
+
+  // Rounded up so that the buckets cover the whole window.
+  int64_t window = ts_end_ - ts_start_;
+  bucket_dur_ = window / bucket_count_ + (window % bucket_count_ ? 1 : 0);
+  next_sample_ = LowerBound(0, ts_start_);
+  Next();
+}
+
+const CounterPyramid& CounterBucketsTable::Cursor::pyramid() const {
+  return storage_->counter_pyramids()[counter_id_];
+}
+
+uint32_t CounterBucketsTable::Cursor::LowerBound(uint32_t start,
+                                                 int64_t ts) const {
+  const auto& rows = pyramid().rows();
+  const auto& timestamps = storage_->counter_values().timestamps();
+  auto it = std::lower_bound(
+      rows.begin() + start, rows.end(), ts,
+      [&timestamps](uint32_t row, int64_t t) { return timestamps[row] < t; });
+  return static_cast<uint32_t>(it - rows.begin());
+}
+
+int CounterBucketsTable::Cursor::Next() {
+  const auto& rows = pyramid().rows();
+  const auto& values = storage_->counter_values();
+  if (eof_ || next_sample_ == rows.size() ||
+      values.timestamps()[rows[next_sample_]] >= ts_end_) {
+    eof_ = true;
+    return SQLITE_OK;
+  }
+
+  // Jumps straight to the bucket of the next sample, skipping the empty ones.
+  int64_t ts = values.timestamps()[rows[next_sample_]];
+  int64_t bucket = (ts - ts_start_) / bucket_dur_;
+  ts_ = ts_start_ + bucket * bucket_dur_;
+  int64_t end = std::min(ts_ + bucket_dur_, ts_end_);
+  dur_ = end - ts_;
+
+  uint32_t end_sample = LowerBound(next_sample_, end);
+  aggregate_ =
+      pyramid().AggregateValues(next_sample_, end_sample, values.values());
+  last_row_ = rows[end_sample - 1];
+  next_sample_ = end_sample;
+  return SQLITE_OK;
+}
+
+int CounterBucketsTable::Cursor::Eof() {
+  return eof_;
+}
+
+int CounterBucketsTable::Cursor::Column(sqlite3_context* context, int N) {
+  switch (N) {
+    case Column::kCounterId:
+      sqlite3_result_int64(context, counter_id_);
+      break;
+    case Column::kTsStart:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(ts_start_));
+      break;
+    case Column::kTsEnd:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(ts_end_));
+      break;
+    case Column::kBucketCount:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(bucket_count_));
+      break;
+    case Column::kTs:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(ts_));
+      break;
+    case Column::kDur:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(dur_));
+      break;
+    case Column::kCount:
+      sqlite3_result_int64(context, aggregate_.count);
+      break;
+    case Column::kMinValue:
+      sqlite3_result_double(context, aggregate_.min);
+      break;
+    case Column::kMaxValue:
+      sqlite3_result_double(context, aggregate_.max);
+      break;
+    case Column::kAvgValue:
+      sqlite3_result_double(context, aggregate_.sum / aggregate_.count);
+      break;
+    case Column::kLastValue:
+      sqlite3_result_double(context,
+                            storage_->counter_values().values()[last_row_]);
+      break;
+    default:
+      PERFETTO_FATAL("Unknown column %d", N);
+      break;
+  }
+  return SQLITE_OK;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACE_PROCESSOR_COUNTER_BUCKETS_TABLE_H_
+#define SRC_TRACE_PROCESSOR_COUNTER_BUCKETS_TABLE_H_
+
+#include <memory>
+
+#include "src/trace_processor/counter_pyramid.h"
+#include "src/trace_processor/table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceStorage;
+
+// Downsamples the values of a counter over a window of time, for drawing its
+// track: splits [ts_start, ts_end) in bucket_count buckets of the same
+// duration and returns the number of values in each bucket and their min,
+// max, average and last value. Buckets without values are skipped. The
+// aggregates come from the pyramid of the counter (see CounterPyramid), so
+// the cost depends on the number of buckets rather than of values.
+// Requires equality constraints on the (hidden) arguments:
+//   SELECT * FROM counter_buckets(counter_id, ts_start, ts_end, bucket_count)
+class CounterBucketsTable : public Table {
+ public:
+  enum Column {
+    kCounterId = 0,
+    kTsStart = 1,
+    kTsEnd = 2,
+    kBucketCount = 3,
+    kTs = 4,
+    kDur = 5,
+    kCount = 6,
+    kMinValue = 7,
+    kMaxValue = 8,
+    kAvgValue = 9,
+    kLastValue = 10,
+  };
+
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
+
+  CounterBucketsTable(sqlite3*, const TraceStorage*);
+
+  // Table implementation.
+  base::Optional<Table::Schema> Init(int, const char* const*) override;
+  std::unique_ptr<Table::Cursor> CreateCursor(const QueryConstraints&,
+                                              sqlite3_value**) override;
+  int BestIndex(const QueryConstraints&, BestIndexInfo*) override;
+
+ private:
+  class Cursor : public Table::Cursor {
+   public:
+    Cursor(const TraceStorage*,
+           uint32_t counter_id,
+           int64_t ts_start,
+           int64_t ts_end,
+           int64_t bucket_count);
+
+    // Implementation of Table::Cursor.
+    int Next() override;
+    int Eof() override;
+    int Column(sqlite3_context*, int N) override;
+
+   private:
+    // Returns the index of the first sample of the counter at or after |ts|,
+    // starting the search at |start|.
+    uint32_t LowerBound(uint32_t start, int64_t ts) const;
+
+    // Not cached as adding counters moves the pyramids.
+    const CounterPyramid& pyramid() const;
+
+    const TraceStorage* const storage_;
+    const uint32_t counter_id_;
+    const int64_t ts_start_;
+    const int64_t ts_end_;
+    const int64_t bucket_count_;
+    int64_t bucket_dur_ = 0;
+
+    // The current bucket.
+    int64_t ts_ = 0;
+    int64_t dur_ = 0;
+    CounterPyramid::Aggregate aggregate_;
+    uint32_t last_row_ = 0;
+    bool eof_ = false;
+
+    // The first sample after the current bucket.
+    uint32_t next_sample_ = 0;
+  };
+
+  const TraceStorage* const storage_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_COUNTER_BUCKETS_TABLE_H_
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/counter_buckets_table.h"
+
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/trace_storage.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+
+class CounterBucketsTableTest : public ::testing::Test {
+ public:
+  CounterBucketsTableTest() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    CounterBucketsTable::RegisterTable(db_.get(), &storage_, nullptr);
+  }
+
+  void AddValue(uint32_t counter_id, int64_t ts, double value) {
+    uint32_t row = storage_.mutable_counter_values()->AddCounterValue(
+        counter_id, ts, value);
+    storage_.AddToCounterPyramid(row);
+  }
+
+  // Runs |sql| and returns the values of all the cells, row by row.
+  std::vector<double> Query(const std::string& sql) {
+    sqlite3_stmt* stmt;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &stmt, nullptr) ==
+                   SQLITE_OK);
+    ScopedStmt scoped_stmt(stmt);
+
+    std::vector<double> values;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      for (int i = 0; i < sqlite3_column_count(stmt); i++)
+        values.emplace_back(sqlite3_column_double(stmt, i));
+    }
+    return values;
+  }
+
+ protected:
+  TraceStorage storage_;
+  ScopedDb db_;
+};
+
+TEST_F(CounterBucketsTableTest, Buckets) {
+  AddValue(0, 5, 1);
+  AddValue(0, 10, 4);
+  AddValue(1, 12, 100);
+  AddValue(0, 15, 2);
+  AddValue(0, 19, 3);
+  AddValue(0, 45, 7);
+  AddValue(0, 50, 8);
+
+  // Buckets of 10ns in [10, 50): the sample at ts 50 is outside the window
+  // and the empty buckets are skipped.
+  EXPECT_THAT(
+      Query("SELECT ts, dur, count, min_value, max_value, avg_value, "
+            "last_value FROM counter_buckets(0, 10, 50, 4)"),
+      ElementsAre(10, 10, 3, 2, 4, 3, 3, 40, 10, 1, 7, 7, 7, 7));
+
+  // The last bucket is cut at the end of the window.
+  EXPECT_THAT(Query("SELECT ts, dur, count FROM counter_buckets(0, 0, 46, 2)"),
+              ElementsAre(0, 23, 4, 23, 23, 1));
+
+  EXPECT_THAT(Query("SELECT count FROM counter_buckets(1, 0, 100, 1)"),
+              ElementsAre(1));
+  EXPECT_THAT(Query("SELECT count FROM counter_buckets(2, 0, 100, 1)"),
+              ElementsAre());
+}
+
+TEST_F(CounterBucketsTableTest, MissingArguments) {
+  sqlite3_stmt* stmt;
+  ASSERT_EQ(sqlite3_prepare_v2(*db_, "SELECT * FROM counter_buckets(0, 0, 1)",
+                               -1, &stmt, nullptr),
+            SQLITE_OK);
+  ScopedStmt scoped_stmt(stmt);
+  ASSERT_EQ(sqlite3_step(stmt), SQLITE_ERROR);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
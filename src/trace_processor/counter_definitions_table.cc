@@ -33,15 +33,17 @@ CounterDefinitionsTable::CounterDefinitionsTable(sqlite3*,
 }
 
 void CounterDefinitionsTable::RegisterTable(sqlite3* db,
-                                            const TraceStorage* storage) {
-  Table::Register<CounterDefinitionsTable>(db, storage, "counter_definitions");
+                                            const TraceStorage* storage,
+                                            const QueryContext* context) {
+  Table::Register<CounterDefinitionsTable>(db, storage, context,
+                                           "counter_definitions");
 }
 
 StorageSchema CounterDefinitionsTable::CreateStorageSchema() {
   const auto& cs = storage_->counter_definitions();
   return StorageSchema::Builder()
       .AddColumn<RowColumn>("counter_id")
-      .AddStringColumn("name", &cs.name_ids(), &storage_->string_pool())
+      .AddStringColumn("name", &cs.name_ids(), storage_)
       .AddColumn<RefColumn>("ref", &cs.refs(), &cs.types(), storage_)
       .AddStringColumn("ref_type", &cs.types(), &ref_types_)
       .Build({"counter_id"});
@@ -55,14 +57,8 @@ int CounterDefinitionsTable::BestIndex(const QueryConstraints& qc,
                                        BestIndexInfo* info) {
   info->estimated_cost = EstimateCost(qc);
 
-  // Only the string columns are handled by SQLite
-  size_t name_index = schema().ColumnIndexFromName("name");
-  size_t ref_type_index = schema().ColumnIndexFromName("ref_type");
   info->order_by_consumed = true;
-  for (size_t i = 0; i < qc.constraints().size(); i++) {
-    auto col = static_cast<size_t>(qc.constraints()[i].iColumn);
-    info->omit[i] = col != name_index && col != ref_type_index;
-  }
+  SetOmittedConstraints(qc, info);
 
   return SQLITE_OK;
 }
@@ -89,8 +85,8 @@ uint32_t CounterDefinitionsTable::EstimateCost(const QueryConstraints& qc) {
 }
 
 CounterDefinitionsTable::RefColumn::RefColumn(std::string col_name,
-                                              const std::deque<int64_t>* refs,
-                                              const std::deque<RefType>* types,
+                                              const ChunkedVector<int64_t>* refs,
+                                              const ChunkedVector<RefType>* types,
                                               const TraceStorage* storage)
     : StorageColumn(col_name, false /* hidden */),
       refs_(refs),
@@ -17,7 +17,6 @@
 #ifndef SRC_TRACE_PROCESSOR_COUNTER_DEFINITIONS_TABLE_H_
 #define SRC_TRACE_PROCESSOR_COUNTER_DEFINITIONS_TABLE_H_
 
-#include <deque>
 #include <memory>
 #include <string>
 #include <vector>
@@ -29,7 +28,9 @@ namespace trace_processor {
 
 class CounterDefinitionsTable : public StorageTable {
  public:
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   CounterDefinitionsTable(sqlite3*, const TraceStorage*);
 
@@ -41,8 +42,8 @@ class CounterDefinitionsTable : public StorageTable {
   class RefColumn final : public StorageColumn {
    public:
     RefColumn(std::string col_name,
-              const std::deque<int64_t>* refs,
-              const std::deque<RefType>* types,
+              const ChunkedVector<int64_t>* refs,
+              const ChunkedVector<RefType>* types,
               const TraceStorage* storage);
 
     void ReportResult(sqlite3_context* ctx, uint32_t row) const override;
@@ -62,8 +63,8 @@ class CounterDefinitionsTable : public StorageTable {
    private:
     int CompareRefsAsc(uint32_t f, uint32_t s) const;
 
-    const std::deque<int64_t>* refs_;
-    const std::deque<RefType>* types_;
+    const ChunkedVector<int64_t>* refs_;
+    const ChunkedVector<RefType>* types_;
     const TraceStorage* storage_ = nullptr;
   };
 
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/counter_pyramid.h"
+
+#include <algorithm>
+
+namespace perfetto {
+namespace trace_processor {
+
+// static
+constexpr uint32_t CounterPyramid::kFanoutShift;
+constexpr size_t CounterPyramid::kMaxLevels;
+
+void CounterPyramid::AddValue(uint32_t row, double value) {
+  auto index = static_cast<uint32_t>(rows_.size());
+  rows_.emplace_back(row);
+
+  // The new level starts with the single full group of the level below.
+  if (levels_.empty()) {
+    levels_.emplace_back();
+  } else if (levels_.size() < kMaxLevels &&
+             index == GroupSize(levels_.size())) {
+    levels_.emplace_back(1, levels_.back()[0]);
+  }
+
+  for (size_t i = 0; i < levels_.size(); i++) {
+    std::vector<Group>& groups = levels_[i];
+    uint32_t group = index >> (kFanoutShift * (i + 1));
+    if (group == groups.size()) {
+      groups.push_back({value, value, value});
+      continue;
+    }
+    Group& g = groups[group];
+    g.min = std::min(g.min, value);
+    g.max = std::max(g.max, value);
+    g.sum += value;
+  }
+}
+
+CounterPyramid::Aggregate CounterPyramid::AggregateValues(
+    uint32_t start,
+    uint32_t end,
+    const ChunkedVector<double>& values) const {
+  PERFETTO_DCHECK(start <= end && end <= rows_.size());
+  Aggregate aggregate;
+  if (start == end)
+    return aggregate;
+
+  aggregate.count = end - start;
+  double first = values[rows_[start]];
+  aggregate.min = first;
+  aggregate.max = first;
+
+  // Walks the range using the largest groups which fit in it: the level goes
+  // up while |i| is the start of a group of the level above which ends
+  // before |end| and down when the groups of the level don't fit anymore.
+  uint32_t i = start;
+  size_t level = 0;
+  while (i < end) {
+    while (level < levels_.size() && i % GroupSize(level + 1) == 0 &&
+           end - i >= GroupSize(level + 1)) {
+      level++;
+    }
+    while (end - i < GroupSize(level))
+      level--;
+
+    if (level == 0) {
+      double value = values[rows_[i]];
+      aggregate.min = std::min(aggregate.min, value);
+      aggregate.max = std::max(aggregate.max, value);
+      aggregate.sum += value;
+    } else {
+      const Group& g = levels_[level - 1][i >> (kFanoutShift * level)];
+      aggregate.min = std::min(aggregate.min, g.min);
+      aggregate.max = std::max(aggregate.max, g.max);
+      aggregate.sum += g.sum;
+    }
+    i += GroupSize(level);
+  }
+  return aggregate;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACE_PROCESSOR_COUNTER_PYRAMID_H_
+#define SRC_TRACE_PROCESSOR_COUNTER_PYRAMID_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "src/trace_processor/chunked_vector.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Multi-resolution aggregates of the values of a counter, built incrementally
+// as the values are added. Level k holds the min, max and sum of each group
+// of 16^k consecutive samples of the counter, so the values of any range of
+// samples can be aggregated by combining O(log(samples)) groups rather than
+// scanning all the samples in the range.
+class CounterPyramid {
+ public:
+  struct Aggregate {
+    uint32_t count = 0;
+    double min = 0;
+    double max = 0;
+    double sum = 0;
+  };
+
+  // Adds the value of the next sample of the counter, at |row| in
+  // CounterValues. Samples must be added by increasing timestamp.
+  void AddValue(uint32_t row, double value);
+
+  // Aggregates the values of the samples [start, end) of the counter.
+  // |values| is the value column of CounterValues.
+  Aggregate AggregateValues(uint32_t start,
+                            uint32_t end,
+                            const ChunkedVector<double>& values) const;
+
+  // The rows in CounterValues of the samples of the counter, by increasing
+  // timestamp.
+  const std::vector<uint32_t>& rows() const { return rows_; }
+
+ private:
+  static constexpr uint32_t kFanoutShift = 4;
+
+  // The top level has groups of 2^28 samples.
+  static constexpr size_t kMaxLevels = 7;
+
+  struct Group {
+    double min;
+    double max;
+    double sum;
+  };
+
+  static uint32_t GroupSize(size_t level) {
+    return 1u << (kFanoutShift * level);
+  }
+
+  std::vector<uint32_t> rows_;
+
+  // levels_[i] holds the groups of level i + 1: the samples themselves are
+  // level 0. A level is only added once the samples don't fit in a single
+  // group of the level below.
+  std::vector<std::vector<Group>> levels_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_COUNTER_PYRAMID_H_
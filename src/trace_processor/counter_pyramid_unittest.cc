@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/counter_pyramid.h"
+
+#include <algorithm>
+#include <random>
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(CounterPyramidTest, Empty) {
+  CounterPyramid pyramid;
+  ChunkedVector<double> values;
+  EXPECT_EQ(pyramid.AggregateValues(0, 0, values).count, 0u);
+}
+
+TEST(CounterPyramidTest, MatchesScan) {
+  // The values of two interleaved counters, so that the rows of each counter
+  // are not contiguous.
+  std::minstd_rand0 rnd(0);
+  ChunkedVector<double> values;
+  CounterPyramid pyramid;
+  CounterPyramid other;
+  std::vector<double> counter_values;
+  for (uint32_t row = 0; row < 20000; row++) {
+    auto value = static_cast<double>(rnd() % 1000) - 500;
+    values.emplace_back(value);
+    if (rnd() % 4 == 0) {
+      other.AddValue(row, value);
+      continue;
+    }
+    pyramid.AddValue(row, value);
+    counter_values.push_back(value);
+  }
+  ASSERT_EQ(pyramid.rows().size(), counter_values.size());
+
+  auto size = static_cast<uint32_t>(counter_values.size());
+  std::vector<std::pair<uint32_t, uint32_t>> ranges = {
+      {0, size}, {0, 1}, {size - 1, size}, {15, 17}, {16, 272}, {1, size}};
+  for (int i = 0; i < 1000; i++) {
+    uint32_t start = rnd() % size;
+    ranges.emplace_back(start, start + rnd() % (size - start + 1));
+  }
+
+  for (const auto& range : ranges) {
+    auto aggregate =
+        pyramid.AggregateValues(range.first, range.second, values);
+    ASSERT_EQ(aggregate.count, range.second - range.first);
+    if (range.first == range.second)
+      continue;
+    auto begin = counter_values.begin() + range.first;
+    auto end = counter_values.begin() + range.second;
+    double sum = 0;
+    for (auto it = begin; it != end; ++it)
+      sum += *it;
+    ASSERT_EQ(aggregate.min, *std::min_element(begin, end));
+    ASSERT_EQ(aggregate.max, *std::max_element(begin, end));
+    ASSERT_EQ(aggregate.sum, sum);
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -23,8 +23,9 @@ CounterValuesTable::CounterValuesTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
 void CounterValuesTable::RegisterTable(sqlite3* db,
-                                       const TraceStorage* storage) {
-  Table::Register<CounterValuesTable>(db, storage, "counter_values");
+                                       const TraceStorage* storage,
+                                       const QueryContext* context) {
+  Table::Register<CounterValuesTable>(db, storage, context, "counter_values");
 }
 
 StorageSchema CounterValuesTable::CreateStorageSchema() {
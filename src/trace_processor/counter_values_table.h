@@ -26,7 +26,9 @@ namespace trace_processor {
 // in the trace.
 class CounterValuesTable : public StorageTable {
  public:
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   CounterValuesTable(sqlite3*, const TraceStorage*);
 
@@ -149,9 +149,9 @@ RowId EventTracker::PushCounter(int64_t timestamp,
   auto counter_row = definitions->AddCounterDefinition(name_id, ref, ref_type);
 
   auto* counter_values = context_->storage->mutable_counter_values();
-  size_t idx = counter_values->AddCounterValue(counter_row, timestamp, value);
-  return TraceStorage::CreateRowId(TableId::kCounterValues,
-                                   static_cast<uint32_t>(idx));
+  uint32_t idx = counter_values->AddCounterValue(counter_row, timestamp, value);
+  context_->storage->AddToCounterPyramid(idx);
+  return TraceStorage::CreateRowId(TableId::kCounterValues, idx);
 }
 
 }  // namespace trace_processor
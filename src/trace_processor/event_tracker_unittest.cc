@@ -66,11 +66,11 @@ TEST_F(EventTrackerTest, InsertSecondSched) {
   ASSERT_EQ(timestamps.size(), 2ul);
   ASSERT_EQ(timestamps[0], timestamp);
   ASSERT_EQ(context.storage->GetThread(1).start_ns, timestamp);
-  ASSERT_EQ(std::string(context.storage->GetString(
-                context.storage->GetThread(1).name_id)),
-            kCommProc1);
-  ASSERT_EQ(context.storage->slices().utids().front(), 1);
-  ASSERT_EQ(context.storage->slices().durations().front(), 1);
+  ASSERT_STREQ(context.storage->GetString(context.storage->GetThread(1).name_id)
+                   .c_str(),
+               kCommProc1);
+  ASSERT_EQ(context.storage->slices().utids()[0], 1);
+  ASSERT_EQ(context.storage->slices().durations()[0], 1);
 }
 
 TEST_F(EventTrackerTest, InsertThirdSched_SameThread) {
@@ -100,11 +100,11 @@ TEST_F(EventTrackerTest, InsertThirdSched_SameThread) {
   ASSERT_EQ(timestamps.size(), 4ul);
   ASSERT_EQ(timestamps[0], timestamp);
   ASSERT_EQ(context.storage->GetThread(1).start_ns, timestamp);
-  ASSERT_EQ(context.storage->slices().durations().at(0), 1u);
-  ASSERT_EQ(context.storage->slices().durations().at(1), 11u - 1u);
-  ASSERT_EQ(context.storage->slices().durations().at(2), 31u - 11u);
-  ASSERT_EQ(context.storage->slices().utids().at(0),
-            context.storage->slices().utids().at(2));
+  ASSERT_EQ(context.storage->slices().durations()[0], 1u);
+  ASSERT_EQ(context.storage->slices().durations()[1], 11u - 1u);
+  ASSERT_EQ(context.storage->slices().durations()[2], 31u - 11u);
+  ASSERT_EQ(context.storage->slices().utids()[0],
+            context.storage->slices().utids()[2]);
 }
 
 TEST_F(EventTrackerTest, CounterDuration) {
@@ -123,16 +123,16 @@ TEST_F(EventTrackerTest, CounterDuration) {
   ASSERT_EQ(context.storage->counter_definitions().size(), 1ul);
 
   ASSERT_EQ(context.storage->counter_values().size(), 4ul);
-  ASSERT_EQ(context.storage->counter_values().timestamps().at(0), timestamp);
-  ASSERT_EQ(context.storage->counter_values().values().at(0), 1000);
+  ASSERT_EQ(context.storage->counter_values().timestamps()[0], timestamp);
+  ASSERT_EQ(context.storage->counter_values().values()[0], 1000);
 
-  ASSERT_EQ(context.storage->counter_values().timestamps().at(1),
+  ASSERT_EQ(context.storage->counter_values().timestamps()[1],
             timestamp + 1);
-  ASSERT_EQ(context.storage->counter_values().values().at(1), 4000);
+  ASSERT_EQ(context.storage->counter_values().values()[1], 4000);
 
-  ASSERT_EQ(context.storage->counter_values().timestamps().at(2),
+  ASSERT_EQ(context.storage->counter_values().timestamps()[2],
             timestamp + 3);
-  ASSERT_EQ(context.storage->counter_values().values().at(2), 5000);
+  ASSERT_EQ(context.storage->counter_values().values()[2], 5000);
 }
 
 }  // namespace
@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/filter_kernels.h"
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PERFETTO_TP_SIMD_FILTER_KERNELS 1
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define PERFETTO_TP_SIMD_FILTER_KERNELS 1
+#else
+#define PERFETTO_TP_SIMD_FILTER_KERNELS 0
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace filter_kernels {
+
+namespace {
+
+#if defined(__AVX2__)
+
+// AVX2: 4 x 64-bit lanes per vector. Narrower integer columns are sign/zero
+// extended to 64-bit lanes so that they can be compared against the 64-bit
+// constant SQLite gives us without any risk of truncation.
+constexpr uint32_t kLanes = 4;
+using VecI = __m256i;
+using VecD = __m256d;
+
+inline VecI SetI64(int64_t v) {
+  return _mm256_set1_epi64x(v);
+}
+inline VecI LoadI64(const int64_t* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+inline VecI LoadI64(const int32_t* p) {
+  return _mm256_cvtepi32_epi64(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+inline VecI LoadI64(const uint32_t* p) {
+  return _mm256_cvtepu32_epi64(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+inline VecI LoadI64(const uint8_t* p) {
+  int32_t v;
+  memcpy(&v, p, sizeof(v));
+  return _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(v));
+}
+inline VecI CmpEqI64(VecI a, VecI b) {
+  return _mm256_cmpeq_epi64(a, b);
+}
+inline VecI CmpGtI64(VecI a, VecI b) {
+  return _mm256_cmpgt_epi64(a, b);
+}
+inline uint64_t MoveMaskI64(VecI a) {
+  return static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(a)));
+}
+
+inline VecD SetF64(double v) {
+  return _mm256_set1_pd(v);
+}
+inline VecD LoadF64(const double* p) {
+  return _mm256_loadu_pd(p);
+}
+inline uint64_t MoveMaskF64(VecD a) {
+  return static_cast<uint32_t>(_mm256_movemask_pd(a));
+}
+
+// NE is unordered (i.e. true when either side is NaN) to match the semantics
+// of std::not_equal_to; all the other predicates are ordered.
+inline VecD CmpEqF64(VecD a, VecD b) {
+  return _mm256_cmp_pd(a, b, _CMP_EQ_OQ);
+}
+inline VecD CmpNeF64(VecD a, VecD b) {
+  return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ);
+}
+inline VecD CmpLtF64(VecD a, VecD b) {
+  return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+}
+inline VecD CmpLeF64(VecD a, VecD b) {
+  return _mm256_cmp_pd(a, b, _CMP_LE_OQ);
+}
+inline VecD CmpGtF64(VecD a, VecD b) {
+  return _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+}
+inline VecD CmpGeF64(VecD a, VecD b) {
+  return _mm256_cmp_pd(a, b, _CMP_GE_OQ);
+}
+
+#elif defined(__SSE4_2__)
+
+// SSE4.2: 2 x 64-bit lanes per vector (pcmpgtq requires SSE4.2).
+constexpr uint32_t kLanes = 2;
+using VecI = __m128i;
+using VecD = __m128d;
+
+inline VecI SetI64(int64_t v) {
+  return _mm_set1_epi64x(v);
+}
+inline VecI LoadI64(const int64_t* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+inline VecI LoadI64(const int32_t* p) {
+  return _mm_cvtepi32_epi64(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+inline VecI LoadI64(const uint32_t* p) {
+  return _mm_cvtepu32_epi64(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+inline VecI LoadI64(const uint8_t* p) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return _mm_cvtepu8_epi64(_mm_cvtsi32_si128(v));
+}
+inline VecI CmpEqI64(VecI a, VecI b) {
+  return _mm_cmpeq_epi64(a, b);
+}
+inline VecI CmpGtI64(VecI a, VecI b) {
+  return _mm_cmpgt_epi64(a, b);
+}
+inline uint64_t MoveMaskI64(VecI a) {
+  return static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(a)));
+}
+
+inline VecD SetF64(double v) {
+  return _mm_set1_pd(v);
+}
+inline VecD LoadF64(const double* p) {
+  return _mm_loadu_pd(p);
+}
+inline uint64_t MoveMaskF64(VecD a) {
+  return static_cast<uint32_t>(_mm_movemask_pd(a));
+}
+
+inline VecD CmpEqF64(VecD a, VecD b) {
+  return _mm_cmpeq_pd(a, b);
+}
+inline VecD CmpNeF64(VecD a, VecD b) {
+  return _mm_cmpneq_pd(a, b);
+}
+inline VecD CmpLtF64(VecD a, VecD b) {
+  return _mm_cmplt_pd(a, b);
+}
+inline VecD CmpLeF64(VecD a, VecD b) {
+  return _mm_cmple_pd(a, b);
+}
+inline VecD CmpGtF64(VecD a, VecD b) {
+  return _mm_cmpgt_pd(a, b);
+}
+inline VecD CmpGeF64(VecD a, VecD b) {
+  return _mm_cmpge_pd(a, b);
+}
+
+#endif
+
+#if PERFETTO_TP_SIMD_FILTER_KERNELS
+
+template <typename T, typename VecCmp>
+PERFETTO_ALWAYS_INLINE uint64_t SimdWordI64(const T* data,
+                                            int64_t value,
+                                            VecCmp cmp) {
+  VecI v = SetI64(value);
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < kMaxValuesPerWord; i += kLanes)
+    word |= MoveMaskI64(cmp(LoadI64(data + i), v)) << i;
+  return word;
+}
+
+// Only EQ and GT are available as integer instructions so the remaining
+// operators are implemented by swapping the operands and/or inverting the
+// result (which is safe as integers, unlike doubles, are totally ordered).
+template <typename T>
+uint64_t SimdCompareWordI64(const T* data, CompareOp op, int64_t value) {
+  auto eq = [](VecI x, VecI v) { return CmpEqI64(x, v); };
+  auto gt = [](VecI x, VecI v) { return CmpGtI64(x, v); };
+  auto lt = [](VecI x, VecI v) { return CmpGtI64(v, x); };
+  switch (op) {
+    case CompareOp::kEq:
+      return SimdWordI64(data, value, eq);
+    case CompareOp::kNe:
+      return ~SimdWordI64(data, value, eq);
+    case CompareOp::kGt:
+      return SimdWordI64(data, value, gt);
+    case CompareOp::kLe:
+      return ~SimdWordI64(data, value, gt);
+    case CompareOp::kLt:
+      return SimdWordI64(data, value, lt);
+    case CompareOp::kGe:
+      return ~SimdWordI64(data, value, lt);
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+template <typename VecCmp>
+PERFETTO_ALWAYS_INLINE uint64_t SimdWordF64(const double* data,
+                                            double value,
+                                            VecCmp cmp) {
+  VecD v = SetF64(value);
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < kMaxValuesPerWord; i += kLanes)
+    word |= MoveMaskF64(cmp(LoadF64(data + i), v)) << i;
+  return word;
+}
+
+uint64_t SimdCompareWordF64(const double* data, CompareOp op, double value) {
+  switch (op) {
+    case CompareOp::kEq:
+      return SimdWordF64(data, value, CmpEqF64);
+    case CompareOp::kNe:
+      return SimdWordF64(data, value, CmpNeF64);
+    case CompareOp::kLt:
+      return SimdWordF64(data, value, CmpLtF64);
+    case CompareOp::kLe:
+      return SimdWordF64(data, value, CmpLeF64);
+    case CompareOp::kGt:
+      return SimdWordF64(data, value, CmpGtF64);
+    case CompareOp::kGe:
+      return SimdWordF64(data, value, CmpGeF64);
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+#endif  // PERFETTO_TP_SIMD_FILTER_KERNELS
+
+template <typename T>
+uint64_t CompareWordI64(const T* data,
+                        uint32_t n,
+                        CompareOp op,
+                        int64_t value) {
+#if PERFETTO_TP_SIMD_FILTER_KERNELS
+  if (n == kMaxValuesPerWord)
+    return SimdCompareWordI64(data, op, value);
+#endif
+  return CompareWord<T, int64_t>(data, n, op, value);
+}
+
+}  // namespace
+
+uint64_t CompareWord(const int64_t* data,
+                     uint32_t n,
+                     CompareOp op,
+                     int64_t value) {
+  return CompareWordI64(data, n, op, value);
+}
+
+uint64_t CompareWord(const int32_t* data,
+                     uint32_t n,
+                     CompareOp op,
+                     int64_t value) {
+  return CompareWordI64(data, n, op, value);
+}
+
+uint64_t CompareWord(const uint32_t* data,
+                     uint32_t n,
+                     CompareOp op,
+                     int64_t value) {
+  return CompareWordI64(data, n, op, value);
+}
+
+uint64_t CompareWord(const uint8_t* data,
+                     uint32_t n,
+                     CompareOp op,
+                     int64_t value) {
+  return CompareWordI64(data, n, op, value);
+}
+
+uint64_t CompareWord(const double* data,
+                     uint32_t n,
+                     CompareOp op,
+                     double value) {
+#if PERFETTO_TP_SIMD_FILTER_KERNELS
+  if (n == kMaxValuesPerWord)
+    return SimdCompareWordF64(data, op, value);
+#endif
+  return CompareWord<double, double>(data, n, op, value);
+}
+
+}  // namespace filter_kernels
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_FILTER_KERNELS_H_
+#define SRC_TRACE_PROCESSOR_FILTER_KERNELS_H_
+
+#include <stdint.h>
+
+#include <functional>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/base/utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace filter_kernels {
+
+// Kernels which compare a contiguous run of (at most 64) column values against
+// a constant and return the result as a bitmask: bit i is set iff
+// |data[i] op value| is true.
+//
+// On x86, the kernels for the common column types are vectorized when the
+// compiler targets AVX2 or SSE4.2 (i.e. -mavx2 or -msse4.2). All other
+// combinations (and partial words) use the branch-free scalar kernel below.
+
+enum class CompareOp {
+  kEq,
+  kNe,
+  kLt,
+  kLe,
+  kGt,
+  kGe,
+};
+
+constexpr uint32_t kMaxValuesPerWord = 64;
+
+template <typename T, typename C, typename Cmp>
+inline uint64_t ScalarCompareWord(const T* data, uint32_t n, C value, Cmp cmp) {
+  PERFETTO_DCHECK(n <= kMaxValuesPerWord);
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < n; i++)
+    word |= static_cast<uint64_t>(cmp(static_cast<C>(data[i]), value)) << i;
+  return word;
+}
+
+template <typename T, typename C>
+uint64_t CompareWord(const T* data, uint32_t n, CompareOp op, C value) {
+  switch (op) {
+    case CompareOp::kEq:
+      return ScalarCompareWord(data, n, value, std::equal_to<C>());
+    case CompareOp::kNe:
+      return ScalarCompareWord(data, n, value, std::not_equal_to<C>());
+    case CompareOp::kLt:
+      return ScalarCompareWord(data, n, value, std::less<C>());
+    case CompareOp::kLe:
+      return ScalarCompareWord(data, n, value, std::less_equal<C>());
+    case CompareOp::kGt:
+      return ScalarCompareWord(data, n, value, std::greater<C>());
+    case CompareOp::kGe:
+      return ScalarCompareWord(data, n, value, std::greater_equal<C>());
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+// Overloads for the column types which have vectorized implementations. These
+// are preferred over the template above by overload resolution.
+uint64_t CompareWord(const int64_t* data,
+                     uint32_t n,
+                     CompareOp op,
+                     int64_t value);
+uint64_t CompareWord(const int32_t* data,
+                     uint32_t n,
+                     CompareOp op,
+                     int64_t value);
+uint64_t CompareWord(const uint32_t* data,
+                     uint32_t n,
+                     CompareOp op,
+                     int64_t value);
+uint64_t CompareWord(const uint8_t* data,
+                     uint32_t n,
+                     CompareOp op,
+                     int64_t value);
+uint64_t CompareWord(const double* data,
+                     uint32_t n,
+                     CompareOp op,
+                     double value);
+
+}  // namespace filter_kernels
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_FILTER_KERNELS_H_
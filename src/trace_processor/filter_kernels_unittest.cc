@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/filter_kernels.h"
+
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace filter_kernels {
+namespace {
+
+const CompareOp kAllOps[] = {CompareOp::kEq, CompareOp::kNe, CompareOp::kLt,
+                             CompareOp::kLe, CompareOp::kGt, CompareOp::kGe};
+
+template <typename C>
+bool Compare(CompareOp op, C a, C b) {
+  switch (op) {
+    case CompareOp::kEq:
+      return a == b;
+    case CompareOp::kNe:
+      return a != b;
+    case CompareOp::kLt:
+      return a < b;
+    case CompareOp::kLe:
+      return a <= b;
+    case CompareOp::kGt:
+      return a > b;
+    case CompareOp::kGe:
+      return a >= b;
+  }
+  return false;
+}
+
+// Checks the kernel for |T| against a per-value comparison for each operator
+// and for both full and partial words.
+template <typename T, typename C>
+void CheckKernel(const std::vector<T>& data, C value) {
+  for (CompareOp op : kAllOps) {
+    for (uint32_t n : {64u, 63u, 17u, 1u}) {
+      uint64_t word = CompareWord(data.data(), n, op, value);
+      for (uint32_t i = 0; i < 64; i++) {
+        bool expected =
+            i < n && Compare(op, static_cast<C>(data[i]), value);
+        ASSERT_EQ(((word >> i) & 1) != 0, expected)
+            << "op " << static_cast<int>(op) << " n " << n << " i " << i;
+      }
+    }
+  }
+}
+
+TEST(FilterKernelsUnittest, Int64) {
+  std::minstd_rand0 rnd(0);
+  std::vector<int64_t> data;
+  for (uint32_t i = 0; i < 64; i++)
+    data.emplace_back(static_cast<int64_t>(rnd() % 8) - 4);
+  data[10] = std::numeric_limits<int64_t>::max();
+  data[11] = std::numeric_limits<int64_t>::min();
+
+  CheckKernel(data, int64_t{0});
+  CheckKernel(data, int64_t{-4});
+  CheckKernel(data, std::numeric_limits<int64_t>::max());
+}
+
+TEST(FilterKernelsUnittest, Int32) {
+  std::minstd_rand0 rnd(1);
+  std::vector<int32_t> data;
+  for (uint32_t i = 0; i < 64; i++)
+    data.emplace_back(static_cast<int32_t>(rnd() % 8) - 4);
+  data[3] = std::numeric_limits<int32_t>::min();
+
+  CheckKernel(data, int64_t{1});
+  CheckKernel(data, int64_t{-1});
+  CheckKernel(data, int64_t{std::numeric_limits<int32_t>::min()});
+}
+
+TEST(FilterKernelsUnittest, Uint32) {
+  std::minstd_rand0 rnd(2);
+  std::vector<uint32_t> data;
+  for (uint32_t i = 0; i < 64; i++)
+    data.emplace_back(static_cast<uint32_t>(rnd() % 8));
+  data[5] = std::numeric_limits<uint32_t>::max();
+
+  CheckKernel(data, int64_t{3});
+  CheckKernel(data, int64_t{-1});
+  CheckKernel(data, int64_t{std::numeric_limits<uint32_t>::max()});
+}
+
+TEST(FilterKernelsUnittest, Uint8) {
+  std::minstd_rand0 rnd(3);
+  std::vector<uint8_t> data;
+  for (uint32_t i = 0; i < 64; i++)
+    data.emplace_back(static_cast<uint8_t>(rnd() % 4));
+  data[7] = 255;
+
+  CheckKernel(data, int64_t{2});
+  CheckKernel(data, int64_t{255});
+}
+
+TEST(FilterKernelsUnittest, Double) {
+  std::minstd_rand0 rnd(4);
+  std::vector<double> data;
+  for (uint32_t i = 0; i < 64; i++)
+    data.emplace_back(static_cast<double>(rnd() % 8) / 2);
+  data[9] = std::numeric_limits<double>::quiet_NaN();
+
+  CheckKernel(data, 1.5);
+  CheckKernel(data, 0.0);
+}
+
+TEST(FilterKernelsUnittest, IntColumnDoubleValue) {
+  std::vector<int64_t> data;
+  for (uint32_t i = 0; i < 64; i++)
+    data.emplace_back(static_cast<int64_t>(i));
+
+  CheckKernel(data, 10.5);
+}
+
+}  // namespace
+}  // namespace filter_kernels
+}  // namespace trace_processor
+}  // namespace perfetto
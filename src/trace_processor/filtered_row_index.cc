@@ -27,8 +27,10 @@ FilteredRowIndex::FilteredRowIndex(uint32_t start_row, uint32_t end_row)
 void FilteredRowIndex::IntersectRows(std::vector<uint32_t> rows) {
   PERFETTO_DCHECK(error_.empty());
 
-  // Sort the rows so all branches below make sense.
-  std::sort(rows.begin(), rows.end());
+  // Sort the rows so all branches below make sense. Rows from a secondary
+  // index are often sorted already.
+  if (!std::is_sorted(rows.begin(), rows.end()))
+    std::sort(rows.begin(), rows.end());
 
   if (mode_ == kAllRows) {
     mode_ = Mode::kRowVector;
@@ -48,26 +50,24 @@ void FilteredRowIndex::IntersectRows(std::vector<uint32_t> rows) {
     return;
   }
 
-  // Initialise start to the beginning of the vector.
-  auto start = row_filter_.begin();
-
   // Skip directly to the rows in range of start and end.
   size_t i = 0;
   for (; i < rows.size() && rows[i] < start_row_; i++) {
   }
+
+  // Unset all bits between the previous row and the current row. That is, this
+  // loop sets all elements not pointed to by rows to false. It does not touch
+  // the rows themselves which means if they were already false (i.e. not
+  // returned) then they won't be returned now and if they were true (i.e.
+  // returned) they will still be returned.
+  uint32_t start = 0;
   for (; i < rows.size() && rows[i] < end_row_; i++) {
-    // Unset all bits between the start iterator and the iterator pointing
-    // to the current row. That is, this loop sets all elements not pointed
-    // to by rows to false. It does not touch the rows themselves which
-    // means if they were already false (i.e. not returned) then they won't
-    // be returned now and if they were true (i.e. returned) they will still
-    // be returned.
-    auto row = rows[i];
-    auto end = row_filter_.begin() + static_cast<ptrdiff_t>(row - start_row_);
-    std::fill(start, end, false);
+    uint32_t end = rows[i] - start_row_;
+    if (start < end)
+      row_filter_.ClearRange(start, end);
     start = end + 1;
   }
-  std::fill(start, row_filter_.end(), false);
+  row_filter_.ClearRange(start, row_filter_.size());
 }
 
 std::vector<uint32_t> FilteredRowIndex::ToRowVector() {
@@ -94,14 +94,15 @@ void FilteredRowIndex::ConvertBitVectorToRowVector() {
 
   mode_ = Mode::kRowVector;
 
-  auto b = row_filter_.begin();
-  auto e = row_filter_.end();
-  using std::find;
-  for (auto it = find(b, e, true); it != e; it = find(it + 1, e, true)) {
-    auto filter_idx = static_cast<uint32_t>(std::distance(b, it));
-    rows_.emplace_back(filter_idx + start_row_);
+  rows_.reserve(row_filter_.GetNumBitsSet());
+  for (uint32_t w = 0; w < row_filter_.word_count(); w++) {
+    uint32_t first_row = start_row_ + w * BitVector::kBitsInWord;
+    for (uint64_t word = row_filter_.word(w); word != 0; word &= word - 1) {
+      auto bit = static_cast<uint32_t>(__builtin_ctzll(word));
+      rows_.emplace_back(first_row + bit);
+    }
   }
-  row_filter_.clear();
+  row_filter_ = BitVector();
 }
 
 std::unique_ptr<RowIterator> FilteredRowIndex::ToRowIterator(bool desc) {
@@ -115,9 +116,13 @@ std::unique_ptr<RowIterator> FilteredRowIndex::ToRowIterator(bool desc) {
       return std::unique_ptr<RangeRowIterator>(
           new RangeRowIterator(start_row_, desc, TakeBitVector()));
     }
-    case Mode::kRowVector:
+    case Mode::kRowVector: {
+      auto rows = TakeRowVector();
+      if (desc)
+        std::reverse(rows.begin(), rows.end());
       return std::unique_ptr<VectorRowIterator>(
-          new VectorRowIterator(TakeRowVector()));
+          new VectorRowIterator(std::move(rows)));
+    }
   }
   PERFETTO_FATAL("For GCC");
 }
@@ -132,12 +137,12 @@ std::vector<uint32_t> FilteredRowIndex::TakeRowVector() {
   return vector;
 }
 
-std::vector<bool> FilteredRowIndex::TakeBitVector() {
+BitVector FilteredRowIndex::TakeBitVector() {
   PERFETTO_DCHECK(error_.empty());
 
   PERFETTO_DCHECK(mode_ == Mode::kBitVector);
   auto filter = std::move(row_filter_);
-  row_filter_.clear();
+  row_filter_ = BitVector();
   mode_ = Mode::kAllRows;
   return filter;
 }
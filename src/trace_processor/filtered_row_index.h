@@ -24,6 +24,7 @@
 #include <vector>
 
 #include "perfetto/base/logging.h"
+#include "src/trace_processor/bit_vector.h"
 #include "src/trace_processor/row_iterators.h"
 
 namespace perfetto {
@@ -45,7 +46,7 @@ class FilteredRowIndex {
  public:
   FilteredRowIndex(uint32_t start_row, uint32_t end_row);
 
-  // One of the following three functions can be called by the filter classes
+  // One of the following four functions can be called by the filter classes
   // to restrict which rows should be returned.
 
   // Interesects the rows specified by |rows| with the already filtered rows
@@ -71,6 +72,28 @@ class FilteredRowIndex {
     }
   }
 
+  // Calls |fn(first_row, count)| for each group of at most 64 consecutive rows
+  // starting at |first_row| which may still be returned. |fn| should return a
+  // bitmask where bit i is set iff row |first_row + i| should be retained.
+  // Prefer this to FilterRows when the filter can be computed for many rows at
+  // once (e.g. see filter_kernels.h).
+  template <typename WordPredicate /* (uint32_t, uint32_t) -> uint64_t */>
+  void FilterWords(WordPredicate fn) {
+    PERFETTO_DCHECK(error_.empty());
+
+    switch (mode_) {
+      case Mode::kAllRows:
+        FilterAllRowsWords(fn);
+        break;
+      case Mode::kBitVector:
+        FilterBitVectorWords(fn);
+        break;
+      case Mode::kRowVector:
+        FilterRowVector([&fn](uint32_t row) { return (fn(row, 1) & 1) != 0; });
+        break;
+    }
+  }
+
   // Called when there is some error in the filter operation requested. The
   // error string is used by the coordinator to report the error to SQLite.
   void set_error(std::string error) { error_ = std::move(error); }
@@ -98,54 +121,78 @@ class FilteredRowIndex {
 
   template <typename Predicate>
   void FilterAllRows(Predicate fn) {
+    FilterAllRowsWords([&fn](uint32_t first_row, uint32_t count) {
+      uint64_t word = 0;
+      for (uint32_t i = 0; i < count; i++)
+        word |= static_cast<uint64_t>(fn(first_row + i)) << i;
+      return word;
+    });
+  }
+
+  template <typename Predicate>
+  void FilterBitVector(Predicate fn) {
+    for (uint32_t w = 0; w < row_filter_.word_count(); w++) {
+      uint64_t word = row_filter_.word(w);
+      uint32_t first_row = start_row_ + w * BitVector::kBitsInWord;
+
+      // Only call |fn| on the rows which are still set, clearing the ones it
+      // rejects.
+      for (uint64_t rem = word; rem != 0; rem &= rem - 1) {
+        uint32_t bit = static_cast<uint32_t>(__builtin_ctzll(rem));
+        if (!fn(first_row + bit))
+          word &= ~(1ull << bit);
+      }
+      row_filter_.set_word(w, word);
+    }
+  }
+
+  template <typename WordPredicate>
+  void FilterAllRowsWords(WordPredicate fn) {
     mode_ = Mode::kBitVector;
-    row_filter_.resize(end_row_ - start_row_, false);
+    row_filter_ = BitVector(end_row_ - start_row_, false);
 
-    for (auto i = start_row_; i < end_row_; i++) {
-      if (fn(i))
-        row_filter_[i - start_row_] = true;
+    for (uint32_t w = 0; w < row_filter_.word_count(); w++) {
+      uint32_t first_row = start_row_ + w * BitVector::kBitsInWord;
+      uint32_t count = std::min(BitVector::kBitsInWord, end_row_ - first_row);
+      row_filter_.set_word(w, fn(first_row, count));
     }
   }
 
-  template <typename Predicate>
-  void FilterBitVector(Predicate fn) {
-    auto b = row_filter_.begin();
-    auto e = row_filter_.end();
-
-    using std::find;
-    for (auto it = find(b, e, true); it != e; it = find(it + 1, e, true)) {
-      auto filter_idx = static_cast<uint32_t>(std::distance(b, it));
-      auto value_it = start_row_ + filter_idx;
-      *it = fn(value_it);
+  template <typename WordPredicate>
+  void FilterBitVectorWords(WordPredicate fn) {
+    for (uint32_t w = 0; w < row_filter_.word_count(); w++) {
+      // Words which have no rows left don't need to be filtered again.
+      uint64_t word = row_filter_.word(w);
+      if (word == 0)
+        continue;
+
+      uint32_t first_row = start_row_ + w * BitVector::kBitsInWord;
+      uint32_t count = std::min(BitVector::kBitsInWord, end_row_ - first_row);
+      row_filter_.set_word(w, word & fn(first_row, count));
     }
   }
 
   template <typename Predicate>
   void FilterRowVector(Predicate fn) {
-    size_t rows_size = rows_.size();
-    for (size_t i = 0; i < rows_size;) {
-      if (fn(rows_[i])) {
-        i++;
-      } else {
-        std::swap(rows_[i], rows_[rows_size - 1]);
-        rows_size--;
-      }
-    }
-    rows_.resize(rows_size);
+    // Keep the rows sorted as IntersectRows() and the row iterators rely on
+    // this.
+    auto it = std::remove_if(rows_.begin(), rows_.end(),
+                             [&fn](uint32_t row) { return !fn(row); });
+    rows_.erase(it, rows_.end());
   }
 
   void ConvertBitVectorToRowVector();
 
   std::vector<uint32_t> TakeRowVector();
 
-  std::vector<bool> TakeBitVector();
+  BitVector TakeBitVector();
 
   Mode mode_;
   uint32_t start_row_;
   uint32_t end_row_;
 
   // Only non-empty when |mode_| == Mode::kBitVector.
-  std::vector<bool> row_filter_;
+  BitVector row_filter_;
 
   // Only non-empty when |mode_| == Mode::kRowVector.
   // This vector is sorted.
@@ -0,0 +1,135 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+
+#include "benchmark/benchmark.h"
+
+#include "src/trace_processor/chunked_vector.h"
+#include "src/trace_processor/filter_kernels.h"
+#include "src/trace_processor/filtered_row_index.h"
+
+namespace {
+
+using perfetto::trace_processor::ChunkedVector;
+using perfetto::trace_processor::FilteredRowIndex;
+using perfetto::trace_processor::RangeRowIterator;
+namespace filter_kernels = perfetto::trace_processor::filter_kernels;
+
+// Emulates "SELECT COUNT(*) FROM sched WHERE ts > X AND dur > Y AND cpu = Z"
+// by filtering three sched-like columns and counting the resulting rows.
+
+struct SchedColumns {
+  ChunkedVector<int64_t> ts;
+  ChunkedVector<int64_t> dur;
+  ChunkedVector<uint32_t> cpu;
+};
+
+void FillColumns(SchedColumns* cols, uint32_t size) {
+  std::minstd_rand0 rnd(0);
+  int64_t ts = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    ts += rnd() % 1000;
+    cols->ts.emplace_back(ts);
+    cols->dur.emplace_back(static_cast<int64_t>(rnd() % 1000));
+    cols->cpu.emplace_back(static_cast<uint32_t>(rnd() % 8));
+  }
+}
+
+template <typename T, typename C>
+void FilterColumn(const ChunkedVector<T>& col,
+                  filter_kernels::CompareOp op,
+                  C value,
+                  FilteredRowIndex* index) {
+  index->FilterWords([&col, op, value](uint32_t first_row, uint32_t count) {
+    uint64_t word = 0;
+    col.ForEachSpan(first_row, first_row + count,
+                    [&word, first_row, op, value](const T* data, uint32_t row,
+                                                  uint32_t n) {
+                      word |= filter_kernels::CompareWord(data, n, op, value)
+                              << (row - first_row);
+                    });
+    return word;
+  });
+}
+
+void FilterArgs(benchmark::internal::Benchmark* b) {
+  b->Arg(1 << 16)->Arg(1 << 20)->Arg(1 << 24);
+}
+
+}  // namespace
+
+static void BM_FilterRowsPerRow(benchmark::State& state) {
+  SchedColumns cols;
+  auto size = static_cast<uint32_t>(state.range(0));
+  FillColumns(&cols, size);
+
+  const int64_t ts_min = cols.ts[size / 4];
+  while (state.KeepRunning()) {
+    FilteredRowIndex index(0, size);
+    index.FilterRows([&cols, ts_min](uint32_t row) PERFETTO_ALWAYS_INLINE {
+      return cols.ts[row] > ts_min;
+    });
+    index.FilterRows([&cols](uint32_t row) PERFETTO_ALWAYS_INLINE {
+      return cols.dur[row] > 500;
+    });
+    index.FilterRows([&cols](uint32_t row) PERFETTO_ALWAYS_INLINE {
+      return cols.cpu[row] == 3;
+    });
+    auto it = index.ToRowIterator(false);
+    benchmark::DoNotOptimize(
+        static_cast<RangeRowIterator*>(it.get())->RowCount());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FilterRowsPerRow)->Apply(FilterArgs);
+
+static void BM_FilterWordsKernels(benchmark::State& state) {
+  SchedColumns cols;
+  auto size = static_cast<uint32_t>(state.range(0));
+  FillColumns(&cols, size);
+
+  const int64_t ts_min = cols.ts[size / 4];
+  while (state.KeepRunning()) {
+    FilteredRowIndex index(0, size);
+    FilterColumn(cols.ts, filter_kernels::CompareOp::kGt, ts_min, &index);
+    FilterColumn(cols.dur, filter_kernels::CompareOp::kGt, int64_t{500},
+                 &index);
+    FilterColumn(cols.cpu, filter_kernels::CompareOp::kEq, int64_t{3},
+                 &index);
+    auto it = index.ToRowIterator(false);
+    benchmark::DoNotOptimize(
+        static_cast<RangeRowIterator*>(it.get())->RowCount());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FilterWordsKernels)->Apply(FilterArgs);
+
+static void BM_IterateFilteredRows(benchmark::State& state) {
+  SchedColumns cols;
+  auto size = static_cast<uint32_t>(state.range(0));
+  FillColumns(&cols, size);
+
+  while (state.KeepRunning()) {
+    FilteredRowIndex index(0, size);
+    FilterColumn(cols.cpu, filter_kernels::CompareOp::kEq, int64_t{3},
+                 &index);
+    uint32_t count = 0;
+    for (auto it = index.ToRowIterator(false); !it->IsEnd(); it->NextRow())
+      count++;
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IterateFilteredRows)->Apply(FilterArgs);
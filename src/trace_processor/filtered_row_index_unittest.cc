@@ -52,6 +52,41 @@ TEST(FilteredRowIndexUnittest, FilterRowsTwice) {
   ASSERT_THAT(index.ToRowVector(), ElementsAre(2));
 }
 
+TEST(FilteredRowIndexUnittest, FilterWords) {
+  FilteredRowIndex index(10, 200);
+  index.FilterWords([](uint32_t first_row, uint32_t count) {
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < count; i++)
+      word |= static_cast<uint64_t>((first_row + i) % 50 == 0) << i;
+    return word;
+  });
+  ASSERT_THAT(index.ToRowVector(), ElementsAre(50, 100, 150));
+}
+
+TEST(FilteredRowIndexUnittest, FilterRowsThenWords) {
+  FilteredRowIndex index(10, 200);
+  index.FilterRows([](uint32_t row) { return row % 10 == 0; });
+  index.FilterWords([](uint32_t first_row, uint32_t count) {
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < count; i++)
+      word |= static_cast<uint64_t>(first_row + i >= 150) << i;
+    return word;
+  });
+  ASSERT_THAT(index.ToRowVector(), ElementsAre(150, 160, 170, 180, 190));
+}
+
+TEST(FilteredRowIndexUnittest, IntersectThenFilterWords) {
+  FilteredRowIndex index(1, 5);
+  index.IntersectRows({0, 2, 3, 4});
+  index.FilterWords([](uint32_t first_row, uint32_t count) {
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < count; i++)
+      word |= static_cast<uint64_t>(first_row + i != 3) << i;
+    return word;
+  });
+  ASSERT_THAT(index.ToRowVector(), ElementsAre(2, 4));
+}
+
 TEST(FilteredRowIndexUnittest, FilterThenIntersect) {
   FilteredRowIndex index(1, 5);
   index.FilterRows([](uint32_t row) { return row == 2 || row == 3; });
@@ -91,6 +126,30 @@ TEST(FilteredRowIndexUnittest, ToIterator) {
   ASSERT_TRUE(iterator->IsEnd());
 }
 
+TEST(FilteredRowIndexUnittest, ToIteratorBitVector) {
+  FilteredRowIndex index(100, 300);
+  index.FilterRows([](uint32_t row) { return row == 101 || row == 250; });
+
+  auto iterator = index.ToRowIterator(false);
+  ASSERT_THAT(iterator->Row(), 101);
+  iterator->NextRow();
+  ASSERT_THAT(iterator->Row(), 250);
+  iterator->NextRow();
+  ASSERT_TRUE(iterator->IsEnd());
+}
+
+TEST(FilteredRowIndexUnittest, ToIteratorBitVectorDesc) {
+  FilteredRowIndex index(100, 300);
+  index.FilterRows([](uint32_t row) { return row == 101 || row == 250; });
+
+  auto iterator = index.ToRowIterator(true);
+  ASSERT_THAT(iterator->Row(), 250);
+  iterator->NextRow();
+  ASSERT_THAT(iterator->Row(), 101);
+  iterator->NextRow();
+  ASSERT_TRUE(iterator->IsEnd());
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
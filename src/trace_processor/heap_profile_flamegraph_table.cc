@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/trace_processor/heap_profile_flamegraph_table.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "src/trace_processor/sqlite_utils.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+using namespace sqlite_utils;
+}  // namespace
+
+HeapProfileFlamegraphTable::HeapProfileFlamegraphTable(
+    sqlite3*,
+    const TraceStorage* storage)
+    : storage_(storage) {}
+
+void HeapProfileFlamegraphTable::RegisterTable(sqlite3* db,
+                                               const TraceStorage* storage,
+                                               const QueryContext* context) {
+  Table::Register<HeapProfileFlamegraphTable>(db, storage, context,
+                                              "heap_profile_flamegraph");
+}
+
+base::Optional<Table::Schema> HeapProfileFlamegraphTable::Init(
+    int,
+    const char* const*) {
+  const bool kHidden = true;
+  return Schema(
+      {
+          // These are the operator columns:
+          Table::Column(Column::kTs, "ts", ColumnType::kLong, kHidden),
+          Table::Column(Column::kUpid, "upid", ColumnType::kUint, kHidden),
+          // These are the ouput columns:
+          Table::Column(Column::kId, "id", ColumnType::kUint),
+          Table::Column(Column::kDepth, "depth", ColumnType::kUint),
+          Table::Column(Column::kParentId, "parent_id", ColumnType::kLong),
+          Table::Column(Column::kName, "name", ColumnType::kString),
+          Table::Column(Column::kMapName, "map_name", ColumnType::kString),
+          Table::Column(Column::kSelfSize, "self_size", ColumnType::kLong),
+          Table::Column(Column::kCumulativeSize, "cumulative_size",
+                        ColumnType::kLong),
+          Table::Column(Column::kSelfCount, "self_count", ColumnType::kLong),
+          Table::Column(Column::kCumulativeCount, "cumulative_count",
+                        ColumnType::kLong),
+      },
+      {Column::kId});
+}
+
+std::unique_ptr<Table::Cursor> HeapProfileFlamegraphTable::CreateCursor(
+    const QueryConstraints& qc,
+    sqlite3_value** argv) {
+  base::Optional<int64_t> ts;
+  base::Optional<uint32_t> upid;
+  for (size_t i = 0; i < qc.constraints().size(); i++) {
+    const auto& cs = qc.constraints()[i];
+    if (!IsOpEq(cs.op))
+      continue;
+    if (cs.iColumn == Column::kTs)
+      ts = sqlite3_value_int64(argv[i]);
+    else if (cs.iColumn == Column::kUpid)
+      upid = static_cast<uint32_t>(sqlite3_value_int64(argv[i]));
+  }
+  if (!ts.has_value() || !upid.has_value()) {
+    SetErrorMessage(sqlite3_mprintf(
+        "heap_profile_flamegraph requires equality constraints on ts and "
+        "upid"));
+    return nullptr;
+  }
+  return std::unique_ptr<Table::Cursor>(new Cursor(storage_, *ts, *upid));
+}
+
+int HeapProfileFlamegraphTable::BestIndex(const QueryConstraints& qc,
+                                          BestIndexInfo* info) {
+  bool has_ts = false;
+  bool has_upid = false;
+  for (size_t i = 0; i < qc.constraints().size(); i++) {
+    const auto& cs = qc.constraints()[i];
+    if (!IsOpEq(cs.op))
+      continue;
+    if (cs.iColumn == Column::kTs) {
+      has_ts = true;
+      info->omit[i] = true;
+    } else if (cs.iColumn == Column::kUpid) {
+      has_upid = true;
+      info->omit[i] = true;
+    }
+  }
+
+  // Make the plans which don't constrain ts and upid, and so fail in
+  // CreateCursor(), as unattractive as possible.
+  info->estimated_cost = has_ts && has_upid
+                             ? storage_->heap_profile_callsites().size()
+                             : std::numeric_limits<uint32_t>::max();
+
+  // Callsites are returned by ascending id.
+  info->order_by_consumed = qc.order_by().size() == 1 &&
+                            qc.order_by()[0].iColumn == Column::kId &&
+                            !qc.order_by()[0].desc;
+  return SQLITE_OK;
+}
+
+HeapProfileFlamegraphTable::Cursor::Cursor(const TraceStorage* storage,
+                                           int64_t ts,
+                                           uint32_t upid)
+    : storage_(storage), ts_(ts), upid_(upid) {
+  const auto& allocations = storage_->heap_profile_allocations();
+  const auto& callsites = storage_->heap_profile_callsites();
+  uint32_t num_callsites = callsites.size();
+  self_sizes_.resize(num_callsites);
+  self_counts_.resize(num_callsites);
+
+  // The allocations are sorted by timestamp, and each dump has a single
+  // timestamp.
+  const auto& timestamps = allocations.timestamps();
+  auto range = std::equal_range(timestamps.begin(), timestamps.end(), ts);
+  std::vector<bool> in_flamegraph(num_callsites);
+  for (auto it = range.first; it != range.second; ++it) {
+    auto row = static_cast<uint32_t>(it - timestamps.begin());
+    if (allocations.upids()[row] != upid)
+      continue;
+    uint32_t callsite_id = allocations.callsite_ids()[row];
+    self_sizes_[callsite_id] += allocations.sizes()[row];
+    self_counts_[callsite_id] += allocations.counts()[row];
+    in_flamegraph[callsite_id] = true;
+  }
+
+  // Children always have a greater id than their parent, so a single pass
+  // in reverse order propagates the cumulative values up to the roots.
+  cumulative_sizes_ = self_sizes_;
+  cumulative_counts_ = self_counts_;
+  for (uint32_t i = num_callsites; i-- > 0;) {
+    if (!in_flamegraph[i])
+      continue;
+    int64_t parent_id = callsites.parent_ids()[i];
+    if (parent_id == TraceStorage::HeapProfileCallsites::kNoParent)
+      continue;
+    auto parent = static_cast<uint32_t>(parent_id);
+    cumulative_sizes_[parent] += cumulative_sizes_[i];
+    cumulative_counts_[parent] += cumulative_counts_[i];
+    in_flamegraph[parent] = true;
+  }
+
+  for (uint32_t i = 0; i < num_callsites; i++) {
+    if (in_flamegraph[i])
+      callsites_.emplace_back(i);
+  }
+}
+
+int HeapProfileFlamegraphTable::Cursor::Column(sqlite3_context* context,
+                                               int N) {
+  uint32_t id = callsites_[index_];
+  const auto& callsites = storage_->heap_profile_callsites();
+  const auto& frames = storage_->heap_profile_frames();
+  switch (N) {
+    case Column::kTs:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(ts_));
+      break;
+    case Column::kUpid:
+      sqlite3_result_int64(context, upid_);
+      break;
+    case Column::kId:
+      sqlite3_result_int64(context, id);
+      break;
+    case Column::kDepth:
+      sqlite3_result_int64(context, callsites.depths()[id]);
+      break;
+    case Column::kParentId: {
+      int64_t parent_id = callsites.parent_ids()[id];
+      if (parent_id == TraceStorage::HeapProfileCallsites::kNoParent)
+        sqlite3_result_null(context);
+      else
+        sqlite3_result_int64(context, static_cast<sqlite_int64>(parent_id));
+      break;
+    }
+    case Column::kName: {
+      StringId name_id = frames.name_ids()[callsites.frame_rows()[id]];
+      sqlite3_result_text(context, storage_->GetString(name_id).c_str(), -1,
+                          kSqliteStatic);
+      break;
+    }
+    case Column::kMapName: {
+      const auto& mappings = storage_->heap_profile_mappings();
+      uint32_t mapping_row = frames.mapping_rows()[callsites.frame_rows()[id]];
+      StringId name_id = mappings.name_ids()[mapping_row];
+      sqlite3_result_text(context, storage_->GetString(name_id).c_str(), -1,
+                          kSqliteStatic);
+      break;
+    }
+    case Column::kSelfSize:
+      sqlite3_result_int64(context, self_sizes_[id]);
+      break;
+    case Column::kCumulativeSize:
+      sqlite3_result_int64(context, cumulative_sizes_[id]);
+      break;
+    case Column::kSelfCount:
+      sqlite3_result_int64(context, self_counts_[id]);
+      break;
+    case Column::kCumulativeCount:
+      sqlite3_result_int64(context, cumulative_counts_[id]);
+      break;
+    default:
+      PERFETTO_FATAL("Unknown column %d", N);
+      break;
+  }
+  return SQLITE_OK;
+}
+
+int HeapProfileFlamegraphTable::Cursor::Next() {
+  index_++;
+  return SQLITE_OK;
+}
+
+int HeapProfileFlamegraphTable::Cursor::Eof() {
+  return index_ >= callsites_.size();
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
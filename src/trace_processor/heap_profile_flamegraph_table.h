@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SRC_TRACE_PROCESSOR_HEAP_PROFILE_FLAMEGRAPH_TABLE_H_
+#define SRC_TRACE_PROCESSOR_HEAP_PROFILE_FLAMEGRAPH_TABLE_H_
+
+#include <memory>
+#include <vector>
+
+#include "src/trace_processor/table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceStorage;
+
+// Aggregates the heap profile dump of a process into a flamegraph: for each
+// callsite with allocations at or below it, returns the size and count of the
+// memory allocated and not freed by the callsite itself and by the callsites
+// below it. Requires equality constraints on the (hidden) ts and upid columns,
+// which select the dump:
+//   SELECT * FROM heap_profile_flamegraph WHERE ts = 123 AND upid = 1
+class HeapProfileFlamegraphTable : public Table {
+ public:
+  enum Column {
+    kTs = 0,
+    kUpid = 1,
+    kId = 2,
+    kDepth = 3,
+    kParentId = 4,
+    kName = 5,
+    kMapName = 6,
+    kSelfSize = 7,
+    kCumulativeSize = 8,
+    kSelfCount = 9,
+    kCumulativeCount = 10,
+  };
+
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
+
+  HeapProfileFlamegraphTable(sqlite3*, const TraceStorage*);
+
+  // Table implementation.
+  base::Optional<Table::Schema> Init(int, const char* const*) override;
+  std::unique_ptr<Table::Cursor> CreateCursor(const QueryConstraints&,
+                                              sqlite3_value**) override;
+  int BestIndex(const QueryConstraints&, BestIndexInfo*) override;
+
+ private:
+  class Cursor : public Table::Cursor {
+   public:
+    Cursor(const TraceStorage*, int64_t ts, uint32_t upid);
+
+    // Implementation of Table::Cursor.
+    int Next() override;
+    int Eof() override;
+    int Column(sqlite3_context*, int N) override;
+
+   private:
+    const TraceStorage* const storage_;
+    const int64_t ts_;
+    const uint32_t upid_;
+
+    // Indexed by callsite id.
+    std::vector<int64_t> self_sizes_;
+    std::vector<int64_t> cumulative_sizes_;
+    std::vector<int64_t> self_counts_;
+    std::vector<int64_t> cumulative_counts_;
+
+    // The callsites returned, in ascending order (so parents come before
+    // their children).
+    std::vector<uint32_t> callsites_;
+    size_t index_ = 0;
+  };
+
+  const TraceStorage* const storage_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_HEAP_PROFILE_FLAMEGRAPH_TABLE_H_
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/trace_processor/heap_profile_flamegraph_table.h"
+
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/trace_storage.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+
+class HeapProfileFlamegraphTableTest : public ::testing::Test {
+ public:
+  HeapProfileFlamegraphTableTest() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    HeapProfileFlamegraphTable::RegisterTable(db_.get(), &storage_, nullptr);
+
+    // Builds the callsite tree:
+    // 0: main
+    //    1: foo
+    //       2: malloc
+    //    3: bar
+    //       4: malloc
+    StringId lib = storage_.InternString("/lib/libc.so");
+    uint32_t mapping = storage_.mutable_heap_profile_mappings()->AddMapping(
+        0, 0, 0, 0, 0, lib);
+    auto* frames = storage_.mutable_heap_profile_frames();
+    uint32_t main = frames->AddFrame(storage_.InternString("main"), mapping, 0);
+    uint32_t foo = frames->AddFrame(storage_.InternString("foo"), mapping, 1);
+    uint32_t bar = frames->AddFrame(storage_.InternString("bar"), mapping, 2);
+    uint32_t alloc =
+        frames->AddFrame(storage_.InternString("malloc"), mapping, 3);
+
+    auto* callsites = storage_.mutable_heap_profile_callsites();
+    callsites->AddCallsite(0, TraceStorage::HeapProfileCallsites::kNoParent,
+                           main);
+    callsites->AddCallsite(1, 0, foo);
+    callsites->AddCallsite(2, 1, alloc);
+    callsites->AddCallsite(1, 0, bar);
+    callsites->AddCallsite(2, 3, alloc);
+  }
+
+  // Runs |sql| and returns the integer values of all the cells, row by row.
+  std::vector<int64_t> QueryInts(const std::string& sql) {
+    sqlite3_stmt* stmt;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &stmt, nullptr) ==
+                   SQLITE_OK);
+    ScopedStmt scoped_stmt(stmt);
+
+    std::vector<int64_t> values;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      for (int i = 0; i < sqlite3_column_count(stmt); i++)
+        values.emplace_back(sqlite3_column_int64(stmt, i));
+    }
+    return values;
+  }
+
+ protected:
+  TraceStorage storage_;
+  ScopedDb db_;
+};
+
+TEST_F(HeapProfileFlamegraphTableTest, CumulativeValues) {
+  auto* allocations = storage_.mutable_heap_profile_allocations();
+  // The dump at ts 100 of upid 1, with a free.
+  allocations->AddAllocation(100, 1, 2, 2, 64);
+  allocations->AddAllocation(100, 1, 2, -1, -16);
+  allocations->AddAllocation(100, 1, 3, 1, 8);
+  // Another process and a later dump, which shouldn't be included.
+  allocations->AddAllocation(100, 2, 4, 1, 1000);
+  allocations->AddAllocation(200, 1, 4, 1, 1000);
+
+  // Only the callsites with allocations below them are returned: 4 isn't.
+  ASSERT_THAT(QueryInts("SELECT id, self_size, cumulative_size, self_count, "
+                        "cumulative_count FROM heap_profile_flamegraph "
+                        "WHERE ts = 100 AND upid = 1"),
+              ElementsAre(0, 0, 56, 0, 2,  //
+                          1, 0, 48, 0, 1,  //
+                          2, 48, 48, 1, 1,  //
+                          3, 8, 8, 1, 1));
+}
+
+TEST_F(HeapProfileFlamegraphTableTest, Names) {
+  storage_.mutable_heap_profile_allocations()->AddAllocation(100, 1, 4, 1, 8);
+
+  sqlite3_stmt* stmt;
+  ASSERT_EQ(sqlite3_prepare_v2(*db_,
+                               "SELECT name, map_name, depth, parent_id "
+                               "FROM heap_profile_flamegraph "
+                               "WHERE ts = 100 AND upid = 1 AND id = 4",
+                               -1, &stmt, nullptr),
+            SQLITE_OK);
+  ScopedStmt scoped_stmt(stmt);
+  ASSERT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+  ASSERT_STREQ(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+               "malloc");
+  ASSERT_STREQ(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+               "/lib/libc.so");
+  ASSERT_EQ(sqlite3_column_int64(stmt, 2), 2);
+  ASSERT_EQ(sqlite3_column_int64(stmt, 3), 3);
+  ASSERT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+}
+
+TEST_F(HeapProfileFlamegraphTableTest, RequiresTsAndUpid) {
+  sqlite3_stmt* stmt;
+  ASSERT_EQ(sqlite3_prepare_v2(*db_,
+                               "SELECT * FROM heap_profile_flamegraph "
+                               "WHERE ts = 100",
+                               -1, &stmt, nullptr),
+            SQLITE_OK);
+  ScopedStmt scoped_stmt(stmt);
+  ASSERT_EQ(sqlite3_step(stmt), SQLITE_ERROR);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
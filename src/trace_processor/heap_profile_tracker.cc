@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/heap_profile_tracker.h"
+
+#include "src/trace_processor/process_tracker.h"
+#include "src/trace_processor/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+HeapProfileTracker::HeapProfileTracker(TraceProcessorContext* context)
+    : context_(context) {}
+
+HeapProfileTracker::~HeapProfileTracker() = default;
+
+template <typename T>
+bool HeapProfileTracker::Lookup(const std::unordered_map<uint64_t, T>& map,
+                                uint64_t id,
+                                T* value) {
+  auto it = map.find(id);
+  if (it == map.end()) {
+    context_->storage->IncrementStats(stats::heap_profile_invalid_ids);
+    return false;
+  }
+  *value = it->second;
+  return true;
+}
+
+void HeapProfileTracker::AddString(uint64_t id, StringId str) {
+  strings_[id] = str;
+}
+
+void HeapProfileTracker::AddMapping(uint64_t id, const SourceMapping& mapping) {
+  StringId build_id = 0;
+  if (!Lookup(strings_, mapping.build_id, &build_id))
+    return;
+
+  // The path is interned one component at a time, e.g. ["system", "lib64",
+  // "libc.so"].
+  std::string path;
+  for (uint64_t path_string_id : mapping.path_string_ids) {
+    StringId component = 0;
+    if (!Lookup(strings_, path_string_id, &component))
+      return;
+    path += "/";
+    path += context_->storage->GetString(component).c_str();
+  }
+  StringId name_id = context_->storage->InternString(base::StringView(path));
+
+  MappingKey key{build_id,    mapping.offset,    mapping.start,
+                 mapping.end, mapping.load_bias, name_id};
+  auto it = mapping_for_key_.find(key);
+  if (it == mapping_for_key_.end()) {
+    auto* mappings = context_->storage->mutable_heap_profile_mappings();
+    uint32_t row = mappings->AddMapping(
+        build_id, static_cast<int64_t>(mapping.offset),
+        static_cast<int64_t>(mapping.start), static_cast<int64_t>(mapping.end),
+        static_cast<int64_t>(mapping.load_bias), name_id);
+    it = mapping_for_key_.emplace(key, row).first;
+  }
+  mapping_rows_[id] = it->second;
+}
+
+void HeapProfileTracker::AddFrame(uint64_t id, const SourceFrame& frame) {
+  StringId name_id = 0;
+  uint32_t mapping_row = 0;
+  if (!Lookup(strings_, frame.function_name_id, &name_id) ||
+      !Lookup(mapping_rows_, frame.mapping_id, &mapping_row)) {
+    return;
+  }
+
+  FrameKey key{name_id, mapping_row, frame.rel_pc};
+  auto it = frame_for_key_.find(key);
+  if (it == frame_for_key_.end()) {
+    uint32_t row = context_->storage->mutable_heap_profile_frames()->AddFrame(
+        name_id, mapping_row, static_cast<int64_t>(frame.rel_pc));
+    it = frame_for_key_.emplace(key, row).first;
+  }
+  frame_rows_[id] = it->second;
+}
+
+void HeapProfileTracker::AddCallstack(uint64_t id,
+                                      const std::vector<uint64_t>& frame_ids) {
+  auto* callsites = context_->storage->mutable_heap_profile_callsites();
+
+  // Walk down the callsite tree from the root, adding the callsites which
+  // don't exist yet.
+  int64_t parent_id = TraceStorage::HeapProfileCallsites::kNoParent;
+  uint32_t depth = 0;
+  for (uint64_t frame_id : frame_ids) {
+    uint32_t frame_row = 0;
+    if (!Lookup(frame_rows_, frame_id, &frame_row))
+      return;
+
+    CallsiteKey key{parent_id, frame_row};
+    auto it = callsite_for_key_.find(key);
+    if (it == callsite_for_key_.end()) {
+      uint32_t row = callsites->AddCallsite(depth, parent_id, frame_row);
+      it = callsite_for_key_.emplace(key, row).first;
+    }
+    parent_id = it->second;
+    depth++;
+  }
+
+  if (parent_id == TraceStorage::HeapProfileCallsites::kNoParent) {
+    context_->storage->IncrementStats(stats::heap_profile_invalid_ids);
+    return;
+  }
+  callstack_leaves_[id] = static_cast<uint32_t>(parent_id);
+}
+
+void HeapProfileTracker::SetPacketTimestamp(int64_t timestamp) {
+  if (!dump_timestamp_)
+    dump_timestamp_ = timestamp;
+}
+
+void HeapProfileTracker::AddAllocation(uint32_t pid,
+                                       const SourceAllocation& alloc) {
+  PERFETTO_DCHECK(dump_timestamp_);
+  int64_t timestamp = *dump_timestamp_;
+  uint32_t callsite_id = 0;
+  if (!Lookup(callstack_leaves_, alloc.callstack_id, &callsite_id))
+    return;
+
+  UniquePid upid = context_->process_tracker->UpdateProcess(pid);
+  auto* allocations = context_->storage->mutable_heap_profile_allocations();
+  allocations->AddAllocation(timestamp, upid, callsite_id,
+                             static_cast<int64_t>(alloc.alloc_count),
+                             static_cast<int64_t>(alloc.self_allocated));
+  if (alloc.free_count > 0 || alloc.self_freed > 0) {
+    allocations->AddAllocation(timestamp, upid, callsite_id,
+                               -static_cast<int64_t>(alloc.free_count),
+                               -static_cast<int64_t>(alloc.self_freed));
+  }
+}
+
+void HeapProfileTracker::FinalizeProfile() {
+  strings_.clear();
+  mapping_rows_.clear();
+  frame_rows_.clear();
+  callstack_leaves_.clear();
+  dump_timestamp_ = base::nullopt;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_HEAP_PROFILE_TRACKER_H_
+#define SRC_TRACE_PROCESSOR_HEAP_PROFILE_TRACKER_H_
+
+#include <stdint.h>
+
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "perfetto/base/hash.h"
+#include "perfetto/base/optional.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceProcessorContext;
+
+// Stores the contents of the heapprofd ProfilePackets into the heap profile
+// tables of TraceStorage.
+//
+// The strings, mappings, frames and callstacks of a dump are interned with ids
+// which are only valid until the end of the dump (which can span several
+// packets, see ProfilePacket.continued). The tracker maps these ids to rows of
+// the storage, which are deduplicated across dumps: heapprofd sends all the
+// interned data again in every dump.
+class HeapProfileTracker {
+ public:
+  struct SourceMapping {
+    uint64_t build_id = 0;
+    uint64_t offset = 0;
+    uint64_t start = 0;
+    uint64_t end = 0;
+    uint64_t load_bias = 0;
+    std::vector<uint64_t> path_string_ids;
+  };
+
+  struct SourceFrame {
+    uint64_t function_name_id = 0;
+    uint64_t mapping_id = 0;
+    uint64_t rel_pc = 0;
+  };
+
+  struct SourceAllocation {
+    uint64_t callstack_id = 0;
+    uint64_t self_allocated = 0;
+    uint64_t self_freed = 0;
+    uint64_t alloc_count = 0;
+    uint64_t free_count = 0;
+  };
+
+  explicit HeapProfileTracker(TraceProcessorContext*);
+  ~HeapProfileTracker();
+
+  // Called with the timestamp of each packet before its data is added. The
+  // packets of a dump can be given different timestamps by the tokenizer: the
+  // one of the first packet is used for all the allocations of the dump.
+  void SetPacketTimestamp(int64_t timestamp);
+
+  // The Add*() methods must be called in this order for the data of a packet,
+  // as each kind of data can refer to the ids of the ones before.
+  void AddString(uint64_t id, StringId str);
+  void AddMapping(uint64_t id, const SourceMapping&);
+  void AddFrame(uint64_t id, const SourceFrame&);
+
+  // |frame_ids| are ordered from the root of the callstack to its leaf.
+  void AddCallstack(uint64_t id, const std::vector<uint64_t>& frame_ids);
+
+  void AddAllocation(uint32_t pid, const SourceAllocation&);
+
+  // Called at the end of each dump to forget the ids interned in the dump.
+  void FinalizeProfile();
+
+ private:
+  HeapProfileTracker(const HeapProfileTracker&) = delete;
+  HeapProfileTracker& operator=(const HeapProfileTracker&) = delete;
+
+  // The contents of the rows of the storage, used to deduplicate them.
+  struct MappingKey {
+    StringId build_id;
+    uint64_t offset;
+    uint64_t start;
+    uint64_t end;
+    uint64_t load_bias;
+    StringId name_id;
+
+    bool operator==(const MappingKey& o) const {
+      return std::tie(build_id, offset, start, end, load_bias, name_id) ==
+             std::tie(o.build_id, o.offset, o.start, o.end, o.load_bias,
+                      o.name_id);
+    }
+
+    struct Hasher {
+      size_t operator()(const MappingKey& key) const {
+        base::Hash hash;
+        hash.Update(key.build_id);
+        hash.Update(key.offset);
+        hash.Update(key.start);
+        hash.Update(key.end);
+        hash.Update(key.load_bias);
+        hash.Update(key.name_id);
+        return static_cast<size_t>(hash.digest());
+      }
+    };
+  };
+
+  struct FrameKey {
+    StringId name_id;
+    uint32_t mapping_row;
+    uint64_t rel_pc;
+
+    bool operator==(const FrameKey& o) const {
+      return std::tie(name_id, mapping_row, rel_pc) ==
+             std::tie(o.name_id, o.mapping_row, o.rel_pc);
+    }
+
+    struct Hasher {
+      size_t operator()(const FrameKey& key) const {
+        base::Hash hash;
+        hash.Update(key.name_id);
+        hash.Update(key.mapping_row);
+        hash.Update(key.rel_pc);
+        return static_cast<size_t>(hash.digest());
+      }
+    };
+  };
+
+  struct CallsiteKey {
+    int64_t parent_id;
+    uint32_t frame_row;
+
+    bool operator==(const CallsiteKey& o) const {
+      return parent_id == o.parent_id && frame_row == o.frame_row;
+    }
+
+    struct Hasher {
+      size_t operator()(const CallsiteKey& key) const {
+        base::Hash hash;
+        hash.Update(key.parent_id);
+        hash.Update(key.frame_row);
+        return static_cast<size_t>(hash.digest());
+      }
+    };
+  };
+
+  // Returns the value mapped to |id| in |map|, incrementing the
+  // heap_profile_invalid_ids stat if there is none.
+  template <typename T>
+  bool Lookup(const std::unordered_map<uint64_t, T>& map,
+              uint64_t id,
+              T* value);
+
+  TraceProcessorContext* const context_;
+
+  // The timestamp of the first packet of the current dump.
+  base::Optional<int64_t> dump_timestamp_;
+
+  // The ids interned in the current dump.
+  std::unordered_map<uint64_t, StringId> strings_;
+  std::unordered_map<uint64_t, uint32_t> mapping_rows_;
+  std::unordered_map<uint64_t, uint32_t> frame_rows_;
+  std::unordered_map<uint64_t, uint32_t> callstack_leaves_;
+
+  // The rows of the storage, keyed by their contents.
+  std::unordered_map<MappingKey, uint32_t, MappingKey::Hasher> mapping_for_key_;
+  std::unordered_map<FrameKey, uint32_t, FrameKey::Hasher> frame_for_key_;
+  std::unordered_map<CallsiteKey, uint32_t, CallsiteKey::Hasher>
+      callsite_for_key_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_HEAP_PROFILE_TRACKER_H_
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/trace_processor/heap_profile_tracker.h"
+
+#include "src/trace_processor/process_tracker.h"
+#include "src/trace_processor/trace_processor_context.h"
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class HeapProfileTrackerTest : public ::testing::Test {
+ public:
+  HeapProfileTrackerTest() {
+    context.storage.reset(new TraceStorage());
+    context.process_tracker.reset(new ProcessTracker(&context));
+    context.heap_profile_tracker.reset(new HeapProfileTracker(&context));
+  }
+
+ protected:
+  // Adds the interned data of a dump with the callstacks main -> foo (id 1)
+  // and main -> bar (id 2). The ids are offset by |base| as each dump can
+  // choose its own.
+  void AddInternedData(uint64_t base) {
+    HeapProfileTracker* tracker = context.heap_profile_tracker.get();
+    tracker->AddString(base + 1, context.storage->InternString("build"));
+    tracker->AddString(base + 2, context.storage->InternString("lib"));
+    tracker->AddString(base + 3, context.storage->InternString("libc.so"));
+    tracker->AddString(base + 4, context.storage->InternString("main"));
+    tracker->AddString(base + 5, context.storage->InternString("foo"));
+    tracker->AddString(base + 6, context.storage->InternString("bar"));
+
+    HeapProfileTracker::SourceMapping mapping;
+    mapping.build_id = base + 1;
+    mapping.path_string_ids = {base + 2, base + 3};
+    tracker->AddMapping(base + 1, mapping);
+
+    for (uint64_t i = 0; i < 3; i++) {
+      HeapProfileTracker::SourceFrame frame;
+      frame.function_name_id = base + 4 + i;
+      frame.mapping_id = base + 1;
+      frame.rel_pc = i;
+      tracker->AddFrame(base + 1 + i, frame);
+    }
+
+    tracker->AddCallstack(base + 1, {base + 1, base + 2});
+    tracker->AddCallstack(base + 2, {base + 1, base + 3});
+  }
+
+  // Adds an allocation in a packet with timestamp |ts|.
+  void AddAllocation(int64_t ts,
+                     uint64_t callstack_id,
+                     uint64_t allocated,
+                     uint64_t freed) {
+    HeapProfileTracker::SourceAllocation alloc;
+    alloc.callstack_id = callstack_id;
+    alloc.self_allocated = allocated;
+    alloc.self_freed = freed;
+    alloc.alloc_count = 1;
+    alloc.free_count = freed ? 1 : 0;
+    context.heap_profile_tracker->SetPacketTimestamp(ts);
+    context.heap_profile_tracker->AddAllocation(42, alloc);
+  }
+
+  TraceProcessorContext context;
+};
+
+TEST_F(HeapProfileTrackerTest, Callsites) {
+  AddInternedData(0);
+
+  const auto& mappings = context.storage->heap_profile_mappings();
+  ASSERT_EQ(mappings.size(), 1u);
+  ASSERT_EQ(context.storage->GetString(mappings.name_ids()[0]),
+            "/lib/libc.so");
+  ASSERT_EQ(context.storage->heap_profile_frames().size(), 3u);
+
+  // main is shared by both callstacks.
+  const auto& callsites = context.storage->heap_profile_callsites();
+  ASSERT_EQ(callsites.size(), 3u);
+  ASSERT_EQ(callsites.parent_ids()[0],
+            TraceStorage::HeapProfileCallsites::kNoParent);
+  ASSERT_EQ(callsites.depths()[0], 0u);
+  ASSERT_EQ(callsites.parent_ids()[1], 0);
+  ASSERT_EQ(callsites.parent_ids()[2], 0);
+  ASSERT_EQ(callsites.depths()[2], 1u);
+  ASSERT_EQ(callsites.frame_rows()[2], 2u);
+}
+
+TEST_F(HeapProfileTrackerTest, DeduplicateAcrossDumps) {
+  AddInternedData(0);
+  AddAllocation(100, 1, 10, 0);
+  AddAllocation(100, 2, 20, 5);
+  context.heap_profile_tracker->FinalizeProfile();
+
+  AddInternedData(100);
+  AddAllocation(200, 102, 30, 0);
+  context.heap_profile_tracker->FinalizeProfile();
+
+  ASSERT_EQ(context.storage->heap_profile_mappings().size(), 1u);
+  ASSERT_EQ(context.storage->heap_profile_frames().size(), 3u);
+  ASSERT_EQ(context.storage->heap_profile_callsites().size(), 3u);
+
+  // The frees are stored as separate, negative, rows.
+  const auto& allocations = context.storage->heap_profile_allocations();
+  ASSERT_EQ(allocations.size(), 4u);
+  ASSERT_EQ(allocations.callsite_ids()[1], 2u);
+  ASSERT_EQ(allocations.sizes()[2], -5);
+  ASSERT_EQ(allocations.counts()[2], -1);
+  ASSERT_EQ(allocations.timestamps()[3], 200);
+  ASSERT_EQ(allocations.callsite_ids()[3], 2u);
+  ASSERT_EQ(context.storage->GetProcess(allocations.upids()[3]).pid, 42u);
+  ASSERT_EQ(context.storage->stats()[stats::heap_profile_invalid_ids].value,
+            0);
+}
+
+TEST_F(HeapProfileTrackerTest, ContinuedDumpTimestamp) {
+  // The interned data and the samples of a dump are split across two
+  // (continued) packets, which the tokenizer gave different timestamps.
+  context.heap_profile_tracker->SetPacketTimestamp(100);
+  AddInternedData(0);
+  AddAllocation(150, 1, 10, 0);
+  AddAllocation(150, 2, 20, 0);
+  context.heap_profile_tracker->FinalizeProfile();
+
+  // The next dump gets the timestamp of its own first packet.
+  AddInternedData(100);
+  AddAllocation(200, 101, 30, 0);
+  context.heap_profile_tracker->FinalizeProfile();
+
+  const auto& allocations = context.storage->heap_profile_allocations();
+  ASSERT_EQ(allocations.size(), 3u);
+  ASSERT_EQ(allocations.timestamps()[0], 100);
+  ASSERT_EQ(allocations.timestamps()[1], 100);
+  ASSERT_EQ(allocations.timestamps()[2], 200);
+}
+
+TEST_F(HeapProfileTrackerTest, InvalidIds) {
+  AddInternedData(0);
+  context.heap_profile_tracker->FinalizeProfile();
+
+  // The ids of the previous dump can't be used anymore.
+  AddAllocation(100, 1, 10, 0);
+  context.heap_profile_tracker->AddCallstack(3, {1, 2});
+
+  ASSERT_EQ(context.storage->heap_profile_allocations().size(), 0u);
+  ASSERT_EQ(context.storage->heap_profile_callsites().size(), 3u);
+  ASSERT_EQ(context.storage->stats()[stats::heap_profile_invalid_ids].value,
+            2);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -33,8 +33,10 @@ InstantsTable::InstantsTable(sqlite3*, const TraceStorage* storage)
   ref_types_[RefType::kRefUtidLookupUpid] = "upid";
 };
 
-void InstantsTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<InstantsTable>(db, storage, "instants");
+void InstantsTable::RegisterTable(sqlite3* db,
+                                  const TraceStorage* storage,
+                                  const QueryContext* context) {
+  Table::Register<InstantsTable>(db, storage, context, "instants");
 }
 
 StorageSchema InstantsTable::CreateStorageSchema() {
@@ -42,7 +44,7 @@ StorageSchema InstantsTable::CreateStorageSchema() {
   return StorageSchema::Builder()
       .AddColumn<IdColumn>("id", TableId::kInstants)
       .AddOrderedNumericColumn("ts", &instants.timestamps())
-      .AddStringColumn("name", &instants.name_ids(), &storage_->string_pool())
+      .AddStringColumn("name", &instants.name_ids(), storage_)
       .AddNumericColumn("value", &instants.values())
       // TODO(lalitm): remove this hack.
       .AddColumn<CounterDefinitionsTable::RefColumn>(
@@ -60,15 +62,8 @@ int InstantsTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
   info->estimated_cost =
       static_cast<uint32_t>(storage_->instants().instant_count());
 
-  // Only the string columns are handled by SQLite
   info->order_by_consumed = true;
-  size_t name_index = schema().ColumnIndexFromName("name");
-  size_t ref_type_index = schema().ColumnIndexFromName("ref_type");
-  for (size_t i = 0; i < qc.constraints().size(); i++) {
-    info->omit[i] =
-        qc.constraints()[i].iColumn != static_cast<int>(name_index) &&
-        qc.constraints()[i].iColumn != static_cast<int>(ref_type_index);
-  }
+  SetOmittedConstraints(qc, info);
 
   return SQLITE_OK;
 }
@@ -28,7 +28,9 @@ namespace trace_processor {
 
 class InstantsTable : public StorageTable {
  public:
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   InstantsTable(sqlite3*, const TraceStorage*);
 
@@ -0,0 +1,480 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/trace_processor/json_tokenizer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <limits>
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+using Result = JsonReadResult;
+
+// Longer numbers than this are rejected, they can't be represented anyway.
+constexpr size_t kMaxNumberSize = 64;
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline int HexDigit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+void AppendUtf8(uint32_t code_point, std::string* out) {
+  if (code_point < 0x80) {
+    out->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+// A recursive descent reader which only keeps the values of the fields of
+// JsonEvent and skips over everything else. Any Read*() method returning a
+// result other than kOk leaves the reader in an unspecified position.
+class JsonReader {
+ public:
+  JsonReader(const char* start, const char* end) : cur_(start), end_(end) {}
+
+  const char* cur() const { return cur_; }
+
+  Result ReadEvent(JsonEvent* event) {
+    return ReadObject([this, event](base::StringView key) -> Result {
+      if (key == "ph")
+        return ReadValue(&event->ph);
+      if (key == "ts")
+        return ReadValue(&event->ts);
+      if (key == "dur")
+        return ReadValue(&event->dur);
+      if (key == "pid")
+        return ReadValue(&event->pid);
+      if (key == "tid")
+        return ReadValue(&event->tid);
+      if (key == "name")
+        return ReadValue(&event->name);
+      if (key == "cat")
+        return ReadValue(&event->cat);
+      if (key == "args")
+        return ReadArgs(event);
+      return ReadValue(nullptr);
+    });
+  }
+
+ private:
+  // Skips whitespace and sets |c| to the following character, without
+  // consuming it.
+  Result Peek(char* c) {
+    while (cur_ < end_ && IsSpace(*cur_))
+      cur_++;
+    if (cur_ == end_)
+      return Result::kNeedsMoreData;
+    *c = *cur_;
+    return Result::kOk;
+  }
+
+  Result Consume(char expected) {
+    char c = 0;
+    Result res = Peek(&c);
+    if (res != Result::kOk)
+      return res;
+    if (c != expected)
+      return Result::kFatalError;
+    cur_++;
+    return Result::kOk;
+  }
+
+  // Reads an object, calling |read_member| with the key of each member. It
+  // must read the value of the member.
+  template <typename Fn>
+  Result ReadObject(Fn read_member) {
+    Result res = Consume('{');
+    if (res != Result::kOk)
+      return res;
+    char c = 0;
+    if ((res = Peek(&c)) != Result::kOk)
+      return res;
+    if (c == '}') {
+      cur_++;
+      return Result::kOk;
+    }
+    for (;;) {
+      if ((res = Peek(&c)) != Result::kOk)
+        return res;
+      if (c != '"')
+        return Result::kFatalError;
+      if ((res = ReadString(&key_)) != Result::kOk)
+        return res;
+      if ((res = Consume(':')) != Result::kOk)
+        return res;
+      if ((res = read_member(key_.string_value)) != Result::kOk)
+        return res;
+      if ((res = Peek(&c)) != Result::kOk)
+        return res;
+      cur_++;
+      if (c == '}')
+        return Result::kOk;
+      if (c != ',')
+        return Result::kFatalError;
+    }
+  }
+
+  Result ReadArgs(JsonEvent* event) {
+    char c = 0;
+    Result res = Peek(&c);
+    if (res != Result::kOk)
+      return res;
+    if (c != '{')
+      return ReadValue(nullptr);
+    return ReadObject([this, event](base::StringView key) -> Result {
+      return ReadValue(key == "name" ? &event->args_name : nullptr);
+    });
+  }
+
+  // Reads any value into |value|, or skips it if |value| is null.
+  Result ReadValue(JsonValue* value) {
+    if (value)
+      value->type = JsonValue::kNone;
+    char c = 0;
+    Result res = Peek(&c);
+    if (res != Result::kOk)
+      return res;
+    switch (c) {
+      case '"':
+        return ReadString(value);
+      case '{':
+      case '[':
+        if (value)
+          value->type = JsonValue::kOther;
+        return SkipContainer();
+      case 't':
+        return ReadLiteral("true", value);
+      case 'f':
+        return ReadLiteral("false", value);
+      case 'n':
+        return ReadLiteral("null", value);
+      default:
+        return ReadNumber(value);
+    }
+  }
+
+  Result ReadString(JsonValue* value) {
+    const char* start = ++cur_;
+
+    // Fast path for the (common) strings without escape sequences, which are
+    // not copied.
+    while (cur_ < end_ && *cur_ != '"' && *cur_ != '\\')
+      cur_++;
+    if (cur_ == end_)
+      return Result::kNeedsMoreData;
+    if (*cur_ == '"') {
+      if (value) {
+        value->type = JsonValue::kString;
+        value->string_value =
+            base::StringView(start, static_cast<size_t>(cur_ - start));
+      }
+      cur_++;
+      return Result::kOk;
+    }
+
+    if (!value)
+      return SkipEscapedString();
+
+    std::string* out = &value->unescaped;
+    out->assign(start, cur_);
+    while (cur_ < end_) {
+      char c = *cur_++;
+      if (c == '"') {
+        value->type = JsonValue::kString;
+        value->string_value = base::StringView(*out);
+        return Result::kOk;
+      }
+      if (c != '\\') {
+        out->push_back(c);
+        continue;
+      }
+      if (cur_ == end_)
+        return Result::kNeedsMoreData;
+      switch (c = *cur_++) {
+        case '"':
+        case '\\':
+        case '/':
+          out->push_back(c);
+          break;
+        case 'b':
+          out->push_back('\b');
+          break;
+        case 'f':
+          out->push_back('\f');
+          break;
+        case 'n':
+          out->push_back('\n');
+          break;
+        case 'r':
+          out->push_back('\r');
+          break;
+        case 't':
+          out->push_back('\t');
+          break;
+        case 'u': {
+          Result res = ReadUnicodeEscape(out);
+          if (res != Result::kOk)
+            return res;
+          break;
+        }
+        default:
+          return Result::kFatalError;
+      }
+    }
+    return Result::kNeedsMoreData;
+  }
+
+  Result SkipEscapedString() {
+    while (cur_ < end_) {
+      char c = *cur_++;
+      if (c == '"')
+        return Result::kOk;
+      if (c == '\\') {
+        if (cur_ == end_)
+          return Result::kNeedsMoreData;
+        cur_++;
+      }
+    }
+    return Result::kNeedsMoreData;
+  }
+
+  // Reads the 4 hex digits following "\u". A pair of escaped UTF-16 surrogates
+  // is combined into a single code point, unpaired ones are replaced by
+  // U+FFFD.
+  Result ReadUnicodeEscape(std::string* out) {
+    uint32_t code_point = 0;
+    Result res = ReadHex4(&code_point);
+    if (res != Result::kOk)
+      return res;
+    if (code_point >= 0xD800 && code_point < 0xDC00) {
+      if (end_ - cur_ < 2)
+        return Result::kNeedsMoreData;
+      if (cur_[0] == '\\' && cur_[1] == 'u') {
+        cur_ += 2;
+        uint32_t low = 0;
+        if ((res = ReadHex4(&low)) != Result::kOk)
+          return res;
+        if (low >= 0xDC00 && low < 0xE000) {
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+        } else {
+          AppendUtf8(0xFFFD, out);
+          code_point = low;
+        }
+      }
+    }
+    if (code_point >= 0xD800 && code_point < 0xE000)
+      code_point = 0xFFFD;
+    AppendUtf8(code_point, out);
+    return Result::kOk;
+  }
+
+  Result ReadHex4(uint32_t* value) {
+    if (end_ - cur_ < 4)
+      return Result::kNeedsMoreData;
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+      int digit = HexDigit(*cur_++);
+      if (digit < 0)
+        return Result::kFatalError;
+      *value = (*value << 4) | static_cast<uint32_t>(digit);
+    }
+    return Result::kOk;
+  }
+
+  Result ReadNumber(JsonValue* value) {
+    const char* start = cur_;
+    bool is_double = false;
+    for (; cur_ < end_; cur_++) {
+      char c = *cur_;
+      if (c == '.' || c == 'e' || c == 'E') {
+        is_double = true;
+      } else if (!(c >= '0' && c <= '9') && c != '-' && c != '+') {
+        break;
+      }
+    }
+    // The number might continue in the next chunk.
+    if (cur_ == end_)
+      return Result::kNeedsMoreData;
+
+    auto size = static_cast<size_t>(cur_ - start);
+    if (size == 0 || size >= kMaxNumberSize)
+      return Result::kFatalError;
+    char buf[kMaxNumberSize];
+    memcpy(buf, start, size);
+    buf[size] = '\0';
+
+    char* num_end = nullptr;
+    if (is_double) {
+      double d = strtod(buf, &num_end);
+      if (value) {
+        value->type = JsonValue::kDouble;
+        value->double_value = d;
+      }
+    } else {
+      int64_t n = strtoll(buf, &num_end, 10);
+      if (value) {
+        value->type = JsonValue::kInt;
+        value->int_value = n;
+      }
+    }
+    return num_end == buf + size ? Result::kOk : Result::kFatalError;
+  }
+
+  Result ReadLiteral(const char* literal, JsonValue* value) {
+    size_t size = strlen(literal);
+    auto available = static_cast<size_t>(end_ - cur_);
+    if (memcmp(cur_, literal, std::min(size, available)) != 0)
+      return Result::kFatalError;
+    if (available < size)
+      return Result::kNeedsMoreData;
+    cur_ += size;
+    if (value)
+      value->type = JsonValue::kOther;
+    return Result::kOk;
+  }
+
+  // Skips the object or array at |cur_|. The contents are only tokenized
+  // enough to find its end and not validated.
+  Result SkipContainer() {
+    uint32_t depth = 0;
+    while (cur_ < end_) {
+      char c = *cur_;
+      if (c == '"') {
+        Result res = ReadString(nullptr);
+        if (res != Result::kOk)
+          return res;
+        continue;
+      }
+      cur_++;
+      if (c == '{' || c == '[') {
+        depth++;
+      } else if (c == '}' || c == ']') {
+        if (--depth == 0)
+          return Result::kOk;
+      }
+    }
+    return Result::kNeedsMoreData;
+  }
+
+  const char* cur_;
+  const char* const end_;
+  JsonValue key_;
+};
+
+base::Optional<int64_t> StringToInt64(base::StringView str) {
+  std::string s = str.ToStdString();
+  char* end;
+  int64_t n = strtoll(s.c_str(), &end, 10);
+  if (end != s.data() + s.size())
+    return base::nullopt;
+  return n;
+}
+
+}  // namespace
+
+void JsonEvent::Clear() {
+  ph.type = JsonValue::kNone;
+  ts.type = JsonValue::kNone;
+  dur.type = JsonValue::kNone;
+  pid.type = JsonValue::kNone;
+  tid.type = JsonValue::kNone;
+  name.type = JsonValue::kNone;
+  cat.type = JsonValue::kNone;
+  args_name.type = JsonValue::kNone;
+}
+
+JsonReadResult ReadJsonEvent(const char* start,
+                             const char* end,
+                             JsonEvent* event,
+                             const char** next) {
+  event->Clear();
+  JsonReader reader(start, end);
+  JsonReadResult res = reader.ReadEvent(event);
+  if (res == JsonReadResult::kOk)
+    *next = reader.cur();
+  return res;
+}
+
+base::Optional<int64_t> CoerceToNs(const JsonValue& value) {
+  switch (value.type) {
+    case JsonValue::kDouble:
+      return static_cast<int64_t>(value.double_value * 1000);
+    case JsonValue::kInt:
+      return value.int_value * 1000;
+    case JsonValue::kString: {
+      base::Optional<int64_t> n = StringToInt64(value.string_value);
+      if (!n.has_value())
+        return base::nullopt;
+      return n.value() * 1000;
+    }
+    case JsonValue::kNone:
+    case JsonValue::kOther:
+      return base::nullopt;
+  }
+  return base::nullopt;
+}
+
+base::Optional<int64_t> CoerceToInt64(const JsonValue& value) {
+  switch (value.type) {
+    case JsonValue::kDouble:
+      return static_cast<int64_t>(value.double_value);
+    case JsonValue::kInt:
+      return value.int_value;
+    case JsonValue::kString:
+      return StringToInt64(value.string_value);
+    case JsonValue::kNone:
+    case JsonValue::kOther:
+      return base::nullopt;
+  }
+  return base::nullopt;
+}
+
+base::Optional<uint32_t> CoerceToUint32(const JsonValue& value) {
+  base::Optional<int64_t> result = CoerceToInt64(value);
+  if (!result.has_value())
+    return base::nullopt;
+  int64_t n = result.value();
+  if (n < 0 || n > std::numeric_limits<uint32_t>::max())
+    return base::nullopt;
+  return static_cast<uint32_t>(n);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
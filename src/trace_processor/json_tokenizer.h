@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SRC_TRACE_PROCESSOR_JSON_TOKENIZER_H_
+#define SRC_TRACE_PROCESSOR_JSON_TOKENIZER_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "perfetto/base/optional.h"
+#include "perfetto/base/string_view.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// A value of a JSON trace event. Strings point into the buffer being read
+// unless they contain escape sequences, in which case they point to the
+// unescaped copy in |unescaped|: a JsonValue must not be copied.
+struct JsonValue {
+  enum Type { kNone = 0, kInt, kDouble, kString, kOther };
+
+  JsonValue() = default;
+  JsonValue(const JsonValue&) = delete;
+  JsonValue& operator=(const JsonValue&) = delete;
+
+  Type type = kNone;
+  int64_t int_value = 0;
+  double double_value = 0;
+  base::StringView string_value;
+  std::string unescaped;
+};
+
+// The fields of a JSON trace event used by the JsonTraceParser. The fields
+// which are missing from the event have type kNone, the ones which are
+// objects, arrays, booleans or null have type kOther.
+struct JsonEvent {
+  void Clear();
+
+  JsonValue ph;
+  JsonValue ts;
+  JsonValue dur;
+  JsonValue pid;
+  JsonValue tid;
+  JsonValue name;
+  JsonValue cat;
+
+  // The "name" entry of the "args" dictionary, used by the metadata events.
+  JsonValue args_name;
+};
+
+enum class JsonReadResult { kOk, kNeedsMoreData, kFatalError };
+
+// Reads the JSON dictionary at |start|, which must point to a '{', into
+// |event| without building a DOM. On success |next| is set to the character
+// following the dictionary. kNeedsMoreData is returned if the dictionary
+// continues past |end|: it must then be read again from the start once more
+// data is available.
+JsonReadResult ReadJsonEvent(const char* start,
+                             const char* end,
+                             JsonEvent* event,
+                             const char** next);
+
+// Json trace event timestamps are in us.
+// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU/edit#heading=h.nso4gcezn7n1
+base::Optional<int64_t> CoerceToNs(const JsonValue& value);
+base::Optional<int64_t> CoerceToInt64(const JsonValue& value);
+base::Optional<uint32_t> CoerceToUint32(const JsonValue& value);
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_JSON_TOKENIZER_H_
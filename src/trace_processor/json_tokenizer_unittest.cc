@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/trace_processor/json_tokenizer.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+JsonReadResult Read(const std::string& json, JsonEvent* event) {
+  const char* next = nullptr;
+  JsonReadResult res =
+      ReadJsonEvent(json.data(), json.data() + json.size(), event, &next);
+  if (res == JsonReadResult::kOk)
+    EXPECT_EQ(next, json.data() + json.size());
+  return res;
+}
+
+std::string ToString(const JsonValue& value) {
+  EXPECT_EQ(value.type, JsonValue::kString);
+  return value.string_value.ToStdString();
+}
+
+// Reads |json| as the value of the "ts" field.
+base::Optional<int64_t> TsToNs(const std::string& json) {
+  JsonEvent event;
+  std::string dict = "{\"ts\": " + json + "}";
+  EXPECT_EQ(Read(dict, &event), JsonReadResult::kOk);
+  return CoerceToNs(event.ts);
+}
+
+base::Optional<int64_t> TsToInt64(const std::string& json) {
+  JsonEvent event;
+  std::string dict = "{\"ts\": " + json + "}";
+  EXPECT_EQ(Read(dict, &event), JsonReadResult::kOk);
+  return CoerceToInt64(event.ts);
+}
+
+base::Optional<uint32_t> TsToUint32(const std::string& json) {
+  JsonEvent event;
+  std::string dict = "{\"ts\": " + json + "}";
+  EXPECT_EQ(Read(dict, &event), JsonReadResult::kOk);
+  return CoerceToUint32(event.ts);
+}
+
+TEST(JsonTokenizerTest, CoerceToUint32) {
+  ASSERT_EQ(TsToUint32("42").value_or(0), 42u);
+  ASSERT_EQ(TsToUint32("\"42\"").value_or(0), 42u);
+  ASSERT_EQ(TsToUint32("42.1").value_or(0), 42u);
+  ASSERT_FALSE(TsToUint32("-1").has_value());
+  ASSERT_FALSE(TsToUint32("4294967296").has_value());
+}
+
+TEST(JsonTokenizerTest, CoerceToInt64) {
+  ASSERT_EQ(TsToInt64("42").value_or(-1), 42);
+  ASSERT_EQ(TsToInt64("\"42\"").value_or(-1), 42);
+  ASSERT_EQ(TsToInt64("42.1").value_or(-1), 42);
+  ASSERT_FALSE(TsToInt64("\"foo\"").has_value());
+  ASSERT_FALSE(TsToInt64("\"1234!\"").has_value());
+  ASSERT_FALSE(TsToInt64("{}").has_value());
+  ASSERT_FALSE(TsToInt64("null").has_value());
+}
+
+TEST(JsonTokenizerTest, CoerceToNs) {
+  ASSERT_EQ(TsToNs("42").value_or(-1), 42000);
+  ASSERT_EQ(TsToNs("\"42\"").value_or(-1), 42000);
+  ASSERT_EQ(TsToNs("42.1").value_or(-1), 42100);
+  ASSERT_EQ(TsToNs("4.2e1").value_or(-1), 42000);
+  ASSERT_FALSE(TsToNs("\"foo\"").has_value());
+  ASSERT_FALSE(TsToNs("\"1234!\"").has_value());
+}
+
+TEST(JsonTokenizerTest, Fields) {
+  // The strings point into the JSON, which must outlive the event.
+  const std::string json =
+      "{\"name\": \"foo\", \"cat\":\"bar\", \"ph\":\"X\", \"ts\": 1, "
+      "\"dur\": 2.5, \"pid\": 3, \"tid\": \"4\", \"args\": {\"x\": [1, "
+      "{\"name\": \"no\"}], \"name\": \"a\"}, \"id\": null, "
+      "\"bind_id\": true, \"flow\": false}";
+  JsonEvent event;
+  ASSERT_EQ(Read(json, &event), JsonReadResult::kOk);
+  ASSERT_EQ(ToString(event.name), "foo");
+  ASSERT_EQ(ToString(event.cat), "bar");
+  ASSERT_EQ(ToString(event.ph), "X");
+  ASSERT_EQ(event.ts.type, JsonValue::kInt);
+  ASSERT_EQ(event.ts.int_value, 1);
+  ASSERT_EQ(event.dur.type, JsonValue::kDouble);
+  ASSERT_EQ(event.dur.double_value, 2.5);
+  ASSERT_EQ(event.pid.int_value, 3);
+  ASSERT_EQ(ToString(event.tid), "4");
+  ASSERT_EQ(ToString(event.args_name), "a");
+
+  // Missing fields are reset.
+  ASSERT_EQ(Read("{}", &event), JsonReadResult::kOk);
+  ASSERT_EQ(event.name.type, JsonValue::kNone);
+  ASSERT_EQ(event.args_name.type, JsonValue::kNone);
+}
+
+TEST(JsonTokenizerTest, BracesAndEscapesInStrings) {
+  JsonEvent event;
+  ASSERT_EQ(Read("{\"name\": \"{a}[b]\\\"}\", \"cat\": \"x\\\\\"}", &event),
+            JsonReadResult::kOk);
+  ASSERT_EQ(ToString(event.name), "{a}[b]\"}");
+  ASSERT_EQ(ToString(event.cat), "x\\");
+
+  ASSERT_EQ(Read("{\"name\": \"\\t\\n\\/\\u0041\\u00e9\\u20AC\\ud83d\\ude00\", "
+                 "\"args\": {\"skipped\": \"\\\"}\"}}",
+                 &event),
+            JsonReadResult::kOk);
+  ASSERT_EQ(ToString(event.name), "\t\n/A\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80");
+
+  // Unpaired surrogates are replaced.
+  ASSERT_EQ(Read("{\"name\": \"\\ud83d!\"}", &event), JsonReadResult::kOk);
+  ASSERT_EQ(ToString(event.name), "\xEF\xBF\xBD!");
+}
+
+TEST(JsonTokenizerTest, NeedsMoreData) {
+  const std::string json =
+      "{\"name\": \"a\\\"b\\u00e9\", \"ts\": 12345, \"args\": {\"a\": [1, "
+      "{\"b\": \"}\"}], \"name\": \"n\"}, \"ok\": true} ";
+  JsonEvent event;
+  for (size_t i = 0; i < json.size() - 1; i++) {
+    const char* next = nullptr;
+    ASSERT_EQ(ReadJsonEvent(json.data(), json.data() + i, &event, &next),
+              JsonReadResult::kNeedsMoreData)
+        << "Prefix of size " << i;
+  }
+  const char* next = nullptr;
+  ASSERT_EQ(ReadJsonEvent(json.data(), json.data() + json.size(), &event,
+                          &next),
+            JsonReadResult::kOk);
+  ASSERT_EQ(next, json.data() + json.size() - 1);
+  ASSERT_EQ(ToString(event.name), "a\"b\xC3\xA9");
+  ASSERT_EQ(event.ts.int_value, 12345);
+  ASSERT_EQ(ToString(event.args_name), "n");
+}
+
+TEST(JsonTokenizerTest, Errors) {
+  JsonEvent event;
+  ASSERT_EQ(Read("{\"name\" \"foo\"}", &event), JsonReadResult::kFatalError);
+  ASSERT_EQ(Read("{\"ts\": 12a}", &event), JsonReadResult::kFatalError);
+  ASSERT_EQ(Read("{\"ts\": tru}", &event), JsonReadResult::kFatalError);
+  ASSERT_EQ(Read("{\"name\": \"\\x\"}", &event), JsonReadResult::kFatalError);
+  ASSERT_EQ(Read("{\"a\": 1 \"b\": 2}", &event), JsonReadResult::kFatalError);
+  ASSERT_EQ(Read("{name: 1}", &event), JsonReadResult::kFatalError);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
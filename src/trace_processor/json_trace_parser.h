@@ -20,39 +20,46 @@
 #include <stdint.h>
 
 #include <memory>
-#include <tuple>
-#include <unordered_map>
+#include <vector>
 
 #include "src/trace_processor/chunked_trace_reader.h"
+#include "src/trace_processor/json_tokenizer.h"
 #include "src/trace_processor/trace_storage.h"
 
-namespace Json {
-class Value;
-}
-
 namespace perfetto {
 namespace trace_processor {
 
 class TraceProcessorContext;
 
-base::Optional<int64_t> CoerceToNs(const Json::Value& value);
-base::Optional<int64_t> CoerceToInt64(const Json::Value& value);
-base::Optional<uint32_t> CoerceToUint32(const Json::Value& value);
-
 // Parses legacy chrome JSON traces. The support for now is extremely rough
 // and supports only explicit TRACE_EVENT_BEGIN/END events.
+// The events are read one by one by the JSON tokenizer, straight from the
+// chunks passed to Parse(): only the tail of a chunk holding an incomplete
+// event is copied.
 class JsonTraceParser : public ChunkedTraceReader {
  public:
   explicit JsonTraceParser(TraceProcessorContext*);
   ~JsonTraceParser() override;
 
   // TraceParser implementation.
-  bool Parse(std::unique_ptr<uint8_t[]>, size_t) override;
+  bool Parse(std::unique_ptr<TraceBlob>) override;
 
  private:
+  enum class State { kBeforeEvents, kInEvents, kAfterEvents };
+
+  // Parses the events in [start, end) and returns a pointer to the first
+  // character which wasn't consumed, or nullptr on a fatal error.
+  const char* ParseEvents(const char* start, const char* end);
+
+  void ParseEvent();
+
   TraceProcessorContext* const context_;
+  State state_ = State::kBeforeEvents;
   uint64_t offset_ = 0;
+
+  // The unconsumed tail of the previous chunk(s).
   std::vector<char> buffer_;
+  JsonEvent event_;
 };
 
 }  // namespace trace_processor
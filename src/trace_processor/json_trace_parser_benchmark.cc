@@ -0,0 +1,179 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <json/reader.h>
+#include <json/value.h>
+
+#include <string>
+
+#include "benchmark/benchmark.h"
+
+#include "src/trace_processor/args_tracker.h"
+#include "src/trace_processor/json_tokenizer.h"
+#include "src/trace_processor/json_trace_parser.h"
+#include "src/trace_processor/process_tracker.h"
+#include "src/trace_processor/slice_tracker.h"
+#include "src/trace_processor/trace_processor_context.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace {
+
+using perfetto::trace_processor::ArgsTracker;
+using perfetto::trace_processor::JsonEvent;
+using perfetto::trace_processor::JsonReadResult;
+using perfetto::trace_processor::JsonTraceParser;
+using perfetto::trace_processor::ProcessTracker;
+using perfetto::trace_processor::ReadJsonEvent;
+using perfetto::trace_processor::SliceTracker;
+using perfetto::trace_processor::TraceBlob;
+using perfetto::trace_processor::TraceProcessorContext;
+using perfetto::trace_processor::TraceStorage;
+
+// The events look like the ones of a Chrome trace: complete events with a
+// few args, some of them nested, on a handful of threads.
+constexpr uint32_t kNumEvents = 200000;
+constexpr size_t kChunkSize = 1024 * 1024;
+
+const std::string& GetTrace() {
+  static std::string* trace = [] {
+    auto* t = new std::string("{\"traceEvents\":[\n");
+    for (uint32_t i = 0; i < kNumEvents; i++) {
+      char buf[512];
+      snprintf(buf, sizeof(buf),
+               "{\"pid\":%u,\"tid\":%u,\"ts\":%u.%03u,\"ph\":\"X\","
+               "\"cat\":\"toplevel,ipc\",\"name\":\"ThreadControllerImpl::"
+               "RunTask%u\",\"dur\":%u,\"tdur\":%u,\"tts\":%u,\"args\":{"
+               "\"src_file\":\"../../ipc/ipc_mojo_bootstrap.cc\","
+               "\"src_func\":\"Accept\",\"data\":{\"frame\":\"0x1f\","
+               "\"url\":\"https://example.com/{path}\"}}},\n",
+               1 + i % 8, 100 + i % 32, i * 10, i % 1000, i % 64, i % 10 + 1,
+               i % 7, i * 9);
+      t->append(buf);
+    }
+    t->append("{\"pid\":1,\"tid\":100,\"ts\":0,\"ph\":\"M\","
+              "\"name\":\"thread_name\",\"args\":{\"name\":\"Main\"}}\n]}");
+    return t;
+  }();
+  return *trace;
+}
+
+// The previous implementation of JsonTraceParser: find the end of the next
+// dictionary by counting braces and parse it into a DOM with jsoncpp.
+bool ReadOneJsonDict(const char* start,
+                     const char* end,
+                     Json::Value* value,
+                     const char** next) {
+  int braces = 0;
+  const char* dict_begin = nullptr;
+  for (const char* s = start; s < end; s++) {
+    if (isspace(*s) || *s == ',')
+      continue;
+    if (*s == '{') {
+      if (braces == 0)
+        dict_begin = s;
+      braces++;
+      continue;
+    }
+    if (*s == '}') {
+      if (braces <= 0)
+        return false;
+      if (--braces > 0)
+        continue;
+      Json::Reader reader;
+      if (!reader.parse(dict_begin, s + 1, *value, false))
+        return false;
+      *next = s + 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+// Reads the fields of every event with jsoncpp, as the parser used to.
+static void BM_JsonReadEventsJsoncpp(benchmark::State& state) {
+  const std::string& trace = GetTrace();
+  while (state.KeepRunning()) {
+    const char* next = trace.data() + trace.find('[') + 1;
+    const char* end = trace.data() + trace.size();
+    Json::Value value;
+    uint32_t num_events = 0;
+    while (ReadOneJsonDict(next, end, &value, &next)) {
+      benchmark::DoNotOptimize(value["ph"].asCString());
+      benchmark::DoNotOptimize(value["ts"].asDouble());
+      benchmark::DoNotOptimize(value["name"].asCString());
+      num_events++;
+    }
+    PERFETTO_CHECK(num_events == kNumEvents + 1);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(GetTrace().size()));
+}
+BENCHMARK(BM_JsonReadEventsJsoncpp)->Unit(benchmark::kMillisecond);
+
+// Reads the fields of every event with the JSON tokenizer.
+static void BM_JsonReadEventsTokenizer(benchmark::State& state) {
+  const std::string& trace = GetTrace();
+  while (state.KeepRunning()) {
+    const char* next = trace.data() + trace.find('[') + 1;
+    const char* end = trace.data() + trace.size();
+    JsonEvent event;
+    uint32_t num_events = 0;
+    for (;;) {
+      while (next < end && (isspace(*next) || *next == ','))
+        next++;
+      if (next == end || *next != '{')
+        break;
+      if (ReadJsonEvent(next, end, &event, &next) != JsonReadResult::kOk)
+        break;
+      benchmark::DoNotOptimize(event.ph.string_value.data());
+      benchmark::DoNotOptimize(event.ts.double_value);
+      benchmark::DoNotOptimize(event.name.string_value.data());
+      num_events++;
+    }
+    PERFETTO_CHECK(num_events == kNumEvents + 1);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(GetTrace().size()));
+}
+BENCHMARK(BM_JsonReadEventsTokenizer)->Unit(benchmark::kMillisecond);
+
+// Parses the trace, in 1MB chunks, into the storage.
+static void BM_JsonTraceParser(benchmark::State& state) {
+  const std::string& trace = GetTrace();
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    TraceProcessorContext context;
+    context.storage.reset(new TraceStorage());
+    context.args_tracker.reset(new ArgsTracker(&context));
+    context.process_tracker.reset(new ProcessTracker(&context));
+    context.slice_tracker.reset(new SliceTracker(&context));
+    JsonTraceParser parser(&context);
+    state.ResumeTiming();
+
+    for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+      size_t size = std::min(kChunkSize, trace.size() - off);
+      std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+      memcpy(buf.get(), trace.data() + off, size);
+      PERFETTO_CHECK(
+          parser.Parse(TraceBlob::FromHeapBuffer(std::move(buf), size)));
+    }
+    PERFETTO_CHECK(context.storage->nestable_slices().slice_count() ==
+                   kNumEvents);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(GetTrace().size()));
+}
+BENCHMARK(BM_JsonTraceParser)->Unit(benchmark::kMillisecond);
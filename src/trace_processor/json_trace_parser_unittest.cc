@@ -16,7 +16,12 @@
 
 #include "src/trace_processor/json_trace_parser.h"
 
-#include <json/value.h>
+#include <string.h>
+
+#include "src/trace_processor/args_tracker.h"
+#include "src/trace_processor/process_tracker.h"
+#include "src/trace_processor/slice_tracker.h"
+#include "src/trace_processor/trace_processor_context.h"
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -25,26 +30,100 @@ namespace perfetto {
 namespace trace_processor {
 namespace {
 
-TEST(JsonTraceParserTest, CoerceToUint32) {
-  ASSERT_EQ(CoerceToUint32(Json::Value(42)).value_or(0), 42);
-  ASSERT_EQ(CoerceToUint32(Json::Value("42")).value_or(0), 42);
-  ASSERT_EQ(CoerceToInt64(Json::Value(42.1)).value_or(-1), 42);
+class JsonTraceParserTest : public ::testing::Test {
+ public:
+  JsonTraceParserTest() { Reset(); }
+
+  void Reset() {
+    context_.reset(new TraceProcessorContext());
+    context_->storage.reset(new TraceStorage());
+    context_->args_tracker.reset(new ArgsTracker(context_.get()));
+    context_->process_tracker.reset(new ProcessTracker(context_.get()));
+    context_->slice_tracker.reset(new SliceTracker(context_.get()));
+    parser_.reset(new JsonTraceParser(context_.get()));
+  }
+
+  // Parses |trace| split in chunks ending at |splits|.
+  bool ParseChunks(const std::string& trace, std::vector<size_t> splits) {
+    splits.push_back(trace.size());
+    size_t start = 0;
+    for (size_t split : splits) {
+      size_t size = split - start;
+      std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+      memcpy(buf.get(), trace.data() + start, size);
+      if (!parser_->Parse(TraceBlob::FromHeapBuffer(std::move(buf), size)))
+        return false;
+      start = split;
+    }
+    return true;
+  }
+
+  std::string SliceName(uint32_t row) {
+    const auto& slices = context_->storage->nestable_slices();
+    return context_->storage->GetString(slices.names()[row]).ToStdString();
+  }
+
+ protected:
+  std::unique_ptr<TraceProcessorContext> context_;
+  std::unique_ptr<JsonTraceParser> parser_;
+};
+
+TEST_F(JsonTraceParserTest, AllChunkBoundaries) {
+  const std::string trace =
+      "{\"traceEvents\": [\n"
+      "{\"ph\": \"M\", \"name\": \"thread_name\", \"ts\": 0, "
+      "\"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"Main\"}},\n"
+      "{\"ph\": \"B\", \"name\": \"a{\\\"}\", \"cat\": \"c\", "
+      "\"ts\": 10, \"pid\": 1, \"tid\": 2},\n"
+      "{\"ph\": \"X\", \"name\": \"b\\u00e9\", \"ts\": 11.5, "
+      "\"dur\": 2, \"pid\": 1, \"tid\": 2, \"args\": {\"x\": \"]}\"}},\n"
+      "{\"ph\": \"E\", \"ts\": 20, \"pid\": 1, \"tid\": 2}\n"
+      "], \"metadata\": {\"x\": \"[{\"}}";
+
+  // The first chunk must contain the start of the array of events.
+  for (size_t i = trace.find('[') + 1; i < trace.size(); i++) {
+    for (size_t j = i; j < trace.size(); j += 7) {
+      Reset();
+      ASSERT_TRUE(ParseChunks(trace, {i, j})) << i << " " << j;
+
+      const auto& slices = context_->storage->nestable_slices();
+      ASSERT_EQ(slices.slice_count(), 2u) << i << " " << j;
+      ASSERT_EQ(SliceName(0), "a{\"}");
+      ASSERT_EQ(slices.start_ns()[0], 10000);
+      ASSERT_EQ(slices.durations()[0], 10000);
+      ASSERT_EQ(SliceName(1), "b\xC3\xA9");
+      ASSERT_EQ(slices.start_ns()[1], 11500);
+      ASSERT_EQ(slices.durations()[1], 2000);
+
+      const auto& thread = context_->storage->GetThread(slices.utids()[0]);
+      ASSERT_EQ(thread.tid, 2u);
+      ASSERT_EQ(context_->storage->GetString(thread.name_id), "Main");
+    }
+  }
 }
 
-TEST(JsonTraceParserTest, CoerceToInt64) {
-  ASSERT_EQ(CoerceToInt64(Json::Value(42)).value_or(-1), 42);
-  ASSERT_EQ(CoerceToInt64(Json::Value("42")).value_or(-1), 42);
-  ASSERT_EQ(CoerceToInt64(Json::Value(42.1)).value_or(-1), 42);
-  ASSERT_FALSE(CoerceToInt64(Json::Value("foo")).has_value());
-  ASSERT_FALSE(CoerceToInt64(Json::Value("1234!")).has_value());
+TEST_F(JsonTraceParserTest, LargeEventAcrossChunks) {
+  // An event much larger than the pieces of the next chunk which are
+  // buffered to complete it.
+  std::string trace = "[{\"ph\": \"X\", \"ts\": 1, \"dur\": 1, \"args\": "
+                      "{\"data\": \"" +
+                      std::string(100000, 'x') +
+                      "\"}, \"name\": \"big\"}, "
+                      "{\"ph\": \"X\", \"ts\": 2, \"dur\": 1, "
+                      "\"name\": \"small\"}]";
+  ASSERT_TRUE(ParseChunks(trace, {10, 5000, 60000}));
+  const auto& slices = context_->storage->nestable_slices();
+  ASSERT_EQ(slices.slice_count(), 2u);
+  ASSERT_EQ(SliceName(0), "big");
+  ASSERT_EQ(SliceName(1), "small");
 }
 
-TEST(JsonTraceParserTest, CoerceToNs) {
-  ASSERT_EQ(CoerceToNs(Json::Value(42)).value_or(-1), 42000);
-  ASSERT_EQ(CoerceToNs(Json::Value("42")).value_or(-1), 42000);
-  ASSERT_EQ(CoerceToNs(Json::Value(42.1)).value_or(-1), 42100);
-  ASSERT_FALSE(CoerceToNs(Json::Value("foo")).has_value());
-  ASSERT_FALSE(CoerceToNs(Json::Value("1234!")).has_value());
+TEST_F(JsonTraceParserTest, Errors) {
+  ASSERT_FALSE(ParseChunks("{\"traceEvents\": {}}", {}));
+  Reset();
+  ASSERT_FALSE(ParseChunks("[{\"ph\": \"B\", \"ts\" 1}]", {5}));
+  Reset();
+  ASSERT_FALSE(ParseChunks("[{\"ph\": \"B\", \"ts\": 1} 1]", {}));
 }
 
 }  // namespace
@@ -32,8 +32,10 @@ using namespace sqlite_utils;
 ProcessTable::ProcessTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
-void ProcessTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<ProcessTable>(db, storage, "process");
+void ProcessTable::RegisterTable(sqlite3* db,
+                                 const TraceStorage* storage,
+                                 const QueryContext* context) {
+  Table::Register<ProcessTable>(db, storage, context, "process");
 }
 
 base::Optional<Table::Schema> ProcessTable::Init(int, const char* const*) {
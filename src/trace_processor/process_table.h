@@ -32,7 +32,9 @@ class ProcessTable : public Table {
  public:
   enum Column { kUpid = 0, kName = 1, kPid = 2 };
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   ProcessTable(sqlite3*, const TraceStorage*);
 
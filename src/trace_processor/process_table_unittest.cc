@@ -37,7 +37,7 @@ class ProcessTableUnittest : public ::testing::Test {
     context_.storage.reset(new TraceStorage());
     context_.process_tracker.reset(new ProcessTracker(&context_));
 
-    ProcessTable::RegisterTable(db_.get(), context_.storage.get());
+    ProcessTable::RegisterTable(db_.get(), context_.storage.get(), nullptr);
   }
 
   void PrepareValidStatement(const std::string& sql) {
@@ -31,6 +31,7 @@
 #include "src/trace_processor/clock_tracker.h"
 #include "src/trace_processor/event_tracker.h"
 #include "src/trace_processor/ftrace_descriptors.h"
+#include "src/trace_processor/heap_profile_tracker.h"
 #include "src/trace_processor/process_tracker.h"
 #include "src/trace_processor/slice_tracker.h"
 #include "src/trace_processor/trace_processor_context.h"
@@ -318,7 +319,7 @@ void ProtoTraceParser::ParseTracePacket(int64_t ts, TraceBlobView blob) {
     ParseAndroidLogPacket(packet.android_log());
 
   if (packet.has_profile_packet())
-    ParseProfilePacket(packet.profile_packet());
+    ParseProfilePacket(ts, packet.profile_packet());
 
   // TODO(lalitm): maybe move this to the flush method in the trace processor
   // once we have it. This may reduce performance in the ArgsTracker though so
@@ -1268,15 +1269,70 @@ void ProtoTraceParser::ParseFtraceStats(ConstBytes blob) {
   }
 }
 
-void ProtoTraceParser::ParseProfilePacket(ConstBytes blob) {
-  protos::pbzero::ProfilePacket::Decoder packet(blob.data, blob.size);
+void ProtoTraceParser::ParseProfilePacket(int64_t ts, ConstBytes blob) {
+  using Packet = protos::pbzero::ProfilePacket;
+  Packet::Decoder packet(blob.data, blob.size);
+  HeapProfileTracker* tracker = context_->heap_profile_tracker.get();
+  tracker->SetPacketTimestamp(ts);
+
   for (auto it = packet.strings(); it; ++it) {
-    protos::pbzero::ProfilePacket::InternedString::Decoder entry(it->data(),
-                                                                 it->size());
+    Packet::InternedString::Decoder entry(it->data(), it->size());
 
     const char* str = reinterpret_cast<const char*>(entry.str().data);
-    context_->storage->InternString(base::StringView(str, entry.str().size));
+    StringId str_id = context_->storage->InternString(
+        base::StringView(str, entry.str().size));
+    tracker->AddString(entry.id(), str_id);
+  }
+
+  for (auto it = packet.mappings(); it; ++it) {
+    Packet::Mapping::Decoder entry(it->data(), it->size());
+    HeapProfileTracker::SourceMapping mapping;
+    mapping.build_id = entry.build_id();
+    mapping.offset = entry.offset();
+    mapping.start = entry.start();
+    mapping.end = entry.end();
+    mapping.load_bias = entry.load_bias();
+    for (auto path_it = entry.path_string_ids(); path_it; ++path_it)
+      mapping.path_string_ids.emplace_back(path_it->as_uint64());
+    tracker->AddMapping(entry.id(), mapping);
+  }
+
+  for (auto it = packet.frames(); it; ++it) {
+    Packet::Frame::Decoder entry(it->data(), it->size());
+    HeapProfileTracker::SourceFrame frame;
+    frame.function_name_id = entry.function_name_id();
+    frame.mapping_id = entry.mapping_id();
+    frame.rel_pc = entry.rel_pc();
+    tracker->AddFrame(entry.id(), frame);
   }
+
+  std::vector<uint64_t> frame_ids;
+  for (auto it = packet.callstacks(); it; ++it) {
+    Packet::Callstack::Decoder entry(it->data(), it->size());
+    frame_ids.clear();
+    for (auto frame_it = entry.frame_ids(); frame_it; ++frame_it)
+      frame_ids.emplace_back(frame_it->as_uint64());
+    tracker->AddCallstack(entry.id(), frame_ids);
+  }
+
+  for (auto it = packet.process_dumps(); it; ++it) {
+    Packet::ProcessHeapSamples::Decoder entry(it->data(), it->size());
+    auto pid = static_cast<uint32_t>(entry.pid());
+    for (auto sample_it = entry.samples(); sample_it; ++sample_it) {
+      Packet::HeapSample::Decoder sample(sample_it->data(), sample_it->size());
+      HeapProfileTracker::SourceAllocation alloc;
+      alloc.callstack_id = sample.callstack_id();
+      alloc.self_allocated = sample.self_allocated();
+      alloc.self_freed = sample.self_freed();
+      alloc.alloc_count = sample.alloc_count();
+      alloc.free_count = sample.free_count();
+      tracker->AddAllocation(pid, alloc);
+    }
+  }
+
+  // A dump spans all the packets up to the first one which isn't continued.
+  if (!packet.continued())
+    tracker->FinalizeProfile();
 }
 
 }  // namespace trace_processor
@@ -101,7 +101,7 @@ class ProtoTraceParser {
                              ConstBytes view);
   void ParseTraceStats(ConstBytes);
   void ParseFtraceStats(ConstBytes);
-  void ParseProfilePacket(ConstBytes);
+  void ParseProfilePacket(int64_t ts, ConstBytes);
 
  private:
   TraceProcessorContext* context_;
@@ -139,7 +139,8 @@ class ProtoTraceParserTest : public ::testing::Test {
     std::unique_ptr<uint8_t[]> raw_trace(new uint8_t[trace_bytes.size()]);
     memcpy(raw_trace.get(), trace_bytes.data(), trace_bytes.size());
     ProtoTraceTokenizer tokenizer(&context_);
-    tokenizer.Parse(std::move(raw_trace), trace_bytes.size());
+    tokenizer.Parse(
+        TraceBlob::FromHeapBuffer(std::move(raw_trace), trace_bytes.size()));
 
     ResetTraceBuffers();
   }
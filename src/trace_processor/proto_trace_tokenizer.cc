@@ -19,6 +19,7 @@
 #include <string>
 
 #include "perfetto/base/logging.h"
+#include "perfetto/base/lz4.h"
 #include "perfetto/base/utils.h"
 #include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
@@ -42,13 +43,138 @@ using protozero::proto_utils::MakeTagLengthDelimited;
 using protozero::proto_utils::MakeTagVarInt;
 using protozero::proto_utils::ParseVarInt;
 
-ProtoTraceTokenizer::ProtoTraceTokenizer(TraceProcessorContext* ctx)
-    : trace_sorter_(ctx->sorter.get()), trace_storage_(ctx->storage.get()) {}
-ProtoTraceTokenizer::~ProtoTraceTokenizer() = default;
+namespace {
 
-bool ProtoTraceTokenizer::Parse(std::unique_ptr<uint8_t[]> owned_buf,
-                                size_t size) {
-  uint8_t* data = &owned_buf[0];
+// Batches handed to the worker threads hold roughly this many bytes of
+// TracePackets. Large enough to amortize the synchronization, small enough to
+// keep all the workers busy with the default 1MB chunks of the shell.
+constexpr size_t kBatchSizeBytes = 128 * 1024;
+
+// Parse() blocks once this many batches per worker are waiting to be
+// tokenized or committed, to bound the memory used by the pipeline.
+constexpr size_t kMaxInFlightBatchesPerWorker = 4;
+
+// The compressed_packets field is always the only field of the TracePackets
+// holding it, so they can be recognized by their first bytes.
+constexpr uint32_t kCompressedPacketsTag = MakeTagLengthDelimited(
+    protos::pbzero::TracePacket::kCompressedPacketsFieldNumber);
+static_assert(kCompressedPacketsTag >= 0x80 && kCompressedPacketsTag < 0x4000,
+              "kCompressedPacketsTag should be encoded in 2 bytes");
+
+inline bool IsCompressedPackets(const TraceBlobView& packet) {
+  return packet.length() >= 2 &&
+         packet.data()[0] == ((kCompressedPacketsTag & 0x7f) | 0x80) &&
+         packet.data()[1] == (kCompressedPacketsTag >> 7);
+}
+
+// LZ4 can't compress data more than ~255 times, so larger sizes are corrupted.
+constexpr uint64_t kMaxCompressionRatio = 255;
+
+}  // namespace
+
+// A batch of TracePackets which is tokenized on a worker thread. The result of
+// the tokenization is recorded as a list of tokens which are replayed, in
+// order, on the caller's thread to push the events to the sorter.
+struct ProtoTraceTokenizer::Batch {
+  struct Token {
+    enum Type : uint8_t {
+      kTracePacket,
+      kFtraceBundlePacket,
+      kFtraceEvent,
+      kFtraceBundleEnd,
+      kFtraceBundleError,
+    };
+
+    Type type;
+    bool has_timestamp;
+    uint32_t packet_idx;
+    uint32_t cpu;
+    int64_t timestamp;
+
+    // Only set for kFtraceEvent: the location of the event in the packet.
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  std::vector<TraceBlobView> packets;
+  size_t size_bytes = 0;
+  std::vector<Token> tokens;
+
+  // Protected by |mutex_|.
+  bool done = false;
+};
+
+// The sink used by the worker threads: it only reads the packets and records
+// tokens, without touching the reference counts of the TraceBlobViews.
+class ProtoTraceTokenizer::TokenRecorder {
+ public:
+  using Token = Batch::Token;
+
+  explicit TokenRecorder(Batch* batch) : batch_(batch) {}
+
+  void set_packet_idx(uint32_t packet_idx) { packet_idx_ = packet_idx; }
+
+  void OnTracePacket(TraceBlobView*, bool has_timestamp, int64_t ts) {
+    Add(Token::kTracePacket, has_timestamp, 0, ts);
+  }
+
+  void OnFtraceBundlePacket(bool has_timestamp, int64_t ts) {
+    if (has_timestamp)
+      Add(Token::kFtraceBundlePacket, true, 0, ts);
+  }
+
+  void OnFtraceEvent(TraceBlobView*,
+                     uint32_t cpu,
+                     int64_t ts,
+                     size_t offset,
+                     size_t length) {
+    Token* token = Add(Token::kFtraceEvent, true, cpu, ts);
+    token->offset = static_cast<uint32_t>(offset);
+    token->length = static_cast<uint32_t>(length);
+  }
+
+  void OnFtraceBundleEnd(uint32_t cpu) {
+    Add(Token::kFtraceBundleEnd, false, cpu, 0);
+  }
+
+  void OnFtraceBundleError() { Add(Token::kFtraceBundleError, false, 0, 0); }
+
+ private:
+  Token* Add(Token::Type type, bool has_timestamp, uint32_t cpu, int64_t ts) {
+    Token token{};
+    token.type = type;
+    token.has_timestamp = has_timestamp;
+    token.packet_idx = packet_idx_;
+    token.cpu = cpu;
+    token.timestamp = ts;
+    batch_->tokens.emplace_back(token);
+    return &batch_->tokens.back();
+  }
+
+  Batch* const batch_;
+  uint32_t packet_idx_ = 0;
+};
+
+ProtoTraceTokenizer::ProtoTraceTokenizer(TraceProcessorContext* ctx,
+                                         uint32_t num_threads)
+    : trace_sorter_(ctx->sorter.get()), trace_storage_(ctx->storage.get()) {
+  for (uint32_t i = 1; i < num_threads; i++)
+    workers_.emplace_back(&ProtoTraceTokenizer::WorkerMain, this);
+}
+
+ProtoTraceTokenizer::~ProtoTraceTokenizer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  pending_cv_.notify_all();
+  for (auto& worker : workers_)
+    worker.join();
+}
+
+bool ProtoTraceTokenizer::Parse(std::unique_ptr<TraceBlob> blob) {
+  const uint8_t* data = blob->data();
+  size_t size = blob->size();
   if (!partial_buf_.empty()) {
     // It takes ~5 bytes for a proto preamble + the varint size.
     const size_t kHeaderBytes = 5;
@@ -99,68 +225,120 @@ bool ProtoTraceTokenizer::Parse(std::unique_ptr<uint8_t[]> owned_buf,
       data += size_missing;
       size -= size_missing;
       partial_buf_.clear();
-      uint8_t* buf_start = &buf[0];  // Note that buf is std::moved below.
-      ParseInternal(std::move(buf), buf_start, size_incl_header);
+      auto packet_blob =
+          TraceBlob::FromHeapBuffer(std::move(buf), size_incl_header);
+      const uint8_t* packet_start = packet_blob->data();
+      ParseInternal(std::move(packet_blob), packet_start, size_incl_header);
     } else {
       partial_buf_.insert(partial_buf_.end(), data, &data[size]);
       return true;
     }
   }
-  ParseInternal(std::move(owned_buf), data, size);
+  ParseInternal(std::move(blob), data, size);
   return true;
 }
 
-void ProtoTraceTokenizer::ParseInternal(std::unique_ptr<uint8_t[]> owned_buf,
-                                        uint8_t* data,
+void ProtoTraceTokenizer::ParseInternal(std::unique_ptr<TraceBlob> blob,
+                                        const uint8_t* data,
                                         size_t size) {
-  PERFETTO_DCHECK(data >= &owned_buf[0]);
-  const uint8_t* start = &owned_buf[0];
-  const size_t data_off = static_cast<size_t>(data - start);
-  TraceBlobView whole_buf(std::move(owned_buf), data_off, size);
+  PERFETTO_DCHECK(data >= blob->data());
+  const size_t data_off = static_cast<size_t>(data - blob->data());
+  TraceBlobView whole_buf(std::move(blob), data_off, size);
+
+  const size_t bytes_left = ParsePackets(&whole_buf, false /* decompressed */);
+  if (bytes_left > 0) {
+    PERFETTO_DCHECK(partial_buf_.empty());
+    partial_buf_.insert(partial_buf_.end(), &data[size - bytes_left],
+                        &data[size]);
+  }
+}
 
-  protos::pbzero::Trace::Decoder decoder(data, size);
+size_t ProtoTraceTokenizer::ParsePackets(TraceBlobView* buf,
+                                         bool decompressed) {
+  protos::pbzero::Trace::Decoder decoder(buf->data(), buf->length());
   for (auto it = decoder.packet(); it; ++it) {
-    size_t field_offset = whole_buf.offset_of(it->data());
-    ParsePacket(whole_buf.slice(field_offset, it->size()));
+    size_t field_offset = buf->offset_of(it->data());
+    TraceBlobView packet = buf->slice(field_offset, it->size());
+    if (PERFETTO_UNLIKELY(IsCompressedPackets(packet))) {
+      // The service never nests compressed packets. Decompressing them
+      // recursively would let a small trace expand without bounds.
+      if (decompressed)
+        trace_storage_->IncrementStats(stats::compressed_packets_invalid);
+      else
+        ParseCompressedPackets(&packet);
+    } else if (workers_.empty()) {
+      TokenizePacket(&packet, this);
+    } else {
+      AddPacketToBatch(std::move(packet));
+    }
   }
+  return decoder.bytes_left();
+}
 
-  const size_t bytes_left = decoder.bytes_left();
-  if (bytes_left > 0) {
-    PERFETTO_DCHECK(partial_buf_.empty());
-    partial_buf_.insert(partial_buf_.end(), &data[decoder.read_offset()],
-                        &data[decoder.read_offset() + bytes_left]);
+void ProtoTraceTokenizer::ParseCompressedPackets(TraceBlobView* packet) {
+  protos::pbzero::TracePacket::Decoder decoder(packet->data(),
+                                               packet->length());
+  auto field = decoder.compressed_packets();
+  protos::pbzero::TracePacket::CompressedPackets::Decoder compressed(
+      field.data, field.size);
+  uint64_t size = compressed.uncompressed_size();
+  auto data = compressed.data();
+  if (size > data.size * kMaxCompressionRatio) {
+    trace_storage_->IncrementStats(stats::compressed_packets_invalid);
+    return;
   }
+
+  // The decompressed packets are sliced out of a buffer of their own, which
+  // is kept alive by the TraceBlobViews until they are parsed.
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+  if (!base::Lz4Decompress(data.data, data.size, buf.get(),
+                           static_cast<size_t>(size))) {
+    trace_storage_->IncrementStats(stats::compressed_packets_invalid);
+    return;
+  }
+  TraceBlobView packets(std::move(buf), 0, static_cast<size_t>(size));
+  if (ParsePackets(&packets, true /* decompressed */) > 0)
+    trace_storage_->IncrementStats(stats::compressed_packets_invalid);
 }
 
-void ProtoTraceTokenizer::ParsePacket(TraceBlobView packet) {
-  protos::pbzero::TracePacket::Decoder decoder(packet.data(), packet.length());
+void ProtoTraceTokenizer::NotifyEndOfFile() {
+  if (workers_.empty())
+    return;
+  SubmitBatch();
+  CommitBatches(0);
+}
 
-  auto timestamp = decoder.has_timestamp()
-                       ? static_cast<int64_t>(decoder.timestamp())
-                       : latest_timestamp_;
-  latest_timestamp_ = std::max(timestamp, latest_timestamp_);
+template <typename Sink>
+void ProtoTraceTokenizer::TokenizePacket(TraceBlobView* packet, Sink* sink) {
+  protos::pbzero::TracePacket::Decoder decoder(packet->data(),
+                                               packet->length());
+  bool has_timestamp = decoder.has_timestamp();
+  auto timestamp = static_cast<int64_t>(decoder.timestamp());
 
   if (decoder.has_ftrace_events()) {
+    sink->OnFtraceBundlePacket(has_timestamp, timestamp);
     auto ftrace_field = decoder.ftrace_events();
-    const size_t fld_off = packet.offset_of(ftrace_field.data);
-    ParseFtraceBundle(packet.slice(fld_off, ftrace_field.size));
+    TokenizeFtraceBundle(packet, ftrace_field.data, ftrace_field.size, sink);
     return;
   }
 
   // Use parent data and length because we want to parse this again
   // later to get the exact type of the packet.
-  trace_sorter_->PushTracePacket(timestamp, std::move(packet));
   PERFETTO_DCHECK(!decoder.bytes_left());
+  sink->OnTracePacket(packet, has_timestamp, timestamp);
 }
 
-PERFETTO_ALWAYS_INLINE
-void ProtoTraceTokenizer::ParseFtraceBundle(TraceBlobView bundle) {
-  protos::pbzero::FtraceEventBundle::Decoder decoder(bundle.data(),
-                                                     bundle.length());
+template <typename Sink>
+PERFETTO_ALWAYS_INLINE void ProtoTraceTokenizer::TokenizeFtraceBundle(
+    TraceBlobView* packet,
+    const uint8_t* data,
+    size_t length,
+    Sink* sink) {
+  protos::pbzero::FtraceEventBundle::Decoder decoder(data, length);
 
   if (PERFETTO_UNLIKELY(!decoder.has_cpu())) {
     PERFETTO_ELOG("CPU field not found in FtraceEventBundle");
-    trace_storage_->IncrementStats(stats::ftrace_bundle_tokenizer_errors);
+    sink->OnFtraceBundleError();
     return;
   }
 
@@ -170,19 +348,20 @@ void ProtoTraceTokenizer::ParseFtraceBundle(TraceBlobView bundle) {
     return;
   }
 
-  for (auto it = decoder.event(); it; ++it) {
-    size_t off = bundle.offset_of(it->data());
-    ParseFtraceEvent(cpu, bundle.slice(off, it->size()));
-  }
-  trace_sorter_->FinalizeFtraceEventBatch(cpu);
+  for (auto it = decoder.event(); it; ++it)
+    TokenizeFtraceEvent(packet, cpu, it->data(), it->size(), sink);
+  sink->OnFtraceBundleEnd(cpu);
 }
 
-PERFETTO_ALWAYS_INLINE
-void ProtoTraceTokenizer::ParseFtraceEvent(uint32_t cpu, TraceBlobView event) {
+template <typename Sink>
+PERFETTO_ALWAYS_INLINE void ProtoTraceTokenizer::TokenizeFtraceEvent(
+    TraceBlobView* packet,
+    uint32_t cpu,
+    const uint8_t* data,
+    size_t length,
+    Sink* sink) {
   constexpr auto kTimestampFieldNumber =
       protos::pbzero::FtraceEvent::kTimestampFieldNumber;
-  const uint8_t* data = event.data();
-  const size_t length = event.length();
   ProtoDecoder decoder(data, length);
   uint64_t raw_timestamp = 0;
   bool timestamp_found = false;
@@ -205,16 +384,140 @@ void ProtoTraceTokenizer::ParseFtraceEvent(uint32_t cpu, TraceBlobView event) {
 
   if (PERFETTO_UNLIKELY(!timestamp_found)) {
     PERFETTO_ELOG("Timestamp field not found in FtraceEvent");
-    trace_storage_->IncrementStats(stats::ftrace_bundle_tokenizer_errors);
+    sink->OnFtraceBundleError();
     return;
   }
 
+  // We don't need to parse this packet, just push it to be sorted with
+  // the timestamp.
   int64_t timestamp = static_cast<int64_t>(raw_timestamp);
+  sink->OnFtraceEvent(packet, cpu, timestamp, packet->offset_of(data), length);
+}
+
+void ProtoTraceTokenizer::OnTracePacket(TraceBlobView* packet,
+                                        bool has_timestamp,
+                                        int64_t ts) {
+  int64_t timestamp = has_timestamp ? ts : latest_timestamp_;
   latest_timestamp_ = std::max(timestamp, latest_timestamp_);
+  trace_sorter_->PushTracePacket(timestamp, std::move(*packet));
+}
 
-  // We don't need to parse this packet, just push it to be sorted with
-  // the timestamp.
-  trace_sorter_->PushFtraceEvent(cpu, timestamp, std::move(event));
+void ProtoTraceTokenizer::OnFtraceBundlePacket(bool has_timestamp,
+                                               int64_t ts) {
+  if (has_timestamp)
+    latest_timestamp_ = std::max(ts, latest_timestamp_);
+}
+
+void ProtoTraceTokenizer::OnFtraceEvent(TraceBlobView* packet,
+                                        uint32_t cpu,
+                                        int64_t ts,
+                                        size_t offset,
+                                        size_t length) {
+  latest_timestamp_ = std::max(ts, latest_timestamp_);
+  trace_sorter_->PushFtraceEvent(cpu, ts, packet->slice(offset, length));
+}
+
+void ProtoTraceTokenizer::OnFtraceBundleEnd(uint32_t cpu) {
+  trace_sorter_->FinalizeFtraceEventBatch(cpu);
+}
+
+void ProtoTraceTokenizer::OnFtraceBundleError() {
+  trace_storage_->IncrementStats(stats::ftrace_bundle_tokenizer_errors);
+}
+
+void ProtoTraceTokenizer::AddPacketToBatch(TraceBlobView packet) {
+  if (!cur_batch_)
+    cur_batch_.reset(new Batch());
+  cur_batch_->size_bytes += packet.length();
+  cur_batch_->packets.emplace_back(std::move(packet));
+  if (cur_batch_->size_bytes >= kBatchSizeBytes)
+    SubmitBatch();
+}
+
+void ProtoTraceTokenizer::SubmitBatch() {
+  if (!cur_batch_)
+    return;
+
+  Batch* batch = cur_batch_.get();
+  in_flight_batches_.emplace_back(std::move(cur_batch_));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_batches_.emplace_back(batch);
+  }
+  pending_cv_.notify_one();
+
+  CommitBatches(kMaxInFlightBatchesPerWorker * workers_.size());
+}
+
+// Commits, in order, the batches which have already been tokenized. If more
+// than |max_in_flight| batches are still in flight after that, waits for the
+// oldest ones to be tokenized and commits them too.
+void ProtoTraceTokenizer::CommitBatches(size_t max_in_flight) {
+  while (!in_flight_batches_.empty()) {
+    Batch* batch = in_flight_batches_.front().get();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!batch->done) {
+        if (in_flight_batches_.size() <= max_in_flight)
+          return;
+        done_cv_.wait(lock, [batch] { return batch->done; });
+      }
+    }
+    CommitBatch(batch);
+    in_flight_batches_.pop_front();
+  }
+}
+
+void ProtoTraceTokenizer::CommitBatch(Batch* batch) {
+  using Token = Batch::Token;
+  for (const Token& token : batch->tokens) {
+    TraceBlobView* packet = &batch->packets[token.packet_idx];
+    switch (token.type) {
+      case Token::kTracePacket:
+        OnTracePacket(packet, token.has_timestamp, token.timestamp);
+        break;
+      case Token::kFtraceBundlePacket:
+        OnFtraceBundlePacket(token.has_timestamp, token.timestamp);
+        break;
+      case Token::kFtraceEvent:
+        OnFtraceEvent(packet, token.cpu, token.timestamp, token.offset,
+                      token.length);
+        break;
+      case Token::kFtraceBundleEnd:
+        OnFtraceBundleEnd(token.cpu);
+        break;
+      case Token::kFtraceBundleError:
+        OnFtraceBundleError();
+        break;
+    }
+  }
+}
+
+void ProtoTraceTokenizer::WorkerMain() {
+  for (;;) {
+    Batch* batch = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pending_cv_.wait(lock,
+                       [this] { return quit_ || !pending_batches_.empty(); });
+      if (quit_)
+        return;
+      batch = pending_batches_.front();
+      pending_batches_.pop_front();
+    }
+
+    TokenRecorder recorder(batch);
+    for (uint32_t i = 0; i < batch->packets.size(); i++) {
+      recorder.set_packet_idx(i);
+      TokenizePacket(&batch->packets[i], &recorder);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      batch->done = true;
+    }
+    done_cv_.notify_all();
+  }
 }
 
 }  // namespace trace_processor
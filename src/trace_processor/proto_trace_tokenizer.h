@@ -19,38 +19,96 @@
 
 #include <stdint.h>
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "src/trace_processor/chunked_trace_reader.h"
+#include "src/trace_processor/trace_blob_view.h"
 
 namespace perfetto {
 namespace trace_processor {
 
 class TraceProcessorContext;
-class TraceBlobView;
 class TraceSorter;
 class TraceStorage;
 
 // Reads a protobuf trace in chunks and extracts boundaries of trace packets
 // (or subfields, for the case of ftrace) with their timestamps.
+//
+// If |num_threads| > 1, the tokenization of TracePackets and the decoding of
+// FtraceEventBundles happens on |num_threads| - 1 worker threads. Parse() only
+// splits the chunks into batches of TracePackets and pushes the tokenized
+// batches, in order, to the TraceSorter. This way the sorting and parsing of
+// the events into storage is still serialized on the caller's thread but
+// overlaps with the tokenization of the following batches.
 class ProtoTraceTokenizer : public ChunkedTraceReader {
  public:
   // |reader| is the abstract method of getting chunks of size |chunk_size_b|
   // from a trace file with these chunks parsed into |trace|.
-  explicit ProtoTraceTokenizer(TraceProcessorContext*);
+  explicit ProtoTraceTokenizer(TraceProcessorContext*,
+                               uint32_t num_threads = 1);
   ~ProtoTraceTokenizer() override;
 
   // ChunkedTraceReader implementation.
-  bool Parse(std::unique_ptr<uint8_t[]>, size_t size) override;
+  bool Parse(std::unique_ptr<TraceBlob>) override;
+  void NotifyEndOfFile() override;
 
  private:
-  void ParseInternal(std::unique_ptr<uint8_t[]> owned_buf,
-                     uint8_t* data,
+  struct Batch;
+  class TokenRecorder;
+
+  void ParseInternal(std::unique_ptr<TraceBlob> blob,
+                     const uint8_t* data,
                      size_t size);
-  void ParsePacket(TraceBlobView);
-  void ParseFtraceBundle(TraceBlobView);
-  void ParseFtraceEvent(uint32_t cpu, TraceBlobView);
+
+  // Tokenizes the TracePackets of the Trace message in |buf|. Returns the
+  // number of bytes of the incomplete packet at its end, if any. If
+  // |decompressed|, |buf| holds the packets decompressed from a
+  // compressed_packets field, and any compressed_packets in it is invalid.
+  size_t ParsePackets(TraceBlobView* buf, bool decompressed);
+
+  // Decompresses the packets of a TracePacket.compressed_packets field and
+  // tokenizes them.
+  void ParseCompressedPackets(TraceBlobView* packet);
+
+  // Extracts the timestamps of |packet| and, for ftrace bundles, of each of
+  // its events and reports them to |sink| (either this class, which pushes
+  // them to the sorter, or a TokenRecorder on the worker threads).
+  template <typename Sink>
+  static void TokenizePacket(TraceBlobView* packet, Sink* sink);
+  template <typename Sink>
+  static void TokenizeFtraceBundle(TraceBlobView* packet,
+                                   const uint8_t* data,
+                                   size_t length,
+                                   Sink* sink);
+  template <typename Sink>
+  static void TokenizeFtraceEvent(TraceBlobView* packet,
+                                  uint32_t cpu,
+                                  const uint8_t* data,
+                                  size_t length,
+                                  Sink* sink);
+
+  // Sink implementation.
+  void OnTracePacket(TraceBlobView* packet, bool has_timestamp, int64_t ts);
+  void OnFtraceBundlePacket(bool has_timestamp, int64_t ts);
+  void OnFtraceEvent(TraceBlobView* packet,
+                     uint32_t cpu,
+                     int64_t ts,
+                     size_t offset,
+                     size_t length);
+  void OnFtraceBundleEnd(uint32_t cpu);
+  void OnFtraceBundleError();
+
+  // Methods used only when tokenizing on worker threads.
+  void AddPacketToBatch(TraceBlobView packet);
+  void SubmitBatch();
+  void CommitBatches(size_t max_in_flight);
+  void CommitBatch(Batch*);
+  void WorkerMain();
 
   TraceSorter* const trace_sorter_;
   TraceStorage* const trace_storage_;
@@ -62,6 +120,23 @@ class ProtoTraceTokenizer : public ChunkedTraceReader {
   // Temporary. Currently trace packets do not have a timestamp, so the
   // timestamp given is latest_timestamp_.
   int64_t latest_timestamp_ = 0;
+
+  // The batch of packets being filled by Parse(), not yet handed to the
+  // workers.
+  std::unique_ptr<Batch> cur_batch_;
+
+  // The batches handed to the workers which are not yet committed to the
+  // sorter, in trace order. Only accessed by the caller's thread.
+  std::deque<std::unique_ptr<Batch>> in_flight_batches_;
+
+  // All the fields below are protected by |mutex_|.
+  std::mutex mutex_;
+  std::condition_variable pending_cv_;
+  std::condition_variable done_cv_;
+  std::deque<Batch*> pending_batches_;
+  bool quit_ = false;
+
+  std::vector<std::thread> workers_;
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/proto_trace_tokenizer.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <tuple>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "perfetto/base/lz4.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "src/trace_processor/proto_trace_parser.h"
+#include "src/trace_processor/trace_processor_context.h"
+#include "src/trace_processor/trace_sorter.h"
+#include "src/trace_processor/trace_storage.h"
+
+#include "perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "perfetto/trace/trace.pbzero.h"
+#include "perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAreArray;
+using ::testing::SizeIs;
+
+// The cpu (or -1 for TracePackets), timestamp and bytes of a parsed event.
+using ParsedEvent = std::tuple<int64_t, int64_t, std::string>;
+
+class RecordingTraceParser : public ProtoTraceParser {
+ public:
+  RecordingTraceParser(TraceProcessorContext* context,
+                       std::vector<ParsedEvent>* events)
+      : ProtoTraceParser(context), events_(events) {}
+
+  void ParseFtracePacket(uint32_t cpu,
+                         int64_t timestamp,
+                         TraceBlobView tbv) override {
+    events_->emplace_back(cpu, timestamp, ToString(tbv));
+  }
+
+  void ParseTracePacket(int64_t timestamp, TraceBlobView tbv) override {
+    events_->emplace_back(-1, timestamp, ToString(tbv));
+  }
+
+ private:
+  static std::string ToString(const TraceBlobView& tbv) {
+    return std::string(reinterpret_cast<const char*>(tbv.data()),
+                       tbv.length());
+  }
+
+  std::vector<ParsedEvent>* events_;
+};
+
+class ProtoTraceTokenizerTest : public ::testing::Test {
+ public:
+  ProtoTraceTokenizerTest() {
+    heap_buf_.reset(new protozero::ScatteredHeapBuffer());
+    stream_writer_.reset(new protozero::ScatteredStreamWriter(heap_buf_.get()));
+    heap_buf_->set_writer(stream_writer_.get());
+    trace_.Reset(stream_writer_.get());
+  }
+
+  // Builds a trace big enough to be split in several batches, with ftrace
+  // events interleaved across cpus, packets without timestamps and malformed
+  // bundles.
+  void WriteTrace() {
+    int64_t ts = 1000;
+    for (uint32_t i = 0; i < 2000; i++) {
+      auto* packet = trace_.add_packet();
+      if (i % 10 == 0) {
+        // A non-ftrace packet, which takes the timestamp of the latest
+        // packet if it has none.
+        if (i % 20 == 0)
+          packet->set_timestamp(static_cast<uint64_t>(ts));
+        packet->set_trusted_uid(static_cast<int32_t>(i));
+        continue;
+      }
+
+      auto* bundle = packet->set_ftrace_events();
+      if (i % 97 == 0)
+        continue;  // Missing cpu: counted as a tokenizer error.
+      bundle->set_cpu(i % 8);
+      for (uint32_t j = 0; j < 20; j++) {
+        auto* event = bundle->add_event();
+        if (i % 89 == 0 && j == 3)
+          continue;  // Missing timestamp: counted as a tokenizer error.
+        event->set_timestamp(static_cast<uint64_t>(ts + j * 7));
+        event->set_pid(i * 100 + j);
+      }
+      ts += 50;
+    }
+  }
+
+  // Loads the trace with |num_threads| threads, in chunks of |chunk_size|
+  // bytes, and returns the events in the order they were parsed.
+  std::vector<ParsedEvent> Load(uint32_t num_threads, size_t chunk_size) {
+    return Load(heap_buf_->StitchSlices(), num_threads, chunk_size);
+  }
+
+  std::vector<ParsedEvent> Load(const std::vector<uint8_t>& trace_bytes,
+                                uint32_t num_threads,
+                                size_t chunk_size) {
+    std::vector<ParsedEvent> events;
+    TraceProcessorContext context;
+    context.storage.reset(new TraceStorage());
+    context.sorter.reset(new TraceSorter(&context, 1000 /* window_size */));
+    context.proto_parser.reset(new RecordingTraceParser(&context, &events));
+
+    ProtoTraceTokenizer tokenizer(&context, num_threads);
+    for (size_t off = 0; off < trace_bytes.size(); off += chunk_size) {
+      size_t size = std::min(chunk_size, trace_bytes.size() - off);
+      std::unique_ptr<uint8_t[]> chunk(new uint8_t[size]);
+      memcpy(chunk.get(), trace_bytes.data() + off, size);
+      EXPECT_TRUE(
+          tokenizer.Parse(TraceBlob::FromHeapBuffer(std::move(chunk), size)));
+    }
+    tokenizer.NotifyEndOfFile();
+    context.sorter->ExtractEventsForced();
+
+    tokenizer_errors_ =
+        context.storage->stats()[stats::ftrace_bundle_tokenizer_errors].value;
+    compressed_packets_invalid_ =
+        context.storage->stats()[stats::compressed_packets_invalid].value;
+    return events;
+  }
+
+ protected:
+  std::unique_ptr<protozero::ScatteredHeapBuffer> heap_buf_;
+  std::unique_ptr<protozero::ScatteredStreamWriter> stream_writer_;
+  protos::pbzero::Trace trace_;
+  int64_t tokenizer_errors_ = 0;
+  int64_t compressed_packets_invalid_ = 0;
+};
+
+// Rewrites |trace_bytes| as TracePackets holding the LZ4 compressed packets,
+// like the service does when the trace config sets a compression_type.
+std::vector<uint8_t> CompressTrace(const std::vector<uint8_t>& trace_bytes,
+                                   size_t batch_size) {
+  protozero::ScatteredHeapBuffer heap_buf;
+  protozero::ScatteredStreamWriter writer(&heap_buf);
+  heap_buf.set_writer(&writer);
+  protos::pbzero::Trace trace;
+  trace.Reset(&writer);
+
+  auto add_batch = [&trace](const uint8_t* begin, size_t size) {
+    std::vector<uint8_t> compressed(base::Lz4CompressBound(size));
+    size_t compressed_size =
+        base::Lz4Compress(begin, size, compressed.data());
+    auto* packets = trace.add_packet()->set_compressed_packets();
+    packets->set_uncompressed_size(size);
+    packets->set_data(compressed.data(), compressed_size);
+  };
+
+  protos::pbzero::Trace::Decoder decoder(trace_bytes.data(),
+                                         trace_bytes.size());
+  const uint8_t* batch_begin = trace_bytes.data();
+  for (auto it = decoder.packet(); it; ++it) {
+    const uint8_t* packet_end = it->data() + it->size();
+    if (static_cast<size_t>(packet_end - batch_begin) >= batch_size) {
+      add_batch(batch_begin, static_cast<size_t>(packet_end - batch_begin));
+      batch_begin = packet_end;
+    }
+  }
+  const uint8_t* trace_end = trace_bytes.data() + trace_bytes.size();
+  if (batch_begin != trace_end)
+    add_batch(batch_begin, static_cast<size_t>(trace_end - batch_begin));
+  trace.Finalize();
+  return heap_buf.StitchSlices();
+}
+
+TEST_F(ProtoTraceTokenizerTest, MultiThreadedMatchesSingleThreaded) {
+  WriteTrace();
+  trace_.Finalize();
+
+  std::vector<ParsedEvent> expected = Load(1, 4096);
+  int64_t expected_errors = tokenizer_errors_;
+  ASSERT_THAT(expected, SizeIs((1800 - 18) * 20 - 20 + 200));
+  ASSERT_EQ(expected_errors, 18 + 20);
+
+  for (uint32_t num_threads : {2u, 4u, 8u}) {
+    for (size_t chunk_size : {size_t{4096}, size_t{1024 * 1024}}) {
+      ASSERT_THAT(Load(num_threads, chunk_size), ElementsAreArray(expected));
+      ASSERT_EQ(tokenizer_errors_, expected_errors);
+    }
+  }
+}
+
+TEST_F(ProtoTraceTokenizerTest, CompressedPackets) {
+  WriteTrace();
+  trace_.Finalize();
+  std::vector<uint8_t> trace_bytes = heap_buf_->StitchSlices();
+  std::vector<ParsedEvent> expected = Load(trace_bytes, 1, 4096);
+  int64_t expected_errors = tokenizer_errors_;
+
+  std::vector<uint8_t> compressed = CompressTrace(trace_bytes, 64 * 1024);
+  ASSERT_LT(compressed.size(), trace_bytes.size());
+  for (uint32_t num_threads : {1u, 4u}) {
+    ASSERT_THAT(Load(compressed, num_threads, 4096),
+                ElementsAreArray(expected));
+    ASSERT_EQ(tokenizer_errors_, expected_errors);
+    ASSERT_EQ(compressed_packets_invalid_, 0);
+  }
+}
+
+TEST_F(ProtoTraceTokenizerTest, InvalidCompressedPackets) {
+  auto* packets = trace_.add_packet()->set_compressed_packets();
+  packets->set_uncompressed_size(1000);
+  const uint8_t kNotLz4[] = {0xff, 0xff, 0xff};
+  packets->set_data(kNotLz4, sizeof(kNotLz4));
+
+  // Claims to decompress to more than LZ4 can produce from its data.
+  packets = trace_.add_packet()->set_compressed_packets();
+  packets->set_uncompressed_size(1024 * 1024 * 1024);
+  packets->set_data(kNotLz4, 1);
+
+  // Valid LZ4 data which isn't a sequence of TracePackets.
+  const char kGarbage[] = "\x0a\xff\xff\xff";
+  std::vector<uint8_t> data(base::Lz4CompressBound(sizeof(kGarbage)));
+  packets = trace_.add_packet()->set_compressed_packets();
+  packets->set_uncompressed_size(sizeof(kGarbage));
+  packets->set_data(data.data(),
+                    base::Lz4Compress(kGarbage, sizeof(kGarbage), data.data()));
+  trace_.Finalize();
+
+  ASSERT_THAT(Load(1, 4096), SizeIs(0));
+  ASSERT_EQ(compressed_packets_invalid_, 3);
+}
+
+TEST_F(ProtoTraceTokenizerTest, NestedCompressedPackets) {
+  WriteTrace();
+  trace_.Finalize();
+
+  // Compressed packets holding compressed packets are rejected rather than
+  // decompressed recursively.
+  std::vector<uint8_t> compressed =
+      CompressTrace(heap_buf_->StitchSlices(), 64 * 1024);
+  std::vector<uint8_t> nested = CompressTrace(compressed, compressed.size());
+  int64_t num_compressed = 0;
+  protos::pbzero::Trace::Decoder decoder(compressed.data(), compressed.size());
+  for (auto it = decoder.packet(); it; ++it)
+    num_compressed++;
+  ASSERT_GT(num_compressed, 1);
+  for (uint32_t num_threads : {1u, 4u}) {
+    ASSERT_THAT(Load(nested, num_threads, 4096), SizeIs(0));
+    ASSERT_EQ(compressed_packets_invalid_, num_compressed);
+    ASSERT_EQ(tokenizer_errors_, 0);
+  }
+}
+
+TEST_F(ProtoTraceTokenizerTest, DestroyWithoutEndOfFile) {
+  WriteTrace();
+  trace_.Finalize();
+
+  // Destroying the tokenizer with batches in flight must not hang or leak.
+  std::vector<uint8_t> trace_bytes = heap_buf_->StitchSlices();
+  std::vector<ParsedEvent> events;
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  context.sorter.reset(new TraceSorter(&context, 1000 /* window_size */));
+  context.proto_parser.reset(new RecordingTraceParser(&context, &events));
+  std::unique_ptr<uint8_t[]> chunk(new uint8_t[trace_bytes.size()]);
+  memcpy(chunk.get(), trace_bytes.data(), trace_bytes.size());
+  ProtoTraceTokenizer tokenizer(&context, 4);
+  ASSERT_TRUE(tokenizer.Parse(
+      TraceBlob::FromHeapBuffer(std::move(chunk), trace_bytes.size())));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACE_PROCESSOR_QUERY_PROFILE_H_
+#define SRC_TRACE_PROCESSOR_QUERY_PROFILE_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+
+namespace perfetto {
+namespace trace_processor {
+
+// The calls made by SQLite to the virtual tables while running a query and the
+// time spent in them. Only collected when Config::profile_queries is set.
+class QueryProfile {
+ public:
+  struct TableStats {
+    std::string table;
+
+    uint64_t filter_calls = 0;
+    uint64_t next_calls = 0;
+    uint64_t column_calls = 0;
+
+    // The rows considered by the table to answer the constraints of the
+    // filters, for the tables reporting them (e.g. the rows within the bounds
+    // of the sorted columns of the storage tables), and the rows returned to
+    // SQLite.
+    uint64_t rows_scanned = 0;
+    uint64_t rows_returned = 0;
+
+    // The time spent in the calls, including the queries they run on other
+    // tables (e.g. span_join reading its child tables).
+    int64_t filter_ns = 0;
+    int64_t next_ns = 0;
+    int64_t column_ns = 0;
+  };
+
+  // Returns the stats of |table|, which are valid as long as this profile.
+  TableStats* GetTableStats(const std::string& table) {
+    auto it = std::find_if(
+        tables_.begin(), tables_.end(),
+        [&table](const TableStats& stats) { return stats.table == table; });
+    if (it != tables_.end())
+      return &*it;
+    tables_.emplace_back();
+    tables_.back().table = table;
+    return &tables_.back();
+  }
+
+  const std::deque<TableStats>& tables() const { return tables_; }
+
+ private:
+  // A deque so that the stats don't move when more tables are added.
+  std::deque<TableStats> tables_;
+};
+
+// The state of the query being run on a SQLite connection, owned by the
+// connection and shared with the virtual tables registered on it. Only
+// accessed by the thread running the query.
+struct QueryContext {
+  // The profile of the query, if it is profiled.
+  QueryProfile* profile = nullptr;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_QUERY_PROFILE_H_
@@ -0,0 +1,172 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark/benchmark.h"
+
+#include "perfetto/base/logging.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/query_result_encoder.h"
+
+#include "perfetto/trace_processor/raw_query.pb.h"
+
+namespace {
+
+using perfetto::trace_processor::Config;
+using perfetto::trace_processor::SqlValue;
+using perfetto::trace_processor::TraceProcessor;
+
+// Reads a result of 1M rows of (int, int, double, string) with the different
+// APIs of the trace processor. The rows come from a plain SQLite table so that
+// the cost of producing them is small compared to the one of reading them.
+
+constexpr uint32_t kNumRows = 1000 * 1000;
+constexpr char kQuery[] = "SELECT ts, dur, value, name FROM rows";
+
+TraceProcessor* GetTraceProcessor() {
+  static TraceProcessor* tp = [] {
+    TraceProcessor* instance =
+        TraceProcessor::CreateInstance(Config()).release();
+    std::string sql =
+        "CREATE TABLE rows AS WITH RECURSIVE seq(x) AS (SELECT 0 UNION ALL "
+        "SELECT x + 1 FROM seq WHERE x < " +
+        std::to_string(kNumRows - 1) +
+        ") SELECT x * 1000 AS ts, x % 997 AS dur, x * 0.25 AS value, "
+        "'slice_' || (x % 100) AS name FROM seq";
+    auto it = instance->ExecuteQuery(perfetto::base::StringView(sql));
+    PERFETTO_CHECK(it.Next() == TraceProcessor::Iterator::kEOF);
+    return instance;
+  }();
+  return tp;
+}
+
+}  // namespace
+
+// Baseline: the cost of producing the rows, without reading them.
+static void BM_QueryResultStepOnly(benchmark::State& state) {
+  TraceProcessor* tp = GetTraceProcessor();
+  while (state.KeepRunning()) {
+    auto it = tp->ExecuteQuery(kQuery);
+    while (it.Next() == TraceProcessor::Iterator::kHasNext) {
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kNumRows);
+}
+BENCHMARK(BM_QueryResultStepOnly)->Unit(benchmark::kMillisecond);
+
+static void BM_QueryResultIteratorGet(benchmark::State& state) {
+  TraceProcessor* tp = GetTraceProcessor();
+  while (state.KeepRunning()) {
+    auto it = tp->ExecuteQuery(kQuery);
+    uint32_t col_count = it.ColumnCount();
+    int64_t checksum = 0;
+    while (it.Next() == TraceProcessor::Iterator::kHasNext) {
+      for (uint32_t col = 0; col < col_count; col++) {
+        SqlValue value = it.Get(col);
+        if (value.type == SqlValue::kLong)
+          checksum += value.long_value;
+        else if (value.type == SqlValue::kString)
+          checksum += value.string_value[0];
+      }
+    }
+    benchmark::DoNotOptimize(checksum);
+  }
+  state.SetItemsProcessed(state.iterations() * kNumRows);
+}
+BENCHMARK(BM_QueryResultIteratorGet)->Unit(benchmark::kMillisecond);
+
+static void BM_QueryResultNextBatch(benchmark::State& state) {
+  TraceProcessor* tp = GetTraceProcessor();
+  TraceProcessor::Iterator::Batch batch;
+  while (state.KeepRunning()) {
+    auto it = tp->ExecuteQuery(kQuery);
+    int64_t checksum = 0;
+    for (;;) {
+      auto res = it.NextBatch(static_cast<uint32_t>(state.range(0)), &batch);
+      for (const auto& col : batch.columns) {
+        for (uint32_t row = 0; row < batch.num_rows; row++) {
+          if (col.types[row] == SqlValue::kLong)
+            checksum += col.long_values[row];
+          else if (col.types[row] == SqlValue::kString)
+            checksum += batch.GetString(col, row)[0];
+        }
+      }
+      if (res != TraceProcessor::Iterator::kHasNext)
+        break;
+    }
+    benchmark::DoNotOptimize(checksum);
+  }
+  state.SetItemsProcessed(state.iterations() * kNumRows);
+}
+BENCHMARK(BM_QueryResultNextBatch)
+    ->Unit(benchmark::kMillisecond)
+    ->Arg(256)
+    ->Arg(4096);
+
+static void BM_QueryResultRawQueryProto(benchmark::State& state) {
+  TraceProcessor* tp = GetTraceProcessor();
+  perfetto::protos::RawQueryArgs args;
+  args.set_sql_query(kQuery);
+  while (state.KeepRunning()) {
+    std::string encoded;
+    tp->ExecuteQuery(args,
+                     [&encoded](const perfetto::protos::RawQueryResult& res) {
+                       res.SerializeToString(&encoded);
+                     });
+    benchmark::DoNotOptimize(encoded);
+  }
+  state.SetItemsProcessed(state.iterations() * kNumRows);
+}
+BENCHMARK(BM_QueryResultRawQueryProto)->Unit(benchmark::kMillisecond);
+
+static void BM_QueryResultEncode(benchmark::State& state) {
+  TraceProcessor* tp = GetTraceProcessor();
+  while (state.KeepRunning()) {
+    auto it = tp->ExecuteQuery(kQuery);
+    std::string encoded;
+    perfetto::trace_processor::EncodeQueryResult(&it, &encoded);
+    benchmark::DoNotOptimize(encoded);
+  }
+  state.SetItemsProcessed(state.iterations() * kNumRows);
+}
+BENCHMARK(BM_QueryResultEncode)->Unit(benchmark::kMillisecond);
+
+// Runs a short query looking up a single row, which is dominated by preparing
+// the statement when the looked up value is part of the SQL text rather than a
+// bound arg.
+static void BM_QueryLookupInlinedValue(benchmark::State& state) {
+  TraceProcessor* tp = GetTraceProcessor();
+  int64_t ts = 0;
+  while (state.KeepRunning()) {
+    std::string sql =
+        "SELECT dur FROM rows WHERE rowid = " + std::to_string(ts++ % kNumRows + 1);
+    auto it = tp->ExecuteQuery(perfetto::base::StringView(sql));
+    PERFETTO_CHECK(it.Next() == TraceProcessor::Iterator::kHasNext);
+    benchmark::DoNotOptimize(it.Get(0).long_value);
+  }
+}
+BENCHMARK(BM_QueryLookupInlinedValue);
+
+static void BM_QueryLookupBoundArg(benchmark::State& state) {
+  TraceProcessor* tp = GetTraceProcessor();
+  std::vector<SqlValue> args(1);
+  args[0].type = SqlValue::kLong;
+  int64_t ts = 0;
+  while (state.KeepRunning()) {
+    args[0].long_value = ts++ % kNumRows + 1;
+    auto it = tp->ExecuteQuery("SELECT dur FROM rows WHERE rowid = ?", args);
+    PERFETTO_CHECK(it.Next() == TraceProcessor::Iterator::kHasNext);
+    benchmark::DoNotOptimize(it.Get(0).long_value);
+  }
+}
+BENCHMARK(BM_QueryLookupBoundArg);
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/query_result_encoder.h"
+
+#include <string.h>
+
+#include "perfetto/base/logging.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+// The memcpy() of the integers and doubles below needs to be adjusted if we
+// want to support big endian CPUs.
+#error Unimplemented for big endian archs.
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+using Batch = TraceProcessor::Iterator::Batch;
+
+void AppendU32(std::string* out, uint32_t value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendBatch(const Batch& batch, std::string* out) {
+  AppendU32(out, batch.num_rows);
+  for (const Batch::Column& col : batch.columns) {
+    out->append(reinterpret_cast<const char*>(col.types.data()),
+                col.types.size());
+    out->resize((out->size() + 7) & ~size_t(7), '\0');
+
+    // Count the values first so that they can be written straight into |out|.
+    size_t num_values = 0;
+    for (uint8_t type : col.types)
+      num_values += type == SqlValue::kLong || type == SqlValue::kDouble;
+    size_t values_offset = out->size();
+    out->resize(values_offset + num_values * sizeof(int64_t));
+    char* values = &(*out)[values_offset];
+    for (uint32_t row = 0; row < batch.num_rows; row++) {
+      if (col.types[row] == SqlValue::kLong) {
+        memcpy(values, &col.long_values[row], sizeof(int64_t));
+        values += sizeof(int64_t);
+      } else if (col.types[row] == SqlValue::kDouble) {
+        memcpy(values, &col.double_values[row], sizeof(double));
+        values += sizeof(double);
+      }
+    }
+
+    for (uint32_t row = 0; row < batch.num_rows; row++) {
+      if (col.types[row] != SqlValue::kString)
+        continue;
+      const char* str = batch.GetString(col, row);
+      out->append(str, strlen(str) + 1);
+    }
+  }
+}
+
+}  // namespace
+
+void EncodeQueryResult(TraceProcessor::Iterator* it,
+                       std::string* out,
+                       uint32_t batch_rows) {
+  PERFETTO_DCHECK(out->size() % 8 == 0);
+  PERFETTO_DCHECK(batch_rows > 0);
+
+  uint32_t col_count = it->ColumnCount();
+  AppendU32(out, col_count);
+  for (uint32_t i = 0; i < col_count; i++) {
+    std::string name = it->GetColumnName(i);
+    out->append(name.c_str(), name.size() + 1);
+  }
+
+  Batch batch;
+  for (;;) {
+    auto res = it->NextBatch(batch_rows, &batch);
+    if (batch.num_rows > 0)
+      AppendBatch(batch, out);
+    if (res != TraceProcessor::Iterator::NextResult::kHasNext)
+      break;
+  }
+  AppendU32(out, 0);
+
+  base::Optional<std::string> error = it->GetLastError();
+  std::string msg = error.has_value() ? *error : "";
+  out->append(msg.c_str(), msg.size() + 1);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_QUERY_RESULT_ENCODER_H_
+#define SRC_TRACE_PROCESSOR_QUERY_RESULT_ENCODER_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "perfetto/trace_processor/trace_processor.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Encodes the rows of |it| in a compact binary format, which is much cheaper
+// to produce than a RawQueryResult proto and can be read by the UI without a
+// proto decoder. All the integers are little endian.
+//
+// uint32      number of columns.
+// char[]      the name of each column, null terminated.
+// batch*      the rows of the result, |batch_rows| at a time:
+//   uint32    number of rows in the batch, 0 for the last (empty) batch.
+//   for each column:
+//     uint8[] the SqlValue::Type of each row.
+//     pad     zeros up to a multiple of 8 bytes from the start of |out|, so
+//             that the values can be read as a typed array.
+//     8-byte  the int64 or double value of each row with such a type, in row
+//             order.
+//     char[]  the value of each string row, null terminated, in row order.
+// char[]      the error, null terminated, empty if the query succeeded.
+//
+// The result is appended to |out|, whose size should be a multiple of 8 bytes.
+void EncodeQueryResult(TraceProcessor::Iterator* it,
+                       std::string* out,
+                       uint32_t batch_rows = 4096);
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_QUERY_RESULT_ENCODER_H_
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/query_result_encoder.h"
+
+#include <string.h>
+
+#include "src/trace_processor/trace_processor_impl.h"
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Reads back the format written by EncodeQueryResult().
+class Decoder {
+ public:
+  explicit Decoder(const std::string& buf) : buf_(buf) {}
+
+  uint32_t ReadU32() {
+    uint32_t value;
+    memcpy(&value, &buf_[pos_], sizeof(value));
+    pos_ += sizeof(value);
+    return value;
+  }
+
+  int64_t ReadI64() {
+    PERFETTO_CHECK(pos_ % 8 == 0);
+    int64_t value;
+    memcpy(&value, &buf_[pos_], sizeof(value));
+    pos_ += sizeof(value);
+    return value;
+  }
+
+  double ReadDouble() {
+    PERFETTO_CHECK(pos_ % 8 == 0);
+    double value;
+    memcpy(&value, &buf_[pos_], sizeof(value));
+    pos_ += sizeof(value);
+    return value;
+  }
+
+  std::string ReadString() {
+    std::string str(&buf_[pos_]);
+    pos_ += str.size() + 1;
+    return str;
+  }
+
+  std::vector<uint8_t> ReadTypes(uint32_t num_rows) {
+    const uint8_t* start = reinterpret_cast<const uint8_t*>(&buf_[pos_]);
+    std::vector<uint8_t> types(start, start + num_rows);
+    pos_ = (pos_ + num_rows + 7) & ~size_t(7);
+    return types;
+  }
+
+  bool done() const { return pos_ == buf_.size(); }
+
+ private:
+  const std::string& buf_;
+  size_t pos_ = 0;
+};
+
+TEST(QueryResultEncoderTest, EncodeRows) {
+  TraceProcessorImpl tp{Config()};
+  auto it = tp.ExecuteQuery(
+      "WITH RECURSIVE seq(x) AS (SELECT 0 UNION ALL SELECT x + 1 FROM seq "
+      "WHERE x < 4) SELECT x, CASE WHEN x % 2 THEN x * 0.5 ELSE 'str' || x "
+      "END AS mixed FROM seq");
+  std::string buf;
+  EncodeQueryResult(&it, &buf, 3);
+
+  Decoder decoder(buf);
+  ASSERT_EQ(decoder.ReadU32(), 2u);
+  ASSERT_EQ(decoder.ReadString(), "x");
+  ASSERT_EQ(decoder.ReadString(), "mixed");
+
+  // The 5 rows are split in batches of 3 and 2 rows.
+  int64_t x = 0;
+  for (uint32_t expected_rows : {3u, 2u}) {
+    uint32_t num_rows = decoder.ReadU32();
+    ASSERT_EQ(num_rows, expected_rows);
+
+    auto types = decoder.ReadTypes(num_rows);
+    for (uint32_t row = 0; row < num_rows; row++) {
+      ASSERT_EQ(types[row], SqlValue::kLong);
+      ASSERT_EQ(decoder.ReadI64(), x + row);
+    }
+
+    // The doubles of the second column come first, then the strings.
+    types = decoder.ReadTypes(num_rows);
+    for (uint32_t row = 0; row < num_rows; row++) {
+      if ((x + row) % 2)
+        ASSERT_EQ(decoder.ReadDouble(), (x + row) * 0.5);
+    }
+    for (uint32_t row = 0; row < num_rows; row++) {
+      if ((x + row) % 2) {
+        ASSERT_EQ(types[row], SqlValue::kDouble);
+      } else {
+        ASSERT_EQ(types[row], SqlValue::kString);
+        ASSERT_EQ(decoder.ReadString(), "str" + std::to_string(x + row));
+      }
+    }
+    x += num_rows;
+  }
+  ASSERT_EQ(decoder.ReadU32(), 0u);
+  ASSERT_EQ(decoder.ReadString(), "");
+  ASSERT_TRUE(decoder.done());
+}
+
+TEST(QueryResultEncoderTest, EncodeError) {
+  TraceProcessorImpl tp{Config()};
+  auto it = tp.ExecuteQuery("SELECT * FROM does_not_exist");
+  std::string buf;
+  EncodeQueryResult(&it, &buf);
+
+  Decoder decoder(buf);
+  ASSERT_EQ(decoder.ReadU32(), 0u);
+  ASSERT_EQ(decoder.ReadU32(), 0u);
+  ASSERT_NE(decoder.ReadString(), "");
+  ASSERT_TRUE(decoder.done());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
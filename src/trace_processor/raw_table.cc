@@ -41,8 +41,10 @@ RawTable::RawTable(sqlite3* db, const TraceStorage* storage)
                           nullptr);
 }
 
-void RawTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<RawTable>(db, storage, "raw");
+void RawTable::RegisterTable(sqlite3* db,
+                             const TraceStorage* storage,
+                             const QueryContext* context) {
+  Table::Register<RawTable>(db, storage, context, "raw");
 }
 
 StorageSchema RawTable::CreateStorageSchema() {
@@ -50,7 +52,7 @@ StorageSchema RawTable::CreateStorageSchema() {
   return StorageSchema::Builder()
       .AddColumn<IdColumn>("id", TableId::kRawEvents)
       .AddOrderedNumericColumn("ts", &raw.timestamps())
-      .AddStringColumn("name", &raw.name_ids(), &storage_->string_pool())
+      .AddStringColumn("name", &raw.name_ids(), storage_)
       .AddNumericColumn("cpu", &raw.cpus())
       .AddNumericColumn("utid", &raw.utids())
       .AddNumericColumn("arg_set_id", &raw.arg_set_ids())
@@ -64,17 +66,13 @@ uint32_t RawTable::RowCount() {
 int RawTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
   info->estimated_cost = RowCount();
 
-  // Only the string columns are handled by SQLite
   info->order_by_consumed = true;
-  size_t name_index = schema().ColumnIndexFromName("name");
-  for (size_t i = 0; i < qc.constraints().size(); i++) {
-    info->omit[i] = qc.constraints()[i].iColumn != static_cast<int>(name_index);
-  }
+  SetOmittedConstraints(qc, info);
 
   return SQLITE_OK;
 }
 
-void RawTable::FormatSystraceArgs(const std::string& event_name,
+void RawTable::FormatSystraceArgs(NullTermStringView event_name,
                                   ArgSetId arg_set_id,
                                   base::StringWriter* writer) {
   const auto& set_ids = storage_->args().set_ids();
@@ -111,7 +109,7 @@ void RawTable::FormatSystraceArgs(const std::string& event_name,
     const auto& value = args.arg_values()[arg_row];
 
     writer->AppendChar(' ');
-    writer->AppendString(key.c_str(), key.length());
+    writer->AppendString(key.c_str(), key.size());
     writer->AppendChar('=');
     value_fn(value);
   };
@@ -198,7 +196,7 @@ void RawTable::FormatSystraceArgs(const std::string& event_name,
       const auto& str = storage_->GetString(value.string_value);
 
       // If the last character is a newline in a print, just drop it.
-      auto chars_to_print = !str.empty() && str[str.size() - 1] == '\n'
+      auto chars_to_print = !str.empty() && str.data()[str.size() - 1] == '\n'
                                 ? str.size() - 1
                                 : str.size();
       writer->AppendString(str.c_str(), chars_to_print);
@@ -25,7 +25,9 @@ namespace trace_processor {
 
 class RawTable : public StorageTable {
  public:
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   RawTable(sqlite3*, const TraceStorage*);
 
@@ -35,7 +37,7 @@ class RawTable : public StorageTable {
   int BestIndex(const QueryConstraints&, BestIndexInfo*) override;
 
  private:
-  void FormatSystraceArgs(const std::string& event_name,
+  void FormatSystraceArgs(NullTermStringView event_name,
                           ArgSetId arg_set_id,
                           base::StringWriter* writer);
   void ToSystrace(sqlite3_context* ctx, int argc, sqlite3_value** argv);
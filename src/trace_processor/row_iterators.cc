@@ -25,19 +25,17 @@ namespace trace_processor {
 
 namespace {
 
-template <typename Iterator>
-uint32_t FindNextOffset(Iterator begin, Iterator end, uint32_t offset) {
-  auto prev_it = begin + static_cast<ptrdiff_t>(offset);
-  auto current_it = std::find(prev_it, end, true);
-  return static_cast<uint32_t>(std::distance(begin, current_it));
-}
-
-uint32_t FindNextOffset(const std::vector<bool>& filter,
-                        uint32_t offset,
-                        bool desc) {
-  if (desc)
-    return FindNextOffset(filter.rbegin(), filter.rend(), offset);
-  return FindNextOffset(filter.begin(), filter.end(), offset);
+// Returns the offset of the next row to return at or after |offset|. In desc
+// mode, offsets are counted from the end of |filter|.
+uint32_t FindNextOffset(const BitVector& filter, uint32_t offset, bool desc) {
+  uint32_t size = filter.size();
+  if (offset >= size)
+    return size;
+  if (!desc)
+    return filter.NextSetBit(offset);
+
+  uint32_t idx = filter.PrevSetBit(size - offset - 1);
+  return idx == size ? size : size - idx - 1;
 }
 
 }  // namespace
@@ -51,7 +49,7 @@ RangeRowIterator::RangeRowIterator(uint32_t start_row,
 
 RangeRowIterator::RangeRowIterator(uint32_t start_row,
                                    bool desc,
-                                   std::vector<bool> row_filter)
+                                   BitVector row_filter)
     : start_row_(start_row),
       end_row_(start_row_ + static_cast<uint32_t>(row_filter.size())),
       desc_(desc),
@@ -80,8 +78,7 @@ uint32_t RangeRowIterator::RowCount() const {
   if (row_filter_.empty()) {
     return end_row_ - start_row_;
   }
-  auto count = std::count(row_filter_.begin(), row_filter_.end(), true);
-  return static_cast<uint32_t>(count);
+  return row_filter_.GetNumBitsSet();
 }
 
 VectorRowIterator::VectorRowIterator(std::vector<uint32_t> row_indices)
@@ -20,6 +20,8 @@
 #include <stdint.h>
 #include <vector>
 
+#include "src/trace_processor/bit_vector.h"
+
 namespace perfetto {
 namespace trace_processor {
 
@@ -39,7 +41,7 @@ class RowIterator {
 class RangeRowIterator : public RowIterator {
  public:
   RangeRowIterator(uint32_t start_row, uint32_t end_row, bool desc);
-  RangeRowIterator(uint32_t start_row, bool desc, std::vector<bool> row_filter);
+  RangeRowIterator(uint32_t start_row, bool desc, BitVector row_filter);
 
   void NextRow() override;
   bool IsEnd() override;
@@ -51,7 +53,7 @@ class RangeRowIterator : public RowIterator {
   uint32_t start_row_ = 0;
   uint32_t end_row_ = 0;
   bool desc_ = false;
-  std::vector<bool> row_filter_;
+  BitVector row_filter_;
 
   // In non-desc mode, this is an offset from start_row_ while in desc mode,
   // this is an offset from end_row_.
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/sched_overview_table.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "src/trace_processor/sqlite_utils.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+using namespace sqlite_utils;
+}  // namespace
+
+SchedOverviewTable::SchedOverviewTable(sqlite3*, const TraceStorage* storage)
+    : storage_(storage) {}
+
+void SchedOverviewTable::RegisterTable(sqlite3* db,
+                                       const TraceStorage* storage,
+                                       const QueryContext* context) {
+  Table::Register<SchedOverviewTable>(db, storage, context, "sched_overview");
+}
+
+base::Optional<Table::Schema> SchedOverviewTable::Init(int,
+                                                       const char* const*) {
+  const bool kHidden = true;
+  return Schema(
+      {
+          // These are the operator columns:
+          Table::Column(Column::kTsStart, "ts_start", ColumnType::kLong,
+                        kHidden),
+          Table::Column(Column::kTsEnd, "ts_end", ColumnType::kLong, kHidden),
+          Table::Column(Column::kBucketSize, "bucket_size", ColumnType::kLong,
+                        kHidden),
+          // These are the ouput columns:
+          Table::Column(Column::kCpu, "cpu", ColumnType::kUint),
+          Table::Column(Column::kTs, "ts", ColumnType::kLong),
+          Table::Column(Column::kDur, "dur", ColumnType::kLong),
+          Table::Column(Column::kBusyDur, "busy_dur", ColumnType::kLong),
+          Table::Column(Column::kUtilization, "utilization",
+                        ColumnType::kDouble),
+      },
+      {Column::kCpu, Column::kTs});
+}
+
+std::unique_ptr<Table::Cursor> SchedOverviewTable::CreateCursor(
+    const QueryConstraints& qc,
+    sqlite3_value** argv) {
+  base::Optional<int64_t> args[3];
+  base::Optional<uint32_t> cpu;
+  for (size_t i = 0; i < qc.constraints().size(); i++) {
+    const auto& cs = qc.constraints()[i];
+    if (!IsOpEq(cs.op))
+      continue;
+    if (cs.iColumn <= Column::kBucketSize)
+      args[cs.iColumn] = sqlite3_value_int64(argv[i]);
+    else if (cs.iColumn == Column::kCpu)
+      cpu = static_cast<uint32_t>(sqlite3_value_int64(argv[i]));
+  }
+  for (const auto& arg : args) {
+    if (!arg.has_value()) {
+      SetErrorMessage(sqlite3_mprintf(
+          "sched_overview requires equality constraints on ts_start, ts_end "
+          "and bucket_size"));
+      return nullptr;
+    }
+  }
+  if (*args[Column::kBucketSize] <= 0) {
+    SetErrorMessage(
+        sqlite3_mprintf("sched_overview requires a positive bucket_size"));
+    return nullptr;
+  }
+  return std::unique_ptr<Table::Cursor>(
+      new Cursor(GetIndex(), *args[Column::kTsStart], *args[Column::kTsEnd],
+                 *args[Column::kBucketSize], cpu));
+}
+
+int SchedOverviewTable::BestIndex(const QueryConstraints& qc,
+                                  BestIndexInfo* info) {
+  uint32_t num_args = 0;
+  bool has_cpu = false;
+  for (size_t i = 0; i < qc.constraints().size(); i++) {
+    const auto& cs = qc.constraints()[i];
+    if (!IsOpEq(cs.op))
+      continue;
+    if (cs.iColumn <= Column::kBucketSize) {
+      num_args++;
+      info->omit[i] = true;
+    } else if (cs.iColumn == Column::kCpu) {
+      has_cpu = true;
+      info->omit[i] = true;
+    }
+  }
+
+  // Make the plans which don't constrain all the arguments, and so fail in
+  // CreateCursor(), as unattractive as possible.
+  if (num_args == 3)
+    info->estimated_cost = has_cpu ? 100 : 1000;
+  else
+    info->estimated_cost = std::numeric_limits<uint32_t>::max();
+
+  // Buckets are returned by ascending cpu and ts.
+  const auto& order_by = qc.order_by();
+  info->order_by_consumed =
+      (order_by.size() == 1 && order_by[0].iColumn == Column::kCpu &&
+       !order_by[0].desc) ||
+      (order_by.size() == 2 && order_by[0].iColumn == Column::kCpu &&
+       !order_by[0].desc && order_by[1].iColumn == Column::kTs &&
+       !order_by[1].desc);
+  return SQLITE_OK;
+}
+
+std::shared_ptr<const SchedOverviewTable::Index>
+SchedOverviewTable::GetIndex() {
+  // The durations of the slices are updated in place when they end, so the
+  // index is only up to date if no slice was added or updated since.
+  const auto& slices = storage_->slices();
+  auto slice_count = static_cast<uint32_t>(slices.slice_count());
+  uint64_t mutation_count = slices.mutation_count();
+  if (index_ && indexed_slice_count_ == slice_count &&
+      indexed_mutation_count_ == mutation_count) {
+    return index_;
+  }
+
+  std::unique_ptr<Index> index(new Index());
+  for (uint32_t i = 0; i < slice_count; i++) {
+    int64_t dur = slices.durations()[i];
+    if (slices.utids()[i] == 0 || dur <= 0)
+      continue;
+    uint32_t cpu = slices.cpus()[i];
+    if (cpu >= index->size())
+      index->resize(cpu + 1);
+    CpuSlices* cpu_slices = &(*index)[cpu];
+    int64_t cumulative_dur = cpu_slices->cumulative_durs.empty()
+                                 ? 0
+                                 : cpu_slices->cumulative_durs.back() +
+                                       (cpu_slices->ends.back() -
+                                        cpu_slices->starts.back());
+    int64_t start = slices.start_ns()[i];
+    cpu_slices->starts.emplace_back(start);
+    cpu_slices->ends.emplace_back(start + dur);
+    cpu_slices->cumulative_durs.emplace_back(cumulative_dur);
+  }
+  index_ = std::move(index);
+  indexed_slice_count_ = slice_count;
+  indexed_mutation_count_ = mutation_count;
+  return index_;
+}
+
+int64_t SchedOverviewTable::CpuSlices::BusyTimeBefore(int64_t ts) const {
+  // The slices of a cpu don't overlap so only the last slice starting before
+  // |ts| can end after it.
+  auto it = std::lower_bound(starts.begin(), starts.end(), ts);
+  if (it == starts.begin())
+    return 0;
+  size_t last = static_cast<size_t>(it - starts.begin()) - 1;
+  return cumulative_durs[last] + std::min(ends[last], ts) - starts[last];
+}
+
+SchedOverviewTable::Cursor::Cursor(std::shared_ptr<const Index> index,
+                                   int64_t ts_start,
+                                   int64_t ts_end,
+                                   int64_t bucket_size,
+                                   base::Optional<uint32_t> cpu)
+    : index_(std::move(index)),
+      ts_start_(ts_start),
+      ts_end_(ts_end),
+      bucket_size_(bucket_size),
+      end_cpu_(cpu ? std::min(*cpu + 1, static_cast<uint32_t>(index_->size()))
+                   : static_cast<uint32_t>(index_->size())) {
+  cpu_ = cpu ? *cpu : 0;
+  if (cpu_ < end_cpu_ && !FindBusyBucket(0))
+    Next();
+}
+
+bool SchedOverviewTable::Cursor::FindBusyBucket(int64_t bucket) {
+  const CpuSlices& slices = (*index_)[cpu_];
+  while (true) {
+    int64_t start = ts_start_ + bucket * bucket_size_;
+    if (start >= ts_end_)
+      return false;
+
+    // Skip the buckets before the first slice ending after |start|.
+    auto it = std::upper_bound(slices.ends.begin(), slices.ends.end(), start);
+    if (it == slices.ends.end())
+      return false;
+    int64_t slice_start = slices.starts[static_cast<size_t>(
+        it - slices.ends.begin())];
+    if (slice_start >= ts_end_)
+      return false;
+    if (slice_start > start)
+      bucket = (slice_start - ts_start_) / bucket_size_;
+
+    start = ts_start_ + bucket * bucket_size_;
+    int64_t end = std::min(start + bucket_size_, ts_end_);
+    busy_dur_ = slices.BusyTimeBefore(end) - slices.BusyTimeBefore(start);
+    if (busy_dur_ > 0) {
+      bucket_ = bucket;
+      return true;
+    }
+    bucket++;
+  }
+}
+
+int SchedOverviewTable::Cursor::Next() {
+  if (cpu_ < end_cpu_ && FindBusyBucket(bucket_ + 1))
+    return SQLITE_OK;
+  for (cpu_++; cpu_ < end_cpu_; cpu_++) {
+    if (FindBusyBucket(0))
+      break;
+  }
+  return SQLITE_OK;
+}
+
+int SchedOverviewTable::Cursor::Eof() {
+  return cpu_ >= end_cpu_;
+}
+
+int SchedOverviewTable::Cursor::Column(sqlite3_context* context, int N) {
+  int64_t ts = ts_start_ + bucket_ * bucket_size_;
+  int64_t dur = std::min(ts + bucket_size_, ts_end_) - ts;
+  switch (N) {
+    case Column::kTsStart:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(ts_start_));
+      break;
+    case Column::kTsEnd:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(ts_end_));
+      break;
+    case Column::kBucketSize:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(bucket_size_));
+      break;
+    case Column::kCpu:
+      sqlite3_result_int64(context, cpu_);
+      break;
+    case Column::kTs:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(ts));
+      break;
+    case Column::kDur:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(dur));
+      break;
+    case Column::kBusyDur:
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(busy_dur_));
+      break;
+    case Column::kUtilization:
+      sqlite3_result_double(context, static_cast<double>(busy_dur_) / dur);
+      break;
+    default:
+      PERFETTO_FATAL("Unknown column %d", N);
+      break;
+  }
+  return SQLITE_OK;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
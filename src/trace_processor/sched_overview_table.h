@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACE_PROCESSOR_SCHED_OVERVIEW_TABLE_H_
+#define SRC_TRACE_PROCESSOR_SCHED_OVERVIEW_TABLE_H_
+
+#include <memory>
+#include <vector>
+
+#include "src/trace_processor/table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceStorage;
+
+// Computes the utilization of the cpus over a window of time, for the
+// overview of the cpu tracks: splits [ts_start, ts_end) in buckets of
+// bucket_size ns and returns, for each cpu and bucket, the time spent running
+// a thread other than the idle one. Buckets where the cpu is idle are
+// skipped. Requires equality constraints on the (hidden) arguments, and can
+// be restricted to some cpus:
+//   SELECT * FROM sched_overview(ts_start, ts_end, bucket_size)
+//   WHERE cpu IN (0, 1)
+// The busy time comes from an index of the cumulative busy time of each cpu,
+// built in a single pass over the sched slices and reused by all the queries
+// (whatever their bucket size) until slices are added or updated. Each
+// bucket then costs a binary search rather than a scan of its slices.
+class SchedOverviewTable : public Table {
+ public:
+  enum Column {
+    kTsStart = 0,
+    kTsEnd = 1,
+    kBucketSize = 2,
+    kCpu = 3,
+    kTs = 4,
+    kDur = 5,
+    kBusyDur = 6,
+    kUtilization = 7,
+  };
+
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
+
+  SchedOverviewTable(sqlite3*, const TraceStorage*);
+
+  // Table implementation.
+  base::Optional<Table::Schema> Init(int, const char* const*) override;
+  std::unique_ptr<Table::Cursor> CreateCursor(const QueryConstraints&,
+                                              sqlite3_value**) override;
+  int BestIndex(const QueryConstraints&, BestIndexInfo*) override;
+
+ private:
+  // The non idle sched slices of a cpu, by increasing ts.
+  struct CpuSlices {
+    // Returns the time spent in the slices before |ts|.
+    int64_t BusyTimeBefore(int64_t ts) const;
+
+    std::vector<int64_t> starts;
+    std::vector<int64_t> ends;
+
+    // The total duration of the slices before each slice.
+    std::vector<int64_t> cumulative_durs;
+  };
+
+  // Indexed by cpu.
+  using Index = std::vector<CpuSlices>;
+
+  class Cursor : public Table::Cursor {
+   public:
+    Cursor(std::shared_ptr<const Index>,
+           int64_t ts_start,
+           int64_t ts_end,
+           int64_t bucket_size,
+           base::Optional<uint32_t> cpu);
+
+    // Implementation of Table::Cursor.
+    int Next() override;
+    int Eof() override;
+    int Column(sqlite3_context*, int N) override;
+
+   private:
+    // Moves to the first bucket, starting at or after |bucket|, where the
+    // current cpu is busy. Returns false if there is none.
+    bool FindBusyBucket(int64_t bucket);
+
+    const std::shared_ptr<const Index> index_;
+    const int64_t ts_start_;
+    const int64_t ts_end_;
+    const int64_t bucket_size_;
+    const uint32_t end_cpu_;
+
+    // The current cpu and bucket.
+    uint32_t cpu_ = 0;
+    int64_t bucket_ = 0;
+    int64_t busy_dur_ = 0;
+  };
+
+  // Returns the index for the current slices of the storage.
+  std::shared_ptr<const Index> GetIndex();
+
+  const TraceStorage* const storage_;
+  std::shared_ptr<const Index> index_;
+  uint32_t indexed_slice_count_ = 0;
+  uint64_t indexed_mutation_count_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SCHED_OVERVIEW_TABLE_H_
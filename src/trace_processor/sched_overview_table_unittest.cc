@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/sched_overview_table.h"
+
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/trace_storage.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+class SchedOverviewTableTest : public ::testing::Test {
+ public:
+  SchedOverviewTableTest() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    SchedOverviewTable::RegisterTable(db_.get(), &storage_, nullptr);
+  }
+
+  void AddSlice(uint32_t cpu, int64_t ts, int64_t dur, UniqueTid utid) {
+    storage_.mutable_slices()->AddSlice(cpu, ts, dur, utid,
+                                        ftrace_utils::TaskState(), 0);
+  }
+
+  // Runs |sql| and returns the integer values of all the cells, row by row.
+  std::vector<int64_t> QueryInts(const std::string& sql) {
+    sqlite3_stmt* stmt;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &stmt, nullptr) ==
+                   SQLITE_OK);
+    ScopedStmt scoped_stmt(stmt);
+
+    std::vector<int64_t> values;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      for (int i = 0; i < sqlite3_column_count(stmt); i++)
+        values.emplace_back(sqlite3_column_int64(stmt, i));
+    }
+    return values;
+  }
+
+ protected:
+  TraceStorage storage_;
+  ScopedDb db_;
+};
+
+TEST_F(SchedOverviewTableTest, BusyTime) {
+  AddSlice(0, 5, 10, 1);
+  AddSlice(1, 8, 4, 2);
+  AddSlice(0, 15, 10, 0);  // Idle.
+  AddSlice(0, 25, 30, 3);
+  AddSlice(1, 40, 5, 2);
+
+  // Buckets of 10ns in [0, 45): the last one is clipped, the empty ones are
+  // skipped.
+  EXPECT_THAT(QueryInts("SELECT cpu, ts, dur, busy_dur, utilization * 100 "
+                        "FROM sched_overview(0, 45, 10)"),
+              ElementsAre(0, 0, 10, 5, 50,    //
+                          0, 10, 10, 5, 50,   //
+                          0, 20, 10, 5, 50,   //
+                          0, 30, 10, 10, 100, //
+                          0, 40, 5, 5, 100,   //
+                          1, 0, 10, 2, 20,    //
+                          1, 10, 10, 2, 20,   //
+                          1, 40, 5, 5, 100));
+
+  EXPECT_THAT(QueryInts("SELECT cpu, ts, busy_dur FROM "
+                        "sched_overview(0, 100, 50) WHERE cpu IN (1, 7)"),
+              ElementsAre(1, 0, 9));
+
+  // The index is rebuilt when slices are added.
+  AddSlice(1, 60, 10, 2);
+  EXPECT_THAT(QueryInts("SELECT cpu, ts, busy_dur FROM "
+                        "sched_overview(0, 100, 50) WHERE cpu = 1"),
+              ElementsAre(1, 0, 9, 1, 50, 10));
+
+  // And when the duration of a slice is updated in place, as done when the
+  // next sched_switch on its cpu is parsed.
+  storage_.mutable_slices()->set_duration(5, 20);
+  EXPECT_THAT(QueryInts("SELECT cpu, ts, busy_dur FROM "
+                        "sched_overview(0, 100, 50) WHERE cpu = 1"),
+              ElementsAre(1, 0, 9, 1, 50, 20));
+}
+
+TEST_F(SchedOverviewTableTest, SkipsIdleBuckets) {
+  AddSlice(0, 0, 10, 1);
+  AddSlice(0, 1000000000, 10, 1);
+  EXPECT_THAT(QueryInts("SELECT ts, busy_dur FROM "
+                        "sched_overview(0, 2000000000, 4)"),
+              ElementsAre(0, 4, 4, 4, 8, 2,  //
+                          1000000000, 4, 1000000004, 4, 1000000008, 2));
+  EXPECT_THAT(QueryInts("SELECT ts FROM sched_overview(20, 100, 10)"),
+              IsEmpty());
+}
+
+TEST_F(SchedOverviewTableTest, MissingArguments) {
+  sqlite3_stmt* stmt;
+  ASSERT_EQ(sqlite3_prepare_v2(*db_,
+                               "SELECT * FROM sched_overview "
+                               "WHERE ts_start = 0 AND ts_end = 10",
+                               -1, &stmt, nullptr),
+            SQLITE_OK);
+  ScopedStmt scoped_stmt(stmt);
+  ASSERT_EQ(sqlite3_step(stmt), SQLITE_ERROR);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -22,8 +22,10 @@ namespace trace_processor {
 SchedSliceTable::SchedSliceTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
-void SchedSliceTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<SchedSliceTable>(db, storage, "sched");
+void SchedSliceTable::RegisterTable(sqlite3* db,
+                                    const TraceStorage* storage,
+                                    const QueryContext* context) {
+  Table::Register<SchedSliceTable>(db, storage, context, "sched");
 }
 
 StorageSchema SchedSliceTable::CreateStorageSchema() {
@@ -33,10 +35,12 @@ StorageSchema SchedSliceTable::CreateStorageSchema() {
       .AddNumericColumn("cpu", &slices.cpus())
       .AddNumericColumn("dur", &slices.durations())
       .AddColumn<TsEndColumn>("ts_end", &slices.start_ns(), &slices.durations())
-      .AddNumericColumn("utid", &slices.utids(), &slices.rows_for_utids())
+      .AddNumericColumn("utid", &slices.utids())
       .AddColumn<EndStateColumn>("end_state", &slices.end_state())
       .AddNumericColumn("priority", &slices.priorities())
       .AddColumn<IdColumn>("row_id", TableId::kSched)
+      .AddIndex({"utid", "ts"})
+      .AddIndex({"cpu", "ts"})
       .Build({"cpu", "ts"});
 }
 
@@ -70,20 +74,11 @@ uint32_t SchedSliceTable::EstimateQueryCost(const QueryConstraints& qc) {
     return 10;
   }
 
-  size_t utid_idx = schema().ColumnIndexFromName("utid");
-  auto has_utid_eq_cs = [utid_idx](const QueryConstraints::Constraint& c) {
-    return c.iColumn == static_cast<int>(utid_idx) &&
-           sqlite_utils::IsOpEq(c.op);
-  };
-  bool has_utid_eq = std::any_of(cs.begin(), cs.end(), has_utid_eq_cs);
-  if (has_utid_eq) {
-    // The other column which is often joined on is utid. Sometimes, doing
-    // nested subqueries on the thread table is faster but with some queries,
-    // it's actually better to do subqueries on this table. Estimate the cost
-    // of filtering on utid equality constraint by dividing the number of slices
-    // by the number of threads.
-    return RowCount() / storage_->thread_count();
-  }
+  // Per-thread and per-cpu queries can be answered using the secondary indexes
+  // on (utid, ts) and (cpu, ts).
+  auto indexed_row_count = EstimateIndexedRowCount(qc);
+  if (indexed_row_count)
+    return *indexed_row_count;
 
   // If we get to this point, we do not have any special filter logic so
   // simply return the number of rows.
@@ -92,8 +87,8 @@ uint32_t SchedSliceTable::EstimateQueryCost(const QueryConstraints& qc) {
 
 SchedSliceTable::EndStateColumn::EndStateColumn(
     std::string col_name,
-    const std::deque<ftrace_utils::TaskState>* deque)
-    : StorageColumn(col_name, false), deque_(deque) {
+    const ChunkedVector<ftrace_utils::TaskState>* vector)
+    : StorageColumn(col_name, false), vector_(vector) {
   for (uint16_t i = 0; i < state_strings_.size(); i++) {
     state_strings_[i] = ftrace_utils::TaskState(i).ToString();
   }
@@ -102,7 +97,7 @@ SchedSliceTable::EndStateColumn::~EndStateColumn() = default;
 
 void SchedSliceTable::EndStateColumn::ReportResult(sqlite3_context* ctx,
                                                    uint32_t row) const {
-  const auto& state = (*deque_)[row];
+  const auto& state = (*vector_)[row];
   if (state.is_valid()) {
     PERFETTO_CHECK(state.raw_state() < state_strings_.size());
     sqlite3_result_text(ctx, state_strings_[state.raw_state()].data(), -1,
@@ -120,7 +115,7 @@ void SchedSliceTable::EndStateColumn::Filter(int op,
     case SQLITE_INDEX_CONSTRAINT_ISNOTNULL: {
       bool non_nulls = op == SQLITE_INDEX_CONSTRAINT_ISNOTNULL;
       index->FilterRows([this, non_nulls](uint32_t row) {
-        const auto& state = (*deque_)[row];
+        const auto& state = (*vector_)[row];
         return state.is_valid() == non_nulls;
       });
       break;
@@ -155,17 +150,17 @@ void SchedSliceTable::EndStateColumn::FilterOnState(
   uint16_t raw_state = compare.raw_state();
   if (op == SQLITE_INDEX_CONSTRAINT_EQ) {
     index->FilterRows([this, raw_state](uint32_t row) {
-      const auto& state = (*deque_)[row];
+      const auto& state = (*vector_)[row];
       return state.is_valid() && state.raw_state() == raw_state;
     });
   } else if (op == SQLITE_INDEX_CONSTRAINT_NE) {
     index->FilterRows([this, raw_state](uint32_t row) {
-      const auto& state = (*deque_)[row];
+      const auto& state = (*vector_)[row];
       return state.is_valid() && state.raw_state() != raw_state;
     });
   } else if (op == SQLITE_INDEX_CONSTRAINT_MATCH) {
     index->FilterRows([this, compare](uint32_t row) {
-      const auto& state = (*deque_)[row];
+      const auto& state = (*vector_)[row];
       if (!state.is_valid())
         return false;
       return (state.raw_state() & compare.raw_state()) == compare.raw_state();
@@ -179,8 +174,8 @@ StorageColumn::Comparator SchedSliceTable::EndStateColumn::Sort(
     const QueryConstraints::OrderBy& ob) const {
   if (ob.desc) {
     return [this](uint32_t f, uint32_t s) {
-      const auto& a = (*deque_)[f];
-      const auto& b = (*deque_)[s];
+      const auto& a = (*vector_)[f];
+      const auto& b = (*vector_)[s];
       if (!a.is_valid()) {
         return !b.is_valid() ? 0 : 1;
       } else if (!b.is_valid()) {
@@ -190,8 +185,8 @@ StorageColumn::Comparator SchedSliceTable::EndStateColumn::Sort(
     };
   }
   return [this](uint32_t f, uint32_t s) {
-    const auto& a = (*deque_)[f];
-    const auto& b = (*deque_)[s];
+    const auto& a = (*vector_)[f];
+    const auto& b = (*vector_)[s];
     if (!a.is_valid()) {
       return !b.is_valid() ? 0 : -1;
     } else if (!b.is_valid()) {
@@ -29,7 +29,9 @@ class SchedSliceTable : public StorageTable {
  public:
   SchedSliceTable(sqlite3*, const TraceStorage* storage);
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   // StorageTable implementation.
   StorageSchema CreateStorageSchema() override;
@@ -42,7 +44,7 @@ class SchedSliceTable : public StorageTable {
   class EndStateColumn : public StorageColumn {
    public:
     EndStateColumn(std::string col_name,
-                   const std::deque<ftrace_utils::TaskState>* deque);
+                   const ChunkedVector<ftrace_utils::TaskState>* vector);
     ~EndStateColumn() override;
 
     void ReportResult(sqlite3_context*, uint32_t row) const override;
@@ -63,7 +65,7 @@ class SchedSliceTable : public StorageTable {
                        sqlite3_value* value,
                        FilteredRowIndex* index) const;
 
-    const std::deque<ftrace_utils::TaskState>* deque_ = nullptr;
+    const ChunkedVector<ftrace_utils::TaskState>* vector_ = nullptr;
   };
 
   const TraceStorage* const storage_;
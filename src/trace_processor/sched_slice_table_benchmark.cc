@@ -0,0 +1,165 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+
+#include "benchmark/benchmark.h"
+
+#include "src/trace_processor/sched_overview_table.h"
+#include "src/trace_processor/sched_slice_table.h"
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace {
+
+using perfetto::trace_processor::SchedOverviewTable;
+using perfetto::trace_processor::SchedSliceTable;
+using perfetto::trace_processor::ScopedDb;
+using perfetto::trace_processor::ScopedStmt;
+using perfetto::trace_processor::TraceStorage;
+
+// Runs the per-thread and per-cpu track queries of the UI on 4M sched slices
+// spread over 1000 threads and 8 cpus. The "Unindexed" variants prefix the
+// utid/cpu column with a unary + so that SQLite does not pass the equality
+// constraint to the table, which then has to scan all the rows in the ts range.
+// The "Overview" ones compare the utilization buckets of the overview and of
+// the zoomed out cpu tracks computed by sched_overview and by a GROUP BY.
+
+constexpr uint32_t kNumSlices = 1 << 22;
+constexpr uint32_t kNumThreads = 1000;
+constexpr uint32_t kNumCpus = 8;
+
+class SchedFixture {
+ public:
+  SchedFixture() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    std::minstd_rand0 rnd(0);
+    perfetto::trace_processor::ftrace_utils::TaskState end_state;
+    for (uint32_t i = 0; i < kNumSlices; i++) {
+      auto cpu = static_cast<uint32_t>(rnd() % kNumCpus);
+      auto utid = static_cast<uint32_t>(rnd() % kNumThreads);
+      storage_.mutable_slices()->AddSlice(cpu, int64_t{i} * 100 /* start_ns */,
+                                          50 /* duration_ns */, utid,
+                                          end_state, 120 /* priority */);
+    }
+    SchedSliceTable::RegisterTable(db_.get(), &storage_, nullptr);
+    SchedOverviewTable::RegisterTable(db_.get(), &storage_, nullptr);
+  }
+
+  int64_t Count(const char* sql) {
+    sqlite3_stmt* stmt;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql, -1, &stmt, nullptr) ==
+                   SQLITE_OK);
+    ScopedStmt scoped_stmt(stmt);
+
+    int64_t count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+      count += sqlite3_column_int64(stmt, 0);
+    return count;
+  }
+
+ private:
+  TraceStorage storage_;
+  ScopedDb db_;
+};
+
+SchedFixture* GetFixture() {
+  static SchedFixture* fixture = new SchedFixture();
+  return fixture;
+}
+
+void RunQuery(benchmark::State& state, const char* sql) {
+  SchedFixture* fixture = GetFixture();
+
+  // Run the query once so the indexes are built before timing.
+  fixture->Count(sql);
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(fixture->Count(sql));
+}
+
+}  // namespace
+
+static void BM_SchedBuildUtidIndex(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    // Each fresh table has its own indexes which are built by the first query
+    // filtering on utid.
+    state.PauseTiming();
+    SchedFixture* fixture = new SchedFixture();
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(
+        fixture->Count("SELECT ts FROM sched WHERE utid = 123"));
+    state.PauseTiming();
+    delete fixture;
+    state.ResumeTiming();
+  }
+}
+BENCHMARK(BM_SchedBuildUtidIndex)->Unit(benchmark::kMillisecond);
+
+static void BM_SchedUtidTrack(benchmark::State& state) {
+  RunQuery(state,
+           "SELECT ts FROM sched WHERE utid = 123 AND ts >= 1000000 AND "
+           "ts < 200000000 ORDER BY ts");
+}
+BENCHMARK(BM_SchedUtidTrack);
+
+static void BM_SchedUtidTrackUnindexed(benchmark::State& state) {
+  RunQuery(state,
+           "SELECT ts FROM sched WHERE +utid = 123 AND ts >= 1000000 AND "
+           "ts < 200000000 ORDER BY ts");
+}
+BENCHMARK(BM_SchedUtidTrackUnindexed);
+
+static void BM_SchedCpuTrack(benchmark::State& state) {
+  RunQuery(state,
+           "SELECT ts FROM sched WHERE cpu = 3 AND ts >= 100000000 AND "
+           "ts < 101000000 ORDER BY ts");
+}
+BENCHMARK(BM_SchedCpuTrack);
+
+static void BM_SchedCpuTrackUnindexed(benchmark::State& state) {
+  RunQuery(state,
+           "SELECT ts FROM sched WHERE +cpu = 3 AND ts >= 100000000 AND "
+           "ts < 101000000 ORDER BY ts");
+}
+BENCHMARK(BM_SchedCpuTrackUnindexed);
+
+static void BM_SchedOverview(benchmark::State& state) {
+  RunQuery(state,
+           "SELECT busy_dur FROM sched_overview(0, 419430400, 4194304)");
+}
+BENCHMARK(BM_SchedOverview);
+
+static void BM_SchedOverviewGroupBy(benchmark::State& state) {
+  RunQuery(state,
+           "SELECT sum(dur) FROM sched WHERE utid != 0 "
+           "GROUP BY cpu, ts / 4194304");
+}
+BENCHMARK(BM_SchedOverviewGroupBy)->Unit(benchmark::kMillisecond);
+
+static void BM_SchedOverviewCpuTrack(benchmark::State& state) {
+  RunQuery(state,
+           "SELECT busy_dur FROM sched_overview(100000000, 200000000, 100000) "
+           "WHERE cpu = 3");
+}
+BENCHMARK(BM_SchedOverviewCpuTrack);
+
+static void BM_SchedOverviewCpuTrackGroupBy(benchmark::State& state) {
+  RunQuery(state,
+           "SELECT sum(dur) FROM sched WHERE cpu = 3 AND utid != 0 AND "
+           "ts >= 100000000 AND ts < 200000000 GROUP BY ts / 100000");
+}
+BENCHMARK(BM_SchedOverviewCpuTrackGroupBy);
@@ -45,7 +45,7 @@ class SchedSliceTableTest : public ::testing::Test {
     context_.process_tracker.reset(new ProcessTracker(&context_));
     context_.event_tracker.reset(new EventTracker(&context_));
 
-    SchedSliceTable::RegisterTable(db_.get(), context_.storage.get());
+    SchedSliceTable::RegisterTable(db_.get(), context_.storage.get(), nullptr);
   }
 
   void PrepareValidStatement(const std::string& sql) {
@@ -263,6 +263,39 @@ TEST_F(SchedSliceTableTest, TimestampFiltering) {
   ASSERT_THAT(query("ts >= 59 and ts < 73"), ElementsAre(59, 60, 70, 71, 72));
 }
 
+TEST_F(SchedSliceTableTest, IndexedUtidAndCpuFiltering) {
+  auto* slices = context_.storage->mutable_slices();
+  ftrace_utils::TaskState end_state;
+  for (int64_t i = 0; i < 20; i++) {
+    auto utid = static_cast<UniqueTid>(i % 3);
+    auto cpu = static_cast<uint32_t>(i % 2);
+    slices->AddSlice(cpu, 100 + i, 1 /* duration */, utid, end_state, 120);
+  }
+
+  auto query = [this](const std::string& sql) {
+    PrepareValidStatement(sql);
+    std::vector<int> res;
+    while (sqlite3_step(*stmt_) == SQLITE_ROW)
+      res.push_back(sqlite3_column_int(*stmt_, 0));
+    return res;
+  };
+
+  ASSERT_THAT(query("SELECT ts FROM sched WHERE utid = 1"),
+              ElementsAre(101, 104, 107, 110, 113, 116, 119));
+  ASSERT_THAT(query("SELECT ts FROM sched WHERE utid = 1 AND ts >= 104 AND "
+                    "ts < 116 ORDER BY ts DESC"),
+              ElementsAre(113, 110, 107, 104));
+  ASSERT_THAT(query("SELECT ts FROM sched WHERE cpu = 0 AND ts > 110 AND "
+                    "utid != 0"),
+              ElementsAre(114, 116));
+  ASSERT_THAT(query("SELECT ts FROM sched WHERE utid = 5"), IsEmpty());
+
+  // Slices added after the first query should be found too.
+  slices->AddSlice(1, 200, 1 /* duration */, 1, end_state, 120);
+  ASSERT_THAT(query("SELECT ts FROM sched WHERE utid = 1 AND ts > 115"),
+              ElementsAre(116, 119, 200));
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/secondary_index.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "src/trace_processor/sqlite_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+bool IsOpRange(int op) {
+  using namespace sqlite_utils;
+  return IsOpGe(op) || IsOpGt(op) || IsOpLe(op) || IsOpLt(op);
+}
+
+}  // namespace
+
+SecondaryIndex::SecondaryIndex(std::vector<size_t> col_indices,
+                               std::vector<const StorageColumn*> columns)
+    : col_indices_(std::move(col_indices)), columns_(std::move(columns)) {
+  PERFETTO_DCHECK(col_indices_.size() == columns_.size());
+  for (size_t i = 0; i < columns_.size(); i++) {
+    QueryConstraints::OrderBy ob;
+    ob.iColumn = static_cast<int>(col_indices_[i]);
+    ob.desc = false;
+    comparators_.emplace_back(columns_[i]->Sort(ob));
+  }
+}
+
+SecondaryIndex::~SecondaryIndex() = default;
+
+std::vector<size_t> SecondaryIndex::MatchConstraints(
+    const std::vector<QueryConstraints::Constraint>& cs) const {
+  std::vector<size_t> matched;
+  size_t col = 0;
+  for (; col < col_indices_.size(); col++) {
+    auto col_idx = static_cast<int>(col_indices_[col]);
+    auto is_eq = [col_idx](const QueryConstraints::Constraint& c) {
+      return c.iColumn == col_idx && sqlite_utils::IsOpEq(c.op);
+    };
+    auto it = std::find_if(cs.begin(), cs.end(), is_eq);
+    if (it == cs.end())
+      break;
+    matched.emplace_back(static_cast<size_t>(std::distance(cs.begin(), it)));
+  }
+
+  // Without an equality constraint on the first column, the index would not
+  // do better than a scan of the table.
+  if (matched.empty() || col == col_indices_.size())
+    return matched;
+
+  auto col_idx = static_cast<int>(col_indices_[col]);
+  for (size_t i = 0; i < cs.size(); i++) {
+    if (cs[i].iColumn == col_idx && IsOpRange(cs[i].op))
+      matched.emplace_back(i);
+  }
+  return matched;
+}
+
+uint32_t SecondaryIndex::EstimateRowCount(
+    const std::vector<QueryConstraints::Constraint>& cs,
+    const std::vector<size_t>& matched,
+    uint32_t row_count) {
+  PERFETTO_DCHECK(!matched.empty());
+  Update(row_count);
+  if (row_count == 0)
+    return 0;
+
+  auto is_eq = [&cs](size_t i) { return sqlite_utils::IsOpEq(cs[i].op); };
+  auto eq_count =
+      static_cast<size_t>(std::count_if(matched.begin(), matched.end(), is_eq));
+  uint32_t estimate = row_count / distinct_counts_[eq_count - 1];
+
+  // Assume each range constraint halves the number of rows.
+  for (size_t i = eq_count; i < matched.size(); i++)
+    estimate /= 2;
+  return std::max(estimate, 1u);
+}
+
+size_t SecondaryIndex::Lookup(
+    const std::vector<QueryConstraints::Constraint>& cs,
+    sqlite3_value** argv,
+    const std::vector<size_t>& matched,
+    uint32_t row_count,
+    std::vector<uint32_t>* rows) {
+  Update(row_count);
+
+  uint32_t begin = 0;
+  uint32_t end = row_count;
+  size_t applied = 0;
+  for (size_t c_idx : matched) {
+    const auto& c = cs[c_idx];
+    auto it = std::find(col_indices_.begin(), col_indices_.end(),
+                        static_cast<size_t>(c.iColumn));
+    PERFETTO_DCHECK(it != col_indices_.end());
+    const auto* col = columns_[static_cast<size_t>(
+        std::distance(col_indices_.begin(), it))];
+
+    auto bounds =
+        col->BoundSortedRows(c.op, argv[c_idx], sorted_rows_, begin, end);
+    if (!bounds.consumed)
+      break;
+    begin = bounds.min_idx;
+    end = bounds.max_idx;
+    applied++;
+  }
+
+  if (applied > 0)
+    rows->assign(sorted_rows_.begin() + begin, sorted_rows_.begin() + end);
+  return applied;
+}
+
+void SecondaryIndex::Update(uint32_t row_count) {
+  auto indexed_count = static_cast<uint32_t>(sorted_rows_.size());
+  if (row_count == indexed_count)
+    return;
+
+  // The table can only shrink if the storage was reset, in which case the
+  // index is rebuilt from scratch.
+  if (row_count < indexed_count) {
+    sorted_rows_.clear();
+    indexed_count = 0;
+  }
+
+  // The rows already in the index keep their relative order so only the new
+  // rows need to be sorted before merging the two runs.
+  sorted_rows_.resize(row_count);
+  auto first_new = sorted_rows_.begin() + indexed_count;
+  std::iota(first_new, sorted_rows_.end(), indexed_count);
+
+  // Sort the new rows one column at a time, starting from the least
+  // significant one. As the sorts are stable and the rows start out in storage
+  // order, naturally ordered columns (e.g. ts) can be skipped until some other
+  // column has been sorted on.
+  bool in_storage_order = true;
+  for (auto it = columns_.rbegin(); it != columns_.rend(); ++it) {
+    const StorageColumn* col = *it;
+    if (in_storage_order && col->IsNaturallyOrdered())
+      continue;
+    col->StableSortRows(first_new, sorted_rows_.end());
+    in_storage_order = false;
+  }
+
+  if (indexed_count > 0) {
+    auto less = [this](uint32_t f, uint32_t s) {
+      return CompareRows(f, s) < 0;
+    };
+    std::inplace_merge(sorted_rows_.begin(), first_new, sorted_rows_.end(),
+                       less);
+  }
+
+  distinct_counts_.assign(columns_.size(), 1);
+  for (uint32_t i = 1; i < row_count; i++) {
+    uint32_t prev = sorted_rows_[i - 1];
+    uint32_t cur = sorted_rows_[i];
+    for (size_t col = 0; col < comparators_.size(); col++) {
+      if (comparators_[col](prev, cur) == 0)
+        continue;
+
+      // A change in column |col| starts a new value of every prefix which
+      // includes it.
+      for (size_t j = col; j < distinct_counts_.size(); j++)
+        distinct_counts_[j]++;
+      break;
+    }
+  }
+}
+
+int SecondaryIndex::CompareRows(uint32_t f, uint32_t s) const {
+  for (const auto& comparator : comparators_) {
+    int c = comparator(f, s);
+    if (c != 0)
+      return c;
+  }
+  return sqlite_utils::CompareValuesAsc(f, s);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
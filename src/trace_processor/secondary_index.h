@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SECONDARY_INDEX_H_
+#define SRC_TRACE_PROCESSOR_SECONDARY_INDEX_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "src/trace_processor/query_constraints.h"
+#include "src/trace_processor/storage_columns.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// An index over the rows of a storage table, sorted by the values of a list of
+// columns (e.g. (utid, ts)). Queries with equality constraints on a prefix of
+// these columns, optionally followed by range constraints on the next column,
+// can then find their rows with a binary search in O(log n + k) instead of
+// scanning the whole table.
+//
+// The index is built on first use and cached. As rows are only ever appended
+// to storage, it is brought up to date by merging in the new rows whenever the
+// row count of the table changes. This means the values of the indexed columns
+// must not change once a row has been added.
+class SecondaryIndex {
+ public:
+  // |col_indices| are the indices in the schema of |columns|, most significant
+  // first.
+  SecondaryIndex(std::vector<size_t> col_indices,
+                 std::vector<const StorageColumn*> columns);
+  ~SecondaryIndex();
+
+  // Returns the indices in |cs| of the constraints which can be answered by
+  // this index: one equality constraint on each of a (non-empty) prefix of
+  // the columns, followed by any range constraints on the next column. The
+  // equality constraints come first, in column order.
+  std::vector<size_t> MatchConstraints(
+      const std::vector<QueryConstraints::Constraint>& cs) const;
+
+  // Returns an estimate of the number of rows, out of |row_count|, which
+  // match the constraints |matched| (as returned by MatchConstraints()).
+  uint32_t EstimateRowCount(const std::vector<QueryConstraints::Constraint>& cs,
+                            const std::vector<size_t>& matched,
+                            uint32_t row_count);
+
+  // Looks up the rows, out of |row_count|, which match the constraints
+  // |matched| (as returned by MatchConstraints()) and stores them in |rows|
+  // in index order. Returns the number of leading constraints of |matched|
+  // which were applied; the others still need to be filtered on. If this is
+  // zero, |rows| is left untouched.
+  size_t Lookup(const std::vector<QueryConstraints::Constraint>& cs,
+                sqlite3_value** argv,
+                const std::vector<size_t>& matched,
+                uint32_t row_count,
+                std::vector<uint32_t>* rows);
+
+  const std::vector<size_t>& col_indices() const { return col_indices_; }
+
+ private:
+  // Sorts the rows added since the last call and merges them into the index.
+  void Update(uint32_t row_count);
+
+  int CompareRows(uint32_t f, uint32_t s) const;
+
+  std::vector<size_t> col_indices_;
+  std::vector<const StorageColumn*> columns_;
+  std::vector<StorageColumn::Comparator> comparators_;
+
+  // All the rows of the table, ordered by the values of |columns_| and then
+  // by row index.
+  std::vector<uint32_t> sorted_rows_;
+
+  // The i-th entry is the number of distinct values of the first i + 1
+  // columns. Used to estimate the selectivity of equality constraints.
+  std::vector<uint32_t> distinct_counts_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SECONDARY_INDEX_H_
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/secondary_index.h"
+
+#include "src/trace_processor/scoped_db.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+constexpr size_t kUtidCol = 0;
+constexpr size_t kTsCol = 1;
+
+class SecondaryIndexTest : public ::testing::Test {
+ public:
+  SecondaryIndexTest()
+      : utid_col_("utid", &utids_, false, false),
+        ts_col_("ts", &ts_, false, true),
+        index_({kUtidCol, kTsCol}, {&utid_col_, &ts_col_}) {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+  }
+
+  ~SecondaryIndexTest() override {
+    for (sqlite3_value* value : values_)
+      sqlite3_value_free(value);
+  }
+
+  void AddRow(uint32_t utid, int64_t ts) {
+    utids_.emplace_back(utid);
+    ts_.emplace_back(ts);
+  }
+
+  // Adds a constraint on |col| with |op| against the value of the SQL
+  // expression |expr|.
+  void AddConstraint(size_t col, int op, const char* expr) {
+    QueryConstraints::Constraint c{};
+    c.iColumn = static_cast<int>(col);
+    c.op = static_cast<unsigned char>(op);
+    c.usable = true;
+    cs_.emplace_back(c);
+
+    std::string sql = std::string("SELECT ") + expr;
+    sqlite3_stmt* stmt;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &stmt, nullptr) ==
+                   SQLITE_OK);
+    ScopedStmt scoped_stmt(stmt);
+    PERFETTO_CHECK(sqlite3_step(stmt) == SQLITE_ROW);
+    values_.emplace_back(sqlite3_value_dup(sqlite3_column_value(stmt, 0)));
+  }
+
+  // Returns the rows matching the constraints added so far and the number of
+  // constraints applied by the index.
+  std::pair<std::vector<uint32_t>, size_t> Lookup() {
+    auto matched = index_.MatchConstraints(cs_);
+    std::vector<uint32_t> rows;
+    size_t applied =
+        index_.Lookup(cs_, values_.data(), matched,
+                      static_cast<uint32_t>(utids_.size()), &rows);
+    return std::make_pair(rows, applied);
+  }
+
+ protected:
+  ChunkedVector<uint32_t> utids_;
+  ChunkedVector<int64_t> ts_;
+  NumericColumn<uint32_t> utid_col_;
+  NumericColumn<int64_t> ts_col_;
+  SecondaryIndex index_;
+
+  ScopedDb db_;
+  std::vector<QueryConstraints::Constraint> cs_;
+  std::vector<sqlite3_value*> values_;
+};
+
+TEST_F(SecondaryIndexTest, MatchConstraints) {
+  // A range constraint on the second column alone can't use the index.
+  AddConstraint(kTsCol, SQLITE_INDEX_CONSTRAINT_GT, "10");
+  ASSERT_THAT(index_.MatchConstraints(cs_), IsEmpty());
+
+  // Equality constraints come first, followed by the range constraints.
+  AddConstraint(kUtidCol, SQLITE_INDEX_CONSTRAINT_EQ, "1");
+  AddConstraint(kTsCol, SQLITE_INDEX_CONSTRAINT_LE, "20");
+  AddConstraint(kTsCol, SQLITE_INDEX_CONSTRAINT_NE, "15");
+  ASSERT_THAT(index_.MatchConstraints(cs_), ElementsAre(1, 0, 2));
+}
+
+TEST_F(SecondaryIndexTest, LookupEqAndRange) {
+  AddRow(1, 10);
+  AddRow(2, 11);
+  AddRow(1, 12);
+  AddRow(3, 13);
+  AddRow(1, 14);
+  AddRow(2, 15);
+
+  AddConstraint(kUtidCol, SQLITE_INDEX_CONSTRAINT_EQ, "1");
+  auto res = Lookup();
+  ASSERT_EQ(res.second, 1u);
+  ASSERT_THAT(res.first, ElementsAre(0, 2, 4));
+
+  AddConstraint(kTsCol, SQLITE_INDEX_CONSTRAINT_GT, "10");
+  AddConstraint(kTsCol, SQLITE_INDEX_CONSTRAINT_LE, "14");
+  res = Lookup();
+  ASSERT_EQ(res.second, 3u);
+  ASSERT_THAT(res.first, ElementsAre(2, 4));
+}
+
+TEST_F(SecondaryIndexTest, LookupAfterAppend) {
+  AddRow(2, 10);
+  AddRow(1, 11);
+
+  AddConstraint(kUtidCol, SQLITE_INDEX_CONSTRAINT_EQ, "2");
+  ASSERT_THAT(Lookup().first, ElementsAre(0));
+
+  // Rows added after the index was built should be merged in.
+  AddRow(2, 12);
+  AddRow(3, 13);
+  AddRow(2, 14);
+  ASSERT_THAT(Lookup().first, ElementsAre(0, 2, 4));
+}
+
+TEST_F(SecondaryIndexTest, LookupNonIntegerValues) {
+  AddRow(1, 10);
+  AddRow(1, 11);
+  AddRow(1, 12);
+
+  // Float values are compared as doubles.
+  AddConstraint(kUtidCol, SQLITE_INDEX_CONSTRAINT_EQ, "1.0");
+  AddConstraint(kTsCol, SQLITE_INDEX_CONSTRAINT_LT, "11.5");
+  auto res = Lookup();
+  ASSERT_EQ(res.second, 2u);
+  ASSERT_THAT(res.first, ElementsAre(0, 1));
+
+  // Comparisons against NULL never match.
+  AddConstraint(kTsCol, SQLITE_INDEX_CONSTRAINT_GE, "NULL");
+  res = Lookup();
+  ASSERT_EQ(res.second, 3u);
+  ASSERT_THAT(res.first, IsEmpty());
+}
+
+TEST_F(SecondaryIndexTest, LookupStringValueNotApplied) {
+  AddRow(1, 10);
+
+  // Strings can't be bounded by the index so the constraint is left to be
+  // filtered by the column.
+  AddConstraint(kUtidCol, SQLITE_INDEX_CONSTRAINT_EQ, "'1'");
+  ASSERT_EQ(Lookup().second, 0u);
+}
+
+TEST_F(SecondaryIndexTest, EstimateRowCount) {
+  for (uint32_t i = 0; i < 100; i++)
+    AddRow(i % 4, i);
+
+  AddConstraint(kUtidCol, SQLITE_INDEX_CONSTRAINT_EQ, "1");
+  auto matched = index_.MatchConstraints(cs_);
+  ASSERT_EQ(index_.EstimateRowCount(cs_, matched, 100), 25u);
+
+  AddConstraint(kTsCol, SQLITE_INDEX_CONSTRAINT_GT, "50");
+  matched = index_.MatchConstraints(cs_);
+  ASSERT_EQ(index_.EstimateRowCount(cs_, matched, 100), 12u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
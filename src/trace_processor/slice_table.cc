@@ -24,8 +24,10 @@ namespace trace_processor {
 SliceTable::SliceTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
-void SliceTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<SliceTable>(db, storage, "slices");
+void SliceTable::RegisterTable(sqlite3* db,
+                               const TraceStorage* storage,
+                               const QueryContext* context) {
+  Table::Register<SliceTable>(db, storage, context, "slices");
 }
 
 StorageSchema SliceTable::CreateStorageSchema() {
@@ -34,11 +36,12 @@ StorageSchema SliceTable::CreateStorageSchema() {
       .AddOrderedNumericColumn("ts", &slices.start_ns())
       .AddNumericColumn("dur", &slices.durations())
       .AddNumericColumn("utid", &slices.utids())
-      .AddStringColumn("cat", &slices.cats(), &storage_->string_pool())
-      .AddStringColumn("name", &slices.names(), &storage_->string_pool())
+      .AddStringColumn("cat", &slices.cats(), storage_)
+      .AddStringColumn("name", &slices.names(), storage_)
       .AddNumericColumn("depth", &slices.depths())
       .AddNumericColumn("stack_id", &slices.stack_ids())
       .AddNumericColumn("parent_stack_id", &slices.parent_stack_ids())
+      .AddIndex({"utid", "ts"})
       .Build({"utid", "ts", "depth"});
 }
 
@@ -47,18 +50,12 @@ uint32_t SliceTable::RowCount() {
 }
 
 int SliceTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
-  info->estimated_cost =
-      static_cast<uint32_t>(storage_->nestable_slices().slice_count());
+  // Per-thread queries can be answered using the secondary index on
+  // (utid, ts).
+  info->estimated_cost = EstimateIndexedRowCount(qc).value_or(RowCount());
 
-  // Only the string columns are handled by SQLite
   info->order_by_consumed = true;
-  size_t name_index = schema().ColumnIndexFromName("name");
-  size_t cat_index = schema().ColumnIndexFromName("cat");
-  for (size_t i = 0; i < qc.constraints().size(); i++) {
-    info->omit[i] =
-        qc.constraints()[i].iColumn != static_cast<int>(name_index) &&
-        qc.constraints()[i].iColumn != static_cast<int>(cat_index);
-  }
+  SetOmittedConstraints(qc, info);
   return SQLITE_OK;
 }
 
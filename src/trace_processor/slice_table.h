@@ -35,7 +35,9 @@ class SliceTable : public StorageTable {
  public:
   SliceTable(sqlite3*, const TraceStorage* storage);
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   // StorageTable implementation.
   StorageSchema CreateStorageSchema() override;
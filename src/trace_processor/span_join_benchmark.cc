@@ -0,0 +1,169 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+
+#include "benchmark/benchmark.h"
+
+#include "src/trace_processor/sched_slice_table.h"
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/span_join_operator_table.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace {
+
+using perfetto::trace_processor::SchedSliceTable;
+using perfetto::trace_processor::ScopedDb;
+using perfetto::trace_processor::ScopedStmt;
+using perfetto::trace_processor::SpanJoinOperatorTable;
+using perfetto::trace_processor::TraceStorage;
+
+// Joins the sched slices of a 10 minute trace on 8 cpus (~2.4M slices of
+// 2ms on average) with the spans of the cpu frequency counters of each cpu
+// (~30k per cpu) and with a global (unpartitioned) gpu frequency counter.
+
+constexpr int64_t kTraceDurationNs = 10 * 60 * 1000 * 1000 * 1000ll;
+constexpr uint32_t kNumCpus = 8;
+constexpr uint32_t kNumThreads = 1000;
+
+class SpanJoinFixture {
+ public:
+  SpanJoinFixture() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    // The sched slices are added by increasing ts, as the parser would.
+    std::minstd_rand0 rnd(0);
+    perfetto::trace_processor::ftrace_utils::TaskState end_state;
+    int64_t next_ts[kNumCpus] = {};
+    while (true) {
+      uint32_t cpu = 0;
+      for (uint32_t i = 1; i < kNumCpus; i++) {
+        if (next_ts[i] < next_ts[cpu])
+          cpu = i;
+      }
+      if (next_ts[cpu] >= kTraceDurationNs)
+        break;
+      int64_t dur = 50000 + static_cast<int64_t>(rnd() % 4000000);
+      auto utid = static_cast<uint32_t>(rnd() % kNumThreads);
+      storage_.mutable_slices()->AddSlice(cpu, next_ts[cpu], dur, utid,
+                                          end_state, 120 /* priority */);
+      next_ts[cpu] += dur;
+    }
+    SchedSliceTable::RegisterTable(db_.get(), &storage_, nullptr);
+    SpanJoinOperatorTable::RegisterTable(db_.get(), &storage_, nullptr);
+
+    Exec("BEGIN;");
+    Exec("CREATE TABLE cpu_freq(ts BIG INT, dur BIG INT, cpu UNSIGNED INT, "
+         "freq BIG INT, PRIMARY KEY (cpu, ts)) WITHOUT ROWID;");
+    for (uint32_t cpu = 0; cpu < kNumCpus; cpu++)
+      AddCounterSpans(&rnd, "cpu_freq", cpu);
+    Exec("CREATE TABLE gpu_freq(ts BIG INT PRIMARY KEY, dur BIG INT, "
+         "gpu UNSIGNED INT, freq BIG INT) WITHOUT ROWID;");
+    AddCounterSpans(&rnd, "gpu_freq", 0);
+    Exec("COMMIT;");
+
+    Exec("CREATE VIRTUAL TABLE sched_cpu_freq USING "
+         "span_join(sched PARTITIONED cpu, cpu_freq PARTITIONED cpu);");
+    Exec("CREATE VIRTUAL TABLE sched_cpu_freq_left USING "
+         "span_left_join(sched PARTITIONED cpu, cpu_freq PARTITIONED cpu);");
+    Exec("CREATE VIRTUAL TABLE sched_gpu_freq USING "
+         "span_join(sched PARTITIONED utid, gpu_freq);");
+  }
+
+  int64_t Sum(const char* sql) {
+    sqlite3_stmt* stmt;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql, -1, &stmt, nullptr) ==
+                   SQLITE_OK);
+    ScopedStmt scoped_stmt(stmt);
+
+    int64_t sum = 0;
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+      sum += sqlite3_column_int64(stmt, 0);
+    PERFETTO_CHECK(ret == SQLITE_DONE);
+    return sum;
+  }
+
+ private:
+  void Exec(const char* sql) {
+    char* error = nullptr;
+    sqlite3_exec(*db_, sql, nullptr, nullptr, &error);
+    if (error)
+      PERFETTO_FATAL("%s: %s", sql, error);
+  }
+
+  // Adds the spans between the changes of a frequency counter, which changes
+  // every 20ms on average.
+  void AddCounterSpans(std::minstd_rand0* rnd,
+                       const char* table,
+                       uint32_t id) {
+    std::string sql =
+        std::string("INSERT INTO ") + table + " VALUES(?, ?, ?, ?);";
+    sqlite3_stmt* stmt;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &stmt,
+                                      nullptr) == SQLITE_OK);
+    ScopedStmt scoped_stmt(stmt);
+    for (int64_t ts = 0; ts < kTraceDurationNs;) {
+      int64_t dur = 1000000 + static_cast<int64_t>((*rnd)() % 40000000);
+      sqlite3_bind_int64(stmt, 1, ts);
+      sqlite3_bind_int64(stmt, 2, dur);
+      sqlite3_bind_int64(stmt, 3, id);
+      sqlite3_bind_int64(stmt, 4, 300000 + (*rnd)() % 2000000);
+      PERFETTO_CHECK(sqlite3_step(stmt) == SQLITE_DONE);
+      sqlite3_reset(stmt);
+      ts += dur;
+    }
+  }
+
+  TraceStorage storage_;
+  ScopedDb db_;
+};
+
+SpanJoinFixture* GetFixture() {
+  static SpanJoinFixture* fixture = new SpanJoinFixture();
+  return fixture;
+}
+
+void RunQuery(benchmark::State& state, const char* sql) {
+  SpanJoinFixture* fixture = GetFixture();
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(fixture->Sum(sql));
+}
+
+}  // namespace
+
+static void BM_SpanJoinSchedCpuFreq(benchmark::State& state) {
+  RunQuery(state, "SELECT SUM(dur * freq / 1000) FROM sched_cpu_freq");
+}
+BENCHMARK(BM_SpanJoinSchedCpuFreq)->Unit(benchmark::kMillisecond);
+
+static void BM_SpanLeftJoinSchedCpuFreq(benchmark::State& state) {
+  RunQuery(state,
+           "SELECT SUM(dur * IFNULL(freq, 0) / 1000) FROM sched_cpu_freq_left");
+}
+BENCHMARK(BM_SpanLeftJoinSchedCpuFreq)->Unit(benchmark::kMillisecond);
+
+static void BM_SpanJoinSchedCpuFreqOneCpu(benchmark::State& state) {
+  RunQuery(state,
+           "SELECT SUM(dur * freq / 1000) FROM sched_cpu_freq WHERE cpu = 3");
+}
+BENCHMARK(BM_SpanJoinSchedCpuFreqOneCpu)->Unit(benchmark::kMillisecond);
+
+// Each of the 1000 threads is joined with all the spans of the gpu frequency.
+static void BM_SpanJoinSchedUtidGpuFreq(benchmark::State& state) {
+  RunQuery(state, "SELECT SUM(dur * freq / 1000) FROM sched_gpu_freq");
+}
+BENCHMARK(BM_SpanJoinSchedUtidGpuFreq)->Unit(benchmark::kMillisecond);
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <algorithm>
 #include <set>
+#include <tuple>
 #include <utility>
 
 #include "perfetto/base/logging.h"
@@ -46,12 +47,18 @@ SpanJoinOperatorTable::SpanJoinOperatorTable(sqlite3* db, const TraceStorage*)
     : db_(db) {}
 
 void SpanJoinOperatorTable::RegisterTable(sqlite3* db,
-                                          const TraceStorage* storage) {
-  Table::Register<SpanJoinOperatorTable>(db, storage, "span_join",
+                                          const TraceStorage* storage,
+                                          const QueryContext* context) {
+  Table::Register<SpanJoinOperatorTable>(db, storage, context, "span_join",
                                          /* read_write */ false,
                                          /* requires_args */ true);
 
-  Table::Register<SpanJoinOperatorTable>(db, storage, "span_left_join",
+  Table::Register<SpanJoinOperatorTable>(db, storage, context, "span_left_join",
+                                         /* read_write */ false,
+                                         /* requires_args */ true);
+
+  Table::Register<SpanJoinOperatorTable>(db, storage, context,
+                                         "span_outer_join",
                                          /* read_write */ false,
                                          /* requires_args */ true);
 }
@@ -89,12 +96,13 @@ base::Optional<Table::Schema> SpanJoinOperatorTable::Init(
     partitioning_ = PartitioningType::kMixedPartitioning;
   }
 
-  auto maybe_t1_defn = CreateTableDefinition(t1_desc, false);
+  auto maybe_t1_defn = CreateTableDefinition(t1_desc, IsOuterJoin());
   if (!maybe_t1_defn.has_value())
     return base::nullopt;
   t1_defn_ = maybe_t1_defn.value();
 
-  auto maybe_t2_defn = CreateTableDefinition(t2_desc, IsLeftJoin());
+  auto maybe_t2_defn =
+      CreateTableDefinition(t2_desc, IsLeftJoin() || IsOuterJoin());
   if (!maybe_t2_defn.has_value())
     return base::nullopt;
   t2_defn_ = maybe_t2_defn.value();
@@ -136,7 +144,7 @@ std::unique_ptr<Table::Cursor> SpanJoinOperatorTable::CreateCursor(
     const QueryConstraints& qc,
     sqlite3_value** argv) {
   auto cursor =
-      std::unique_ptr<SpanJoinOperatorTable::Cursor>(new Cursor(this, db_));
+      std::unique_ptr<SpanJoinOperatorTable::Cursor>(new Cursor(this));
   int value = cursor->Initialize(qc, argv);
   return value != SQLITE_OK ? nullptr : std::move(cursor);
 }
@@ -231,134 +239,187 @@ std::string SpanJoinOperatorTable::GetNameForGlobalColumnIndex(
   return defn.columns()[locator.col_index].name().c_str();
 }
 
-SpanJoinOperatorTable::Cursor::Cursor(SpanJoinOperatorTable* table, sqlite3* db)
-    : t1_(table, &table->t1_defn_, db),
-      t2_(table, &table->t2_defn_, db),
-      table_(table) {}
+int SpanJoinOperatorTable::GetSpanIndex(
+    const TableDefinition& defn,
+    std::string sql,
+    std::shared_ptr<const SpanIndex>* index) {
+  span_indexes_.erase(
+      std::remove_if(span_indexes_.begin(), span_indexes_.end(),
+                     [](const std::weak_ptr<const SpanIndex>& cached) {
+                       return cached.expired();
+                     }),
+      span_indexes_.end());
+  for (const auto& cached : span_indexes_) {
+    auto live = cached.lock();
+    if (live->sql() == sql) {
+      *index = std::move(live);
+      return SQLITE_OK;
+    }
+  }
+
+  std::unique_ptr<SpanIndex> new_index;
+  int err = SpanIndex::Build(db_, defn, std::move(sql), &new_index);
+  if (err != SQLITE_OK)
+    return err;
+  *index = std::move(new_index);
+  span_indexes_.emplace_back(*index);
+  return SQLITE_OK;
+}
+
+std::string SpanJoinOperatorTable::CreateSqlQuery(
+    const TableDefinition& defn,
+    const std::vector<std::string>& cs) const {
+  std::vector<std::string> col_names;
+  for (const Table::Column& c : defn.columns()) {
+    col_names.push_back("`" + c.name() + "`");
+  }
+
+  // The spans are sorted when they are indexed, which is faster than asking
+  // SQLite to sort the rows.
+  std::string sql = "SELECT " + base::Join(col_names, ", ");
+  sql += " FROM " + defn.name();
+  if (!cs.empty()) {
+    sql += " WHERE " + base::Join(cs, " AND ");
+  }
+  sql += ";";
+  PERFETTO_DLOG("%s", sql.c_str());
+  return sql;
+}
+
+SpanJoinOperatorTable::Cursor::Cursor(SpanJoinOperatorTable* table)
+    : table_(table) {}
 
 int SpanJoinOperatorTable::Cursor::Initialize(const QueryConstraints& qc,
                                               sqlite3_value** argv) {
-  int err = t1_.Initialize(qc, argv);
+  const TableDefinition& t1_defn = table_->t1_defn_;
+  auto t1_sql = table_->CreateSqlQuery(
+      t1_defn, table_->ComputeSqlConstraintsForDefinition(t1_defn, qc, argv));
+  int err = table_->GetSpanIndex(t1_defn, std::move(t1_sql), &t1_index_);
   if (err != SQLITE_OK)
     return err;
 
-  err = t2_.Initialize(qc, argv);
+  const TableDefinition& t2_defn = table_->t2_defn_;
+  auto t2_sql = table_->CreateSqlQuery(
+      t2_defn, table_->ComputeSqlConstraintsForDefinition(t2_defn, qc, argv));
+  err = table_->GetSpanIndex(t2_defn, std::move(t2_sql), &t2_index_);
   if (err != SQLITE_OK)
     return err;
 
-  // Step the partitioned table to allow for us to look into it below.
-  Query* step_now = t1_.IsPartitioned() ? &t1_ : &t2_;
-  next_stepped_ = step_now == &t1_ ? &t2_ : &t1_;
-
-  auto res = step_now->Step();
-  if (PERFETTO_UNLIKELY(res.is_err()))
-    return res.err_code;
-
-  // Forward the unpartitioned table to reflect the partition of the partitoined
-  // table.
-  if (table_->partitioning_ == PartitioningType::kMixedPartitioning) {
-    PERFETTO_DCHECK(step_now->IsPartitioned());
-
-    // If we emit shadow slices, we need to step because the first slice will
-    // be a full partition shadow slice that we need to skip.
-    if (step_now->definition()->emit_shadow_slices()) {
-      PERFETTO_DCHECK(step_now->IsFullPartitionShadowSlice());
-      res = step_now->StepToNextPartition();
-      if (PERFETTO_UNLIKELY(res.is_err()))
-        return res.err_code;
-    }
-
-    res = next_stepped_->StepToPartition(step_now->partition());
-    if (PERFETTO_UNLIKELY(res.is_err()))
-      return res.err_code;
-  }
-
-  // Otherwise, find an overlapping span.
-  return Next();
+  FindOverlappingSpan();
+  return SQLITE_OK;
 }
 
-bool SpanJoinOperatorTable::Cursor::IsOverlappingSpan() {
-  if (t1_.partition() != t2_.partition()) {
-    return false;
-  } else if (t1_.ts_end() <= t2_.ts_start() || t2_.ts_end() <= t1_.ts_start()) {
-    return false;
+bool SpanJoinOperatorTable::Cursor::NextPartition() {
+  const auto& t1_partitions = t1_index_->partitions();
+  const auto& t2_partitions = t2_index_->partitions();
+  bool t1_shadow = table_->t1_defn_.emit_shadow_slices();
+  bool t2_shadow = table_->t2_defn_.emit_shadow_slices();
+
+  switch (table_->partitioning_) {
+    case PartitioningType::kNoPartitioning: {
+      if (t1_next_partition_ > 0)
+        return false;
+      t1_next_partition_++;
+      t1_.Reset(t1_index_.get(), &t1_partitions[0], t1_shadow);
+      t2_.Reset(t2_index_.get(), &t2_partitions[0], t2_shadow);
+      return true;
+    }
+    case PartitioningType::kMixedPartitioning: {
+      // Every partition of the partitioned table is joined with all the spans
+      // of the unpartitioned one.
+      if (table_->t1_defn_.IsPartitioned()) {
+        if (t1_next_partition_ == t1_partitions.size())
+          return false;
+        const auto& partition = t1_partitions[t1_next_partition_++];
+        partition_ = partition.partition;
+        t1_.Reset(t1_index_.get(), &partition, t1_shadow);
+        t2_.Reset(t2_index_.get(), &t2_partitions[0], t2_shadow);
+      } else {
+        if (t2_next_partition_ == t2_partitions.size())
+          return false;
+        const auto& partition = t2_partitions[t2_next_partition_++];
+        partition_ = partition.partition;
+        t1_.Reset(t1_index_.get(), &t1_partitions[0], t1_shadow);
+        t2_.Reset(t2_index_.get(), &partition, t2_shadow);
+      }
+      return true;
+    }
+    case PartitioningType::kSamePartitioning: {
+      // Merge the sorted partitions of the two tables. A partition missing
+      // from one of them is only joined if that table emits shadow slices.
+      while (t1_next_partition_ < t1_partitions.size() ||
+             t2_next_partition_ < t2_partitions.size()) {
+        const SpanIndex::Partition* t1_partition =
+            t1_next_partition_ < t1_partitions.size()
+                ? &t1_partitions[t1_next_partition_]
+                : nullptr;
+        const SpanIndex::Partition* t2_partition =
+            t2_next_partition_ < t2_partitions.size()
+                ? &t2_partitions[t2_next_partition_]
+                : nullptr;
+        if (t1_partition && t2_partition &&
+            t1_partition->partition != t2_partition->partition) {
+          if (t1_partition->partition < t2_partition->partition)
+            t2_partition = nullptr;
+          else
+            t1_partition = nullptr;
+        }
+        t1_next_partition_ += t1_partition ? 1 : 0;
+        t2_next_partition_ += t2_partition ? 1 : 0;
+
+        if ((!t1_partition && !t1_shadow) || (!t2_partition && !t2_shadow))
+          continue;
+
+        partition_ = t1_partition ? t1_partition->partition
+                                  : t2_partition->partition;
+        t1_.Reset(t1_index_.get(), t1_partition, t1_shadow);
+        t2_.Reset(t2_index_.get(), t2_partition, t2_shadow);
+        return true;
+      }
+      return false;
+    }
   }
-  return true;
+  PERFETTO_FATAL("For GCC");
 }
 
-int SpanJoinOperatorTable::Cursor::Next() {
-  // TODO: Propagate error msg to the table.
-  auto res = next_stepped_->Step();
-  if (res.is_err())
-    return res.err_code;
-
+void SpanJoinOperatorTable::Cursor::FindOverlappingSpan() {
   while (true) {
-    if (t1_.Eof() || t2_.Eof()) {
-      if (table_->partitioning_ != PartitioningType::kMixedPartitioning)
-        return SQLITE_OK;
-
-      auto* partitioned = t1_.IsPartitioned() ? &t1_ : &t2_;
-      auto* unpartitioned = t1_.IsPartitioned() ? &t2_ : &t1_;
-      if (partitioned->Eof())
-        return SQLITE_OK;
-
-      res = partitioned->StepToNextPartition();
-      if (PERFETTO_UNLIKELY(res.is_err()))
-        return res.err_code;
-      else if (PERFETTO_UNLIKELY(res.is_eof()))
-        continue;
-
-      res = unpartitioned->StepToPartition(partitioned->partition());
-      if (PERFETTO_UNLIKELY(res.is_err()))
-        return res.err_code;
-      else if (PERFETTO_UNLIKELY(res.is_eof()))
-        continue;
+    while (!t1_.Eof() && !t2_.Eof()) {
+      bool overlapping =
+          t1_.ts_start() < t2_.ts_end() && t2_.ts_start() < t1_.ts_end();
+      if (overlapping && (t1_.IsRealSlice() || t2_.IsRealSlice()))
+        return;
+
+      // The span ending first cannot overlap any of the next spans of the
+      // other table.
+      if (t1_.ts_end() <= t2_.ts_end())
+        t1_.Next();
+      else
+        t2_.Next();
+    }
+    if (!NextPartition()) {
+      eof_ = true;
+      return;
     }
-
-    int64_t partition = std::max(t1_.partition(), t2_.partition());
-    res = t1_.StepToPartition(partition);
-    if (PERFETTO_UNLIKELY(res.is_err()))
-      return res.err_code;
-    else if (PERFETTO_UNLIKELY(res.is_eof()))
-      continue;
-
-    res = t2_.StepToPartition(t1_.partition());
-    if (PERFETTO_UNLIKELY(res.is_err()))
-      return res.err_code;
-    else if (PERFETTO_UNLIKELY(res.is_eof()))
-      continue;
-
-    if (t1_.partition() != t2_.partition())
-      continue;
-
-    auto ts = std::max(t1_.ts_start(), t2_.ts_start());
-    res = t1_.StepUntil(ts);
-    if (PERFETTO_UNLIKELY(res.is_err()))
-      return res.err_code;
-    else if (PERFETTO_UNLIKELY(res.is_eof()))
-      continue;
-
-    res = t2_.StepUntil(t1_.ts_start());
-    if (PERFETTO_UNLIKELY(res.is_err()))
-      return res.err_code;
-    else if (PERFETTO_UNLIKELY(res.is_eof()))
-      continue;
-
-    if (IsOverlappingSpan())
-      break;
   }
-  next_stepped_ = t1_.ts_end() <= t2_.ts_end() ? &t1_ : &t2_;
+}
 
+int SpanJoinOperatorTable::Cursor::Next() {
+  PERFETTO_DCHECK(!eof_);
+  if (t1_.ts_end() <= t2_.ts_end())
+    t1_.Next();
+  else
+    t2_.Next();
+  FindOverlappingSpan();
   return SQLITE_OK;
 }
 
 int SpanJoinOperatorTable::Cursor::Eof() {
-  return t1_.Eof() || t2_.Eof();
+  return eof_;
 }
 
 int SpanJoinOperatorTable::Cursor::Column(sqlite3_context* context, int N) {
-  PERFETTO_DCHECK(!t1_.Eof());
-  PERFETTO_DCHECK(!t2_.Eof());
+  PERFETTO_DCHECK(!eof_);
 
   if (N == Column::kTimestamp) {
     auto max_ts = std::max(t1_.ts_start(), t2_.ts_start());
@@ -371,240 +432,200 @@ int SpanJoinOperatorTable::Cursor::Column(sqlite3_context* context, int N) {
     sqlite3_result_int64(context, static_cast<sqlite3_int64>(dur));
   } else if (N == Column::kPartition &&
              table_->partitioning_ != PartitioningType::kNoPartitioning) {
-    PERFETTO_DCHECK(table_->partitioning_ ==
-                        PartitioningType::kMixedPartitioning ||
-                    t1_.partition() == t2_.partition());
-    auto partition = t1_.IsPartitioned() ? t1_.partition() : t2_.partition();
-    sqlite3_result_int64(context, static_cast<sqlite3_int64>(partition));
+    sqlite3_result_int64(context, static_cast<sqlite3_int64>(partition_));
   } else {
     size_t index = static_cast<size_t>(N);
     const auto& locator = table_->global_index_to_column_locator_[index];
-    if (locator.defn == t1_.definition())
-      t1_.ReportSqliteResult(context, locator.col_index);
+    const SpanIterator& it = locator.defn == &table_->t1_defn_ ? t1_ : t2_;
+    const SpanIndex& span_index =
+        locator.defn == &table_->t1_defn_ ? *t1_index_ : *t2_index_;
+    if (it.IsRealSlice())
+      span_index.ReportSqliteResult(context, it.span(), locator.col_index);
     else
-      t2_.ReportSqliteResult(context, locator.col_index);
+      sqlite3_result_null(context);
   }
   return SQLITE_OK;
 }
 
-SpanJoinOperatorTable::Query::Query(SpanJoinOperatorTable* table,
-                                    const TableDefinition* definition,
-                                    sqlite3* db)
-    : defn_(definition), db_(db), table_(table) {
-  PERFETTO_DCHECK(!defn_->IsPartitioned() ||
-                  defn_->partition_idx() < defn_->columns().size());
-}
-
-SpanJoinOperatorTable::Query::~Query() = default;
-
-int SpanJoinOperatorTable::Query::Initialize(const QueryConstraints& qc,
-                                             sqlite3_value** argv) {
-  sql_query_ = CreateSqlQuery(
-      table_->ComputeSqlConstraintsForDefinition(*defn_, qc, argv));
-  return PrepareRawStmt();
-}
-
-SpanJoinOperatorTable::Query::StepRet SpanJoinOperatorTable::Query::Step() {
-  PERFETTO_DCHECK(!Eof());
-  sqlite3_stmt* stmt = stmt_.get();
-
-  // In this loop, we will try and find the slice to from the cursor.
-  // Terminology: "Shadow slices" are slices which fill in the gaps between real
-  // slices from the underlying cursor in each partition (if any).
-  // For queries which don't need "shadow slices", we simply return non-zero
-  // duration slices from the underlying cursor.
-  do {
-    if (mode_ == Mode::kShadowSlice) {
-      PERFETTO_DCHECK(defn_->emit_shadow_slices());
-
-      // If we're out of slices in the cursor, this shadow slice will be the
-      // final slice.
-      if (cursor_eof_) {
-        mode_ = Mode::kRealSlice;
-        return StepRet(StepRet::Code::kEof);
-      }
+// static
+int SpanJoinOperatorTable::SpanIndex::Build(
+    sqlite3* db,
+    const TableDefinition& defn,
+    std::string sql,
+    std::unique_ptr<SpanIndex>* out) {
+  sqlite3_stmt* raw_stmt = nullptr;
+  int err = sqlite3_prepare_v2(db, sql.c_str(), static_cast<int>(sql.size()),
+                               &raw_stmt, nullptr);
+  ScopedStmt stmt(raw_stmt);
+  if (err != SQLITE_OK)
+    return err;
 
-      // Look ahead to see if the cursor changes partition (if the cursor is
-      // partitioned). If so, then we need to fill the gap between the ts == 0
-      // and the start of that slice. Otherwise after this slice, we have the
-      // real slice from the cursor.
-      if (!defn_->IsPartitioned() || partition_ == CursorPartition()) {
-        mode_ = Mode::kRealSlice;
-        ts_start_ = CursorTs();
-        ts_end_ = ts_start_ + CursorDur();
-      } else if (IsFullPartitionShadowSlice()) {
-        mode_ = Mode::kShadowSlice;
-        ts_start_ = 0;
-        ts_end_ = CursorTs();
-        partition_ = CursorPartition();
-      } else {
-        mode_ = Mode::kShadowSlice;
-        ts_start_ = 0;
-        ts_end_ = std::numeric_limits<int64_t>::max();
-      }
+  std::unique_ptr<SpanIndex> index(new SpanIndex(std::move(sql)));
+  index->columns_.resize(defn.columns().size());
+
+  auto ts_idx = static_cast<int>(defn.ts_idx());
+  auto dur_idx = static_cast<int>(defn.dur_idx());
+  auto partition_idx = static_cast<int>(defn.partition_idx());
+  std::vector<int64_t> partitions;
+  std::vector<int64_t> ts_starts;
+  std::vector<int64_t> ts_ends;
+  uint32_t row = 0;
+  for (err = sqlite3_step(*stmt); err == SQLITE_ROW;
+       err = sqlite3_step(*stmt)) {
+    // Rows with null partition keys and empty spans can never be part of the
+    // output.
+    if (defn.IsPartitioned() &&
+        sqlite3_column_type(*stmt, partition_idx) == SQLITE_NULL) {
       continue;
     }
+    int64_t ts = sqlite3_column_int64(*stmt, ts_idx);
+    int64_t dur = sqlite3_column_int64(*stmt, dur_idx);
+    if (dur <= 0)
+      continue;
 
-    int res;
-    if (defn_->IsPartitioned()) {
-      auto partition_idx = static_cast<int>(defn_->partition_idx());
-      // Fastforward through any rows with null partition keys.
-      int row_type;
-      do {
-        res = sqlite3_step(stmt);
-        row_type = sqlite3_column_type(stmt, partition_idx);
-      } while (res == SQLITE_ROW && row_type == SQLITE_NULL);
-    } else {
-      res = sqlite3_step(stmt);
-    }
-
-    if (res == SQLITE_ROW) {
-      // After every row, there will be a shadow slice so emit that if we need
-      // to do so. Otherwise, just emit the underlying slice.
-      if (defn_->emit_shadow_slices()) {
-        mode_ = Mode::kShadowSlice;
-        ts_start_ = ts_end_;
-        ts_end_ = !defn_->IsPartitioned() || partition_ == CursorPartition()
-                      ? CursorTs()
-                      : std::numeric_limits<int64_t>::max();
-      } else {
-        mode_ = Mode::kRealSlice;
-        ts_start_ = CursorTs();
-        ts_end_ = ts_start_ + CursorDur();
-        if (defn_->IsPartitioned())
-          partition_ = CursorPartition();
+    partitions.push_back(defn.IsPartitioned()
+                             ? sqlite3_column_int64(*stmt, partition_idx)
+                             : 0);
+    ts_starts.push_back(ts);
+    ts_ends.push_back(ts + dur);
+    for (size_t i = 0; i < defn.columns().size(); i++) {
+      auto col = static_cast<int>(i);
+      if (col == ts_idx || col == dur_idx ||
+          (defn.IsPartitioned() && col == partition_idx)) {
+        continue;
       }
-    } else if (res == SQLITE_DONE) {
-      cursor_eof_ = true;
-      if (!defn_->emit_shadow_slices())
-        return StepRet(StepRet::Code::kEof);
-
-      // Close off the remainder of this partition with a shadow slice.
-      mode_ = Mode::kShadowSlice;
-      ts_start_ = ts_end_;
-      ts_end_ = std::numeric_limits<int64_t>::max();
-    } else {
-      return StepRet(StepRet::Code::kError, res);
+      ColumnValues* values = &index->columns_[i];
+      int type = sqlite3_column_type(*stmt, col);
+      int64_t value = 0;
+      switch (type) {
+        case SQLITE_INTEGER:
+          value = sqlite3_column_int64(*stmt, col);
+          break;
+        case SQLITE_FLOAT: {
+          double double_value = sqlite3_column_double(*stmt, col);
+          memcpy(&value, &double_value, sizeof(value));
+          break;
+        }
+        case SQLITE_TEXT: {
+          auto str = reinterpret_cast<const char*>(
+              sqlite3_column_text(*stmt, col));
+          value = static_cast<int64_t>(index->string_data_.size());
+          index->string_data_.append(str, strlen(str) + 1);
+          break;
+        }
+        default:
+          type = SQLITE_NULL;
+          break;
+      }
+      values->types.push_back(static_cast<uint8_t>(type));
+      values->values.push_back(value);
     }
-  } while (ts_start_ == ts_end_);
-
-  return StepRet(StepRet::Code::kRow);
-}
-
-SpanJoinOperatorTable::Query::StepRet
-SpanJoinOperatorTable::Query::StepToNextPartition() {
-  PERFETTO_DCHECK(defn_->IsPartitioned());
-  PERFETTO_DCHECK(!Eof());
-
-  auto current_partition = partition_;
-  while (partition_ <= current_partition) {
-    auto res = Step();
-    if (!res.is_row())
-      return res;
+    row++;
   }
-  return StepRet(StepRet::Code::kRow);
-}
-
-SpanJoinOperatorTable::Query::StepRet
-SpanJoinOperatorTable::Query::StepToPartition(int64_t target_partition) {
-  PERFETTO_DCHECK(partition_ <= target_partition);
-  if (defn_->IsPartitioned()) {
-    while (partition_ < target_partition) {
-      if (IsFullPartitionShadowSlice() &&
-          target_partition < CursorPartition()) {
-        partition_ = target_partition;
-        return StepRet(StepRet::Code::kRow);
-      }
+  if (err != SQLITE_DONE)
+    return err;
 
-      auto res = Step();
-      if (!res.is_row())
-        return res;
+  index->rows_.resize(row);
+  for (uint32_t i = 0; i < row; i++)
+    index->rows_[i] = i;
+  std::sort(index->rows_.begin(), index->rows_.end(),
+            [&partitions, &ts_starts](uint32_t a, uint32_t b) {
+              return std::tie(partitions[a], ts_starts[a], a) <
+                     std::tie(partitions[b], ts_starts[b], b);
+            });
+
+  index->ts_starts_.resize(row);
+  index->ts_ends_.resize(row);
+  for (uint32_t span = 0; span < row; span++) {
+    uint32_t r = index->rows_[span];
+    index->ts_starts_[span] = ts_starts[r];
+    index->ts_ends_[span] = ts_ends[r];
+
+    int64_t partition = partitions[r];
+    if (index->partitions_.empty() ||
+        index->partitions_.back().partition != partition) {
+      index->partitions_.push_back({partition, span, span});
     }
-  } else if (/* !defn_->IsPartitioned() && */ partition_ < target_partition) {
-    int res = PrepareRawStmt();
-    if (res != SQLITE_OK)
-      return StepRet(StepRet::Code::kError, res);
-    partition_ = target_partition;
+    index->partitions_.back().end = span + 1;
   }
-  return StepRet(StepRet::Code::kRow);
-}
+  if (!defn.IsPartitioned() && index->partitions_.empty())
+    index->partitions_.push_back({0, 0, 0});
 
-SpanJoinOperatorTable::Query::StepRet SpanJoinOperatorTable::Query::StepUntil(
-    int64_t timestamp) {
-  PERFETTO_DCHECK(!Eof());
-  auto partition = partition_;
-  while (partition_ == partition && ts_end_ <= timestamp) {
-    auto res = Step();
-    if (!res.is_row())
-      return res;
-  }
-  return StepRet(StepRet::Code::kRow);
+  *out = std::move(index);
+  return SQLITE_OK;
 }
 
-std::string SpanJoinOperatorTable::Query::CreateSqlQuery(
-    const std::vector<std::string>& cs) const {
-  std::vector<std::string> col_names;
-  for (const Table::Column& c : defn_->columns()) {
-    col_names.push_back("`" + c.name() + "`");
-  }
-
-  std::string sql = "SELECT " + base::Join(col_names, ", ");
-  sql += " FROM " + defn_->name();
-  if (!cs.empty()) {
-    sql += " WHERE " + base::Join(cs, " AND ");
+void SpanJoinOperatorTable::SpanIndex::ReportSqliteResult(
+    sqlite3_context* context,
+    uint32_t span,
+    size_t index) const {
+  const ColumnValues& values = columns_[index];
+  uint32_t row = rows_[span];
+  int64_t value = values.values[row];
+  switch (values.types[row]) {
+    case SQLITE_INTEGER:
+      sqlite3_result_int64(context, value);
+      break;
+    case SQLITE_FLOAT: {
+      double double_value;
+      memcpy(&double_value, &value, sizeof(double_value));
+      sqlite3_result_double(context, double_value);
+      break;
+    }
+    case SQLITE_TEXT:
+      sqlite3_result_text(context,
+                          string_data_.data() + static_cast<size_t>(value), -1,
+                          sqlite_utils::kSqliteStatic);
+      break;
+    default:
+      sqlite3_result_null(context);
+      break;
   }
-  sql += " ORDER BY ";
-  sql += defn_->IsPartitioned()
-             ? base::Join({"`" + defn_->partition_col() + "`", "ts"}, ", ")
-             : "ts";
-  sql += ";";
-  PERFETTO_DLOG("%s", sql.c_str());
-  return sql;
 }
 
-int SpanJoinOperatorTable::Query::PrepareRawStmt() {
-  sqlite3_stmt* stmt = nullptr;
-  int err =
-      sqlite3_prepare_v2(db_, sql_query_.c_str(),
-                         static_cast<int>(sql_query_.size()), &stmt, nullptr);
-  stmt_.reset(stmt);
-
-  ts_start_ = 0;
-  ts_end_ = 0;
-  partition_ = std::numeric_limits<int64_t>::lowest();
-  cursor_eof_ = false;
-  mode_ = Mode::kRealSlice;
-
-  return err;
+void SpanJoinOperatorTable::SpanIterator::Reset(
+    const SpanIndex* index,
+    const SpanIndex::Partition* partition,
+    bool emit_shadow_slices) {
+  index_ = index;
+  next_span_ = partition ? partition->start : 0;
+  end_span_ = partition ? partition->end : 0;
+  emit_shadow_slices_ = emit_shadow_slices;
+  covered_until_ = 0;
+  eof_ = false;
+  Next();
 }
 
-void SpanJoinOperatorTable::Query::ReportSqliteResult(sqlite3_context* context,
-                                                      size_t index) {
-  if (mode_ != Mode::kRealSlice) {
-    sqlite3_result_null(context);
+void SpanJoinOperatorTable::SpanIterator::Next() {
+  PERFETTO_DCHECK(!eof_);
+  constexpr int64_t kEndOfTime = std::numeric_limits<int64_t>::max();
+  if (next_span_ == end_span_) {
+    // Close off the remainder of the partition with a shadow slice.
+    if (emit_shadow_slices_ && covered_until_ < kEndOfTime) {
+      is_real_ = false;
+      ts_start_ = covered_until_;
+      ts_end_ = kEndOfTime;
+      covered_until_ = kEndOfTime;
+    } else {
+      eof_ = true;
+    }
     return;
   }
 
-  sqlite3_stmt* stmt = stmt_.get();
-  int idx = static_cast<int>(index);
-  switch (sqlite3_column_type(stmt, idx)) {
-    case SQLITE_INTEGER:
-      sqlite3_result_int64(context, sqlite3_column_int64(stmt, idx));
-      break;
-    case SQLITE_FLOAT:
-      sqlite3_result_double(context, sqlite3_column_double(stmt, idx));
-      break;
-    case SQLITE_TEXT: {
-      // TODO(lalitm): note for future optimizations: if we knew the addresses
-      // of the string intern pool, we could check if the string returned here
-      // comes from the pool, and pass it as non-transient.
-      const auto kSqliteTransient =
-          reinterpret_cast<sqlite3_destructor_type>(-1);
-      auto ptr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, idx));
-      sqlite3_result_text(context, ptr, -1, kSqliteTransient);
-      break;
-    }
+  int64_t span_start = index_->ts_start(next_span_);
+  if (emit_shadow_slices_ && covered_until_ < span_start) {
+    is_real_ = false;
+    ts_start_ = covered_until_;
+    ts_end_ = span_start;
+    covered_until_ = span_start;
+    return;
   }
+
+  is_real_ = true;
+  span_ = next_span_++;
+  ts_start_ = span_start;
+  ts_end_ = index_->ts_end(span_);
+  covered_until_ = std::max(covered_until_, ts_end_);
 }
 
 SpanJoinOperatorTable::TableDefinition::TableDefinition(
@@ -65,6 +65,10 @@ namespace trace_processor {
 //
 // All other columns apart from timestamp (ts), duration (dur) and the join key
 // are passed through unchanged.
+//
+// span_left_join also outputs the parts of the spans of the first table which
+// don't overlap any span of the second table, with NULL values for the columns
+// of the second table. span_outer_join does this for both tables.
 class SpanJoinOperatorTable : public Table {
  public:
   // Columns of the span operator table.
@@ -77,7 +81,9 @@ class SpanJoinOperatorTable : public Table {
 
   SpanJoinOperatorTable(sqlite3*, const TraceStorage*);
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   // Table implementation.
   base::Optional<Table::Schema> Init(int, const char* const*) override;
@@ -137,96 +143,99 @@ class SpanJoinOperatorTable : public Table {
     uint32_t partition_idx_ = std::numeric_limits<uint32_t>::max();
   };
 
-  class Query {
+  // The spans of a child table, read with a single query on the table and
+  // sorted by partition and start timestamp, along with the values of their
+  // other columns. The cursors sweep over this index instead of stepping the
+  // child query, so the spans of an unpartitioned table are read once rather
+  // than once for every partition of the other table.
+  class SpanIndex {
    public:
-    struct StepRet {
-      enum Code {
-        kRow,
-        kEof,
-        kError,
-      };
-
-      StepRet(Code c, int e = SQLITE_OK) : code(c), err_code(e) {}
-
-      bool is_row() const { return code == Code::kRow; }
-      bool is_eof() const { return code == Code::kEof; }
-      bool is_err() const { return code == Code::kError; }
-
-      Code code = Code::kEof;
-      int err_code = SQLITE_OK;
+    // The spans of a partition are [start, end) in the index. Unpartitioned
+    // tables have a single (possibly empty) partition.
+    struct Partition {
+      int64_t partition;
+      uint32_t start;
+      uint32_t end;
     };
 
-    Query(SpanJoinOperatorTable*, const TableDefinition*, sqlite3* db);
-    virtual ~Query();
+    // Runs |sql| and indexes the spans it returns. Returns an SQLite error
+    // code.
+    static int Build(sqlite3* db,
+                     const TableDefinition& defn,
+                     std::string sql,
+                     std::unique_ptr<SpanIndex>* index);
 
-    int Initialize(const QueryConstraints& qc, sqlite3_value** argv);
-
-    StepRet Step();
-    StepRet StepToNextPartition();
-    StepRet StepToPartition(int64_t target_partition);
-    StepRet StepUntil(int64_t timestamp);
+    void ReportSqliteResult(sqlite3_context* context,
+                            uint32_t span,
+                            size_t index) const;
 
-    void ReportSqliteResult(sqlite3_context* context, size_t index);
+    const std::string& sql() const { return sql_; }
+    const std::vector<Partition>& partitions() const { return partitions_; }
+    int64_t ts_start(uint32_t span) const { return ts_starts_[span]; }
+    int64_t ts_end(uint32_t span) const { return ts_ends_[span]; }
 
-    int64_t ts_start() const { return ts_start_; }
-    int64_t ts_end() const { return ts_end_; }
-    int64_t partition() const { return partition_; }
+   private:
+    // The values of one of the columns, by row of the query result.
+    struct ColumnValues {
+      // The SQLite type of each value.
+      std::vector<uint8_t> types;
 
-    const TableDefinition* definition() const { return defn_; }
+      // Integers, bit casted doubles or offsets in |string_data_|.
+      std::vector<int64_t> values;
+    };
 
-    bool Eof() const { return cursor_eof_ && mode_ == Mode::kRealSlice; }
-    bool IsPartitioned() const { return defn_->IsPartitioned(); }
-    bool IsRealSlice() const { return mode_ == Mode::kRealSlice; }
+    explicit SpanIndex(std::string sql) : sql_(std::move(sql)) {}
 
-    bool IsFullPartitionShadowSlice() const {
-      return mode_ == Mode::kShadowSlice && ts_start_ == 0 &&
-             ts_end_ == std::numeric_limits<int64_t>::max();
-    }
+    std::string sql_;
+    std::vector<Partition> partitions_;
 
-   private:
-    enum Mode {
-      kRealSlice,
-      kShadowSlice,
-    };
+    // The start, end and row in |columns_| of each span.
+    std::vector<int64_t> ts_starts_;
+    std::vector<int64_t> ts_ends_;
+    std::vector<uint32_t> rows_;
 
-    int PrepareRawStmt();
-    std::string CreateSqlQuery(const std::vector<std::string>& cs) const;
+    // Empty for the ts, dur and partition columns.
+    std::vector<ColumnValues> columns_;
+    std::string string_data_;
+  };
 
-    int64_t CursorTs() const {
-      auto ts_idx = static_cast<int>(defn_->ts_idx());
-      return sqlite3_column_int64(stmt_.get(), ts_idx);
-    }
+  // Iterates over the spans of one partition of a SpanIndex by increasing
+  // start timestamp.
+  // Terminology: "Shadow slices" are slices which fill in the gaps between real
+  // slices in each partition, from 0 to the end of time.
+  class SpanIterator {
+   public:
+    void Reset(const SpanIndex* index,
+               const SpanIndex::Partition* partition,
+               bool emit_shadow_slices);
+    void Next();
 
-    int64_t CursorDur() const {
-      auto dur_idx = static_cast<int>(defn_->dur_idx());
-      return sqlite3_column_int64(stmt_.get(), dur_idx);
-    }
+    bool Eof() const { return eof_; }
+    bool IsRealSlice() const { return is_real_; }
+    int64_t ts_start() const { return ts_start_; }
+    int64_t ts_end() const { return ts_end_; }
+    uint32_t span() const { return span_; }
 
-    int64_t CursorPartition() const {
-      PERFETTO_DCHECK(defn_->IsPartitioned());
-      auto partition_idx = static_cast<int>(defn_->partition_idx());
-      return sqlite3_column_int64(stmt_.get(), partition_idx);
-    }
+   private:
+    const SpanIndex* index_ = nullptr;
+    uint32_t next_span_ = 0;
+    uint32_t end_span_ = 0;
+    bool emit_shadow_slices_ = false;
 
-    std::string sql_query_;
-    ScopedStmt stmt_;
+    // End of the time covered by the slices returned so far.
+    int64_t covered_until_ = 0;
 
     int64_t ts_start_ = 0;
     int64_t ts_end_ = 0;
-    int64_t partition_ = std::numeric_limits<int64_t>::lowest();
-
-    bool cursor_eof_ = false;
-    Mode mode_ = Mode::kRealSlice;
-
-    const TableDefinition* const defn_;
-    sqlite3* const db_;
-    SpanJoinOperatorTable* const table_;
+    uint32_t span_ = 0;
+    bool is_real_ = false;
+    bool eof_ = true;
   };
 
   // Base class for a cursor on the span table.
   class Cursor : public Table::Cursor {
    public:
-    Cursor(SpanJoinOperatorTable*, sqlite3* db);
+    explicit Cursor(SpanJoinOperatorTable*);
     ~Cursor() override = default;
 
     int Initialize(const QueryConstraints& qc, sqlite3_value** argv);
@@ -235,12 +244,26 @@ class SpanJoinOperatorTable : public Table {
     int Next() override;
     int Eof() override;
 
-   protected:
-    bool IsOverlappingSpan();
+   private:
+    // Moves the iterators to the next partition present in the output.
+    // Returns false if there are no more partitions.
+    bool NextPartition();
 
-    Query t1_;
-    Query t2_;
-    Query* next_stepped_ = nullptr;
+    // Steps the iterators until they are on overlapping spans, at least one
+    // of them real, moving to the following partitions if needed.
+    void FindOverlappingSpan();
+
+    std::shared_ptr<const SpanIndex> t1_index_;
+    std::shared_ptr<const SpanIndex> t2_index_;
+
+    SpanIterator t1_;
+    SpanIterator t2_;
+
+    // The next partition of each index to join.
+    size_t t1_next_partition_ = 0;
+    size_t t2_next_partition_ = 0;
+    int64_t partition_ = 0;
+    bool eof_ = false;
 
     SpanJoinOperatorTable* const table_;
   };
@@ -252,6 +275,7 @@ class SpanJoinOperatorTable : public Table {
   };
 
   bool IsLeftJoin() const { return name() == "span_left_join"; }
+  bool IsOuterJoin() const { return name() == "span_outer_join"; }
 
   const std::string& partition_col() const {
     return t1_defn_.IsPartitioned() ? t1_defn_.partition_col()
@@ -273,11 +297,26 @@ class SpanJoinOperatorTable : public Table {
   void CreateSchemaColsForDefn(const TableDefinition& defn,
                                std::vector<Table::Column>* cols);
 
+  std::string CreateSqlQuery(const TableDefinition& defn,
+                             const std::vector<std::string>& cs) const;
+
+  // Returns the index of the spans returned by |sql| on the table of |defn|,
+  // reusing the index of a live cursor running the same query.
+  int GetSpanIndex(const TableDefinition& defn,
+                   std::string sql,
+                   std::shared_ptr<const SpanIndex>* index);
+
   TableDefinition t1_defn_;
   TableDefinition t2_defn_;
   PartitioningType partitioning_;
   std::unordered_map<size_t, ColumnLocator> global_index_to_column_locator_;
 
+  // The indexes of the live cursors. SQLite creates a new cursor for each
+  // filter of the table (e.g. for every row of the outer table of a nested
+  // loop join) while the previous one is still alive: this avoids reading
+  // the child tables again each time.
+  std::vector<std::weak_ptr<const SpanIndex>> span_indexes_;
+
   sqlite3* const db_;
 };
 
@@ -34,7 +34,8 @@ class SpanJoinOperatorTableTest : public ::testing::Test {
 
     context_.storage.reset(new TraceStorage());
 
-    SpanJoinOperatorTable::RegisterTable(db_.get(), context_.storage.get());
+    SpanJoinOperatorTable::RegisterTable(db_.get(), context_.storage.get(),
+                                         nullptr);
   }
 
   void PrepareValidStatement(const std::string& sql) {
@@ -261,6 +262,107 @@ TEST_F(SpanJoinOperatorTableTest, NoPartitioning) {
   ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
 }
 
+TEST_F(SpanJoinOperatorTableTest, OuterJoin) {
+  RunStatement(
+      "CREATE TEMP TABLE f("
+      "ts BIG INT PRIMARY KEY, "
+      "dur BIG INT, "
+      "cpu UNSIGNED INT, "
+      "f_val BIG INT"
+      ");");
+  RunStatement(
+      "CREATE TEMP TABLE s("
+      "ts BIG INT PRIMARY KEY, "
+      "dur BIG INT, "
+      "cpu UNSIGNED INT, "
+      "s_val BIG INT"
+      ");");
+  RunStatement(
+      "CREATE VIRTUAL TABLE sp USING span_outer_join(f PARTITIONED cpu, "
+      "s PARTITIONED cpu);");
+
+  RunStatement("INSERT INTO f VALUES(100, 10, 1, 111);");
+  RunStatement("INSERT INTO f VALUES(200, 10, 2, 222);");
+
+  RunStatement("INSERT INTO s VALUES(105, 20, 1, 333);");
+  RunStatement("INSERT INTO s VALUES(300, 10, 3, 444);");
+
+  PrepareValidStatement(
+      "SELECT ts, dur, cpu, IFNULL(f_val, -1), IFNULL(s_val, -1) FROM sp");
+  AssertNextRow({100, 5, 1, 111, -1});
+  AssertNextRow({105, 5, 1, 111, 333});
+  AssertNextRow({110, 15, 1, -1, 333});
+  AssertNextRow({200, 10, 2, 222, -1});
+  AssertNextRow({300, 10, 3, -1, 444});
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+}
+
+TEST_F(SpanJoinOperatorTableTest, LeftJoinPartitionsAfterLastT2Partition) {
+  RunStatement(
+      "CREATE TEMP TABLE f("
+      "ts BIG INT PRIMARY KEY, "
+      "dur BIG INT, "
+      "cpu UNSIGNED INT, "
+      "f_val BIG INT"
+      ");");
+  RunStatement(
+      "CREATE TEMP TABLE s("
+      "ts BIG INT PRIMARY KEY, "
+      "dur BIG INT, "
+      "cpu UNSIGNED INT, "
+      "s_val BIG INT"
+      ");");
+  RunStatement(
+      "CREATE VIRTUAL TABLE sp USING span_left_join(f PARTITIONED cpu, "
+      "s PARTITIONED cpu);");
+
+  RunStatement("INSERT INTO f VALUES(100, 10, 1, 111);");
+  RunStatement("INSERT INTO f VALUES(200, 10, 3, 333);");
+  RunStatement("INSERT INTO f VALUES(300, 10, 5, 555);");
+
+  RunStatement("INSERT INTO s VALUES(100, 5, 1, 444);");
+  RunStatement("INSERT INTO s VALUES(150, 10, 2, 666);");
+
+  // The partitions of f after the last partition of s are still emitted.
+  PrepareValidStatement(
+      "SELECT ts, dur, cpu, f_val, IFNULL(s_val, -1) FROM sp");
+  AssertNextRow({100, 5, 1, 111, 444});
+  AssertNextRow({105, 5, 1, 111, -1});
+  AssertNextRow({200, 10, 3, 333, -1});
+  AssertNextRow({300, 10, 5, 555, -1});
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+}
+
+TEST_F(SpanJoinOperatorTableTest, LeftJoinEmptyT2) {
+  RunStatement(
+      "CREATE TEMP TABLE f("
+      "ts BIG INT PRIMARY KEY, "
+      "dur BIG INT, "
+      "cpu UNSIGNED INT, "
+      "f_val BIG INT"
+      ");");
+  RunStatement(
+      "CREATE TEMP TABLE s("
+      "ts BIG INT PRIMARY KEY, "
+      "dur BIG INT, "
+      "cpu UNSIGNED INT, "
+      "s_val BIG INT"
+      ");");
+  RunStatement(
+      "CREATE VIRTUAL TABLE sp USING span_left_join(f PARTITIONED cpu, "
+      "s PARTITIONED cpu);");
+
+  RunStatement("INSERT INTO f VALUES(100, 10, 1, 111);");
+  RunStatement("INSERT INTO f VALUES(200, 10, 2, 222);");
+
+  // All the rows of f are emitted when s is empty.
+  PrepareValidStatement(
+      "SELECT ts, dur, cpu, f_val, IFNULL(s_val, -1) FROM sp");
+  AssertNextRow({100, 10, 1, 111, -1});
+  AssertNextRow({200, 10, 2, 222, -1});
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
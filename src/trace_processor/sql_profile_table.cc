@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/sql_profile_table.h"
+
+#include <sqlite3.h>
+
+#include "src/trace_processor/sqlite_utils.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+SqlProfileTable::SqlProfileTable(sqlite3*, const TraceStorage* storage)
+    : storage_(storage) {}
+
+void SqlProfileTable::RegisterTable(sqlite3* db,
+                                    const TraceStorage* storage,
+                                    const QueryContext* context) {
+  Table::Register<SqlProfileTable>(db, storage, context, "sql_profile");
+}
+
+base::Optional<Table::Schema> SqlProfileTable::Init(int, const char* const*) {
+  return Schema(
+      {
+          Table::Column(Column::kTimeStarted, "started", ColumnType::kLong),
+          Table::Column(Column::kTable, "table_name", ColumnType::kString),
+          Table::Column(Column::kFilterCalls, "filter_calls",
+                        ColumnType::kLong),
+          Table::Column(Column::kNextCalls, "next_calls", ColumnType::kLong),
+          Table::Column(Column::kColumnCalls, "column_calls",
+                        ColumnType::kLong),
+          Table::Column(Column::kRowsScanned, "rows_scanned",
+                        ColumnType::kLong),
+          Table::Column(Column::kRowsReturned, "rows_returned",
+                        ColumnType::kLong),
+          Table::Column(Column::kFilterDur, "filter_dur", ColumnType::kLong),
+          Table::Column(Column::kNextDur, "next_dur", ColumnType::kLong),
+          Table::Column(Column::kColumnDur, "column_dur", ColumnType::kLong),
+          Table::Column(Column::kQueryId, "query_id", ColumnType::kLong),
+      },
+      {Column::kQueryId, Column::kTable});
+}
+
+std::unique_ptr<Table::Cursor> SqlProfileTable::CreateCursor(
+    const QueryConstraints&,
+    sqlite3_value**) {
+  return std::unique_ptr<Table::Cursor>(new Cursor(storage_));
+}
+
+int SqlProfileTable::BestIndex(const QueryConstraints&, BestIndexInfo* info) {
+  info->order_by_consumed = false;  // Delegate sorting to SQLite.
+  return SQLITE_OK;
+}
+
+SqlProfileTable::Cursor::Cursor(const TraceStorage* storage)
+    : stats_(storage->sql_stats().CopyEntries()) {
+  SkipEmptyQueries();
+}
+
+SqlProfileTable::Cursor::~Cursor() = default;
+
+void SqlProfileTable::Cursor::SkipEmptyQueries() {
+  while (query_ < stats_.size() && stats_.profiles[query_].tables().empty())
+    query_++;
+}
+
+int SqlProfileTable::Cursor::Next() {
+  if (++table_ < stats_.profiles[query_].tables().size())
+    return SQLITE_OK;
+  table_ = 0;
+  query_++;
+  SkipEmptyQueries();
+  return SQLITE_OK;
+}
+
+int SqlProfileTable::Cursor::Eof() {
+  return query_ >= stats_.size();
+}
+
+int SqlProfileTable::Cursor::Column(sqlite3_context* context, int col) {
+  const QueryProfile::TableStats& table =
+      stats_.profiles[query_].tables()[table_];
+  switch (col) {
+    case Column::kTimeStarted:
+      sqlite3_result_int64(context, stats_.times_started[query_]);
+      break;
+    case Column::kTable:
+      sqlite3_result_text(context, table.table.c_str(), -1,
+                          sqlite_utils::kSqliteStatic);
+      break;
+    case Column::kFilterCalls:
+      sqlite3_result_int64(context,
+                           static_cast<int64_t>(table.filter_calls));
+      break;
+    case Column::kNextCalls:
+      sqlite3_result_int64(context, static_cast<int64_t>(table.next_calls));
+      break;
+    case Column::kColumnCalls:
+      sqlite3_result_int64(context,
+                           static_cast<int64_t>(table.column_calls));
+      break;
+    case Column::kRowsScanned:
+      sqlite3_result_int64(context,
+                           static_cast<int64_t>(table.rows_scanned));
+      break;
+    case Column::kRowsReturned:
+      sqlite3_result_int64(context,
+                           static_cast<int64_t>(table.rows_returned));
+      break;
+    case Column::kFilterDur:
+      sqlite3_result_int64(context, table.filter_ns);
+      break;
+    case Column::kNextDur:
+      sqlite3_result_int64(context, table.next_ns);
+      break;
+    case Column::kColumnDur:
+      sqlite3_result_int64(context, table.column_ns);
+      break;
+    case Column::kQueryId:
+      sqlite3_result_int64(context, stats_.ids[query_]);
+      break;
+  }
+  return SQLITE_OK;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
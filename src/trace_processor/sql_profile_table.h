@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACE_PROCESSOR_SQL_PROFILE_TABLE_H_
+#define SRC_TRACE_PROCESSOR_SQL_PROFILE_TABLE_H_
+
+#include <memory>
+
+#include "src/trace_processor/table.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class QueryConstraints;
+
+// A virtual table with the calls made to each virtual table by the queries
+// logged in the sqlstats table, when they are profiled. The rows of a query
+// have its sqlstats |id| as |query_id|, and the same |started| time.
+class SqlProfileTable : public Table {
+ public:
+  enum Column {
+    kTimeStarted = 0,
+    kTable = 1,
+    kFilterCalls = 2,
+    kNextCalls = 3,
+    kColumnCalls = 4,
+    kRowsScanned = 5,
+    kRowsReturned = 6,
+    kFilterDur = 7,
+    kNextDur = 8,
+    kColumnDur = 9,
+    kQueryId = 10,
+  };
+
+  SqlProfileTable(sqlite3*, const TraceStorage* storage);
+
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
+
+  // Table implementation.
+  base::Optional<Table::Schema> Init(int, const char* const*) override;
+  std::unique_ptr<Table::Cursor> CreateCursor(const QueryConstraints&,
+                                              sqlite3_value**) override;
+  int BestIndex(const QueryConstraints&, BestIndexInfo*) override;
+
+ private:
+  // Implementation of the SQLite cursor interface.
+  class Cursor : public Table::Cursor {
+   public:
+    Cursor(const TraceStorage* storage);
+    ~Cursor() override;
+
+    // Implementation of Table::Cursor.
+    int Next() override;
+    int Eof() override;
+    int Column(sqlite3_context*, int N) override;
+
+   private:
+    // Moves to the first table of the query at or after |query_| with any.
+    void SkipEmptyQueries();
+
+    // A copy of the stats taken when the cursor is created, as they can be
+    // updated by a query running on another connection.
+    const TraceStorage::SqlStats::Entries stats_;
+    size_t query_ = 0;
+    size_t table_ = 0;
+  };
+
+  const TraceStorage* const storage_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQL_PROFILE_TABLE_H_
@@ -31,8 +31,10 @@ namespace trace_processor {
 SqlStatsTable::SqlStatsTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
-void SqlStatsTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<SqlStatsTable>(db, storage, "sqlstats");
+void SqlStatsTable::RegisterTable(sqlite3* db,
+                                  const TraceStorage* storage,
+                                  const QueryContext* context) {
+  Table::Register<SqlStatsTable>(db, storage, context, "sqlstats");
 }
 
 base::Optional<Table::Schema> SqlStatsTable::Init(int, const char* const*) {
@@ -42,6 +44,8 @@ base::Optional<Table::Schema> SqlStatsTable::Init(int, const char* const*) {
           Table::Column(Column::kTimeQueued, "queued", ColumnType::kLong),
           Table::Column(Column::kTimeStarted, "started", ColumnType::kLong),
           Table::Column(Column::kTimeEnded, "ended", ColumnType::kLong),
+          Table::Column(Column::kTimePrepared, "prepared", ColumnType::kLong),
+          Table::Column(Column::kId, "id", ColumnType::kLong),
       },
       {Column::kTimeQueued});
 }
@@ -57,9 +61,8 @@ int SqlStatsTable::BestIndex(const QueryConstraints&, BestIndexInfo* info) {
   return SQLITE_OK;
 }
 
-SqlStatsTable::Cursor::Cursor(const TraceStorage* storage) : storage_(storage) {
-  num_rows_ = storage->sql_stats().size();
-}
+SqlStatsTable::Cursor::Cursor(const TraceStorage* storage)
+    : stats_(storage->sql_stats().CopyEntries()) {}
 
 SqlStatsTable::Cursor::~Cursor() = default;
 
@@ -69,27 +72,33 @@ int SqlStatsTable::Cursor::Next() {
 }
 
 int SqlStatsTable::Cursor::Eof() {
-  return row_ >= num_rows_;
+  return row_ >= stats_.size();
 }
 
 int SqlStatsTable::Cursor::Column(sqlite3_context* context, int col) {
-  const TraceStorage::SqlStats& stats = storage_->sql_stats();
   switch (col) {
     case Column::kQuery:
-      sqlite3_result_text(context, stats.queries()[row_].c_str(), -1,
+      sqlite3_result_text(context, stats_.queries[row_].c_str(), -1,
                           sqlite_utils::kSqliteStatic);
       break;
     case Column::kTimeQueued:
       sqlite3_result_int64(context,
-                           static_cast<int64_t>(stats.times_queued()[row_]));
+                           static_cast<int64_t>(stats_.times_queued[row_]));
       break;
     case Column::kTimeStarted:
       sqlite3_result_int64(context,
-                           static_cast<int64_t>(stats.times_started()[row_]));
+                           static_cast<int64_t>(stats_.times_started[row_]));
       break;
     case Column::kTimeEnded:
       sqlite3_result_int64(context,
-                           static_cast<int64_t>(stats.times_ended()[row_]));
+                           static_cast<int64_t>(stats_.times_ended[row_]));
+      break;
+    case Column::kTimePrepared:
+      sqlite3_result_int64(context,
+                           static_cast<int64_t>(stats_.times_prepared[row_]));
+      break;
+    case Column::kId:
+      sqlite3_result_int64(context, stats_.ids[row_]);
       break;
   }
   return SQLITE_OK;
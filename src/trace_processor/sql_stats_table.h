@@ -21,12 +21,12 @@
 #include <memory>
 
 #include "src/trace_processor/table.h"
+#include "src/trace_processor/trace_storage.h"
 
 namespace perfetto {
 namespace trace_processor {
 
 class QueryConstraints;
-class TraceStorage;
 
 // A virtual table that allows to introspect performances of the SQL engine
 // for the kMaxLogEntries queries.
@@ -37,11 +37,15 @@ class SqlStatsTable : public Table {
     kTimeQueued = 1,
     kTimeStarted = 2,
     kTimeEnded = 3,
+    kTimePrepared = 4,
+    kId = 5,
   };
 
   SqlStatsTable(sqlite3*, const TraceStorage* storage);
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   // Table implementation.
   base::Optional<Table::Schema> Init(int, const char* const*) override;
@@ -62,9 +66,10 @@ class SqlStatsTable : public Table {
     int Column(sqlite3_context*, int N) override;
 
    private:
+    // A copy of the stats taken when the cursor is created, as they can be
+    // updated by a query running on another connection.
+    const TraceStorage::SqlStats::Entries stats_;
     size_t row_ = 0;
-    size_t num_rows_ = 0;
-    const TraceStorage* const storage_;
   };
 
   const TraceStorage* const storage_;
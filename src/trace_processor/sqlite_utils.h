@@ -26,6 +26,7 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/base/optional.h"
+#include "src/trace_processor/filter_kernels.h"
 #include "src/trace_processor/scoped_db.h"
 #include "src/trace_processor/table.h"
 
@@ -67,6 +68,18 @@ inline bool IsOpLt(int op) {
   return op == SQLITE_INDEX_CONSTRAINT_LT;
 }
 
+inline bool IsOpNe(int op) {
+  return op == SQLITE_INDEX_CONSTRAINT_NE;
+}
+
+inline bool IsOpGlob(int op) {
+  return op == SQLITE_INDEX_CONSTRAINT_GLOB;
+}
+
+inline bool IsOpLike(int op) {
+  return op == SQLITE_INDEX_CONSTRAINT_LIKE;
+}
+
 inline std::string OpToString(int op) {
   switch (op) {
     case SQLITE_INDEX_CONSTRAINT_EQ:
@@ -94,6 +107,36 @@ inline bool IsOpIsNotNull(int op) {
   return op == SQLITE_INDEX_CONSTRAINT_ISNOTNULL;
 }
 
+// Converts |op| to the equivalent operator of the filter kernels. Returns false
+// if there is no such operator (e.g. for IS NULL).
+inline bool ToCompareOp(int op, filter_kernels::CompareOp* compare_op) {
+  using filter_kernels::CompareOp;
+  switch (op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+    case SQLITE_INDEX_CONSTRAINT_IS:
+      *compare_op = CompareOp::kEq;
+      return true;
+    case SQLITE_INDEX_CONSTRAINT_NE:
+    case SQLITE_INDEX_CONSTRAINT_ISNOT:
+      *compare_op = CompareOp::kNe;
+      return true;
+    case SQLITE_INDEX_CONSTRAINT_LT:
+      *compare_op = CompareOp::kLt;
+      return true;
+    case SQLITE_INDEX_CONSTRAINT_LE:
+      *compare_op = CompareOp::kLe;
+      return true;
+    case SQLITE_INDEX_CONSTRAINT_GT:
+      *compare_op = CompareOp::kGt;
+      return true;
+    case SQLITE_INDEX_CONSTRAINT_GE:
+      *compare_op = CompareOp::kGe;
+      return true;
+    default:
+      return false;
+  }
+}
+
 template <typename T>
 T ExtractSqliteValue(sqlite3_value* value);
 
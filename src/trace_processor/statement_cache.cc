@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/statement_cache.h"
+
+#include <sqlite3.h>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// static
+constexpr size_t StatementCache::kDefaultCapacity;
+
+StatementCache::StatementCache(sqlite3* db, size_t capacity)
+    : db_(db), capacity_(capacity) {}
+
+StatementCache::~StatementCache() = default;
+
+int StatementCache::Acquire(base::StringView sql, ScopedStmt* stmt) {
+  auto it = index_.find(sql.ToStdString());
+  if (it != index_.end()) {
+    hits_++;
+    *stmt = std::move(it->second->stmt);
+    entries_.erase(it->second);
+    index_.erase(it);
+    return SQLITE_OK;
+  }
+
+  misses_++;
+  sqlite3_stmt* raw_stmt = nullptr;
+  int err = sqlite3_prepare_v2(db_, sql.data(), static_cast<int>(sql.size()),
+                               &raw_stmt, nullptr);
+  stmt->reset(raw_stmt);
+  return err;
+}
+
+void StatementCache::Release(std::string sql, ScopedStmt stmt) {
+  // Statements which failed to prepare or are empty (e.g. only a comment)
+  // are cheap to prepare again.
+  if (!stmt || capacity_ == 0)
+    return;
+
+  // The statement can be reused as long as its cursors are closed and its
+  // parameters are cleared. The error of the last step, if any, is reported
+  // again by sqlite3_reset() and doesn't matter here.
+  sqlite3_reset(*stmt);
+  sqlite3_clear_bindings(*stmt);
+
+  // Another query with the same SQL may have run at the same time: keep the
+  // statement released last.
+  auto it = index_.find(sql);
+  if (it != index_.end()) {
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+
+  if (entries_.size() >= capacity_) {
+    PERFETTO_DCHECK(!entries_.empty());
+    index_.erase(entries_.back().sql);
+    entries_.pop_back();
+  }
+
+  entries_.emplace_front(Entry{sql, std::move(stmt)});
+  index_.emplace(std::move(sql), entries_.begin());
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
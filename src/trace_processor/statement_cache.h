@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACE_PROCESSOR_STATEMENT_CACHE_H_
+#define SRC_TRACE_PROCESSOR_STATEMENT_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "perfetto/base/string_view.h"
+#include "src/trace_processor/scoped_db.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// A LRU cache of prepared statements keyed by their SQL text, to avoid
+// preparing (and so planning) again the queries which are run over and over
+// with different parameters.
+//
+// A statement is only used by one query at a time: Acquire() takes it out of
+// the cache and Release() puts it back once the query is done with it.
+class StatementCache {
+ public:
+  static constexpr size_t kDefaultCapacity = 64;
+
+  explicit StatementCache(sqlite3* db, size_t capacity = kDefaultCapacity);
+  ~StatementCache();
+
+  // Sets |stmt| to a statement running |sql|, either taken from the cache or
+  // newly prepared. Returns the error code of sqlite3_prepare_v2() if the
+  // statement had to be prepared and failed.
+  int Acquire(base::StringView sql, ScopedStmt* stmt);
+
+  // Resets |stmt|, which runs |sql|, and puts it in the cache, evicting the
+  // least recently used statement if it is full.
+  void Release(std::string sql, ScopedStmt stmt);
+
+  size_t size() const { return entries_.size(); }
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+
+ private:
+  struct Entry {
+    std::string sql;
+    ScopedStmt stmt;
+  };
+
+  StatementCache(const StatementCache&) = delete;
+  StatementCache& operator=(const StatementCache&) = delete;
+
+  sqlite3* const db_;
+  const size_t capacity_;
+
+  // The most recently used statement first.
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_STATEMENT_CACHE_H_
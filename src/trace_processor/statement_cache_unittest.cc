@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/statement_cache.h"
+
+#include <sqlite3.h>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class StatementCacheTest : public ::testing::Test {
+ public:
+  StatementCacheTest() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+  }
+
+  int64_t Run(sqlite3_stmt* stmt, int64_t arg) {
+    PERFETTO_CHECK(sqlite3_bind_int64(stmt, 1, arg) == SQLITE_OK);
+    PERFETTO_CHECK(sqlite3_step(stmt) == SQLITE_ROW);
+    return sqlite3_column_int64(stmt, 0);
+  }
+
+ protected:
+  ScopedDb db_;
+};
+
+TEST_F(StatementCacheTest, ReusesReleasedStatements) {
+  StatementCache cache(*db_);
+  const char kSql[] = "SELECT ? * 2";
+
+  ScopedStmt stmt;
+  ASSERT_EQ(cache.Acquire(kSql, &stmt), SQLITE_OK);
+  sqlite3_stmt* raw_stmt = *stmt;
+  ASSERT_EQ(Run(*stmt, 2), 4);
+  cache.Release(kSql, std::move(stmt));
+  ASSERT_EQ(cache.size(), 1u);
+
+  // The statement is reset and its parameters cleared.
+  ASSERT_EQ(cache.Acquire(kSql, &stmt), SQLITE_OK);
+  ASSERT_EQ(*stmt, raw_stmt);
+  ASSERT_EQ(cache.size(), 0u);
+  ASSERT_EQ(sqlite3_step(*stmt), SQLITE_ROW);
+  ASSERT_EQ(sqlite3_column_type(*stmt, 0), SQLITE_NULL);
+  sqlite3_reset(*stmt);
+  ASSERT_EQ(Run(*stmt, 3), 6);
+
+  ASSERT_EQ(cache.hits(), 1u);
+  ASSERT_EQ(cache.misses(), 1u);
+}
+
+TEST_F(StatementCacheTest, StatementsInUseAreNotShared) {
+  StatementCache cache(*db_);
+  const char kSql[] = "SELECT ? + 1";
+
+  ScopedStmt first;
+  ScopedStmt second;
+  ASSERT_EQ(cache.Acquire(kSql, &first), SQLITE_OK);
+  ASSERT_EQ(cache.Acquire(kSql, &second), SQLITE_OK);
+  ASSERT_NE(*first, *second);
+  ASSERT_EQ(Run(*first, 1), 2);
+  ASSERT_EQ(Run(*second, 2), 3);
+
+  cache.Release(kSql, std::move(first));
+  cache.Release(kSql, std::move(second));
+  ASSERT_EQ(cache.size(), 1u);
+}
+
+TEST_F(StatementCacheTest, EvictsLeastRecentlyUsed) {
+  StatementCache cache(*db_, 2);
+  for (const char* sql : {"SELECT 1", "SELECT 2", "SELECT 3"}) {
+    ScopedStmt stmt;
+    ASSERT_EQ(cache.Acquire(sql, &stmt), SQLITE_OK);
+    cache.Release(sql, std::move(stmt));
+  }
+  ASSERT_EQ(cache.size(), 2u);
+
+  ScopedStmt stmt;
+  ASSERT_EQ(cache.Acquire("SELECT 3", &stmt), SQLITE_OK);
+  cache.Release("SELECT 3", std::move(stmt));
+  ASSERT_EQ(cache.Acquire("SELECT 1", &stmt), SQLITE_OK);
+  ASSERT_EQ(cache.hits(), 1u);
+  ASSERT_EQ(cache.misses(), 4u);
+}
+
+TEST_F(StatementCacheTest, PrepareError) {
+  StatementCache cache(*db_);
+  ScopedStmt stmt;
+  ASSERT_NE(cache.Acquire("SELECT * FROM does_not_exist", &stmt), SQLITE_OK);
+  cache.Release("SELECT * FROM does_not_exist", std::move(stmt));
+  ASSERT_EQ(cache.size(), 0u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
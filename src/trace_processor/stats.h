@@ -31,6 +31,7 @@ namespace stats {
   F(android_log_num_total,                      kSingle,  kInfo,  kTrace),    \
   F(atrace_tgid_mismatch,                       kSingle,  kError, kTrace),    \
   F(clock_snapshot_not_monotonic,               kSingle,  kError, kTrace),    \
+  F(compressed_packets_invalid,                 kSingle,  kError, kTrace),    \
   F(counter_events_out_of_order,                kSingle,  kError, kAnalysis), \
   F(ftrace_bundle_tokenizer_errors,             kSingle,  kError, kAnalysis), \
   F(ftrace_cpu_bytes_read_begin,                kIndexed, kInfo,  kTrace),    \
@@ -49,6 +50,7 @@ namespace stats {
   F(ftrace_cpu_overrun_end,                     kIndexed, kError, kTrace),    \
   F(ftrace_cpu_read_events_begin,               kIndexed, kInfo,  kTrace),    \
   F(ftrace_cpu_read_events_end,                 kIndexed, kInfo,  kTrace),    \
+  F(heap_profile_invalid_ids,                   kSingle,  kError, kAnalysis), \
   F(invalid_clock_snapshots,                    kSingle,  kError, kAnalysis), \
   F(invalid_cpu_times,                          kSingle,  kError, kAnalysis), \
   F(meminfo_unknown_keys,                       kSingle,  kError, kAnalysis), \
@@ -59,6 +61,8 @@ namespace stats {
   F(rss_stat_unknown_keys,                      kSingle,  kError, kAnalysis), \
   F(rss_stat_negative_size,                     kSingle,  kInfo,  kAnalysis), \
   F(sched_switch_out_of_order,                  kSingle,  kError, kAnalysis), \
+  F(sorter_out_of_order_dropped,                kSingle,  kError, kAnalysis), \
+  F(sorter_peak_buffered_bytes,                 kSingle,  kInfo,  kAnalysis), \
   F(sys_unknown_syscall,                        kSingle,  kError, kAnalysis), \
   F(traced_buf_buffer_size,                     kIndexed, kInfo,  kTrace),    \
   F(traced_buf_bytes_overwritten,               kIndexed, kInfo,  kTrace),    \
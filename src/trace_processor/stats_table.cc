@@ -24,8 +24,10 @@ namespace trace_processor {
 StatsTable::StatsTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
-void StatsTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<StatsTable>(db, storage, "stats");
+void StatsTable::RegisterTable(sqlite3* db,
+                               const TraceStorage* storage,
+                               const QueryContext* context) {
+  Table::Register<StatsTable>(db, storage, context, "stats");
 }
 
 base::Optional<Table::Schema> StatsTable::Init(int, const char* const*) {
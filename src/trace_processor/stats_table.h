@@ -34,7 +34,9 @@ class StatsTable : public Table {
  public:
   enum Column { kName = 0, kIndex, kSeverity, kSource, kValue };
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   StatsTable(sqlite3*, const TraceStorage*);
 
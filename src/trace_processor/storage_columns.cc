@@ -23,9 +23,24 @@ StorageColumn::StorageColumn(std::string col_name, bool hidden)
     : col_name_(col_name), hidden_(hidden) {}
 StorageColumn::~StorageColumn() = default;
 
+void StorageColumn::StableSortRows(std::vector<uint32_t>::iterator begin,
+                                   std::vector<uint32_t>::iterator end) const {
+  QueryConstraints::OrderBy ob;
+  ob.iColumn = 0;
+  ob.desc = false;
+  auto comparator = Sort(ob);
+  std::stable_sort(begin, end, [&comparator](uint32_t f, uint32_t s) {
+    return comparator(f, s) < 0;
+  });
+}
+
+StringIdSet::StringIdSet(std::vector<uint32_t> ids)
+    : ids_(ids.begin(), ids.end()) {}
+StringIdSet::~StringIdSet() = default;
+
 TsEndColumn::TsEndColumn(std::string col_name,
-                         const std::deque<int64_t>* ts_start,
-                         const std::deque<int64_t>* dur)
+                         const ChunkedVector<int64_t>* ts_start,
+                         const ChunkedVector<int64_t>* dur)
     : StorageColumn(col_name, false /* hidden */),
       ts_start_(ts_start),
       dur_(dur) {}
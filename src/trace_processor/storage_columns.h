@@ -15,12 +15,14 @@
 #ifndef SRC_TRACE_PROCESSOR_STORAGE_COLUMNS_H_
 #define SRC_TRACE_PROCESSOR_STORAGE_COLUMNS_H_
 
-#include <deque>
+#include <algorithm>
 #include <limits>
 #include <memory>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
+#include "src/trace_processor/chunked_vector.h"
 #include "src/trace_processor/filtered_row_index.h"
 #include "src/trace_processor/sqlite_utils.h"
 #include "src/trace_processor/trace_storage.h"
@@ -61,9 +63,34 @@ class StorageColumn {
   // Generally this is only possible if the column is sorted.
   virtual Bounds BoundFilter(int, sqlite3_value*) const { return Bounds{}; }
 
+  // Given |sorted_rows| which, between positions |begin| and |end|, are
+  // ordered by the value of this column, returns the sub-range of positions
+  // of the rows which match a filter on this column. Bounds::consumed is false
+  // if the filter cannot be answered this way. Used by SecondaryIndex.
+  virtual Bounds BoundSortedRows(int,
+                                 sqlite3_value*,
+                                 const std::vector<uint32_t>&,
+                                 uint32_t begin,
+                                 uint32_t end) const {
+    Bounds bounds;
+    bounds.min_idx = begin;
+    bounds.max_idx = end;
+    return bounds;
+  }
+
+  // Sorts the rows between |begin| and |end| in ascending order of the value
+  // of this column, keeping the relative order of rows with equal values.
+  virtual void StableSortRows(std::vector<uint32_t>::iterator begin,
+                              std::vector<uint32_t>::iterator end) const;
+
   // Returns whether this column is sorted in the storage.
   virtual bool IsNaturallyOrdered() const { return false; }
 
+  // Returns whether Filter() exactly applies constraints with |op|. If so,
+  // tables can tell SQLite to omit double checking the constraint on the rows
+  // returned.
+  virtual bool CanOmitConstraint(int) const { return true; }
+
   const std::string& name() const { return col_name_; }
   bool hidden() const { return hidden_; }
 
@@ -72,29 +99,25 @@ class StorageColumn {
   bool hidden_ = false;
 };
 
-// A column of numeric data backed by a deque.
+// A column of numeric data backed by a ChunkedVector.
 template <typename T>
 class NumericColumn : public StorageColumn {
  public:
-  // |index| is an optional multimap which maps the values in deque
-  // to the rows they are located at.
   NumericColumn(std::string col_name,
-                const std::deque<T>* deque,
-                const std::deque<std::vector<uint32_t>>* index,
+                const ChunkedVector<T>* vector,
                 bool hidden,
                 bool is_naturally_ordered)
       : StorageColumn(col_name, hidden),
-        deque_(deque),
-        index_(index),
+        vector_(vector),
         is_naturally_ordered_(is_naturally_ordered) {}
 
   void ReportResult(sqlite3_context* ctx, uint32_t row) const override {
-    sqlite_utils::ReportSqliteResult(ctx, (*deque_)[row]);
+    sqlite_utils::ReportSqliteResult(ctx, (*vector_)[row]);
   }
 
   Bounds BoundFilter(int op, sqlite3_value* sqlite_val) const override {
     Bounds bounds;
-    bounds.max_idx = static_cast<uint32_t>(deque_->size());
+    bounds.max_idx = static_cast<uint32_t>(vector_->size());
 
     if (!is_naturally_ordered_)
       return bounds;
@@ -117,13 +140,13 @@ class NumericColumn : public StorageColumn {
     if (min <= kTMin && max >= kTMax)
       return bounds;
 
-    // Convert the values into indices into the deque.
-    auto min_it = std::lower_bound(deque_->begin(), deque_->end(), min);
+    // Convert the values into indices into the vector.
+    auto min_it = std::lower_bound(vector_->begin(), vector_->end(), min);
     bounds.min_idx =
-        static_cast<uint32_t>(std::distance(deque_->begin(), min_it));
-    auto max_it = std::upper_bound(min_it, deque_->end(), max);
+        static_cast<uint32_t>(std::distance(vector_->begin(), min_it));
+    auto max_it = std::upper_bound(min_it, vector_->end(), max);
     bounds.max_idx =
-        static_cast<uint32_t>(std::distance(deque_->begin(), max_it));
+        static_cast<uint32_t>(std::distance(vector_->begin(), max_it));
     bounds.consumed = true;
 
     return bounds;
@@ -133,14 +156,6 @@ class NumericColumn : public StorageColumn {
               sqlite3_value* value,
               FilteredRowIndex* index) const override {
     auto type = sqlite3_value_type(value);
-
-    // If we are doing equality filtering on integers, try and use the index.
-    bool is_int_compare = std::is_integral<T>::value && type == SQLITE_INTEGER;
-    if (sqlite_utils::IsOpEq(op) && is_int_compare && index_ != nullptr) {
-      FilterIntegerIndexEq(value, index);
-      return;
-    }
-
     bool is_null = type == SQLITE_NULL;
     if (std::is_integral<T>::value && (type == SQLITE_INTEGER || is_null)) {
       FilterWithCast<int64_t>(op, value, index);
@@ -154,14 +169,53 @@ class NumericColumn : public StorageColumn {
   Comparator Sort(const QueryConstraints::OrderBy& ob) const override {
     if (ob.desc) {
       return [this](uint32_t f, uint32_t s) {
-        return sqlite_utils::CompareValuesDesc((*deque_)[f], (*deque_)[s]);
+        return sqlite_utils::CompareValuesDesc((*vector_)[f], (*vector_)[s]);
       };
     }
     return [this](uint32_t f, uint32_t s) {
-      return sqlite_utils::CompareValuesAsc((*deque_)[f], (*deque_)[s]);
+      return sqlite_utils::CompareValuesAsc((*vector_)[f], (*vector_)[s]);
     };
   }
 
+  Bounds BoundSortedRows(int op,
+                         sqlite3_value* value,
+                         const std::vector<uint32_t>& sorted_rows,
+                         uint32_t begin,
+                         uint32_t end) const override {
+    Bounds bounds;
+    bounds.min_idx = begin;
+    bounds.max_idx = end;
+
+    auto type = sqlite3_value_type(value);
+    if (std::is_integral<T>::value && type == SQLITE_INTEGER) {
+      BoundSortedRowsWithCast<int64_t>(op, value, sorted_rows, &bounds);
+    } else if (type == SQLITE_INTEGER || type == SQLITE_FLOAT) {
+      BoundSortedRowsWithCast<double>(op, value, sorted_rows, &bounds);
+    } else if (type == SQLITE_NULL && IsOpComparison(op)) {
+      // Comparisons against NULL never match any row.
+      bounds.max_idx = begin;
+      bounds.consumed = true;
+    }
+    return bounds;
+  }
+
+  void StableSortRows(std::vector<uint32_t>::iterator begin,
+                      std::vector<uint32_t>::iterator end) const override {
+    // Sort a contiguous copy of the values, breaking ties on the original
+    // position, rather than reading the column for every comparison.
+    std::vector<std::pair<T, uint32_t>> values;
+    values.reserve(static_cast<size_t>(std::distance(begin, end)));
+    for (auto it = begin; it != end; ++it) {
+      auto pos = static_cast<uint32_t>(std::distance(begin, it));
+      values.emplace_back((*vector_)[*it], pos);
+    }
+    std::sort(values.begin(), values.end());
+
+    std::vector<uint32_t> rows(begin, end);
+    for (size_t i = 0; i < values.size(); i++)
+      begin[static_cast<ptrdiff_t>(i)] = rows[values[i].second];
+  }
+
   bool IsNaturallyOrdered() const override { return is_naturally_ordered_; }
 
   Table::ColumnType GetType() const override {
@@ -179,31 +233,83 @@ class NumericColumn : public StorageColumn {
   }
 
  protected:
-  const std::deque<T>* deque_ = nullptr;
-  const std::deque<std::vector<uint32_t>>* index_ = nullptr;
+  const ChunkedVector<T>* vector_ = nullptr;
 
  private:
   T kTMin = std::numeric_limits<T>::lowest();
   T kTMax = std::numeric_limits<T>::max();
 
-  void FilterIntegerIndexEq(sqlite3_value* value,
-                            FilteredRowIndex* index) const {
-    auto raw = sqlite_utils::ExtractSqliteValue<int64_t>(value);
-    if (raw < 0 || raw >= static_cast<int64_t>(index_->size())) {
-      index->IntersectRows({});
+  static bool IsOpComparison(int op) {
+    using namespace sqlite_utils;
+    return IsOpEq(op) || IsOpGe(op) || IsOpGt(op) || IsOpLe(op) || IsOpLt(op);
+  }
+
+  template <typename C>
+  void BoundSortedRowsWithCast(int op,
+                               sqlite3_value* value,
+                               const std::vector<uint32_t>& sorted_rows,
+                               Bounds* bounds) const {
+    if (!IsOpComparison(op))
       return;
+
+    C constant = sqlite_utils::ExtractSqliteValue<C>(value);
+    auto lt = [this, constant](uint32_t row) {
+      return static_cast<C>((*vector_)[row]) < constant;
+    };
+    auto le = [this, constant](uint32_t row) {
+      return static_cast<C>((*vector_)[row]) <= constant;
+    };
+
+    auto begin = sorted_rows.begin() + bounds->min_idx;
+    auto end = sorted_rows.begin() + bounds->max_idx;
+    if (sqlite_utils::IsOpEq(op)) {
+      begin = std::partition_point(begin, end, lt);
+      end = std::partition_point(begin, end, le);
+    } else if (sqlite_utils::IsOpGe(op)) {
+      begin = std::partition_point(begin, end, lt);
+    } else if (sqlite_utils::IsOpGt(op)) {
+      begin = std::partition_point(begin, end, le);
+    } else if (sqlite_utils::IsOpLe(op)) {
+      end = std::partition_point(begin, end, le);
+    } else if (sqlite_utils::IsOpLt(op)) {
+      end = std::partition_point(begin, end, lt);
     }
-    index->IntersectRows((*index_)[static_cast<size_t>(raw)]);
+    bounds->min_idx =
+        static_cast<uint32_t>(std::distance(sorted_rows.begin(), begin));
+    bounds->max_idx =
+        static_cast<uint32_t>(std::distance(sorted_rows.begin(), end));
+    bounds->consumed = true;
   }
 
   template <typename C>
   void FilterWithCast(int op,
                       sqlite3_value* value,
                       FilteredRowIndex* index) const {
+    // Comparisons against non-null values are computed 64 rows at a time using
+    // the filter kernels directly on the contiguous runs of the column.
+    filter_kernels::CompareOp compare_op;
+    if (sqlite3_value_type(value) != SQLITE_NULL &&
+        sqlite_utils::ToCompareOp(op, &compare_op)) {
+      C constant = sqlite_utils::ExtractSqliteValue<C>(value);
+      index->FilterWords([this, compare_op, constant](uint32_t first_row,
+                                                      uint32_t count) {
+        uint64_t word = 0;
+        vector_->ForEachSpan(
+            first_row, first_row + count,
+            [&word, first_row, compare_op, constant](const T* data,
+                                                     uint32_t row, uint32_t n) {
+              word |= filter_kernels::CompareWord(data, n, compare_op, constant)
+                      << (row - first_row);
+            });
+        return word;
+      });
+      return;
+    }
+
     auto predicate = sqlite_utils::CreateNumericPredicate<C>(op, value);
     auto cast_predicate = [this,
                            predicate](uint32_t row) PERFETTO_ALWAYS_INLINE {
-      return predicate(static_cast<C>((*deque_)[row]));
+      return predicate(static_cast<C>((*vector_)[row]));
     };
     index->FilterRows(cast_predicate);
   }
@@ -211,19 +317,78 @@ class NumericColumn : public StorageColumn {
   bool is_naturally_ordered_ = false;
 };
 
-template <typename Id>
+// Looks up the string for |id| in |StringMap|. Overloaded for the interned
+// strings in TraceStorage and for small static tables of strings (e.g. the
+// names of RefTypes) owned by a table.
+inline NullTermStringView LookupString(const TraceStorage& storage,
+                                       StringId id) {
+  return storage.GetString(id);
+}
+
+inline NullTermStringView LookupString(const std::vector<std::string>& strings,
+                                       size_t id) {
+  return NullTermStringView(strings[id]);
+}
+
+// Returns the id of |str| in |StringMap| or nullopt if it is not present.
+inline base::Optional<StringId> FindStringId(const TraceStorage& storage,
+                                             base::StringView str) {
+  return storage.GetStringId(str);
+}
+
+inline base::Optional<size_t> FindStringId(
+    const std::vector<std::string>& strings,
+    base::StringView str) {
+  for (size_t i = 0; i < strings.size(); i++) {
+    if (base::StringView(strings[i]) == str)
+      return i;
+  }
+  return base::nullopt;
+}
+
+// Calls |fn(id, str)| for each distinct string in |StringMap|.
+template <typename Fn>
+void ForEachString(const TraceStorage& storage, Fn fn) {
+  for (auto it = storage.string_pool().CreateIterator(); it; ++it) {
+    StringId id = it.StringId();
+    fn(id, storage.GetString(id));
+  }
+}
+
+template <typename Fn>
+void ForEachString(const std::vector<std::string>& strings, Fn fn) {
+  for (size_t i = 0; i < strings.size(); i++)
+    fn(i, NullTermStringView(strings[i]));
+}
+
+// A set of string ids, used to filter string columns by evaluating a predicate
+// once per distinct string rather than once per row. A hash set as the ids of
+// the strings in TraceStorage are offsets into its string pool, which makes
+// them too sparse to index a vector or bitvector.
+class StringIdSet {
+ public:
+  explicit StringIdSet(std::vector<uint32_t> ids);
+  ~StringIdSet();
+
+  bool Contains(uint32_t id) const { return ids_.count(id) > 0; }
+
+ private:
+  std::unordered_set<uint32_t> ids_;
+};
+
+template <typename Id, typename StringMap>
 class StringColumn final : public StorageColumn {
  public:
   StringColumn(std::string col_name,
-               const std::deque<Id>* deque,
-               const std::vector<std::string>* string_map,
+               const ChunkedVector<Id>* vector,
+               const StringMap* string_map,
                bool hidden = false)
       : StorageColumn(col_name, hidden),
-        deque_(deque),
+        vector_(vector),
         string_map_(string_map) {}
 
   void ReportResult(sqlite3_context* ctx, uint32_t row) const override {
-    const auto& str = (*string_map_)[(*deque_)[row]];
+    NullTermStringView str = LookupString(*string_map_, (*vector_)[row]);
     if (str.empty()) {
       sqlite3_result_null(ctx);
     } else {
@@ -233,23 +398,71 @@ class StringColumn final : public StorageColumn {
 
   Bounds BoundFilter(int, sqlite3_value*) const override {
     Bounds bounds;
-    bounds.max_idx = static_cast<uint32_t>(deque_->size());
+    bounds.max_idx = static_cast<uint32_t>(vector_->size());
     return bounds;
   }
 
-  void Filter(int, sqlite3_value*, FilteredRowIndex*) const override {}
+  void Filter(int op,
+              sqlite3_value* value,
+              FilteredRowIndex* index) const override {
+    using namespace sqlite_utils;
+
+    // Range constraints are left to SQLite.
+    if (!IsOpEq(op) && !IsOpNe(op) && !IsOpGlob(op) && !IsOpLike(op) &&
+        !IsOpIsNull(op) && !IsOpIsNotNull(op)) {
+      return;
+    }
+
+    // Equality is resolved to a single id so it becomes an integer comparison
+    // on the ids in the column.
+    if (IsOpEq(op)) {
+      const auto* str =
+          reinterpret_cast<const char*>(sqlite3_value_text(value));
+      if (str == nullptr) {
+        index->IntersectRows({});
+        return;
+      }
+      // The empty string is reported as NULL and so never matches.
+      auto id = FindStringId(*string_map_, base::StringView(str));
+      if (!id || LookupString(*string_map_, *id).empty()) {
+        index->IntersectRows({});
+        return;
+      }
+      FilterIdEq(static_cast<int64_t>(*id), index);
+      return;
+    }
+
+    // Otherwise, evaluate the predicate once for each distinct string and
+    // filter the rows on whether their id is in the resulting set.
+    auto predicate = CreateStringPredicate(op, value);
+    std::vector<uint32_t> ids;
+    ForEachString(*string_map_, [&predicate, &ids](size_t id,
+                                                   NullTermStringView str) {
+      if (predicate(str.empty() ? nullptr : str.c_str()))
+        ids.emplace_back(static_cast<uint32_t>(id));
+    });
+    FilterIdSet(StringIdSet(std::move(ids)), index);
+  }
+
+  // LIKE is left for SQLite to double check as its case sensitivity depends on
+  // PRAGMA case_sensitive_like.
+  bool CanOmitConstraint(int op) const override {
+    using namespace sqlite_utils;
+    return IsOpEq(op) || IsOpNe(op) || IsOpGlob(op) || IsOpIsNull(op) ||
+           IsOpIsNotNull(op);
+  }
 
   Comparator Sort(const QueryConstraints::OrderBy& ob) const override {
     if (ob.desc) {
       return [this](uint32_t f, uint32_t s) {
-        const std::string& a = (*string_map_)[(*deque_)[f]];
-        const std::string& b = (*string_map_)[(*deque_)[s]];
+        NullTermStringView a = LookupString(*string_map_, (*vector_)[f]);
+        NullTermStringView b = LookupString(*string_map_, (*vector_)[s]);
         return sqlite_utils::CompareValuesDesc(a, b);
       };
     }
     return [this](uint32_t f, uint32_t s) {
-      const std::string& a = (*string_map_)[(*deque_)[f]];
-      const std::string& b = (*string_map_)[(*deque_)[s]];
+      NullTermStringView a = LookupString(*string_map_, (*vector_)[f]);
+      NullTermStringView b = LookupString(*string_map_, (*vector_)[s]);
       return sqlite_utils::CompareValuesAsc(a, b);
     };
   }
@@ -261,17 +474,47 @@ class StringColumn final : public StorageColumn {
   bool IsNaturallyOrdered() const override { return false; }
 
  private:
-  const std::deque<Id>* deque_ = nullptr;
-  const std::vector<std::string>* string_map_ = nullptr;
+  void FilterIdEq(int64_t id, FilteredRowIndex* index) const {
+    index->FilterWords([this, id](uint32_t first_row, uint32_t count) {
+      uint64_t word = 0;
+      vector_->ForEachSpan(
+          first_row, first_row + count,
+          [&word, first_row, id](const Id* data, uint32_t row, uint32_t n) {
+            word |= filter_kernels::CompareWord(
+                        data, n, filter_kernels::CompareOp::kEq, id)
+                    << (row - first_row);
+          });
+      return word;
+    });
+  }
+
+  void FilterIdSet(const StringIdSet& set, FilteredRowIndex* index) const {
+    index->FilterWords([this, &set](uint32_t first_row, uint32_t count) {
+      uint64_t word = 0;
+      vector_->ForEachSpan(
+          first_row, first_row + count,
+          [&word, &set, first_row](const Id* data, uint32_t row, uint32_t n) {
+            uint32_t shift = row - first_row;
+            for (uint32_t i = 0; i < n; i++) {
+              bool contains = set.Contains(static_cast<uint32_t>(data[i]));
+              word |= static_cast<uint64_t>(contains) << (shift + i);
+            }
+          });
+      return word;
+    });
+  }
+
+  const ChunkedVector<Id>* vector_ = nullptr;
+  const StringMap* string_map_ = nullptr;
 };
 
 // Column which represents the "ts_end" column present in all time based
-// tables. It is computed by adding together the values in two deques.
+// tables. It is computed by adding together the values in two columns.
 class TsEndColumn final : public StorageColumn {
  public:
   TsEndColumn(std::string col_name,
-              const std::deque<int64_t>* ts_start,
-              const std::deque<int64_t>* dur);
+              const ChunkedVector<int64_t>* ts_start,
+              const ChunkedVector<int64_t>* dur);
   ~TsEndColumn() override;
 
   void ReportResult(sqlite3_context*, uint32_t) const override;
@@ -290,8 +533,8 @@ class TsEndColumn final : public StorageColumn {
   bool IsNaturallyOrdered() const override { return false; }
 
  private:
-  const std::deque<int64_t>* ts_start_;
-  const std::deque<int64_t>* dur_;
+  const ChunkedVector<int64_t>* ts_start_;
+  const ChunkedVector<int64_t>* dur_;
 };
 
 // Column which is used to reference the args table in other tables. That is,
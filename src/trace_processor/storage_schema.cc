@@ -22,9 +22,24 @@ namespace perfetto {
 namespace trace_processor {
 
 StorageSchema::StorageSchema() = default;
-StorageSchema::StorageSchema(Columns columns,
-                             std::vector<std::string> primary_keys)
-    : columns_(std::move(columns)), primary_keys_(std::move(primary_keys)) {}
+StorageSchema::StorageSchema(
+    Columns columns,
+    std::vector<std::string> primary_keys,
+    std::vector<std::vector<std::string>> index_column_names)
+    : columns_(std::move(columns)), primary_keys_(std::move(primary_keys)) {
+  for (const auto& names : index_column_names) {
+    std::vector<size_t> col_indices;
+    std::vector<const StorageColumn*> cols;
+    for (const auto& name : names) {
+      size_t idx = ColumnIndexFromName(name);
+      PERFETTO_CHECK(idx < columns_.size());
+      col_indices.emplace_back(idx);
+      cols.emplace_back(columns_[idx].get());
+    }
+    indexes_.emplace_back(
+        new SecondaryIndex(std::move(col_indices), std::move(cols)));
+  }
+}
 
 Table::Schema StorageSchema::ToTableSchema() {
   std::vector<Table::Column> columns;
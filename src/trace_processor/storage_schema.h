@@ -16,13 +16,13 @@
 #define SRC_TRACE_PROCESSOR_STORAGE_SCHEMA_H_
 
 #include <algorithm>
-#include <deque>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "src/trace_processor/filtered_row_index.h"
+#include "src/trace_processor/secondary_index.h"
 #include "src/trace_processor/sqlite_utils.h"
 #include "src/trace_processor/storage_columns.h"
 #include "src/trace_processor/table.h"
@@ -37,6 +37,7 @@ namespace trace_processor {
 class StorageSchema {
  public:
   using Columns = std::vector<std::unique_ptr<StorageColumn>>;
+  using Indexes = std::vector<std::unique_ptr<SecondaryIndex>>;
 
   // Builder class for StorageSchema.
   class Builder {
@@ -48,41 +49,50 @@ class StorageSchema {
     }
 
     template <class T>
-    Builder& AddNumericColumn(
-        std::string column_name,
-        const std::deque<T>* vals,
-        const std::deque<std::vector<uint32_t>>* index = nullptr) {
+    Builder& AddNumericColumn(std::string column_name,
+                              const ChunkedVector<T>* vals) {
       columns_.emplace_back(
-          new NumericColumn<T>(column_name, vals, index, false, false));
+          new NumericColumn<T>(column_name, vals, false, false));
       return *this;
     }
 
     template <class T>
     Builder& AddOrderedNumericColumn(std::string column_name,
-                                     const std::deque<T>* vals) {
+                                     const ChunkedVector<T>* vals) {
       columns_.emplace_back(
-          new NumericColumn<T>(column_name, vals, nullptr, false, true));
+          new NumericColumn<T>(column_name, vals, false, true));
       return *this;
     }
 
-    template <class Id>
+    template <class Id, class StringMap>
     Builder& AddStringColumn(std::string column_name,
-                             const std::deque<Id>* ids,
-                             const std::vector<std::string>* string_map) {
-      columns_.emplace_back(new StringColumn<Id>(column_name, ids, string_map));
+                             const ChunkedVector<Id>* ids,
+                             const StringMap* string_map) {
+      columns_.emplace_back(
+          new StringColumn<Id, StringMap>(column_name, ids, string_map));
+      return *this;
+    }
+
+    // Adds a SecondaryIndex sorted by the numeric columns |column_names|.
+    Builder& AddIndex(std::vector<std::string> column_names) {
+      index_column_names_.emplace_back(std::move(column_names));
       return *this;
     }
 
     StorageSchema Build(std::vector<std::string> primary_keys) {
-      return StorageSchema(std::move(columns_), std::move(primary_keys));
+      return StorageSchema(std::move(columns_), std::move(primary_keys),
+                           std::move(index_column_names_));
     }
 
    private:
     Columns columns_;
+    std::vector<std::vector<std::string>> index_column_names_;
   };
 
   StorageSchema();
-  StorageSchema(Columns columns, std::vector<std::string> primary_keys);
+  StorageSchema(Columns columns,
+                std::vector<std::string> primary_keys,
+                std::vector<std::vector<std::string>> index_column_names);
 
   Table::Schema ToTableSchema();
 
@@ -92,10 +102,13 @@ class StorageSchema {
 
   Columns* mutable_columns() { return &columns_; }
 
+  Indexes* mutable_indexes() { return &indexes_; }
+
  private:
   friend class Builder;
 
   Columns columns_;
+  Indexes indexes_;
   std::vector<std::string> primary_keys_;
 };
 
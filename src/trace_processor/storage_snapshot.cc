@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage_snapshot.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/base/scoped_file.h"
+#include "perfetto/base/utils.h"
+#include "src/trace_processor/trace_storage.h"
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) && \
+    !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+#define PERFETTO_HAS_MMAP() 1
+#else
+#define PERFETTO_HAS_MMAP() 0
+#endif
+
+#if PERFETTO_HAS_MMAP()
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "perfetto/base/file_utils.h"
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+constexpr char kMagic[8] = {'P', 'E', 'R', 'F', 'S', 'N', 'A', 'P'};
+
+// Must be bumped whenever the layout of the snapshot changes, that is when
+// TraceStorage::Snapshot() or the types it visits change.
+constexpr uint32_t kSnapshotVersion = 3;
+
+constexpr bool kSnapshotsSupported =
+    PERFETTO_HAS_MMAP() && sizeof(void*) == 8;
+
+#if PERFETTO_HAS_MMAP()
+
+// Column chunks are page aligned in the file so that they can be mmap-ed.
+uint64_t AlignToPage(uint64_t offset) {
+  return (offset + base::kPageSize - 1) & ~(base::kPageSize - 1);
+}
+
+// Visits the storage to write it to a file. The small fields are buffered,
+// the columns are written straight from their chunks.
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(base::ScopedFile fd) : fd_(std::move(fd)) {}
+
+  void Bytes(const void* data, size_t size) {
+    buf_.append(static_cast<const char*>(data), size);
+    offset_ += size;
+    if (buf_.size() >= kBufferSize)
+      Flush();
+  }
+
+  template <typename T>
+  void Value(T* value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be snapshotted");
+    Bytes(value, sizeof(T));
+  }
+
+  template <typename T>
+  void Optional(base::Optional<T>* opt) {
+    bool has_value = opt->has_value();
+    T value = has_value ? **opt : T();
+    Value(&has_value);
+    Value(&value);
+  }
+
+  template <typename T>
+  void Vector(std::vector<T>* vec) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be snapshotted");
+    uint64_t size = vec->size();
+    Value(&size);
+    Bytes(vec->data(), vec->size() * sizeof(T));
+  }
+
+  template <typename Container, typename T>
+  void Resize(Container* container, const T&) {
+    uint64_t size = container->size();
+    Value(&size);
+  }
+
+  template <typename M>
+  void Map(M* map) {
+    uint64_t size = map->size();
+    Value(&size);
+    for (const auto& entry : *map) {
+      auto key = entry.first;
+      auto value = entry.second;
+      Value(&key);
+      Value(&value);
+    }
+  }
+
+  template <typename T>
+  void Column(ChunkedVector<T>* column) {
+    uint64_t size = column->size();
+    uint64_t elem_size = sizeof(T);
+    Value(&size);
+    Value(&elem_size);
+
+    SeekTo(AlignToPage(offset_));
+    uint64_t start = offset_;
+    column->ForEachSpan(0, static_cast<uint32_t>(size),
+                        [this](const T* data, uint32_t, uint32_t count) {
+                          WriteDirect(data, count * sizeof(T));
+                        });
+    SeekTo(start + ChunkedVector<T>::CapacityFor(static_cast<size_t>(size)) *
+                       sizeof(T));
+  }
+
+  // Flushes the buffered data and sets the size of the file, which includes
+  // the padding of the last column. Returns false if any write failed.
+  bool Finish() {
+    Flush();
+    if (ok_ && ftruncate(*fd_, static_cast<off_t>(offset_)) != 0)
+      ok_ = false;
+    return ok_;
+  }
+
+ private:
+  static constexpr size_t kBufferSize = 1024 * 1024;
+
+  void Flush() {
+    WriteToFile(buf_.data(), buf_.size());
+    buf_.clear();
+  }
+
+  void WriteDirect(const void* data, size_t size) {
+    Flush();
+    WriteToFile(data, size);
+    offset_ += size;
+  }
+
+  void WriteToFile(const void* data, size_t size) {
+    if (!ok_ || size == 0)
+      return;
+    ok_ = base::WriteAll(*fd_, data, size) == static_cast<ssize_t>(size);
+  }
+
+  // Moves to |offset|, leaving a hole in the file for the bytes skipped.
+  void SeekTo(uint64_t offset) {
+    Flush();
+    if (ok_ && lseek(*fd_, static_cast<off_t>(offset), SEEK_SET) < 0)
+      ok_ = false;
+    offset_ = offset;
+  }
+
+  base::ScopedFile fd_;
+  std::string buf_;
+  uint64_t offset_ = 0;
+  bool ok_ = true;
+};
+
+// Visits the storage to load it from the (private, writable) mmap of a file.
+// The reads from the file are bounds checked, so a truncated file or one with
+// corrupted sizes makes ok() return false. The values read are not: a row
+// referring to a string, thread or row which doesn't exist isn't detected.
+class SnapshotReader {
+ public:
+  SnapshotReader(std::shared_ptr<void> mapping, uint8_t* start, size_t size)
+      : mapping_(std::move(mapping)), start_(start), size_(size) {}
+
+  bool ok() const { return ok_; }
+
+  void Bytes(void* data, size_t size) {
+    if (!Consume(size))
+      return;
+    memcpy(data, start_ + offset_ - size, size);
+  }
+
+  template <typename T>
+  void Value(T* value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be snapshotted");
+    Bytes(value, sizeof(T));
+  }
+
+  template <typename T>
+  void Optional(base::Optional<T>* opt) {
+    bool has_value = false;
+    T value{};
+    Value(&has_value);
+    Value(&value);
+    if (has_value)
+      *opt = value;
+    else
+      opt->reset();
+  }
+
+  template <typename T>
+  void Vector(std::vector<T>* vec) {
+    uint64_t size = ReadSize(sizeof(T));
+    vec->resize(static_cast<size_t>(size));
+    Bytes(vec->data(), vec->size() * sizeof(T));
+  }
+
+  template <typename Container, typename T>
+  void Resize(Container* container, const T& value) {
+    // Each element takes at least one byte in the file.
+    container->resize(static_cast<size_t>(ReadSize(1)), value);
+  }
+
+  template <typename M>
+  void Map(M* map) {
+    using Key = typename M::key_type;
+    using Mapped = typename M::mapped_type;
+    uint64_t size = ReadSize(sizeof(Key) + sizeof(Mapped));
+    for (uint64_t i = 0; i < size; i++) {
+      Key key{};
+      Mapped value{};
+      Value(&key);
+      Value(&value);
+      (*map)[key] = value;
+    }
+  }
+
+  template <typename T>
+  void Column(ChunkedVector<T>* column) {
+    uint64_t size = 0;
+    uint64_t elem_size = 0;
+    Value(&size);
+    Value(&elem_size);
+    if (elem_size != sizeof(T) || size > std::numeric_limits<uint32_t>::max())
+      ok_ = false;
+
+    offset_ = std::min(static_cast<size_t>(AlignToPage(offset_)), size_);
+    auto bytes = ChunkedVector<T>::CapacityFor(static_cast<size_t>(size)) *
+                 sizeof(T);
+    uint8_t* data = start_ + offset_;
+    if (!Consume(bytes) || size == 0)
+      return;
+    column->AdoptChunks(reinterpret_cast<T*>(data), static_cast<size_t>(size),
+                        mapping_);
+  }
+
+ private:
+  bool Consume(size_t size) {
+    if (!ok_ || size > size_ - offset_) {
+      ok_ = false;
+      return false;
+    }
+    offset_ += size;
+    return true;
+  }
+
+  // Reads the number of elements of a container, each taking at least
+  // |elem_size| bytes in the rest of the file.
+  uint64_t ReadSize(size_t elem_size) {
+    uint64_t size = 0;
+    Value(&size);
+    if (!ok_ || size > (size_ - offset_) / elem_size) {
+      ok_ = false;
+      return 0;
+    }
+    return size;
+  }
+
+  std::shared_ptr<void> mapping_;
+  uint8_t* const start_;
+  const size_t size_;
+  size_t offset_ = 0;
+  bool ok_ = true;
+};
+
+#endif  // PERFETTO_HAS_MMAP()
+
+}  // namespace
+
+bool SaveStorageSnapshot(const TraceStorage& storage, const std::string& path) {
+  if (!kSnapshotsSupported) {
+    PERFETTO_ELOG("Snapshots are not supported on this platform");
+    return false;
+  }
+#if PERFETTO_HAS_MMAP()
+  base::ScopedFile fd(base::OpenFile(path, O_CREAT | O_TRUNC | O_WRONLY, 0600));
+  if (!fd) {
+    PERFETTO_PLOG("Failed to create snapshot %s", path.c_str());
+    return false;
+  }
+
+  SnapshotWriter writer(std::move(fd));
+  writer.Bytes(kMagic, sizeof(kMagic));
+  uint32_t version = kSnapshotVersion;
+  writer.Value(&version);
+
+  // Visiting the storage with the writer doesn't modify it.
+  const_cast<TraceStorage&>(storage).Snapshot(&writer);
+  if (!writer.Finish()) {
+    PERFETTO_PLOG("Failed to write snapshot %s", path.c_str());
+    return false;
+  }
+  return true;
+#else
+  base::ignore_result(storage, path);
+  return false;
+#endif
+}
+
+bool IsStorageSnapshot(const std::string& path) {
+  base::ScopedFstream file(fopen(path.c_str(), "rb"));
+  if (!file)
+    return false;
+  char magic[sizeof(kMagic)];
+  return fread(magic, 1, sizeof(magic), *file) == sizeof(magic) &&
+         memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+bool LoadStorageSnapshot(const std::string& path, TraceStorage* storage) {
+  PERFETTO_DCHECK(storage->slices().slice_count() == 0);
+  if (!kSnapshotsSupported)
+    return false;
+#if PERFETTO_HAS_MMAP()
+  base::ScopedFile fd(base::OpenFile(path, O_RDONLY));
+  if (!fd)
+    return false;
+
+  struct stat stat_buf {};
+  if (fstat(*fd, &stat_buf) != 0 ||
+      static_cast<size_t>(stat_buf.st_size) < sizeof(kMagic)) {
+    return false;
+  }
+  auto size = static_cast<size_t>(stat_buf.st_size);
+
+  // The mapping is writable (but private) so that rows can still be appended
+  // to the columns or updated after loading.
+  void* ptr =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, *fd, 0);
+  if (ptr == MAP_FAILED) {
+    PERFETTO_PLOG("Failed to mmap snapshot %s", path.c_str());
+    return false;
+  }
+  std::shared_ptr<void> mapping(ptr, [size](void* p) {
+    PERFETTO_CHECK(munmap(p, size) == 0);
+  });
+
+  // Files which are not snapshots (e.g. traces) are rejected silently.
+  if (memcmp(ptr, kMagic, sizeof(kMagic)) != 0)
+    return false;
+
+  SnapshotReader reader(mapping, static_cast<uint8_t*>(ptr), size);
+  char magic[sizeof(kMagic)];
+  reader.Bytes(magic, sizeof(magic));
+  uint32_t version = 0;
+  reader.Value(&version);
+  if (reader.ok() && version != kSnapshotVersion) {
+    PERFETTO_ELOG("Snapshot %s has version %u, expected %u", path.c_str(),
+                  version, kSnapshotVersion);
+    return false;
+  }
+
+  // The snapshot is read into a separate storage so that |storage|, whose
+  // strings may already be referenced by the trackers, is only replaced once
+  // the whole snapshot has been validated. The strings interned by the
+  // trackers on construction are replaced by the (identical) ones in the
+  // snapshot.
+  std::unique_ptr<TraceStorage> loaded(new TraceStorage());
+  if (reader.ok())
+    loaded->Snapshot(&reader);
+  if (!reader.ok()) {
+    PERFETTO_ELOG("Snapshot %s is corrupted", path.c_str());
+    return false;
+  }
+  loaded->RebuildCounterPyramids();
+  storage->ReplaceContents(std::move(*loaded));
+  return true;
+#else
+  base::ignore_result(path, storage);
+  return false;
+#endif
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
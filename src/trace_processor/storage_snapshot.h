@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_STORAGE_SNAPSHOT_H_
+#define SRC_TRACE_PROCESSOR_STORAGE_SNAPSHOT_H_
+
+#include <string>
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceStorage;
+
+// A snapshot is a binary dump of the contents of TraceStorage, which can be
+// loaded back much faster than parsing the trace again.
+//
+// The file starts with a header (magic, format version) followed by the fields
+// of TraceStorage, in the order in which they are visited by
+// TraceStorage::Snapshot(), in the native byte order. Each column is stored as
+// its chunks (see ChunkedVector), page aligned and padded with a hole up to a
+// whole number of chunks. Loading a snapshot then mmaps the file and points
+// the columns straight at their chunks in the mapping, so that the cost of
+// loading is mostly the one of the string pool and of the hash tables used to
+// deduplicate args and counters, and the columns are only read from disk as
+// they are queried.
+//
+// Snapshots are a cache of the parsed trace, not an interchange format: they
+// can only be loaded by a build of the trace processor with the same format
+// version, on the same architecture. They are only supported on 64-bit
+// platforms with mmap.
+//
+// Loading only validates the layout of the file, not the ids stored in the
+// columns (e.g. StringIds, UniqueTids or the rows of other tables), which
+// the tables use as is. Only load snapshots saved by a trusted trace
+// processor: unlike a trace, a corrupted or crafted snapshot can make queries
+// read out of bounds.
+
+// Saves |storage| to |path|, replacing its contents. Returns false on failure.
+bool SaveStorageSnapshot(const TraceStorage& storage, const std::string& path);
+
+// Returns true if |path| starts with the magic of a snapshot. A snapshot which
+// then fails to load is not a trace either and shouldn't be parsed as one.
+bool IsStorageSnapshot(const std::string& path);
+
+// Loads the snapshot at |path| into |storage|, which must be empty. Returns
+// false, leaving |storage| untouched, if |path| is not a snapshot or can't be
+// loaded.
+bool LoadStorageSnapshot(const std::string& path, TraceStorage* storage);
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_STORAGE_SNAPSHOT_H_
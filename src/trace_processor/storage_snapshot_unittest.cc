@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage_snapshot.h"
+
+#include <unistd.h>
+
+#include "perfetto/base/temp_file.h"
+#include "src/trace_processor/trace_storage.h"
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Snapshots are only supported on 64-bit platforms.
+constexpr bool kSupported = sizeof(void*) == 8;
+
+class StorageSnapshotTest : public ::testing::Test {
+ protected:
+  void SaveAndLoad(const TraceStorage& storage, TraceStorage* loaded) {
+    ASSERT_TRUE(SaveStorageSnapshot(storage, tmp_.path()));
+    ASSERT_TRUE(LoadStorageSnapshot(tmp_.path(), loaded));
+  }
+
+  base::TempFile tmp_ = base::TempFile::Create();
+};
+
+TEST_F(StorageSnapshotTest, RoundTrip) {
+  if (!kSupported)
+    return;
+
+  TraceStorage storage;
+  StringId name = storage.InternString("name");
+  StringId comm = storage.InternString("comm");
+
+  UniquePid upid = storage.AddEmptyProcess(42);
+  storage.GetMutableProcess(upid)->name_id = name;
+  UniqueTid utid = storage.AddEmptyThread(43);
+  storage.GetMutableThread(utid)->upid = upid;
+  storage.GetMutableThread(utid)->name_id = comm;
+
+  // Span more than one chunk of the columns.
+  const uint32_t kNumSlices = 100000;
+  for (uint32_t i = 0; i < kNumSlices; i++) {
+    storage.mutable_slices()->AddSlice(i % 4, i * 10, 5, utid,
+                                       ftrace_utils::TaskState(), 120);
+  }
+
+  TraceStorage::Args::Arg arg;
+  arg.flat_key = name;
+  arg.key = name;
+  arg.value = TraceStorage::Args::Variadic::String(comm);
+  storage.mutable_args()->AddArgSet({arg}, 0, 1);
+
+  auto counter_id = storage.mutable_counter_definitions()->AddCounterDefinition(
+      name, 1, RefType::kRefCpuId);
+  storage.mutable_counter_values()->AddCounterValue(counter_id, 100, 1.5);
+
+  storage.IncrementStats(stats::android_log_num_total, 7);
+  storage.SetIndexedStats(stats::ftrace_cpu_bytes_read_end, 3, 1000);
+
+  TraceStorage loaded;
+  SaveAndLoad(storage, &loaded);
+
+  const auto& slices = loaded.slices();
+  ASSERT_EQ(slices.slice_count(), kNumSlices);
+  for (uint32_t i = 0; i < kNumSlices; i++) {
+    ASSERT_EQ(slices.cpus()[i], i % 4);
+    ASSERT_EQ(slices.start_ns()[i], i * 10);
+    ASSERT_EQ(slices.utids()[i], utid);
+  }
+
+  ASSERT_EQ(loaded.string_count(), storage.string_count());
+  ASSERT_EQ(loaded.GetString(name), "name");
+  ASSERT_EQ(loaded.GetStringId("comm"), comm);
+
+  ASSERT_EQ(loaded.process_count(), storage.process_count());
+  ASSERT_EQ(loaded.GetProcess(upid).pid, 42u);
+  ASSERT_EQ(loaded.GetProcess(upid).name_id, name);
+  ASSERT_EQ(loaded.GetThread(utid).tid, 43u);
+  ASSERT_EQ(loaded.GetThread(utid).upid, upid);
+
+  ASSERT_EQ(loaded.args().args_count(), 1u);
+  ASSERT_EQ(loaded.args().arg_values()[0].string_value, comm);
+  ASSERT_EQ(loaded.counter_values().values()[0], 1.5);
+  ASSERT_EQ(loaded.counter_pyramids().at(counter_id).rows().size(), 1u);
+
+  ASSERT_EQ(loaded.stats()[stats::android_log_num_total].value, 7);
+  ASSERT_EQ(
+      loaded.stats()[stats::ftrace_cpu_bytes_read_end].indexed_values.at(3),
+      1000);
+}
+
+TEST_F(StorageSnapshotTest, AppendAfterLoad) {
+  if (!kSupported)
+    return;
+
+  TraceStorage storage;
+  StringId name = storage.InternString("name");
+  auto counter_id = storage.mutable_counter_definitions()->AddCounterDefinition(
+      name, 1, RefType::kRefCpuId);
+  for (int64_t i = 0; i < 10; i++)
+    storage.mutable_counter_values()->AddCounterValue(counter_id, i, 0);
+
+  TraceStorage loaded;
+  SaveAndLoad(storage, &loaded);
+
+  // The loaded columns, strings and hash tables can still be added to.
+  auto* values = loaded.mutable_counter_values();
+  values->set_arg_set_id(0, 1);
+  values->AddCounterValue(counter_id, 10, 0);
+  ASSERT_EQ(values->size(), 11u);
+  ASSERT_EQ(values->arg_set_ids()[0], 1u);
+  ASSERT_EQ(values->timestamps()[10], 10);
+
+  ASSERT_EQ(loaded.InternString("name"), name);
+  ASSERT_NE(loaded.InternString("other"), name);
+  ASSERT_EQ(loaded.mutable_counter_definitions()->AddCounterDefinition(
+                name, 1, RefType::kRefCpuId),
+            counter_id);
+
+  // The file is mapped privately so it isn't changed by the writes above.
+  TraceStorage reloaded;
+  ASSERT_TRUE(LoadStorageSnapshot(tmp_.path(), &reloaded));
+  ASSERT_EQ(reloaded.counter_values().arg_set_ids()[0], kInvalidArgSetId);
+  ASSERT_EQ(reloaded.counter_values().size(), 10u);
+}
+
+TEST_F(StorageSnapshotTest, NotASnapshot) {
+  std::string contents = "{\"traceEvents\": []}";
+  ASSERT_EQ(write(tmp_.fd(), contents.data(), contents.size()),
+            static_cast<ssize_t>(contents.size()));
+
+  TraceStorage storage;
+  ASSERT_FALSE(IsStorageSnapshot(tmp_.path()));
+  ASSERT_FALSE(LoadStorageSnapshot(tmp_.path(), &storage));
+  ASSERT_FALSE(IsStorageSnapshot("/does/not/exist"));
+  ASSERT_FALSE(LoadStorageSnapshot("/does/not/exist", &storage));
+  ASSERT_EQ(storage.string_count(), 1u);
+}
+
+TEST_F(StorageSnapshotTest, Truncated) {
+  if (!kSupported)
+    return;
+
+  TraceStorage storage;
+  for (int64_t i = 0; i < 10; i++)
+    storage.mutable_counter_values()->AddCounterValue(0, i, 0);
+
+  ASSERT_TRUE(SaveStorageSnapshot(storage, tmp_.path()));
+  ASSERT_EQ(ftruncate(tmp_.fd(), 4096), 0);
+  ASSERT_TRUE(IsStorageSnapshot(tmp_.path()));
+
+  // The strings already interned in the target storage (e.g. by the trackers)
+  // must survive a failed load.
+  TraceStorage loaded;
+  StringId name = loaded.InternString("name");
+  ASSERT_FALSE(LoadStorageSnapshot(tmp_.path(), &loaded));
+  ASSERT_EQ(loaded.counter_values().size(), 0u);
+  ASSERT_EQ(loaded.string_count(), 2u);
+  ASSERT_EQ(loaded.GetString(name), "name");
+}
+
+TEST_F(StorageSnapshotTest, VersionMismatch) {
+  if (!kSupported)
+    return;
+
+  TraceStorage storage;
+  storage.mutable_counter_values()->AddCounterValue(0, 1, 0);
+  ASSERT_TRUE(SaveStorageSnapshot(storage, tmp_.path()));
+
+  // The version follows the 8 bytes of magic.
+  uint32_t version = 0xffffffff;
+  ASSERT_EQ(pwrite(tmp_.fd(), &version, sizeof(version), 8),
+            static_cast<ssize_t>(sizeof(version)));
+  ASSERT_TRUE(IsStorageSnapshot(tmp_.path()));
+
+  TraceStorage loaded;
+  StringId name = loaded.InternString("name");
+  ASSERT_FALSE(LoadStorageSnapshot(tmp_.path(), &loaded));
+  ASSERT_EQ(loaded.counter_values().size(), 0u);
+  ASSERT_EQ(loaded.GetString(name), "name");
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -67,12 +67,30 @@ std::unique_ptr<RowIterator> StorageTable::CreateBestRowIterator(
 FilteredRowIndex StorageTable::CreateRangeIterator(
     const std::vector<QueryConstraints::Constraint>& cs,
     sqlite3_value** argv) {
+  // If a secondary index applies, look up the rows matching the constraints it
+  // can answer.
+  std::vector<bool> consumed(cs.size(), false);
+  std::vector<uint32_t> index_rows;
+  bool has_index_rows = false;
+  std::vector<size_t> matched;
+  SecondaryIndex* secondary_index = FindBestIndex(cs, &matched);
+  if (secondary_index) {
+    size_t applied = secondary_index->Lookup(cs, argv, matched, RowCount(),
+                                             &index_rows);
+    for (size_t i = 0; i < applied; i++)
+      consumed[matched[i]] = true;
+    has_index_rows = applied > 0;
+  }
+
   // Try and bound the search space to the smallest possible index region and
   // store any leftover constraints to filter using bitvector.
   uint32_t min_idx = 0;
   uint32_t max_idx = RowCount();
   std::vector<size_t> bitvector_cs;
   for (size_t i = 0; i < cs.size(); i++) {
+    if (consumed[i])
+      continue;
+
     const auto& c = cs[i];
     size_t column = static_cast<size_t>(c.iColumn);
     auto bounds = schema_.GetColumn(column).BoundFilter(c.op, argv[i]);
@@ -90,7 +108,10 @@ FilteredRowIndex StorageTable::CreateRangeIterator(
   }
 
   // Create an filter index and allow each of the columns filter on it.
+  RecordRowsScanned(has_index_rows ? index_rows.size() : max_idx - min_idx);
   FilteredRowIndex index(min_idx, max_idx);
+  if (has_index_rows)
+    index.IntersectRows(std::move(index_rows));
   for (const auto& c_idx : bitvector_cs) {
     const auto& c = cs[c_idx];
     auto* value = argv[c_idx];
@@ -171,6 +192,39 @@ bool StorageTable::HasEqConstraint(const QueryConstraints& qc,
   return std::find_if(cs.begin(), cs.end(), fn) != cs.end();
 }
 
+void StorageTable::SetOmittedConstraints(const QueryConstraints& qc,
+                                         BestIndexInfo* info) {
+  const auto& cs = qc.constraints();
+  for (size_t i = 0; i < cs.size(); i++) {
+    const auto& col = schema_.GetColumn(static_cast<size_t>(cs[i].iColumn));
+    info->omit[i] = col.CanOmitConstraint(cs[i].op);
+  }
+}
+
+base::Optional<uint32_t> StorageTable::EstimateIndexedRowCount(
+    const QueryConstraints& qc) {
+  const auto& cs = qc.constraints();
+  std::vector<size_t> matched;
+  SecondaryIndex* secondary_index = FindBestIndex(cs, &matched);
+  if (!secondary_index)
+    return base::nullopt;
+  return secondary_index->EstimateRowCount(cs, matched, RowCount());
+}
+
+SecondaryIndex* StorageTable::FindBestIndex(
+    const std::vector<QueryConstraints::Constraint>& cs,
+    std::vector<size_t>* matched) {
+  SecondaryIndex* best = nullptr;
+  for (const auto& secondary_index : *schema_.mutable_indexes()) {
+    auto index_matched = secondary_index->MatchConstraints(cs);
+    if (index_matched.size() > matched->size()) {
+      best = secondary_index.get();
+      *matched = std::move(index_matched);
+    }
+  }
+  return best;
+}
+
 StorageTable::Cursor::Cursor(std::unique_ptr<RowIterator> iterator,
                              std::vector<std::unique_ptr<StorageColumn>>* cols)
     : iterator_(std::move(iterator)), columns_(std::move(cols)) {}
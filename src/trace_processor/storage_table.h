@@ -64,7 +64,23 @@ class StorageTable : public Table {
 
   bool HasEqConstraint(const QueryConstraints&, const std::string& col_name);
 
+  // Sets |info->omit| for the constraints which are exactly applied by the
+  // Filter() of their column (see StorageColumn::CanOmitConstraint()).
+  void SetOmittedConstraints(const QueryConstraints&, BestIndexInfo* info);
+
+  // Returns an estimate of the number of rows which will be looked at to
+  // answer a query with constraints |qc| if one of the secondary indexes of the
+  // schema can be used to answer it or base::nullopt otherwise.
+  base::Optional<uint32_t> EstimateIndexedRowCount(const QueryConstraints& qc);
+
  private:
+  // Returns the secondary index which can answer the most constraints in |cs|
+  // and stores the indices of those constraints in |matched| or returns
+  // nullptr if no index can be used.
+  SecondaryIndex* FindBestIndex(
+      const std::vector<QueryConstraints::Constraint>& cs,
+      std::vector<size_t>* matched);
+
   // Creates a row iterator which is optimized for a generic storage schema
   // (i.e. it does not make assumptions about values of columns).
   std::unique_ptr<RowIterator> CreateBestRowIterator(const QueryConstraints& qc,
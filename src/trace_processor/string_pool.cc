@@ -21,7 +21,7 @@
 namespace perfetto {
 namespace trace_processor {
 
-StringPool::StringPool() {
+StringPool::StringPool() : index_(kInitialIndexCapacity) {
   blocks_.emplace_back();
 
   // Reserve a slot for the null string.
@@ -33,7 +33,9 @@ StringPool::~StringPool() = default;
 StringPool::StringPool(StringPool&&) noexcept = default;
 StringPool& StringPool::operator=(StringPool&&) = default;
 
-StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
+StringPool::Id StringPool::InsertString(base::StringView str,
+                                        uint64_t hash,
+                                        size_t slot) {
   // We shouldn't be writing string with more than 2^16 characters to the pool.
   PERFETTO_CHECK(str.size() < std::numeric_limits<uint16_t>::max());
 
@@ -57,10 +59,26 @@ StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
   // Finish by computing the id of the pointer and adding a mapping from the
   // hash to the string_id.
   Id string_id = PtrToId(ptr);
-  string_index_.emplace(hash, string_id);
+  index_[slot].hash = hash;
+  index_[slot].id = string_id;
+  size_++;
+
+  // Keep the load factor of the index below 0.5.
+  if (size_ * 2 > index_.size())
+    GrowIndex();
   return string_id;
 }
 
+void StringPool::GrowIndex() {
+  std::vector<IndexSlot> old_index(index_.size() * 2);
+  old_index.swap(index_);
+  for (const IndexSlot& old_slot : old_index) {
+    if (old_slot.id == 0)
+      continue;
+    index_[FindSlot(old_slot.hash)] = old_slot;
+  }
+}
+
 uint8_t* StringPool::Block::TryInsert(base::StringView str) {
   auto str_size = str.size();
   auto size = str_size + kMetadataSize;
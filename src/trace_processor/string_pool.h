@@ -17,10 +17,10 @@
 #ifndef SRC_TRACE_PROCESSOR_STRING_POOL_H_
 #define SRC_TRACE_PROCESSOR_STRING_POOL_H_
 
+#include "perfetto/base/optional.h"
 #include "perfetto/base/paged_memory.h"
 #include "src/trace_processor/null_term_string_view.h"
 
-#include <unordered_map>
 #include <vector>
 
 namespace perfetto {
@@ -69,12 +69,26 @@ class StringPool {
       return 0;
 
     auto hash = str.Hash();
-    auto id_it = string_index_.find(hash);
-    if (id_it != string_index_.end()) {
-      PERFETTO_DCHECK(Get(id_it->second) == str);
-      return id_it->second;
+    size_t slot = FindSlot(hash);
+    Id id = index_[slot].id;
+    if (id != 0) {
+      PERFETTO_DCHECK(Get(id) == str);
+      return id;
     }
-    return InsertString(str, hash);
+    return InsertString(str, hash, slot);
+  }
+
+  // Returns the id of |str| if it has been interned in the pool or nullopt
+  // otherwise. Unlike InternString(), this never modifies the pool.
+  base::Optional<Id> GetId(base::StringView str) const {
+    if (str.data() == nullptr)
+      return 0;
+
+    Id id = index_[FindSlot(str.Hash())].id;
+    if (id == 0)
+      return base::nullopt;
+    PERFETTO_DCHECK(Get(id) == str);
+    return id;
   }
 
   NullTermStringView Get(Id id) const {
@@ -83,12 +97,37 @@ class StringPool {
     return GetFromPtr(IdToPtr(id));
   }
 
-  Iterator CreateIterator() { return Iterator(this); }
-
-  size_t size() const { return string_index_.size(); }
+  Iterator CreateIterator() const { return Iterator(this); }
+
+  // Returns the number of strings in the pool, excluding the null string.
+  size_t size() const { return size_; }
+
+  // Saves the pool to, or loads it from, a storage snapshot depending on the
+  // visitor (see storage_snapshot.h). Only supported on 64-bit platforms,
+  // where the pool is a single block and the ids are offsets into it.
+  template <typename Visitor>
+  void Snapshot(Visitor* v) {
+    PERFETTO_CHECK(blocks_.size() == 1);
+    Block& block = blocks_.back();
+    uint32_t pos = block.pos();
+    v->Value(&pos);
+    v->Bytes(block.Get(0), pos);
+    block.set_pos(pos);
+    v->Vector(&index_);
+    v->Value(&size_);
+  }
 
  private:
   using StringHash = uint64_t;
+
+  // A slot of the open addressing hash table mapping string hashes to ids.
+  // Slots with |id| == 0 are empty as the null string is never inserted into
+  // the table.
+  struct IndexSlot {
+    StringHash hash;
+    Id id;
+  };
+
   struct Block {
     Block() : mem_(base::PagedMemory::Allocate(kBlockSize)) {}
     ~Block() = default;
@@ -113,6 +152,7 @@ class StringPool {
     }
 
     uint32_t pos() const { return pos_; }
+    void set_pos(uint32_t pos) { pos_ = pos; }
 
    private:
     static constexpr size_t kBlockSize =
@@ -129,8 +169,28 @@ class StringPool {
   // Number of bytes to reserve for size and null terminator.
   static constexpr uint8_t kMetadataSize = 3;
 
-  // Inserts the string with the given hash into the pool
-  Id InsertString(base::StringView, uint64_t hash);
+  // Initial number of slots in |index_|. Must be a power of two.
+  static constexpr size_t kInitialIndexCapacity = 4096;
+
+  // Inserts the string with the given hash into the pool, storing its id in
+  // |slot| of |index_|.
+  Id InsertString(base::StringView, uint64_t hash, size_t slot);
+
+  // Returns the slot of |index_| which either contains |hash| or is the empty
+  // slot where |hash| should be inserted.
+  size_t FindSlot(StringHash hash) const {
+    // Linear probing: the load factor is kept below 0.5 (see GrowIndex()) so
+    // probe sequences are short and an empty slot is always found.
+    size_t mask = index_.size() - 1;
+    for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask) {
+      const IndexSlot& index_slot = index_[i];
+      if (index_slot.id == 0 || index_slot.hash == hash)
+        return i;
+    }
+  }
+
+  // Doubles the capacity of |index_| and reinserts all the entries.
+  void GrowIndex();
 
   // |ptr| should point to the start of the string metadata (i.e. the first byte
   // of the size).
@@ -182,10 +242,13 @@ class StringPool {
   // The actual memory storing the strings.
   std::vector<Block> blocks_;
 
-  // Maps hashes of strings to the Id in the string pool.
-  // TODO(lalitm): At some point we should benchmark just using a static
-  // hashtable of 1M elements, we can afford paying a fixed 8MB here
-  std::unordered_map<StringHash, Id> string_index_;
+  // Maps hashes of strings to the Id in the string pool. This is an open
+  // addressing hash table (see FindSlot()) which, unlike std::unordered_map,
+  // does not require a heap allocation for each interned string.
+  std::vector<IndexSlot> index_;
+
+  // Number of strings in the pool, excluding the null string.
+  size_t size_ = 0;
 };
 
 }  // namespace trace_processor
@@ -70,6 +70,25 @@ TEST(StringPoolTest, Iterator) {
   ASSERT_FALSE(++it);
 }
 
+TEST(StringPoolTest, GrowIndex) {
+  StringPool pool;
+
+  // Insert enough strings to force the index to be resized a few times and
+  // check that all the ids are still found afterwards.
+  std::vector<StringPool::Id> ids;
+  for (uint32_t i = 0; i < 100000; i++) {
+    std::string str = "string_" + std::to_string(i);
+    ids.emplace_back(pool.InternString(base::StringView(str)));
+  }
+  ASSERT_EQ(pool.size(), 100000u);
+
+  for (uint32_t i = 0; i < 100000; i++) {
+    std::string str = "string_" + std::to_string(i);
+    ASSERT_EQ(pool.InternString(base::StringView(str)), ids[i]);
+    ASSERT_EQ(pool.Get(ids[i]), base::StringView(str));
+  }
+}
+
 TEST(StringPoolTest, StressTest) {
   // First create a buffer with 128MB of random characters.
   constexpr size_t kBufferSize = 128 * 1024 * 1024;
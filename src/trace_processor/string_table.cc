@@ -32,8 +32,10 @@ namespace trace_processor {
 StringTable::StringTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
-void StringTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<StringTable>(db, storage, "strings");
+void StringTable::RegisterTable(sqlite3* db,
+                                const TraceStorage* storage,
+                                const QueryContext* context) {
+  Table::Register<StringTable>(db, storage, context, "strings");
 }
 
 base::Optional<Table::Schema> StringTable::Init(int, const char* const*) {
@@ -57,26 +59,25 @@ int StringTable::BestIndex(const QueryConstraints&, BestIndexInfo* info) {
   return SQLITE_OK;
 }
 
-StringTable::Cursor::Cursor(const TraceStorage* storage) : storage_(storage) {
-  num_rows_ = storage->string_count();
-}
+StringTable::Cursor::Cursor(const TraceStorage* storage)
+    : it_(storage->string_pool().CreateIterator()), storage_(storage) {}
 
 StringTable::Cursor::~Cursor() = default;
 
 int StringTable::Cursor::Next() {
-  row_++;
+  ++it_;
   return SQLITE_OK;
 }
 
 int StringTable::Cursor::Eof() {
-  return row_ >= num_rows_;
+  return !it_;
 }
 
 int StringTable::Cursor::Column(sqlite3_context* context, int col) {
-  StringId string_id = static_cast<StringId>(row_);
+  StringId string_id = it_.StringId();
   switch (col) {
     case Column::kStringId:
-      sqlite3_result_int64(context, static_cast<sqlite3_int64>(row_));
+      sqlite3_result_int64(context, static_cast<sqlite3_int64>(string_id));
       break;
     case Column::kString:
       sqlite3_result_text(context, storage_->GetString(string_id).c_str(), -1,
@@ -20,6 +20,7 @@
 #include <limits>
 #include <memory>
 
+#include "src/trace_processor/string_pool.h"
 #include "src/trace_processor/table.h"
 
 namespace perfetto {
@@ -38,7 +39,9 @@ class StringTable : public Table {
 
   StringTable(sqlite3*, const TraceStorage* storage);
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   // Table implementation.
   base::Optional<Table::Schema> Init(int, const char* const*) override;
@@ -59,8 +62,7 @@ class StringTable : public Table {
     int Column(sqlite3_context*, int N) override;
 
    private:
-    size_t row_ = 0;
-    size_t num_rows_ = 0;
+    StringPool::Iterator it_;
     const TraceStorage* const storage_;
   };
 
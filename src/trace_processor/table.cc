@@ -21,6 +21,7 @@
 #include <algorithm>
 
 #include "perfetto/base/logging.h"
+#include "perfetto/base/time.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -30,6 +31,7 @@ namespace {
 struct TableDescriptor {
   Table::Factory factory;
   const TraceStorage* storage = nullptr;
+  const QueryContext* context = nullptr;
   std::string name;
   sqlite3_module module = {};
 };
@@ -70,12 +72,14 @@ Table::~Table() = default;
 
 void Table::RegisterInternal(sqlite3* db,
                              const TraceStorage* storage,
+                             const QueryContext* context,
                              const std::string& table_name,
                              bool read_write,
                              bool requires_args,
                              Factory factory) {
   std::unique_ptr<TableDescriptor> desc(new TableDescriptor());
   desc->storage = storage;
+  desc->context = context;
   desc->factory = factory;
   desc->name = table_name;
   sqlite3_module* module = &desc->module;
@@ -86,6 +90,9 @@ void Table::RegisterInternal(sqlite3* db,
     const TableDescriptor* xdesc = static_cast<const TableDescriptor*>(arg);
     auto table = xdesc->factory(xdb, xdesc->storage);
     table->name_ = xdesc->name;
+    // argv[2] is the name of the table being created.
+    table->instance_name_ = argc > 2 ? argv[2] : xdesc->name;
+    table->query_context_ = xdesc->context;
 
     auto opt_schema = table->Init(argc, argv);
     if (!opt_schema.has_value()) {
@@ -134,14 +141,10 @@ void Table::RegisterInternal(sqlite3* db,
                        sqlite3_value** v) {
     return ToCursor(c)->Filter(i, s, a, v);
   };
-  module->xNext = [](sqlite3_vtab_cursor* c) {
-    return ToCursor(c)->cursor()->Next();
-  };
-  module->xEof = [](sqlite3_vtab_cursor* c) {
-    return ToCursor(c)->cursor()->Eof();
-  };
+  module->xNext = [](sqlite3_vtab_cursor* c) { return ToCursor(c)->Next(); };
+  module->xEof = [](sqlite3_vtab_cursor* c) { return ToCursor(c)->Eof(); };
   module->xColumn = [](sqlite3_vtab_cursor* c, sqlite3_context* a, int b) {
-    return ToCursor(c)->cursor()->Column(a, b);
+    return ToCursor(c)->Column(a, b);
   };
 
   module->xRowid = [](sqlite3_vtab_cursor* c, sqlite3_int64* r) {
@@ -243,6 +246,16 @@ int Table::BestIndexInternal(sqlite3_index_info* idx) {
   return SQLITE_OK;
 }
 
+QueryProfile* Table::query_profile() const {
+  return query_context_ ? query_context_->profile : nullptr;
+}
+
+void Table::RecordRowsScanned(uint64_t rows) {
+  QueryProfile* profile = query_profile();
+  if (profile)
+    profile->GetTableStats(instance_name_)->rows_scanned += rows;
+}
+
 int Table::FindFunction(const char*, FindFunctionFn, void**) {
   return 0;
 }
@@ -270,10 +283,51 @@ int Table::RawCursor::Filter(int idxNum,
   }
   PERFETTO_DCHECK(table->qc_cache_.constraints().size() ==
                   static_cast<size_t>(argc));
+
+  QueryProfile* profile = table->query_profile();
+  stats_ = profile ? profile->GetTableStats(table->instance_name_) : nullptr;
+  if (!stats_) {
+    cursor_ = table_->CreateCursor(table->qc_cache_, argv);
+    return !cursor_ ? SQLITE_ERROR : SQLITE_OK;
+  }
+
+  base::TimeNanos t_start = base::GetWallTimeNs();
   cursor_ = table_->CreateCursor(table->qc_cache_, argv);
+  stats_->filter_calls++;
+  stats_->filter_ns += (base::GetWallTimeNs() - t_start).count();
   return !cursor_ ? SQLITE_ERROR : SQLITE_OK;
 }
 
+int Table::RawCursor::Next() {
+  if (!stats_)
+    return cursor_->Next();
+
+  base::TimeNanos t_start = base::GetWallTimeNs();
+  int ret = cursor_->Next();
+  stats_->next_calls++;
+  stats_->next_ns += (base::GetWallTimeNs() - t_start).count();
+  return ret;
+}
+
+int Table::RawCursor::Eof() {
+  // SQLite checks for the end once per row, after Filter() and each Next().
+  int eof = cursor_->Eof();
+  if (stats_ && !eof)
+    stats_->rows_returned++;
+  return eof;
+}
+
+int Table::RawCursor::Column(sqlite3_context* context, int N) {
+  if (!stats_)
+    return cursor_->Column(context, N);
+
+  base::TimeNanos t_start = base::GetWallTimeNs();
+  int ret = cursor_->Column(context, N);
+  stats_->column_calls++;
+  stats_->column_ns += (base::GetWallTimeNs() - t_start).count();
+  return ret;
+}
+
 Table::Cursor::~Cursor() = default;
 
 int Table::Cursor::RowId(sqlite3_int64*) {
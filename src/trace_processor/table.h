@@ -26,6 +26,7 @@
 
 #include "perfetto/base/optional.h"
 #include "src/trace_processor/query_constraints.h"
+#include "src/trace_processor/query_profile.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -94,6 +95,9 @@ class Table : public sqlite3_vtab {
     explicit RawCursor(Table* table);
 
     int Filter(int num, const char* idxStr, int argc, sqlite3_value**);
+    int Next();
+    int Eof();
+    int Column(sqlite3_context* context, int N);
     Cursor* cursor() { return cursor_.get(); }
 
    private:
@@ -101,6 +105,10 @@ class Table : public sqlite3_vtab {
 
     Table* const table_;
     std::unique_ptr<Cursor> cursor_;
+
+    // The stats of the table in the profile of the query running the last
+    // filter, if it is profiled.
+    QueryProfile::TableStats* stats_ = nullptr;
   };
 
   // The schema of the table. Created by subclasses to allow the table class to
@@ -145,10 +153,11 @@ class Table : public sqlite3_vtab {
   template <typename T>
   static void Register(sqlite3* db,
                        const TraceStorage* storage,
+                       const QueryContext* context,
                        const std::string& name,
                        bool read_write = false,
                        bool requires_args = false) {
-    RegisterInternal(db, storage, name, read_write, requires_args,
+    RegisterInternal(db, storage, context, name, read_write, requires_args,
                      GetFactory<T>());
   }
 
@@ -170,6 +179,10 @@ class Table : public sqlite3_vtab {
     zErrMsg = error;
   }
 
+  // Called by derived classes from CreateCursor() to report the number of
+  // rows they consider to answer the constraints, in the profile of the query.
+  void RecordRowsScanned(uint64_t rows);
+
   const Schema& schema() const { return schema_; }
   const std::string& name() const { return name_; }
 
@@ -183,6 +196,7 @@ class Table : public sqlite3_vtab {
 
   static void RegisterInternal(sqlite3* db,
                                const TraceStorage*,
+                               const QueryContext*,
                                const std::string& name,
                                bool read_write,
                                bool requires_args,
@@ -192,12 +206,20 @@ class Table : public sqlite3_vtab {
   int OpenInternal(sqlite3_vtab_cursor**);
   int BestIndexInternal(sqlite3_index_info*);
 
+  // Returns the profile of the query being run, if it is profiled.
+  QueryProfile* query_profile() const;
+
   Table(const Table&) = delete;
   Table& operator=(const Table&) = delete;
 
   std::string name_;
   Schema schema_;
 
+  // The name given to CREATE VIRTUAL TABLE or, for the tables used without
+  // being created, |name_|. Identifies the table in the query profiles.
+  std::string instance_name_;
+  const QueryContext* query_context_ = nullptr;
+
   QueryConstraints qc_cache_;
   int qc_hash_ = 0;
   int best_index_num_ = 0;
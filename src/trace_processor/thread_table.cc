@@ -32,8 +32,10 @@ using namespace sqlite_utils;
 ThreadTable::ThreadTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
-void ThreadTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
-  Table::Register<ThreadTable>(db, storage, "thread");
+void ThreadTable::RegisterTable(sqlite3* db,
+                                const TraceStorage* storage,
+                                const QueryContext* context) {
+  Table::Register<ThreadTable>(db, storage, context, "thread");
 }
 
 base::Optional<Table::Schema> ThreadTable::Init(int, const char* const*) {
@@ -32,7 +32,9 @@ class ThreadTable : public Table {
  public:
   enum Column { kUtid = 0, kUpid = 1, kName = 2, kTid = 3 };
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   ThreadTable(sqlite3*, const TraceStorage*);
 
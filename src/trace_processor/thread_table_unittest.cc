@@ -42,8 +42,8 @@ class ThreadTableUnittest : public ::testing::Test {
     context_.process_tracker.reset(new ProcessTracker(&context_));
     context_.event_tracker.reset(new EventTracker(&context_));
 
-    ThreadTable::RegisterTable(db_.get(), context_.storage.get());
-    ProcessTable::RegisterTable(db_.get(), context_.storage.get());
+    ThreadTable::RegisterTable(db_.get(), context_.storage.get(), nullptr);
+    ProcessTable::RegisterTable(db_.get(), context_.storage.get(), nullptr);
   }
 
   void PrepareValidStatement(const std::string& sql) {
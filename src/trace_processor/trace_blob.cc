@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/trace_processor/trace_blob.h"
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/base/utils.h"
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) && \
+    !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+#define PERFETTO_HAS_MMAP() 1
+#else
+#define PERFETTO_HAS_MMAP() 0
+#endif
+
+#if PERFETTO_HAS_MMAP()
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "perfetto/base/scoped_file.h"
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+class HeapTraceBlob : public TraceBlob {
+ public:
+  HeapTraceBlob(std::unique_ptr<uint8_t[]> buf, size_t size)
+      : buf_(std::move(buf)), size_(size) {}
+
+  const uint8_t* data() const override { return buf_.get(); }
+  size_t size() const override { return size_; }
+
+ private:
+  std::unique_ptr<uint8_t[]> buf_;
+  size_t size_;
+};
+
+}  // namespace
+
+// static
+std::unique_ptr<TraceBlob> TraceBlob::FromHeapBuffer(
+    std::unique_ptr<uint8_t[]> buf,
+    size_t size) {
+  return std::unique_ptr<TraceBlob>(new HeapTraceBlob(std::move(buf), size));
+}
+
+TraceBlob::~TraceBlob() = default;
+
+class MmappedTraceFile::Mapping {
+ public:
+  Mapping(uint8_t* start, size_t size) : start_(start), size_(size) {}
+
+  ~Mapping() {
+#if PERFETTO_HAS_MMAP()
+    if (size_ > 0)
+      PERFETTO_CHECK(munmap(start_, size_) == 0);
+#endif
+  }
+
+  const uint8_t* start() const { return start_; }
+  size_t size() const { return size_; }
+
+  // Tells the kernel that the pages fully contained in [data, data + size)
+  // won't be accessed again for a while, so they can be dropped from memory.
+  // They are backed by the file so will be read again if needed.
+  void AdviseDontNeed(const uint8_t* data, size_t size) const {
+#if PERFETTO_HAS_MMAP()
+    auto begin = reinterpret_cast<uintptr_t>(data);
+    uintptr_t end = begin + size;
+    begin = (begin + base::kPageSize - 1) & ~(base::kPageSize - 1);
+    end &= ~(base::kPageSize - 1);
+    if (end <= begin)
+      return;
+    int res = madvise(reinterpret_cast<void*>(begin), end - begin,
+                      MADV_DONTNEED);
+    PERFETTO_DCHECK(res == 0);
+#else
+    base::ignore_result(data, size);
+#endif
+  }
+
+ private:
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+
+  uint8_t* const start_;
+  const size_t size_;
+};
+
+// A slice of the mapping, which drops its pages once the TraceProcessor is done
+// with it.
+class MmappedTraceFile::MappedSlice : public TraceBlob {
+ public:
+  MappedSlice(std::shared_ptr<Mapping> mapping, size_t offset, size_t size)
+      : mapping_(std::move(mapping)),
+        data_(mapping_->start() + offset),
+        size_(size) {}
+
+  ~MappedSlice() override { mapping_->AdviseDontNeed(data_, size_); }
+
+  const uint8_t* data() const override { return data_; }
+  size_t size() const override { return size_; }
+
+ private:
+  std::shared_ptr<Mapping> mapping_;
+  const uint8_t* const data_;
+  const size_t size_;
+};
+
+// static
+std::unique_ptr<MmappedTraceFile> MmappedTraceFile::Open(
+    const std::string& path) {
+#if PERFETTO_HAS_MMAP()
+  base::ScopedFile fd(base::OpenFile(path, O_RDONLY));
+  if (!fd)
+    return nullptr;
+
+  struct stat stat_buf {};
+  if (fstat(*fd, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode))
+    return nullptr;
+
+  auto size = static_cast<size_t>(stat_buf.st_size);
+  uint8_t* start = nullptr;
+  if (size > 0) {
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, *fd, 0);
+    if (ptr == MAP_FAILED)
+      return nullptr;
+    start = static_cast<uint8_t*>(ptr);
+
+    // The trace is read once from start to end: let the kernel read ahead
+    // aggressively.
+    madvise(ptr, size, MADV_SEQUENTIAL);
+  }
+  return std::unique_ptr<MmappedTraceFile>(
+      new MmappedTraceFile(std::make_shared<Mapping>(start, size)));
+#else
+  base::ignore_result(path);
+  return nullptr;
+#endif
+}
+
+MmappedTraceFile::MmappedTraceFile(std::shared_ptr<Mapping> mapping)
+    : mapping_(std::move(mapping)) {}
+
+MmappedTraceFile::~MmappedTraceFile() = default;
+
+size_t MmappedTraceFile::size() const {
+  return mapping_->size();
+}
+
+std::unique_ptr<TraceBlob> MmappedTraceFile::Slice(size_t offset,
+                                                   size_t size) const {
+  PERFETTO_CHECK(offset + size <= mapping_->size());
+  return std::unique_ptr<TraceBlob>(new MappedSlice(mapping_, offset, size));
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
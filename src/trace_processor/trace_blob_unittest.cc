@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/trace_processor/trace_blob.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "perfetto/base/temp_file.h"
+#include "src/trace_processor/trace_blob_view.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(TraceBlobTest, FromHeapBuffer) {
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[4]{1, 2, 3, 4});
+  const uint8_t* data = buf.get();
+  auto blob = TraceBlob::FromHeapBuffer(std::move(buf), 4);
+  ASSERT_EQ(blob->data(), data);
+  ASSERT_EQ(blob->size(), 4u);
+}
+
+TEST(MmappedTraceFileTest, OpenMissingFile) {
+  ASSERT_EQ(MmappedTraceFile::Open("/does/not/exist"), nullptr);
+}
+
+TEST(MmappedTraceFileTest, Slices) {
+  // Span a few pages so that the slices have whole pages to release.
+  std::string contents;
+  for (int i = 0; contents.size() < 5 * 4096; i++)
+    contents += std::to_string(i) + ",";
+
+  base::TempFile tmp = base::TempFile::Create();
+  ASSERT_EQ(write(tmp.fd(), contents.data(), contents.size()),
+            static_cast<ssize_t>(contents.size()));
+
+  std::unique_ptr<MmappedTraceFile> file = MmappedTraceFile::Open(tmp.path());
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(file->size(), contents.size());
+
+  const size_t kSliceSize = 3000;
+  std::vector<TraceBlobView> views;
+  for (size_t off = 0; off < file->size(); off += kSliceSize) {
+    size_t size = std::min(kSliceSize, file->size() - off);
+    auto slice = file->Slice(off, size);
+    ASSERT_EQ(slice->size(), size);
+    ASSERT_EQ(memcmp(slice->data(), contents.data() + off, size), 0);
+    views.emplace_back(std::move(slice), 0, size);
+  }
+
+  // The slices keep the mapping alive after the file is gone.
+  file.reset();
+  size_t off = 0;
+  for (auto& view : views) {
+    ASSERT_EQ(memcmp(view.data(), contents.data() + off, view.length()), 0);
+    off += view.length();
+  }
+
+  // Releasing the pages of a slice must not affect the other ones.
+  for (size_t i = 0; i < views.size(); i += 2)
+    views[i] = TraceBlobView(TraceBlob::FromHeapBuffer(nullptr, 0), 0, 0);
+  for (size_t i = 1; i < views.size(); i += 2) {
+    ASSERT_EQ(memcmp(views[i].data(), contents.data() + i * kSliceSize,
+                     views[i].length()),
+              0);
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
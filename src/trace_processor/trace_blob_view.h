@@ -24,6 +24,7 @@
 #include <memory>
 
 #include "perfetto/base/logging.h"
+#include "perfetto/trace_processor/trace_blob.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -35,14 +36,20 @@ namespace trace_processor {
 // to the same buffer have passed through the pipeline and been parsed.
 class TraceBlobView {
  public:
-  TraceBlobView(std::unique_ptr<uint8_t[]> buffer, size_t offset, size_t length)
-      : shbuf_(SharedBuf(std::move(buffer))),
+  TraceBlobView(std::unique_ptr<TraceBlob> blob, size_t offset, size_t length)
+      : shbuf_(SharedBuf(std::move(blob))),
         offset_(static_cast<uint32_t>(offset)),
         length_(static_cast<uint32_t>(length)) {
     PERFETTO_DCHECK(offset <= std::numeric_limits<uint32_t>::max());
     PERFETTO_DCHECK(length <= std::numeric_limits<uint32_t>::max());
   }
 
+  TraceBlobView(std::unique_ptr<uint8_t[]> buffer, size_t offset, size_t length)
+      : TraceBlobView(TraceBlob::FromHeapBuffer(std::move(buffer),
+                                                offset + length),
+                      offset,
+                      length) {}
+
   // Allow std::move().
   TraceBlobView(TraceBlobView&&) noexcept = default;
   TraceBlobView& operator=(TraceBlobView&&) = default;
@@ -79,8 +86,8 @@ class TraceBlobView {
   // - Is not thread safe, which is not needed for our purposes.
   class SharedBuf {
    public:
-    explicit SharedBuf(std::unique_ptr<uint8_t[]> mem) {
-      rcbuf_ = new RefCountedBuf(std::move(mem));
+    explicit SharedBuf(std::unique_ptr<TraceBlob> blob) {
+      rcbuf_ = new RefCountedBuf(std::move(blob));
     }
 
     SharedBuf(const SharedBuf& copy) : rcbuf_(copy.rcbuf_) {
@@ -117,14 +124,15 @@ class TraceBlobView {
 
     bool operator==(const SharedBuf& x) const { return x.rcbuf_ == rcbuf_; }
     bool operator!=(const SharedBuf& x) const { return !(x == *this); }
-    const uint8_t* data() const { return rcbuf_->mem.get(); }
+    const uint8_t* data() const { return rcbuf_->mem; }
 
    private:
     struct RefCountedBuf {
-      explicit RefCountedBuf(std::unique_ptr<uint8_t[]> buf)
-          : refcount(1), mem(std::move(buf)) {}
+      explicit RefCountedBuf(std::unique_ptr<TraceBlob> b)
+          : refcount(1), blob(std::move(b)), mem(blob->data()) {}
       int refcount;
-      std::unique_ptr<uint8_t[]> mem;
+      std::unique_ptr<TraceBlob> blob;
+      const uint8_t* mem;
     };
 
     RefCountedBuf* rcbuf_ = nullptr;
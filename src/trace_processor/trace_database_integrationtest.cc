@@ -37,6 +37,10 @@ class TraceProcessorIntegrationTest : public ::testing::Test {
       : processor_(TraceProcessor::CreateInstance(Config())) {}
 
  protected:
+  void ResetProcessor(const Config& config) {
+    processor_ = TraceProcessor::CreateInstance(config);
+  }
+
   bool LoadTrace(const char* name, int min_chunk_size = 1) {
     base::ScopedFstream f(fopen(base::GetTestDataPath(name).c_str(), "rb"));
     std::minstd_rand0 rnd_engine(0);
@@ -77,6 +81,21 @@ TEST_F(TraceProcessorIntegrationTest, AndroidSchedAndPs) {
   ASSERT_EQ(res.columns(1).long_values(0), 19684308497);
 }
 
+TEST_F(TraceProcessorIntegrationTest, AndroidSchedAndPsMultiThreaded) {
+  Config config;
+  config.num_ingestion_threads = 4;
+  ResetProcessor(config);
+  ASSERT_TRUE(LoadTrace("android_sched_and_ps.pb"));
+  protos::RawQueryResult res;
+  Query(
+      "select count(*), max(ts) - min(ts) from sched "
+      "where dur != 0 and utid != 0",
+      &res);
+  ASSERT_EQ(res.num_records(), 1);
+  ASSERT_EQ(res.columns(0).long_values(0), 139783);
+  ASSERT_EQ(res.columns(1).long_values(0), 19684308497);
+}
+
 TEST_F(TraceProcessorIntegrationTest, Sfgate) {
   ASSERT_TRUE(LoadTrace("sfgate.json", strlen("{\"traceEvents\":[")));
   protos::RawQueryResult res;
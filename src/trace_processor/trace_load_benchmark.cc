@@ -0,0 +1,148 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "perfetto/base/scoped_file.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/base/test/utils.h"
+
+#include "perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "perfetto/trace/ftrace/sched.pbzero.h"
+#include "perfetto/trace/trace.pbzero.h"
+#include "perfetto/trace/trace_packet.pbzero.h"
+
+namespace {
+
+using perfetto::trace_processor::Config;
+using perfetto::trace_processor::TraceProcessor;
+
+// Measures the time to load a trace, end to end, with 1, 2, 4 and 8 ingestion
+// threads. The trace is read in memory upfront and pushed in 1MB chunks, as
+// trace_processor_shell does.
+
+constexpr size_t kChunkSize = 1024 * 1024;
+
+std::vector<uint8_t> ReadTestTrace(const char* name) {
+  std::vector<uint8_t> trace;
+  perfetto::base::ScopedFstream f(
+      fopen(perfetto::base::GetTestDataPath(name).c_str(), "rb"));
+  if (!f)
+    return trace;
+  uint8_t buf[4096];
+  for (;;) {
+    size_t rsize = fread(buf, 1, sizeof(buf), *f);
+    if (rsize == 0)
+      break;
+    trace.insert(trace.end(), buf, buf + rsize);
+  }
+  return trace;
+}
+
+// Generates ~100MB of sched_switch events spread over 8 cpus, in bundles of
+// 100 events like the ones written by traced_probes.
+std::vector<uint8_t> GenerateFtraceTrace() {
+  constexpr uint32_t kNumCpus = 8;
+  constexpr uint32_t kNumBundles = 20000;
+  constexpr uint32_t kEventsPerBundle = 100;
+
+  protozero::ScatteredHeapBuffer heap_buf;
+  protozero::ScatteredStreamWriter stream_writer(&heap_buf);
+  heap_buf.set_writer(&stream_writer);
+  perfetto::protos::pbzero::Trace trace;
+  trace.Reset(&stream_writer);
+
+  std::minstd_rand0 rnd(0);
+  uint64_t ts = 0;
+  for (uint32_t i = 0; i < kNumBundles; i++) {
+    auto* bundle = trace.add_packet()->set_ftrace_events();
+    bundle->set_cpu(i % kNumCpus);
+    for (uint32_t j = 0; j < kEventsPerBundle; j++) {
+      ts += rnd() % 1000;
+      auto* event = bundle->add_event();
+      event->set_timestamp(ts);
+      event->set_pid(rnd() % 1000);
+      auto* sched_switch = event->set_sched_switch();
+      sched_switch->set_prev_pid(static_cast<int32_t>(rnd() % 1000));
+      sched_switch->set_prev_comm("prev_comm");
+      sched_switch->set_prev_prio(120);
+      sched_switch->set_prev_state(1);
+      sched_switch->set_next_pid(static_cast<int32_t>(rnd() % 1000));
+      sched_switch->set_next_comm("next_comm");
+      sched_switch->set_next_prio(120);
+    }
+  }
+  trace.Finalize();
+  return heap_buf.StitchSlices();
+}
+
+void LoadTrace(benchmark::State& state, const std::vector<uint8_t>& trace) {
+  if (trace.empty()) {
+    state.SkipWithError("Test trace not found");
+    return;
+  }
+
+  Config config;
+  config.num_ingestion_threads = static_cast<uint32_t>(state.range(0));
+  while (state.KeepRunning()) {
+    std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
+    for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+      size_t size = std::min(kChunkSize, trace.size() - off);
+      std::unique_ptr<uint8_t[]> chunk(new uint8_t[size]);
+      memcpy(chunk.get(), trace.data() + off, size);
+      tp->Parse(std::move(chunk), size);
+    }
+    tp->NotifyEndOfFile();
+
+    // Don't account for the destruction of the storage.
+    state.PauseTiming();
+    tp.reset();
+    state.ResumeTiming();
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(trace.size()));
+}
+
+void ThreadCounts(benchmark::internal::Benchmark* b) {
+  for (int threads : {1, 2, 4, 8})
+    b->Arg(threads);
+  b->Unit(benchmark::kMillisecond);
+  b->UseRealTime();
+}
+
+}  // namespace
+
+static void BM_TraceLoadAndroidSchedAndPs(benchmark::State& state) {
+  static const std::vector<uint8_t>* trace =
+      new std::vector<uint8_t>(ReadTestTrace("android_sched_and_ps.pb"));
+  LoadTrace(state, *trace);
+}
+BENCHMARK(BM_TraceLoadAndroidSchedAndPs)->Apply(ThreadCounts);
+
+static void BM_TraceLoadSynthFtrace(benchmark::State& state) {
+  static const std::vector<uint8_t>* trace =
+      new std::vector<uint8_t>(GenerateFtraceTrace());
+  LoadTrace(state, *trace);
+}
+BENCHMARK(BM_TraceLoadSynthFtrace)->Apply(ThreadCounts);
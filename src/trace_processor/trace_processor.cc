@@ -15,6 +15,7 @@
  */
 
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/storage_snapshot.h"
 #include "src/trace_processor/table.h"
 #include "src/trace_processor/trace_processor_impl.h"
 
@@ -29,6 +30,15 @@ std::unique_ptr<TraceProcessor> TraceProcessor::CreateInstance(
 
 TraceProcessor::~TraceProcessor() = default;
 
+// static
+bool TraceProcessor::IsSnapshot(const std::string& path) {
+  return IsStorageSnapshot(path);
+}
+
+bool TraceProcessor::Parse(std::unique_ptr<uint8_t[]> data, size_t size) {
+  return Parse(TraceBlob::FromHeapBuffer(std::move(data), size));
+}
+
 TraceProcessor::Iterator::Iterator(std::unique_ptr<IteratorImpl> iterator)
     : iterator_(std::move(iterator)) {}
 TraceProcessor::Iterator::~Iterator() = default;
@@ -48,11 +58,23 @@ SqlValue TraceProcessor::Iterator::Get(uint32_t col) {
   return iterator_->Get(col);
 }
 
+TraceProcessor::Iterator::NextResult TraceProcessor::Iterator::NextBatch(
+    uint32_t max_rows,
+    Batch* batch) {
+  PERFETTO_DCHECK(IsValid());
+  return iterator_->NextBatch(max_rows, batch);
+}
+
 uint32_t TraceProcessor::Iterator::ColumnCount() {
   PERFETTO_DCHECK(IsValid());
   return iterator_->ColumnCount();
 }
 
+std::string TraceProcessor::Iterator::GetColumnName(uint32_t col) {
+  PERFETTO_DCHECK(IsValid());
+  return iterator_->GetColumnName(col);
+}
+
 base::Optional<std::string> TraceProcessor::Iterator::GetLastError() {
   PERFETTO_DCHECK(IsValid());
   return iterator_->GetLastError();
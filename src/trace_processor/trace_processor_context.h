@@ -25,6 +25,7 @@ namespace trace_processor {
 class ArgsTracker;
 class ChunkedTraceReader;
 class EventTracker;
+class HeapProfileTracker;
 class ProcessTracker;
 class ProtoTraceParser;
 class SliceTracker;
@@ -43,6 +44,7 @@ class TraceProcessorContext {
   std::unique_ptr<ProcessTracker> process_tracker;
   std::unique_ptr<EventTracker> event_tracker;
   std::unique_ptr<ClockTracker> clock_tracker;
+  std::unique_ptr<HeapProfileTracker> heap_profile_tracker;
   std::unique_ptr<TraceStorage> storage;
   std::unique_ptr<ProtoTraceParser> proto_parser;
   std::unique_ptr<TraceSorter> sorter;
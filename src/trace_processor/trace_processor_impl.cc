@@ -20,28 +20,40 @@
 #include <algorithm>
 #include <functional>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/base/time.h"
 #include "src/trace_processor/android_logs_table.h"
 #include "src/trace_processor/args_table.h"
 #include "src/trace_processor/args_tracker.h"
 #include "src/trace_processor/clock_tracker.h"
+#include "src/trace_processor/counter_buckets_table.h"
 #include "src/trace_processor/counter_definitions_table.h"
 #include "src/trace_processor/counter_values_table.h"
 #include "src/trace_processor/event_tracker.h"
+#include "src/trace_processor/heap_profile_allocation_table.h"
+#include "src/trace_processor/heap_profile_callsite_table.h"
+#include "src/trace_processor/heap_profile_flamegraph_table.h"
+#include "src/trace_processor/heap_profile_frame_table.h"
+#include "src/trace_processor/heap_profile_mapping_table.h"
+#include "src/trace_processor/heap_profile_tracker.h"
 #include "src/trace_processor/instants_table.h"
 #include "src/trace_processor/process_table.h"
 #include "src/trace_processor/process_tracker.h"
 #include "src/trace_processor/proto_trace_parser.h"
 #include "src/trace_processor/proto_trace_tokenizer.h"
 #include "src/trace_processor/raw_table.h"
+#include "src/trace_processor/sched_overview_table.h"
 #include "src/trace_processor/sched_slice_table.h"
 #include "src/trace_processor/slice_table.h"
 #include "src/trace_processor/slice_tracker.h"
 #include "src/trace_processor/span_join_operator_table.h"
+#include "src/trace_processor/sql_profile_table.h"
 #include "src/trace_processor/sql_stats_table.h"
 #include "src/trace_processor/sqlite3_str_split.h"
+#include "src/trace_processor/sqlite_utils.h"
 #include "src/trace_processor/stats_table.h"
+#include "src/trace_processor/storage_snapshot.h"
 #include "src/trace_processor/string_table.h"
 #include "src/trace_processor/table.h"
 #include "src/trace_processor/thread_table.h"
@@ -138,6 +150,60 @@ std::string RemoveWhitespace(const std::string& input) {
   return str;
 }
 
+int BindArgs(sqlite3_stmt* stmt, const std::vector<SqlValue>& args) {
+  for (size_t i = 0; i < args.size(); i++) {
+    // Parameters are numbered from 1.
+    int idx = static_cast<int>(i) + 1;
+    const SqlValue& arg = args[i];
+    int err = SQLITE_OK;
+    switch (arg.type) {
+      case SqlValue::kLong:
+        err = sqlite3_bind_int64(stmt, idx, arg.long_value);
+        break;
+      case SqlValue::kDouble:
+        err = sqlite3_bind_double(stmt, idx, arg.double_value);
+        break;
+      case SqlValue::kString:
+        err = sqlite3_bind_text(stmt, idx, arg.string_value, -1,
+                                sqlite_utils::kSqliteTransient);
+        break;
+      case SqlValue::kNull:
+        err = sqlite3_bind_null(stmt, idx);
+        break;
+    }
+    if (err)
+      return err;
+  }
+  return SQLITE_OK;
+}
+
+std::vector<SqlValue> ToSqlValues(const protos::RawQueryArgs& args) {
+  using Arg = protos::RawQueryArgs::Arg;
+  std::vector<SqlValue> values(static_cast<size_t>(args.args_size()));
+  for (size_t i = 0; i < values.size(); i++) {
+    const Arg& arg = args.args(static_cast<int>(i));
+    SqlValue* value = &values[i];
+    switch (arg.value_case()) {
+      case Arg::kLongValue:
+        value->type = SqlValue::kLong;
+        value->long_value = arg.long_value();
+        break;
+      case Arg::kDoubleValue:
+        value->type = SqlValue::kDouble;
+        value->double_value = arg.double_value();
+        break;
+      case Arg::kStringValue:
+        value->type = SqlValue::kString;
+        value->string_value = arg.string_value().c_str();
+        break;
+      case Arg::VALUE_NOT_SET:
+        value->type = SqlValue::kNull;
+        break;
+    }
+  }
+  return values;
+}
+
 }  // namespace
 
 TraceType GuessTraceType(const uint8_t* data, size_t size) {
@@ -154,55 +220,97 @@ TraceType GuessTraceType(const uint8_t* data, size_t size) {
 }
 
 TraceProcessorImpl::TraceProcessorImpl(const Config& cfg) {
-  sqlite3* db = nullptr;
-  PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
-  InitializeSqlite(db);
-  CreateBuiltinTables(db);
-  CreateBuiltinViews(db);
-  db_.reset(std::move(db));
-
   context_.storage.reset(new TraceStorage());
+  storage_ = context_.storage.get();
+  InitializeDb();
+
   context_.args_tracker.reset(new ArgsTracker(&context_));
   context_.slice_tracker.reset(new SliceTracker(&context_));
   context_.event_tracker.reset(new EventTracker(&context_));
   context_.proto_parser.reset(new ProtoTraceParser(&context_));
   context_.process_tracker.reset(new ProcessTracker(&context_));
   context_.clock_tracker.reset(new ClockTracker(&context_));
+  context_.heap_profile_tracker.reset(new HeapProfileTracker(&context_));
   context_.sorter.reset(
       new TraceSorter(&context_, static_cast<int64_t>(cfg.window_size_ns)));
+  if (cfg.streaming_sort)
+    context_.sorter->EnableStreaming();
+  context_.sorter->SetMaxBufferedBytes(cfg.max_sorter_buffered_bytes);
+
+  profile_queries_ = cfg.profile_queries;
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  num_ingestion_threads_ = std::max(cfg.num_ingestion_threads, 1u);
+#endif
+}
 
-  ArgsTable::RegisterTable(*db_, context_.storage.get());
-  ProcessTable::RegisterTable(*db_, context_.storage.get());
-  SchedSliceTable::RegisterTable(*db_, context_.storage.get());
-  SliceTable::RegisterTable(*db_, context_.storage.get());
-  SqlStatsTable::RegisterTable(*db_, context_.storage.get());
-  StringTable::RegisterTable(*db_, context_.storage.get());
-  ThreadTable::RegisterTable(*db_, context_.storage.get());
-  CounterDefinitionsTable::RegisterTable(*db_, context_.storage.get());
-  CounterValuesTable::RegisterTable(*db_, context_.storage.get());
-  SpanJoinOperatorTable::RegisterTable(*db_, context_.storage.get());
-  WindowOperatorTable::RegisterTable(*db_, context_.storage.get());
-  InstantsTable::RegisterTable(*db_, context_.storage.get());
-  StatsTable::RegisterTable(*db_, context_.storage.get());
-  AndroidLogsTable::RegisterTable(*db_, context_.storage.get());
-  RawTable::RegisterTable(*db_, context_.storage.get());
+TraceProcessorImpl::TraceProcessorImpl(TraceProcessorImpl* parent)
+    : storage_(parent->storage_),
+      read_only_(true),
+      end_of_file_(true),
+      parent_(parent) {
+  InitializeDb();
+  BuildBoundsTable(*db_, storage_->GetTraceTimestampBoundsNs());
+}
+
+void TraceProcessorImpl::InitializeDb() {
+  sqlite3* db = nullptr;
+  PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+  InitializeSqlite(db);
+  CreateBuiltinTables(db);
+  CreateBuiltinViews(db);
+  db_.reset(std::move(db));
+  statement_cache_.reset(new StatementCache(*db_));
+
+  ArgsTable::RegisterTable(*db_, storage_, &query_context_);
+  ProcessTable::RegisterTable(*db_, storage_, &query_context_);
+  SchedSliceTable::RegisterTable(*db_, storage_, &query_context_);
+  SchedOverviewTable::RegisterTable(*db_, storage_, &query_context_);
+  SliceTable::RegisterTable(*db_, storage_, &query_context_);
+  SqlStatsTable::RegisterTable(*db_, storage_, &query_context_);
+  SqlProfileTable::RegisterTable(*db_, storage_, &query_context_);
+  StringTable::RegisterTable(*db_, storage_, &query_context_);
+  ThreadTable::RegisterTable(*db_, storage_, &query_context_);
+  CounterDefinitionsTable::RegisterTable(*db_, storage_, &query_context_);
+  CounterValuesTable::RegisterTable(*db_, storage_, &query_context_);
+  CounterBucketsTable::RegisterTable(*db_, storage_, &query_context_);
+  SpanJoinOperatorTable::RegisterTable(*db_, storage_, &query_context_);
+  WindowOperatorTable::RegisterTable(*db_, storage_, &query_context_);
+  InstantsTable::RegisterTable(*db_, storage_, &query_context_);
+  StatsTable::RegisterTable(*db_, storage_, &query_context_);
+  AndroidLogsTable::RegisterTable(*db_, storage_, &query_context_);
+  RawTable::RegisterTable(*db_, storage_, &query_context_);
+  HeapProfileMappingTable::RegisterTable(*db_, storage_, &query_context_);
+  HeapProfileFrameTable::RegisterTable(*db_, storage_, &query_context_);
+  HeapProfileCallsiteTable::RegisterTable(*db_, storage_, &query_context_);
+  HeapProfileAllocationTable::RegisterTable(*db_, storage_, &query_context_);
+  HeapProfileFlamegraphTable::RegisterTable(*db_, storage_, &query_context_);
 }
 
 TraceProcessorImpl::~TraceProcessorImpl() {
   for (auto* it : iterators_)
     it->Reset();
+  if (parent_)
+    parent_->num_read_only_connections_.fetch_sub(1);
 }
 
-bool TraceProcessorImpl::Parse(std::unique_ptr<uint8_t[]> data, size_t size) {
-  if (size == 0)
+bool TraceProcessorImpl::Parse(std::unique_ptr<TraceBlob> blob) {
+  if (blob->size() == 0)
     return true;
   if (unrecoverable_parse_error_)
     return false;
+  if (read_only_ || num_read_only_connections_.load() > 0) {
+    PERFETTO_ELOG("Can't parse a trace with read-only connections");
+    return false;
+  }
+  if (snapshot_loaded_) {
+    PERFETTO_ELOG("Can't parse a trace after loading a snapshot");
+    return false;
+  }
 
   // If this is the first Parse() call, guess the trace type and create the
   // appropriate parser.
   if (!context_.chunk_reader) {
-    TraceType trace_type = GuessTraceType(data.get(), size);
+    TraceType trace_type = GuessTraceType(blob->data(), blob->size());
     switch (trace_type) {
       case kJsonTraceType:
         PERFETTO_DLOG("Legacy JSON trace detected");
@@ -213,21 +321,49 @@ bool TraceProcessorImpl::Parse(std::unique_ptr<uint8_t[]> data, size_t size) {
 #endif
         break;
       case kProtoTraceType:
-        context_.chunk_reader.reset(new ProtoTraceTokenizer(&context_));
+        context_.chunk_reader.reset(
+            new ProtoTraceTokenizer(&context_, num_ingestion_threads_));
         break;
       case kUnknownTraceType:
         return false;
     }
   }
 
-  bool res = context_.chunk_reader->Parse(std::move(data), size);
+  bool res = context_.chunk_reader->Parse(std::move(blob));
   unrecoverable_parse_error_ |= !res;
   return res;
 }
 
 void TraceProcessorImpl::NotifyEndOfFile() {
+  // Nothing can have been parsed while there are read-only connections, and
+  // they may be reading the storage.
+  if (read_only_ || num_read_only_connections_.load() > 0)
+    return;
+  if (context_.chunk_reader)
+    context_.chunk_reader->NotifyEndOfFile();
   context_.sorter->ExtractEventsForced();
   BuildBoundsTable(*db_, context_.storage->GetTraceTimestampBoundsNs());
+  end_of_file_ = true;
+}
+
+bool TraceProcessorImpl::SaveSnapshot(const std::string& path) {
+  return SaveStorageSnapshot(*storage_, path);
+}
+
+bool TraceProcessorImpl::LoadSnapshot(const std::string& path) {
+  // The trackers (e.g. pid -> upid) are not part of the snapshot so the
+  // snapshot can't be mixed with parsed events. Neither can it replace the
+  // storage under read-only connections.
+  if (read_only_ || num_read_only_connections_.load() > 0 ||
+      context_.chunk_reader || snapshot_loaded_) {
+    return false;
+  }
+  if (!LoadStorageSnapshot(path, context_.storage.get()))
+    return false;
+  snapshot_loaded_ = true;
+  BuildBoundsTable(*db_, context_.storage->GetTraceTimestampBoundsNs());
+  end_of_file_ = true;
+  return true;
 }
 
 void TraceProcessorImpl::ExecuteQuery(
@@ -238,18 +374,32 @@ void TraceProcessorImpl::ExecuteQuery(
 
   base::TimeNanos t_start = base::GetWallTimeNs();
   const std::string& sql = args.sql_query();
-  context_.storage->mutable_sql_stats()->RecordQueryBegin(
-      sql, static_cast<int64_t>(args.time_queued_ns()), t_start.count());
-  sqlite3_stmt* raw_stmt;
-  int err = sqlite3_prepare_v2(*db_, sql.c_str(), static_cast<int>(sql.size()),
-                               &raw_stmt, nullptr);
-  ScopedStmt stmt(raw_stmt);
+
+  // The stats are shared by all the connections to the storage so only the
+  // queries of its owner, which may be concurrent with the ones of read-only
+  // connections, record them.
+  TraceStorage::SqlStats* sql_stats =
+      read_only_ ? nullptr : storage_->mutable_sql_stats();
+  if (sql_stats) {
+    proto.set_query_id(sql_stats->RecordQueryBegin(
+        sql, static_cast<int64_t>(args.time_queued_ns()), t_start.count()));
+  }
+  ScopedStmt stmt;
+  int err = statement_cache_->Acquire(base::StringView(sql), &stmt);
+  if (!err)
+    err = BindArgs(*stmt, ToSqlValues(args));
+  if (sql_stats)
+    sql_stats->RecordQueryPrepared(base::GetWallTimeNs().count());
 
   int col_count = sqlite3_column_count(*stmt);
   int row_count = 0;
 
+  QueryProfile profile;
+  const bool profile_query = profile_queries_ && !args.disable_profiling();
   while (!err) {
+    query_context_.profile = profile_query ? &profile : nullptr;
     int r = sqlite3_step(*stmt);
+    query_context_.profile = nullptr;
     if (r != SQLITE_ROW) {
       if (r != SQLITE_DONE)
         err = r;
@@ -321,8 +471,15 @@ void TraceProcessorImpl::ExecuteQuery(
     row_count++;
   }
 
-  if (err) {
+  if (err)
     proto.set_error(sqlite3_errmsg(*db_));
+
+  // Releasing the statement closes the cursors recording into the profile.
+  statement_cache_->Release(sql, std::move(stmt));
+  if (sql_stats)
+    sql_stats->RecordQueryProfile(std::move(profile));
+
+  if (err) {
     callback(std::move(proto));
     return;
   }
@@ -335,27 +492,36 @@ void TraceProcessorImpl::ExecuteQuery(
   }
 
   base::TimeNanos t_end = base::GetWallTimeNs();
-  context_.storage->mutable_sql_stats()->RecordQueryEnd(t_end.count());
+  if (sql_stats)
+    sql_stats->RecordQueryEnd(t_end.count());
   proto.set_execution_time_ns(static_cast<uint64_t>((t_end - t_start).count()));
   callback(proto);
 }
 
 TraceProcessor::Iterator TraceProcessorImpl::ExecuteQuery(
     base::StringView sql) {
-  sqlite3_stmt* raw_stmt;
-  int err = sqlite3_prepare_v2(*db_, sql.data(), static_cast<int>(sql.size()),
-                               &raw_stmt, nullptr);
+  return ExecuteQuery(sql, std::vector<SqlValue>());
+}
+
+TraceProcessor::Iterator TraceProcessorImpl::ExecuteQuery(
+    base::StringView sql,
+    const std::vector<SqlValue>& args) {
+  ScopedStmt stmt;
+  int err = statement_cache_->Acquire(sql, &stmt);
+  if (!err)
+    err = BindArgs(*stmt, args);
 
   uint32_t col_count = 0;
   base::Optional<std::string> error;
   if (err) {
     error = base::Optional<std::string>(sqlite3_errmsg(*db_));
   } else {
-    col_count = static_cast<uint32_t>(sqlite3_column_count(raw_stmt));
+    col_count = static_cast<uint32_t>(sqlite3_column_count(*stmt));
   }
 
   std::unique_ptr<IteratorImpl> impl(
-      new IteratorImpl(this, *db_, ScopedStmt(raw_stmt), col_count, error));
+      new IteratorImpl(this, *db_, sql.ToStdString(), std::move(stmt),
+                       col_count, error));
   iterators_.emplace_back(impl.get());
   return TraceProcessor::Iterator(std::move(impl));
 }
@@ -367,13 +533,36 @@ void TraceProcessorImpl::InterruptQuery() {
   sqlite3_interrupt(db_.get());
 }
 
+std::unique_ptr<TraceProcessor> TraceProcessorImpl::CreateReadOnlyConnection() {
+  if (!end_of_file_) {
+    PERFETTO_ELOG("Read-only connections require the trace to be loaded");
+    return nullptr;
+  }
+  num_read_only_connections_.fetch_add(1);
+  return std::unique_ptr<TraceProcessor>(new TraceProcessorImpl(this));
+}
+
+bool TraceProcessorImpl::IsReadOnlyQuery(base::StringView sql) {
+  ScopedStmt stmt;
+  if (statement_cache_->Acquire(sql, &stmt) != SQLITE_OK || !stmt)
+    return false;
+  // Transaction control statements (e.g. BEGIN) are reported as read-only but
+  // change the state of the connection: only the ones returning rows count.
+  bool read_only =
+      sqlite3_stmt_readonly(*stmt) && sqlite3_column_count(*stmt) > 0;
+  statement_cache_->Release(sql.ToStdString(), std::move(stmt));
+  return read_only;
+}
+
 TraceProcessor::IteratorImpl::IteratorImpl(TraceProcessorImpl* trace_processor,
                                            sqlite3* db,
+                                           std::string sql,
                                            ScopedStmt stmt,
                                            uint32_t column_count,
                                            base::Optional<std::string> error)
     : trace_processor_(trace_processor),
       db_(db),
+      sql_(std::move(sql)),
       stmt_(std::move(stmt)),
       column_count_(column_count),
       error_(error) {}
@@ -384,11 +573,82 @@ TraceProcessor::IteratorImpl::~IteratorImpl() {
     auto it = std::find(its->begin(), its->end(), this);
     PERFETTO_CHECK(it != its->end());
     its->erase(it);
+    trace_processor_->statement_cache_->Release(std::move(sql_),
+                                                std::move(stmt_));
+  }
+}
+
+TraceProcessor::Iterator::NextResult TraceProcessor::IteratorImpl::NextBatch(
+    uint32_t max_rows,
+    Iterator::Batch* batch) {
+  // The rows are written by index into columns sized for a full batch, which
+  // are then shrunk to the rows actually read. This only reallocates when the
+  // batch grows.
+  batch->num_rows = 0;
+  batch->string_data.clear();
+  batch->columns.resize(column_count_);
+  for (auto& col : batch->columns) {
+    col.types.resize(max_rows);
+    col.long_values.resize(max_rows);
+    col.double_values.resize(max_rows);
+    col.string_offsets.resize(max_rows);
   }
+
+  Iterator::NextResult res = Iterator::NextResult::kHasNext;
+  uint32_t row = 0;
+  for (; row < max_rows; row++) {
+    res = Next();
+    if (res != Iterator::NextResult::kHasNext)
+      break;
+
+    for (uint32_t i = 0; i < column_count_; i++) {
+      auto& col = batch->columns[i];
+
+      // Going through the sqlite3_value is one call into SQLite per cell fewer
+      // than sqlite3_column_type() followed by sqlite3_column_xxx().
+      sqlite3_value* value = sqlite3_column_value(*stmt_, static_cast<int>(i));
+      switch (sqlite3_value_type(value)) {
+        case SQLITE_INTEGER:
+          col.types[row] = SqlValue::kLong;
+          col.long_values[row] = sqlite3_value_int64(value);
+          break;
+        case SQLITE_TEXT: {
+          col.types[row] = SqlValue::kString;
+          col.string_offsets[row] =
+              static_cast<uint32_t>(batch->string_data.size());
+          const char* str =
+              reinterpret_cast<const char*>(sqlite3_value_text(value));
+          // Copy the null terminator too.
+          auto size = static_cast<size_t>(sqlite3_value_bytes(value));
+          batch->string_data.append(str, size + 1);
+          break;
+        }
+        case SQLITE_FLOAT:
+          col.types[row] = SqlValue::kDouble;
+          col.double_values[row] = sqlite3_value_double(value);
+          break;
+        default:
+          col.types[row] = SqlValue::kNull;
+          break;
+      }
+    }
+  }
+
+  batch->num_rows = row;
+  if (row < max_rows) {
+    for (auto& col : batch->columns) {
+      col.types.resize(row);
+      col.long_values.resize(row);
+      col.double_values.resize(row);
+      col.string_offsets.resize(row);
+    }
+  }
+  return res;
 }
 
 void TraceProcessor::IteratorImpl::Reset() {
-  *this = IteratorImpl(nullptr, nullptr, ScopedStmt(), 0, base::nullopt);
+  *this = IteratorImpl(nullptr, nullptr, std::string(), ScopedStmt(), 0,
+                       base::nullopt);
 }
 
 }  // namespace trace_processor
@@ -21,13 +21,17 @@
 #include <atomic>
 #include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "perfetto/base/string_view.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/query_profile.h"
 #include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/statement_cache.h"
 #include "src/trace_processor/trace_processor_context.h"
+#include "src/trace_processor/trace_storage.h"
 
 namespace perfetto {
 
@@ -54,25 +58,70 @@ class TraceProcessorImpl : public TraceProcessor {
 
   ~TraceProcessorImpl() override;
 
-  bool Parse(std::unique_ptr<uint8_t[]>, size_t) override;
+  using TraceProcessor::Parse;
+  bool Parse(std::unique_ptr<TraceBlob>) override;
 
   void NotifyEndOfFile() override;
 
+  bool SaveSnapshot(const std::string& path) override;
+
+  bool LoadSnapshot(const std::string& path) override;
+
   void ExecuteQuery(
       const protos::RawQueryArgs&,
       std::function<void(const protos::RawQueryResult&)>) override;
 
   Iterator ExecuteQuery(base::StringView sql) override;
 
+  Iterator ExecuteQuery(base::StringView sql,
+                        const std::vector<SqlValue>& args) override;
+
   void InterruptQuery() override;
 
+  std::unique_ptr<TraceProcessor> CreateReadOnlyConnection() override;
+
+  bool IsReadOnlyQuery(base::StringView sql) override;
+
  private:
   // Needed for iterators to be able to delete themselves from the vector.
   friend class IteratorImpl;
 
+  // Creates a read-only connection to the storage of |parent|.
+  explicit TraceProcessorImpl(TraceProcessorImpl* parent);
+
+  // Opens the database and registers the tables of |storage_| in it.
+  void InitializeDb();
+
   ScopedDb db_;  // Keep first.
+  std::unique_ptr<StatementCache> statement_cache_;
   TraceProcessorContext context_;
+
+  // The storage queried: context_.storage, or the one of the parent
+  // TraceProcessor for read-only connections.
+  TraceStorage* storage_ = nullptr;
+
+  // Whether this is a read-only connection, which can't parse traces and
+  // doesn't record sql_stats as they are shared with its parent.
+  bool read_only_ = false;
+
+  // Set once the trace is fully loaded, which read-only connections require.
+  bool end_of_file_ = false;
+
+  // The TraceProcessor this read-only connection was created by, or nullptr.
+  TraceProcessorImpl* parent_ = nullptr;
+
+  // The live read-only connections created by this TraceProcessor, which
+  // prevent it from changing the storage. Atomic as the connections can be
+  // destroyed on other threads.
+  std::atomic<uint32_t> num_read_only_connections_{0};
+
+  // The state of the query being run, shared with the tables of |db_|.
+  QueryContext query_context_;
+
   bool unrecoverable_parse_error_ = false;
+  bool snapshot_loaded_ = false;
+  uint32_t num_ingestion_threads_ = 1;
+  bool profile_queries_ = false;
 
   std::vector<IteratorImpl*> iterators_;
 
@@ -86,6 +135,7 @@ class TraceProcessor::IteratorImpl {
  public:
   IteratorImpl(TraceProcessorImpl* impl,
                sqlite3* db,
+               std::string sql,
                ScopedStmt,
                uint32_t column_count,
                base::Optional<std::string> error);
@@ -136,8 +186,14 @@ class TraceProcessor::IteratorImpl {
     return value;
   }
 
+  Iterator::NextResult NextBatch(uint32_t max_rows, Iterator::Batch* batch);
+
   uint32_t ColumnCount() { return column_count_; }
 
+  std::string GetColumnName(uint32_t col) {
+    return sqlite3_column_name(*stmt_, static_cast<int>(col));
+  }
+
   base::Optional<std::string> GetLastError() { return error_; }
 
   bool IsValid() { return trace_processor_ != nullptr; }
@@ -148,6 +204,7 @@ class TraceProcessor::IteratorImpl {
  private:
   TraceProcessorImpl* trace_processor_;
   sqlite3* db_ = nullptr;
+  std::string sql_;
   ScopedStmt stmt_;
   uint32_t column_count_ = 0;
   base::Optional<std::string> error_;
@@ -16,6 +16,14 @@
 
 #include "src/trace_processor/trace_processor_impl.h"
 
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+
+#include "perfetto/trace_processor/raw_query.pb.h"
+#include "src/trace_processor/trace_storage.h"
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -48,6 +56,252 @@ TEST(TraceProcessorImplTest, GuessTraceType_Proto) {
   EXPECT_EQ(kProtoTraceType, GuessTraceType(prefix, sizeof(prefix)));
 }
 
+TEST(TraceProcessorImplTest, IteratorNextBatch) {
+  using Result = TraceProcessor::Iterator::NextResult;
+  TraceProcessorImpl tp{Config()};
+  auto it = tp.ExecuteQuery(
+      "WITH RECURSIVE seq(x) AS (SELECT 0 UNION ALL SELECT x + 1 FROM seq "
+      "WHERE x < 9) SELECT x, x * 0.5 AS half, 'str' || x, NULL FROM seq");
+  ASSERT_EQ(it.ColumnCount(), 4u);
+  ASSERT_EQ(it.GetColumnName(1), "half");
+
+  TraceProcessor::Iterator::Batch batch;
+  ASSERT_EQ(it.NextBatch(4, &batch), Result::kHasNext);
+  ASSERT_EQ(batch.num_rows, 4u);
+  ASSERT_EQ(batch.columns.size(), 4u);
+
+  ASSERT_EQ(it.NextBatch(4, &batch), Result::kHasNext);
+  ASSERT_EQ(batch.num_rows, 4u);
+  const auto& cols = batch.columns;
+  for (uint32_t row = 0; row < 4; row++) {
+    ASSERT_EQ(cols[0].types[row], SqlValue::kLong);
+    ASSERT_EQ(cols[0].long_values[row], row + 4);
+    ASSERT_EQ(cols[1].types[row], SqlValue::kDouble);
+    ASSERT_EQ(cols[1].double_values[row], (row + 4) * 0.5);
+    ASSERT_EQ(cols[2].types[row], SqlValue::kString);
+    ASSERT_STREQ(batch.GetString(cols[2], row),
+                 ("str" + std::to_string(row + 4)).c_str());
+    ASSERT_EQ(cols[3].types[row], SqlValue::kNull);
+  }
+
+  // The last batch is partial.
+  ASSERT_EQ(it.NextBatch(4, &batch), Result::kEOF);
+  ASSERT_EQ(batch.num_rows, 2u);
+  ASSERT_EQ(batch.columns[0].long_values[1], 9);
+  ASSERT_STREQ(batch.GetString(batch.columns[2], 1), "str9");
+}
+
+TEST(TraceProcessorImplTest, IteratorNextBatchError) {
+  TraceProcessorImpl tp{Config()};
+  auto it = tp.ExecuteQuery("SELECT * FROM does_not_exist");
+  TraceProcessor::Iterator::Batch batch;
+  ASSERT_EQ(it.NextBatch(4, &batch), TraceProcessor::Iterator::kError);
+  ASSERT_EQ(batch.num_rows, 0u);
+  ASSERT_TRUE(it.GetLastError().has_value());
+}
+
+TEST(TraceProcessorImplTest, IteratorBoundArgs) {
+  using Result = TraceProcessor::Iterator::NextResult;
+  TraceProcessorImpl tp{Config()};
+  const char kSql[] = "SELECT ? + 1, ? || 'b', ?";
+  for (int64_t i = 0; i < 3; i++) {
+    std::vector<SqlValue> args(3);
+    args[0].type = SqlValue::kLong;
+    args[0].long_value = i;
+    args[1].type = SqlValue::kString;
+    args[1].string_value = "a";
+    auto it = tp.ExecuteQuery(kSql, args);
+    ASSERT_EQ(it.Next(), Result::kHasNext);
+    ASSERT_EQ(it.Get(0).long_value, i + 1);
+    ASSERT_STREQ(it.Get(1).string_value, "ab");
+    ASSERT_EQ(it.Get(2).type, SqlValue::kNull);
+    ASSERT_EQ(it.Next(), Result::kEOF);
+  }
+
+  std::vector<SqlValue> too_many_args(4);
+  auto it = tp.ExecuteQuery(kSql, too_many_args);
+  ASSERT_EQ(it.Next(), Result::kError);
+}
+
+TEST(TraceProcessorImplTest, QueryProfile) {
+  using Result = TraceProcessor::Iterator::NextResult;
+  Config config;
+  config.profile_queries = true;
+  TraceProcessorImpl tp{config};
+
+  // The query is logged in sqlstats before it runs, so it reads its own row.
+  protos::RawQueryArgs args;
+  args.set_sql_query("SELECT query FROM sqlstats");
+  uint64_t num_records = 0;
+  int64_t query_id = 0;
+  auto callback = [&num_records,
+                   &query_id](const protos::RawQueryResult& res) {
+    num_records = res.num_records();
+    query_id = res.query_id();
+  };
+  tp.ExecuteQuery(args, callback);
+  ASSERT_EQ(num_records, 1u);
+  ASSERT_GT(query_id, 0);
+
+  const char kProfileSql[] =
+      "SELECT table_name, filter_calls, next_calls, column_calls, "
+      "rows_returned FROM sql_profile WHERE query_id = ?";
+  std::vector<SqlValue> profile_args(1);
+  profile_args[0].type = SqlValue::kLong;
+  profile_args[0].long_value = query_id;
+  auto it = tp.ExecuteQuery(kProfileSql, profile_args);
+  ASSERT_EQ(it.Next(), Result::kHasNext);
+  ASSERT_STREQ(it.Get(0).string_value, "sqlstats");
+  ASSERT_EQ(it.Get(1).long_value, 1);
+  ASSERT_EQ(it.Get(2).long_value, 1);
+  ASSERT_EQ(it.Get(3).long_value, 1);
+  ASSERT_EQ(it.Get(4).long_value, 1);
+  ASSERT_EQ(it.Next(), Result::kEOF);
+
+  // A query can opt out of the profiling, but it's still logged.
+  const int64_t profiled_query_id = query_id;
+  args.set_disable_profiling(true);
+  tp.ExecuteQuery(args, callback);
+  ASSERT_EQ(num_records, 2u);
+  ASSERT_GT(query_id, profiled_query_id);
+  profile_args[0].long_value = query_id;
+  it = tp.ExecuteQuery(kProfileSql, profile_args);
+  ASSERT_EQ(it.Next(), Result::kEOF);
+}
+
+TEST(TraceProcessorImplTest, ReadOnlyConnections) {
+  using Result = TraceProcessor::Iterator::NextResult;
+  TraceProcessorImpl tp{Config()};
+  std::string json = "[";
+  for (int i = 0; i < 100; i++) {
+    json += "{\"ph\":\"X\",\"name\":\"s\",\"ts\":" +
+            std::to_string(i * 10) + ",\"dur\":5,\"pid\":1,\"tid\":1},";
+  }
+  json.back() = ']';
+  std::unique_ptr<uint8_t[]> data(new uint8_t[json.size()]);
+  memcpy(data.get(), json.data(), json.size());
+  ASSERT_TRUE(tp.Parse(std::move(data), json.size()));
+
+  // The trace isn't fully loaded yet.
+  ASSERT_EQ(tp.CreateReadOnlyConnection(), nullptr);
+  tp.NotifyEndOfFile();
+
+  std::vector<std::unique_ptr<TraceProcessor>> connections;
+  for (int i = 0; i < 4; i++) {
+    connections.emplace_back(tp.CreateReadOnlyConnection());
+    ASSERT_NE(connections.back(), nullptr);
+  }
+
+  // Each connection, including the parent, counts the slices on its thread.
+  std::vector<TraceProcessor*> tps{&tp};
+  for (const auto& connection : connections)
+    tps.push_back(connection.get());
+  std::vector<int64_t> counts(tps.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < tps.size(); i++) {
+    threads.emplace_back([&tps, &counts, i] {
+      for (int j = 0; j < 20; j++) {
+        auto it = tps[i]->ExecuteQuery(
+            "SELECT COUNT(*) FROM slices INNER JOIN trace_bounds "
+            "WHERE ts >= start_ts AND dur = 5000");
+        if (it.Next() == Result::kHasNext)
+          counts[i] += it.Get(0).long_value;
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  for (int64_t count : counts)
+    ASSERT_EQ(count, 100 * 20);
+
+  // Views are only visible to the connection which created them.
+  ASSERT_EQ(tp.ExecuteQuery("CREATE VIEW v AS SELECT 1").Next(), Result::kEOF);
+  ASSERT_EQ(connections[0]->ExecuteQuery("SELECT * FROM v").Next(),
+            Result::kError);
+
+  // The trace can't change under the connections.
+  std::unique_ptr<uint8_t[]> more(new uint8_t[1]{'['});
+  ASSERT_FALSE(tp.Parse(std::move(more), 1));
+}
+
+TEST(TraceProcessorImplTest, ReadOnlyConnectionReadsSqlStats) {
+  using Result = TraceProcessor::Iterator::NextResult;
+  Config config;
+  config.profile_queries = true;
+  TraceProcessorImpl tp{config};
+  tp.NotifyEndOfFile();
+  std::unique_ptr<TraceProcessor> connection = tp.CreateReadOnlyConnection();
+  ASSERT_NE(connection, nullptr);
+
+  // The parent records its queries (wrapping around the log) while the
+  // connection reads the stats on another thread.
+  std::atomic<bool> done{false};
+  std::thread parent([&tp, &done] {
+    protos::RawQueryArgs args;
+    args.set_sql_query("SELECT COUNT(*) FROM slices");
+    for (size_t i = 0; i < 3 * TraceStorage::SqlStats::kMaxLogEntries; i++)
+      tp.ExecuteQuery(args, [](const protos::RawQueryResult&) {});
+    done = true;
+  });
+  // Each table copies the log when queried, so the two counts can be taken
+  // at different times. The queries only read one table each, so neither
+  // exceeds the size of the log.
+  const auto kMaxLogEntries =
+      static_cast<int64_t>(TraceStorage::SqlStats::kMaxLogEntries);
+  do {
+    auto it = connection->ExecuteQuery(
+        "SELECT (SELECT COUNT(*) FROM sqlstats WHERE ended >= 0), "
+        "(SELECT COUNT(*) FROM sql_profile WHERE rows_returned >= 0)");
+    ASSERT_EQ(it.Next(), Result::kHasNext);
+    ASSERT_LE(it.Get(0).long_value, kMaxLogEntries);
+    ASSERT_LE(it.Get(1).long_value, kMaxLogEntries);
+  } while (!done);
+  parent.join();
+
+  auto it = connection->ExecuteQuery("SELECT COUNT(*) FROM sqlstats");
+  ASSERT_EQ(it.Next(), Result::kHasNext);
+  ASSERT_EQ(it.Get(0).long_value, kMaxLogEntries);
+}
+
+TEST(TraceProcessorImplTest, ReadOnlyConnectionsBlockParsingWhileAlive) {
+  TraceProcessorImpl tp{Config()};
+  tp.NotifyEndOfFile();
+  std::unique_ptr<TraceProcessor> connection = tp.CreateReadOnlyConnection();
+  ASSERT_NE(connection, nullptr);
+
+  const std::string json =
+      "[{\"ph\":\"X\",\"name\":\"s\",\"ts\":0,\"dur\":5,\"pid\":1,"
+      "\"tid\":1}]";
+  auto make_blob = [&json] {
+    std::unique_ptr<uint8_t[]> data(new uint8_t[json.size()]);
+    memcpy(data.get(), json.data(), json.size());
+    return data;
+  };
+  ASSERT_FALSE(tp.Parse(make_blob(), json.size()));
+
+  // The trace can be parsed again once the connection is gone.
+  connection.reset();
+  ASSERT_TRUE(tp.Parse(make_blob(), json.size()));
+}
+
+TEST(TraceProcessorImplTest, IsReadOnlyQuery) {
+  using Result = TraceProcessor::Iterator::NextResult;
+  TraceProcessorImpl tp{Config()};
+  ASSERT_EQ(tp.ExecuteQuery("CREATE TABLE t(x INT)").Next(), Result::kEOF);
+
+  ASSERT_TRUE(tp.IsReadOnlyQuery("SELECT 1"));
+  ASSERT_TRUE(tp.IsReadOnlyQuery("-- comment\nSELECT * FROM t"));
+  ASSERT_TRUE(tp.IsReadOnlyQuery("WITH a AS (SELECT 1) SELECT * FROM a"));
+
+  ASSERT_FALSE(tp.IsReadOnlyQuery("CREATE VIEW v AS SELECT 1"));
+  ASSERT_FALSE(
+      tp.IsReadOnlyQuery("WITH a AS (SELECT 1) INSERT INTO t SELECT * FROM a"));
+  ASSERT_FALSE(tp.IsReadOnlyQuery("WITH a AS (SELECT 1) DELETE FROM t"));
+  ASSERT_FALSE(tp.IsReadOnlyQuery("BEGIN"));
+  ASSERT_FALSE(tp.IsReadOnlyQuery("SELECT * FROM does_not_exist"));
+  ASSERT_FALSE(tp.IsReadOnlyQuery(""));
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -17,11 +17,15 @@
 #include <aio.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <iostream>
+#include <thread>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
@@ -57,6 +61,7 @@ namespace trace_processor {
 
 namespace {
 TraceProcessor* g_tp;
+bool g_query_profile = false;
 
 #if PERFETTO_BUILDFLAG(PERFETTO_STANDALONE_BUILD)
 
@@ -267,6 +272,40 @@ void PrintShellUsage() {
       ".dump FILE   Export the trace as a sqlite database.\n");
 }
 
+// Prints the calls made to the virtual tables by the query with |query_id|
+// (see RawQueryResult.query_id), which are recorded in the sql_profile table
+// when queries are profiled.
+void PrintQueryProfile(int64_t query_id) {
+  protos::RawQueryArgs query;
+  query.set_sql_query(
+      "SELECT table_name, filter_calls, next_calls, column_calls, "
+      "rows_scanned, rows_returned, filter_dur, next_dur, column_dur "
+      "FROM sql_profile WHERE query_id = ?");
+  query.add_args()->set_long_value(query_id);
+  query.set_disable_profiling(true);
+  g_tp->ExecuteQuery(query, [](const protos::RawQueryResult& res) {
+    if (res.has_error()) {
+      PERFETTO_ELOG("Failed to read the query profile: %s",
+                    res.error().c_str());
+      return;
+    }
+    fprintf(stderr, "%-24s %8s %10s %10s %12s %13s %10s %10s %10s\n",
+            "table", "filter", "next", "column", "rows_scanned",
+            "rows_returned", "filter_ms", "next_ms", "column_ms");
+    for (int r = 0; r < static_cast<int>(res.num_records()); r++) {
+      auto value = [&res, r](int col) {
+        return static_cast<long long>(res.columns(col).long_values(r));
+      };
+      fprintf(stderr,
+              "%-24s %8lld %10lld %10lld %12lld %13lld %10.3f %10.3f "
+              "%10.3f\n",
+              res.columns(0).string_values(r).c_str(), value(1), value(2),
+              value(3), value(4), value(5), value(6) / 1E6, value(7) / 1E6,
+              value(8) / 1E6);
+    }
+  });
+}
+
 int StartInteractiveShell() {
   SetupLineEditor();
 
@@ -295,9 +334,14 @@ int StartInteractiveShell() {
     protos::RawQueryArgs query;
     query.set_sql_query(line);
     base::TimeNanos t_start = base::GetWallTimeNs();
-    g_tp->ExecuteQuery(query, [t_start](const protos::RawQueryResult& res) {
-      PrintQueryResultInteractively(t_start, res);
-    });
+    int64_t query_id = 0;
+    g_tp->ExecuteQuery(
+        query, [t_start, &query_id](const protos::RawQueryResult& res) {
+          PrintQueryResultInteractively(t_start, res);
+          query_id = res.query_id();
+        });
+    if (g_query_profile)
+      PrintQueryProfile(query_id);
 
     FreeLine(line);
   }
@@ -375,43 +419,183 @@ bool LoadQueries(FILE* input, std::vector<std::string>* output) {
   return true;
 }
 
+// Calls |fn| with the indices 0 to |num_threads| - 1 on as many threads, the
+// calling one included, and waits for them all to return.
+void RunOnThreads(size_t num_threads, std::function<void(size_t)> fn) {
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++)
+    threads.emplace_back(fn, i);
+  fn(0);
+  for (auto& thread : threads)
+    thread.join();
+}
+
+void RunQuery(TraceProcessor* tp,
+              const std::string& sql_query,
+              protos::RawQueryResult* result) {
+  protos::RawQueryArgs query;
+  query.set_sql_query(sql_query);
+  tp->ExecuteQuery(query, [result](const protos::RawQueryResult& res) {
+    *result = res;
+  });
+}
+
+// Runs |queries| using one thread per connection in |connections|, which must
+// all be connected to the same trace, and returns their results in order.
+// Consecutive read-only queries (see TraceProcessor::IsReadOnlyQuery()) run in
+// parallel. The other queries (e.g. CREATE VIEW) run on every connection after
+// all the queries preceding them, so that the queries following them see their
+// effects whichever connection runs them.
+std::vector<protos::RawQueryResult> RunQueries(
+    const std::vector<std::string>& queries,
+    const std::vector<TraceProcessor*>& connections) {
+  std::vector<protos::RawQueryResult> results(queries.size());
+  size_t begin = 0;
+  while (begin < queries.size()) {
+    TraceProcessor* tp = connections[0];
+    if (connections.size() == 1 ||
+        !tp->IsReadOnlyQuery(base::StringView(queries[begin]))) {
+      // The query has the same effect on every connection so only the result
+      // of the first one is reported.
+      PERFETTO_ILOG("Executing query: %s", queries[begin].c_str());
+      std::vector<protos::RawQueryResult> other_results(connections.size());
+      RunOnThreads(connections.size(), [&](size_t i) {
+        RunQuery(connections[i], queries[begin],
+                 i == 0 ? &results[begin] : &other_results[i]);
+      });
+      if (g_query_profile)
+        PrintQueryProfile(results[begin].query_id());
+      begin++;
+      continue;
+    }
+
+    size_t end = begin + 1;
+    while (end < queries.size() &&
+           tp->IsReadOnlyQuery(base::StringView(queries[end])))
+      end++;
+    std::atomic<size_t> next_query{begin};
+    RunOnThreads(connections.size(), [&](size_t i) {
+      for (size_t q = next_query++; q < end; q = next_query++) {
+        PERFETTO_ILOG("Executing query: %s", queries[q].c_str());
+        RunQuery(connections[i], queries[q], &results[q]);
+      }
+    });
+    begin = end;
+  }
+  return results;
+}
+
 bool RunQueryAndPrintResult(const std::vector<std::string> queries,
+                            const std::vector<TraceProcessor*>& connections,
                             FILE* output) {
   bool is_first_query = true;
   bool is_query_error = false;
   bool has_output = false;
-  for (const auto& sql_query : queries) {
+  for (const auto& res : RunQueries(queries, connections)) {
     // Add an extra newline separator between query results.
     if (!is_first_query)
       fprintf(output, "\n");
     is_first_query = false;
 
-    PERFETTO_ILOG("Executing query: %s", sql_query.c_str());
-
-    protos::RawQueryArgs query;
-    query.set_sql_query(sql_query);
-    g_tp->ExecuteQuery(query, [output, &is_query_error,
-                               &has_output](const protos::RawQueryResult& res) {
-      if (res.has_error()) {
-        PERFETTO_ELOG("SQLite error: %s", res.error().c_str());
+    if (res.has_error()) {
+      PERFETTO_ELOG("SQLite error: %s", res.error().c_str());
+      is_query_error = true;
+      continue;
+    } else if (res.num_records() != 0) {
+      if (has_output) {
+        PERFETTO_ELOG(
+            "More than one query generated result rows. This is "
+            "unsupported.");
         is_query_error = true;
-        return;
-      } else if (res.num_records() != 0) {
-        if (has_output) {
-          PERFETTO_ELOG(
-              "More than one query generated result rows. This is "
-              "unsupported.");
-          is_query_error = true;
-          return;
-        }
-        has_output = true;
+        continue;
       }
-      PrintQueryResultAsCsv(res, output);
-    });
+      has_output = true;
+    }
+    PrintQueryResultAsCsv(res, output);
   }
   return !is_query_error;
 }
 
+// 1MB chunk size seems the best tradeoff on a MacBook Pro 2013 - i7 2.8 GHz.
+constexpr size_t kChunkSize = 1024 * 1024;
+
+// Loads the trace by memory mapping the file and passing slices of the mapping
+// to the trace processor, which parses the events in place without copying
+// them. Returns the size of the trace or -1 if the file can't be mapped.
+int64_t LoadTraceMmapped(TraceProcessor* tp, const char* trace_file_path) {
+  std::unique_ptr<MmappedTraceFile> file =
+      MmappedTraceFile::Open(trace_file_path);
+  if (!file)
+    return -1;
+
+  size_t file_size = file->size();
+  for (size_t off = 0; off < file_size; off += kChunkSize) {
+    if ((off / kChunkSize) % 128 == 0)
+      fprintf(stderr, "\rLoading trace: %.2f MB\r", off / 1E6);
+    tp->Parse(file->Slice(off, std::min(kChunkSize, file_size - off)));
+  }
+  return static_cast<int64_t>(file_size);
+}
+
+// Loads the trace in chunks using async IO, for files which can't be memory
+// mapped. Returns the size of the trace or -1 if the file can't be opened.
+int64_t LoadTraceWithAio(TraceProcessor* tp, const char* trace_file_path) {
+  base::ScopedFile fd(base::OpenFile(trace_file_path, O_RDONLY));
+  if (!fd) {
+    PERFETTO_ELOG("Could not open trace file (path: %s)", trace_file_path);
+    return -1;
+  }
+
+  // We create a simple pipeline where, at each iteration, we parse the current
+  // chunk and asynchronously start reading the next chunk.
+  struct aiocb cb {};
+  cb.aio_nbytes = kChunkSize;
+  cb.aio_fildes = *fd;
+
+  std::unique_ptr<uint8_t[]> aio_buf(new uint8_t[kChunkSize]);
+  cb.aio_buf = aio_buf.get();
+
+  PERFETTO_CHECK(aio_read(&cb) == 0);
+  struct aiocb* aio_list[1] = {&cb};
+
+  uint64_t file_size = 0;
+  for (int i = 0;; i++) {
+    if (i % 128 == 0)
+      fprintf(stderr, "\rLoading trace: %.2f MB\r", file_size / 1E6);
+
+    // Block waiting for the pending read to complete.
+    PERFETTO_CHECK(aio_suspend(aio_list, 1, nullptr) == 0);
+    auto rsize = aio_return(&cb);
+    if (rsize <= 0)
+      break;
+    file_size += static_cast<uint64_t>(rsize);
+
+    // Take ownership of the completed buffer and enqueue a new async read
+    // with a fresh buffer.
+    std::unique_ptr<uint8_t[]> buf(std::move(aio_buf));
+    aio_buf.reset(new uint8_t[kChunkSize]);
+    cb.aio_buf = aio_buf.get();
+    cb.aio_offset += rsize;
+    PERFETTO_CHECK(aio_read(&cb) == 0);
+
+    // Parse the completed buffer while the async read is in-flight.
+    tp->Parse(std::move(buf), static_cast<size_t>(rsize));
+  }
+  return static_cast<int64_t>(file_size);
+}
+
+// Loads the trace from a snapshot previously saved with --save-snapshot.
+// Returns the size of the snapshot or -1 if it couldn't be loaded.
+int64_t LoadSnapshot(TraceProcessor* tp, const char* trace_file_path) {
+  if (!tp->LoadSnapshot(trace_file_path)) {
+    PERFETTO_ELOG("Could not load snapshot %s", trace_file_path);
+    return -1;
+  }
+  struct stat stat_buf {};
+  PERFETTO_CHECK(stat(trace_file_path, &stat_buf) == 0);
+  return static_cast<int64_t>(stat_buf.st_size);
+}
+
 void PrintUsage(char** argv) {
   PERFETTO_ELOG(
       "Interactive trace processor shell.\n"
@@ -421,7 +605,16 @@ void PrintUsage(char** argv) {
       " -s FILE   Read and execute contents of file before launching an "
       "interactive shell.\n"
       " -q FILE   Read and execute an SQL query from a file.\n"
-      " -e FILE   Export the trace into a SQLite database.\n",
+      " -e FILE   Export the trace into a SQLite database.\n"
+      " -t NUM    Number of threads used to load the trace (default: 1).\n"
+      " -j NUM    Number of threads running the queries of -q/-s FILE "
+      "(default: 1). Consecutive SELECTs run in parallel, the other queries "
+      "run once the previous ones are done.\n"
+      " --query-profile  Print the calls made by each query to the virtual "
+      "tables, and the time spent in them.\n"
+      " --save-snapshot FILE  Save the parsed trace to a snapshot, which can "
+      "be loaded much faster than the trace by passing it instead of "
+      "trace_file.pb.\n",
       argv[0]);
 }
 
@@ -433,6 +626,9 @@ int TraceProcessorMain(int argc, char** argv) {
   const char* trace_file_path = nullptr;
   const char* query_file_path = nullptr;
   const char* sqlite_file_path = nullptr;
+  const char* snapshot_file_path = nullptr;
+  uint32_t num_ingestion_threads = 1;
+  uint32_t num_query_threads = 1;
   bool launch_shell = true;
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--version") == 0) {
@@ -458,6 +654,40 @@ int TraceProcessorMain(int argc, char** argv) {
       }
       sqlite_file_path = argv[i];
       continue;
+    } else if (strcmp(argv[i], "-t") == 0) {
+      if (++i == argc) {
+        PrintUsage(argv);
+        return 1;
+      }
+      int num_threads = atoi(argv[i]);
+      if (num_threads <= 0) {
+        PERFETTO_ELOG("Invalid number of threads: %s", argv[i]);
+        return 1;
+      }
+      num_ingestion_threads = static_cast<uint32_t>(num_threads);
+      continue;
+    } else if (strcmp(argv[i], "-j") == 0) {
+      if (++i == argc) {
+        PrintUsage(argv);
+        return 1;
+      }
+      int num_threads = atoi(argv[i]);
+      if (num_threads <= 0) {
+        PERFETTO_ELOG("Invalid number of threads: %s", argv[i]);
+        return 1;
+      }
+      num_query_threads = static_cast<uint32_t>(num_threads);
+      continue;
+    } else if (strcmp(argv[i], "--save-snapshot") == 0) {
+      if (++i == argc) {
+        PrintUsage(argv);
+        return 1;
+      }
+      snapshot_file_path = argv[i];
+      continue;
+    } else if (strcmp(argv[i], "--query-profile") == 0) {
+      g_query_profile = true;
+      continue;
     } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
       PrintUsage(argv);
       return 0;
@@ -472,60 +702,41 @@ int TraceProcessorMain(int argc, char** argv) {
     PrintUsage(argv);
     return 1;
   }
+  if (g_query_profile && num_query_threads > 1) {
+    PERFETTO_ELOG("--query-profile can't be used with -j");
+    return 1;
+  }
 
   // Load the trace file into the trace processor.
   Config config;
+  config.num_ingestion_threads = num_ingestion_threads;
+  config.profile_queries = g_query_profile;
   std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
-  base::ScopedFile fd(base::OpenFile(trace_file_path, O_RDONLY));
-  if (!fd) {
-    PERFETTO_ELOG("Could not open trace file (path: %s)", trace_file_path);
-    return 1;
-  }
-
-  // Load the trace in chunks using async IO. We create a simple pipeline where,
-  // at each iteration, we parse the current chunk and asynchronously start
-  // reading the next chunk.
-
-  // 1MB chunk size seems the best tradeoff on a MacBook Pro 2013 - i7 2.8 GHz.
-  constexpr size_t kChunkSize = 1024 * 1024;
-  struct aiocb cb {};
-  cb.aio_nbytes = kChunkSize;
-  cb.aio_fildes = *fd;
-
-  std::unique_ptr<uint8_t[]> aio_buf(new uint8_t[kChunkSize]);
-  cb.aio_buf = aio_buf.get();
-
-  PERFETTO_CHECK(aio_read(&cb) == 0);
-  struct aiocb* aio_list[1] = {&cb};
-
-  uint64_t file_size = 0;
   auto t_load_start = base::GetWallTimeMs();
-  for (int i = 0;; i++) {
-    if (i % 128 == 0)
-      fprintf(stderr, "\rLoading trace: %.2f MB\r", file_size / 1E6);
-
-    // Block waiting for the pending read to complete.
-    PERFETTO_CHECK(aio_suspend(aio_list, 1, nullptr) == 0);
-    auto rsize = aio_return(&cb);
-    if (rsize <= 0)
-      break;
-    file_size += static_cast<uint64_t>(rsize);
-
-    // Take ownership of the completed buffer and enqueue a new async read
-    // with a fresh buffer.
-    std::unique_ptr<uint8_t[]> buf(std::move(aio_buf));
-    aio_buf.reset(new uint8_t[kChunkSize]);
-    cb.aio_buf = aio_buf.get();
-    cb.aio_offset += rsize;
-    PERFETTO_CHECK(aio_read(&cb) == 0);
-
-    // Parse the completed buffer while the async read is in-flight.
-    tp->Parse(std::move(buf), static_cast<size_t>(rsize));
+  // A snapshot which can't be loaded (e.g. because it was saved by another
+  // version) is not parsed as a trace.
+  bool from_snapshot = TraceProcessor::IsSnapshot(trace_file_path);
+  int64_t file_size = -1;
+  if (from_snapshot) {
+    file_size = LoadSnapshot(tp.get(), trace_file_path);
+    if (file_size < 0)
+      return 1;
+  } else {
+    file_size = LoadTraceMmapped(tp.get(), trace_file_path);
+    if (file_size < 0)
+      file_size = LoadTraceWithAio(tp.get(), trace_file_path);
+    if (file_size < 0)
+      return 1;
+    tp->NotifyEndOfFile();
   }
-  tp->NotifyEndOfFile();
   double t_load = (base::GetWallTimeMs() - t_load_start).count() / 1E3;
-  double size_mb = file_size / 1E6;
-  PERFETTO_ILOG("Trace loaded: %.2f MB (%.1f MB/s)", size_mb, size_mb / t_load);
+  double size_mb = static_cast<double>(file_size) / 1E6;
+  PERFETTO_ILOG("%s loaded: %.2f MB (%.1f MB/s)",
+                from_snapshot ? "Snapshot" : "Trace", size_mb,
+                size_mb / t_load);
+
+  if (snapshot_file_path && !tp->SaveSnapshot(snapshot_file_path))
+    return 1;
   g_tp = tp.get();
 
 #if PERFETTO_HAS_SIGNAL_H()
@@ -545,7 +756,15 @@ int TraceProcessorMain(int argc, char** argv) {
     }
   }
 
-  if (!RunQueryAndPrintResult(queries, stdout)) {
+  // The other threads run the queries on read-only connections to the trace.
+  std::vector<std::unique_ptr<TraceProcessor>> read_only_connections;
+  std::vector<TraceProcessor*> connections{tp.get()};
+  for (uint32_t i = 1; i < num_query_threads && !queries.empty(); i++) {
+    read_only_connections.emplace_back(tp->CreateReadOnlyConnection());
+    connections.push_back(read_only_connections.back().get());
+  }
+
+  if (!RunQueryAndPrintResult(queries, connections, stdout)) {
     return 1;
   }
 
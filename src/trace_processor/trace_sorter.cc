@@ -18,6 +18,7 @@
 #include <utility>
 
 #include "src/trace_processor/proto_trace_parser.h"
+#include "src/trace_processor/stats.h"
 #include "src/trace_processor/trace_sorter.h"
 
 namespace perfetto {
@@ -43,7 +44,7 @@ void TraceSorter::Queue::Sort() {
   PERFETTO_DCHECK(std::is_sorted(events_.begin(), sort_end));
   auto sort_begin = std::lower_bound(events_.begin(), sort_end, sort_min_ts_,
                                      &TimestampedTracePiece::Compare);
-  std::sort(sort_begin, events_.end());
+  std::stable_sort(sort_begin, events_.end());
   sort_start_idx_ = 0;
   sort_min_ts_ = 0;
 
@@ -51,82 +52,81 @@ void TraceSorter::Queue::Sort() {
   PERFETTO_DCHECK(std::is_sorted(events_.begin(), events_.end()));
 }
 
-// Removes all the events in |queues_| that are earlier than the given window
-// size and moves them to the next parser stages, respecting global timestamp
+// Removes all the events in |queues_| that are not later than |extract_end_ts|
+// and moves them to the next parser stages, respecting global timestamp
 // order. This function is a "extract min from N sorted queues", with some
 // little cleverness: we know that events tend to be bursty, so events are
 // not going to be randomly distributed on the N |queues_|.
-// Upon each iteration this function finds the first two queues (if any) that
-// have the oldest events, and extracts events from the 1st until hitting the
-// min_ts of the 2nd. Imagine the queues are as follows:
+// Upon each iteration this function takes the queue with the oldest event from
+// the top of |heap_| and extracts events from it until hitting the min_ts of
+// the next queue (one of the two children of the top of the heap). Imagine the
+// queues are as follows:
 //
 //  q0           {min_ts: 10  max_ts: 30}
 //  q1    {min_ts:5              max_ts: 35}
 //  q2              {min_ts: 12    max_ts: 40}
 //
 // We know that we can extract all events from q1 until we hit ts=10 without
-// looking at any other queue. After hitting ts=10, we need to re-look to all of
-// them to figure out the next min-event.
-// There are more suitable data structures to do this (e.g. keeping a min-heap
-// to avoid re-scanning all the queues all the times) but doesn't seem worth it.
-// With Android traces (that have 8 CPUs) this function accounts for ~1-3% cpu
-// time in a profiler.
-void TraceSorter::SortAndExtractEventsBeyondWindow(int64_t window_size_ns) {
+// looking at any other queue. After hitting ts=10, q1 is moved down the heap
+// according to its new min_ts, in O(log N), and q0 becomes the top.
+void TraceSorter::SortAndExtractEvents(int64_t extract_end_ts) {
   DCHECK_ftrace_batch_cpu(kNoBatch);
   constexpr int64_t kTsMax = std::numeric_limits<int64_t>::max();
   const bool was_empty = global_min_ts_ == kTsMax && global_max_ts_ == 0;
-  int64_t extract_end_ts = global_max_ts_ - window_size_ns;
   auto* next_stage = context_->proto_parser.get();
+
+  if (buffered_bytes_ > peak_buffered_bytes_) {
+    peak_buffered_bytes_ = buffered_bytes_;
+    context_->storage->SetStats(stats::sorter_peak_buffered_bytes,
+                                static_cast<int64_t>(peak_buffered_bytes_));
+  }
+
+  // When over the cap on the buffered bytes, extract the oldest events until
+  // down to half of it, so that this doesn't happen again on the next push.
+  uint64_t target_bytes = std::numeric_limits<uint64_t>::max();
+  if (buffered_bytes_ > max_buffered_bytes_)
+    target_bytes = max_buffered_bytes_ / 2;
+
   size_t iterations = 0;
-  for (;; iterations++) {
-    size_t min_queue_idx = 0;  // The index of the queue with the min(ts).
-
-    // The top-2 min(ts) among all queues.
-    // queues_[min_queue_idx].events.timestamp == min_queue_ts[0].
-    int64_t min_queue_ts[2]{kTsMax, kTsMax};
-
-    // This loop identifies the queue which starts with the earliest event and
-    // also remembers the earliest event of the 2nd queue (in min_queue_ts[1]).
-    bool has_queues_with_expired_events = false;
-    for (size_t i = 0; i < queues_.size(); i++) {
-      auto& queue = queues_[i];
-      if (queue.events_.empty())
-        continue;
-      PERFETTO_DCHECK(queue.min_ts_ >= global_min_ts_);
-      PERFETTO_DCHECK(queue.max_ts_ <= global_max_ts_);
-      if (queue.min_ts_ < min_queue_ts[0]) {
-        min_queue_ts[1] = min_queue_ts[0];
-        min_queue_ts[0] = queue.min_ts_;
-        min_queue_idx = i;
-        has_queues_with_expired_events = true;
-      } else if (queue.min_ts_ < min_queue_ts[1]) {
-        min_queue_ts[1] = queue.min_ts_;
-      }
-    }
-    if (!has_queues_with_expired_events) {
-      // All the queues have events that start after the window (i.e. they are
-      // too recent and not eligible to be extracted given the current window).
+  for (; !heap_.empty(); iterations++) {
+    const uint32_t min_queue_idx = heap_[0];
+    Queue& queue = queues_[min_queue_idx];
+
+    // All the queues have events that start after the window (i.e. they are
+    // too recent and not eligible to be extracted given the current window).
+    const bool over_budget = buffered_bytes_ > target_bytes;
+    const int64_t end_ts = over_budget ? kTsMax : extract_end_ts;
+    if (queue.min_ts_ > end_ts)
       break;
-    }
 
-    Queue& queue = queues_[min_queue_idx];
     auto& events = queue.events_;
     if (queue.needs_sorting())
       queue.Sort();
     PERFETTO_DCHECK(queue.min_ts_ == events.front().timestamp);
     PERFETTO_DCHECK(queue.min_ts_ == global_min_ts_);
 
+    // The earliest event of all the other queues is at the top of one of the
+    // two subtrees of the heap.
+    int64_t next_queue_min_ts = kTsMax;
+    for (size_t pos = 1; pos <= 2 && pos < heap_.size(); pos++) {
+      next_queue_min_ts =
+          std::min(next_queue_min_ts, queues_[heap_[pos]].min_ts_);
+    }
+
     // Now that we identified the min-queue, extract all events from it until
-    // we hit either: (1) the min-ts of the 2nd queue or (2) the window limit,
+    // we hit either: (1) the min-ts of the next queue or (2) the window limit,
     // whichever comes first.
-    int64_t extract_until_ts = std::min(extract_end_ts, min_queue_ts[1]);
+    int64_t extract_until_ts = std::min(end_ts, next_queue_min_ts);
     size_t num_extracted = 0;
     for (auto& event : events) {
       int64_t timestamp = event.timestamp;
       if (timestamp > extract_until_ts)
         break;
+      if (over_budget && buffered_bytes_ <= target_bytes)
+        break;
 
-      auto blob_view = std::move(event.blob_view);
+      auto blob_view = TakeBlobView(event.blob_view_idx);
+      last_extracted_ts_ = timestamp;
       ++num_extracted;
       if (bypass_next_stage_for_testing_)
         continue;
@@ -136,36 +136,36 @@ void TraceSorter::SortAndExtractEventsBeyondWindow(int64_t window_size_ns) {
         next_stage->ParseTracePacket(timestamp, std::move(blob_view));
       } else {
         // Ftrace queues start at offset 1. So queues_[1] = cpu[0] and so on.
-        uint32_t cpu = static_cast<uint32_t>(min_queue_idx - 1);
+        uint32_t cpu = min_queue_idx - 1;
         next_stage->ParseFtracePacket(cpu, timestamp, std::move(blob_view));
       }
     }  // for (event: events)
 
-    if (!num_extracted) {
-      // No events can be extracted from any of the queues. This means that
-      // either we hit the window or all queues are empty.
-      break;
-    }
+    // The first event of the queue is always eligible, as it is not later
+    // than either the window end or the first event of the next queue.
+    PERFETTO_DCHECK(num_extracted > 0);
 
     // Now remove the entries from the event buffer and update the queue-local
-    // and global time bounds.
+    // time bounds and the position of the queue in the heap.
     events.erase_front(num_extracted);
-
-    // Update the global_{min,max}_ts to reflect the bounds after extraction.
     if (events.empty()) {
       queue.min_ts_ = kTsMax;
       queue.max_ts_ = 0;
-      global_min_ts_ = min_queue_ts[1];
+      HeapPop();
+    } else {
+      queue.min_ts_ = queue.events_.front().timestamp;
+      HeapSiftDown(0);
+    }
 
-      // If we extraced the max entry from a queue (i.e. we emptied the queue)
-      // we need to recompute the global max, because it might have been the one
-      // just extracted.
+    // Update the global_{min,max}_ts to reflect the bounds after extraction.
+    // The global max can only change once all the queues have been emptied:
+    // with a non-zero window, the events at the global max are never
+    // extracted.
+    if (heap_.empty()) {
+      global_min_ts_ = kTsMax;
       global_max_ts_ = 0;
-      for (auto& q : queues_)
-        global_max_ts_ = std::max(global_max_ts_, q.max_ts_);
     } else {
-      queue.min_ts_ = queue.events_.front().timestamp;
-      global_min_ts_ = std::min(queue.min_ts_, min_queue_ts[1]);
+      global_min_ts_ = queues_[heap_[0]].min_ts_;
     }
   }  // for(;;)
 
@@ -177,6 +177,10 @@ void TraceSorter::SortAndExtractEventsBeyondWindow(int64_t window_size_ns) {
 
 #if PERFETTO_DCHECK_IS_ON()
   // Check that the global min/max are consistent.
+  size_t dbg_non_empty_queues = 0;
+  for (auto& q : queues_)
+    dbg_non_empty_queues += q.events_.empty() ? 0 : 1;
+  PERFETTO_DCHECK(dbg_non_empty_queues == heap_.size());
   int64_t dbg_min_ts = kTsMax;
   int64_t dbg_max_ts = 0;
   for (auto& q : queues_) {
@@ -188,5 +192,115 @@ void TraceSorter::SortAndExtractEventsBeyondWindow(int64_t window_size_ns) {
 #endif
 }
 
+bool TraceSorter::AdmitEvent(size_t index, int64_t timestamp) {
+  PERFETTO_DCHECK(bounded_);
+  if (streaming_ && low_watermark_ != kNoWatermark &&
+      timestamp < low_watermark_) {
+    max_lateness_ns_ = std::max(max_lateness_ns_, low_watermark_ - timestamp);
+  }
+
+  // Events are extracted in timestamp order, so an event earlier than the last
+  // extracted one can't be passed to the parser anymore.
+  if (PERFETTO_UNLIKELY(timestamp < last_extracted_ts_)) {
+    context_->storage->IncrementStats(stats::sorter_out_of_order_dropped);
+    return false;
+  }
+
+  if (!streaming_)
+    return true;
+  if (PERFETTO_UNLIKELY(watermarks_start_ts_ ==
+                        std::numeric_limits<int64_t>::max())) {
+    watermarks_start_ts_ = timestamp + kWatermarkWarmupNs;
+  }
+  Queue& queue = queues_[index];
+  if (timestamp <= queue.watermark_)
+    return true;
+
+  // The low watermark only needs to be recomputed if this queue was holding
+  // it or is a new one (its previous watermark was then kNoWatermark).
+  if (queue.watermark_ == kNoWatermark) {
+    low_watermark_dirty_ = true;
+    low_watermark_new_queue_ = true;
+  } else if (index == low_watermark_queue_) {
+    low_watermark_dirty_ = true;
+  }
+  queue.watermark_ = timestamp;
+  return true;
+}
+
+void TraceSorter::UpdateLowWatermark() {
+  // Recomputing the low watermark is O(num queues), and with ftrace bundles
+  // written round-robin by the cpus the queue holding it moves forward on
+  // almost every bundle. As a stale low watermark only delays extraction, only
+  // recompute it once every few moves. A new queue, instead, can lower it.
+  if (!low_watermark_new_queue_ &&
+      ++low_watermark_skipped_updates_ < queues_.size() / 8) {
+    return;
+  }
+  low_watermark_skipped_updates_ = 0;
+  low_watermark_new_queue_ = false;
+  low_watermark_ = kNoWatermark;
+  for (size_t i = 0; i < queues_.size(); i++) {
+    int64_t watermark = queues_[i].watermark_;
+    if (watermark == kNoWatermark)
+      continue;
+    if (low_watermark_ == kNoWatermark || watermark < low_watermark_) {
+      low_watermark_ = watermark;
+      low_watermark_queue_ = i;
+    }
+  }
+  low_watermark_dirty_ = false;
+}
+
+void TraceSorter::HeapUpdate(uint32_t queue_idx) {
+  Queue& queue = queues_[queue_idx];
+  if (queue.heap_pos_ == kNotInHeap) {
+    queue.heap_pos_ = static_cast<uint32_t>(heap_.size());
+    heap_.emplace_back(queue_idx);
+  }
+  HeapSiftUp(queue.heap_pos_);
+}
+
+void TraceSorter::HeapSiftUp(uint32_t pos) {
+  const uint32_t queue_idx = heap_[pos];
+  while (pos > 0) {
+    uint32_t parent = (pos - 1) / 2;
+    if (!HeapLess(queue_idx, heap_[parent]))
+      break;
+    heap_[pos] = heap_[parent];
+    queues_[heap_[pos]].heap_pos_ = pos;
+    pos = parent;
+  }
+  heap_[pos] = queue_idx;
+  queues_[queue_idx].heap_pos_ = pos;
+}
+
+void TraceSorter::HeapSiftDown(uint32_t pos) {
+  const uint32_t queue_idx = heap_[pos];
+  const auto size = static_cast<uint32_t>(heap_.size());
+  for (;;) {
+    uint32_t child = 2 * pos + 1;
+    if (child >= size)
+      break;
+    if (child + 1 < size && HeapLess(heap_[child + 1], heap_[child]))
+      child++;
+    if (!HeapLess(heap_[child], queue_idx))
+      break;
+    heap_[pos] = heap_[child];
+    queues_[heap_[pos]].heap_pos_ = pos;
+    pos = child;
+  }
+  heap_[pos] = queue_idx;
+  queues_[queue_idx].heap_pos_ = pos;
+}
+
+void TraceSorter::HeapPop() {
+  queues_[heap_[0]].heap_pos_ = kNotInHeap;
+  heap_[0] = heap_.back();
+  heap_.pop_back();
+  if (!heap_.empty())
+    HeapSiftDown(0);
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -40,7 +40,10 @@ namespace trace_processor {
 //
 // Due to this, this class is oprerates as a streaming merge-sort of N+1 queues
 // (N = num cpus + 1 for non-ftrace events). Each queue in turn gets sorted (if
-// necessary) before proceeding with the global merge-sort-extract.
+// necessary) before proceeding with the global merge-sort-extract. The queue
+// holding the next event to extract is found through a min-heap of the queues,
+// keyed by their earliest event, so that this stays cheap on traces from
+// machines with hundreds of cpus.
 // When an event is pushed through, it is just appeneded to the end of one of
 // the N queues. While appending, we keep track of the fact that the queue
 // is still ordered or just lost ordering. When an out-of-order event is
@@ -57,45 +60,18 @@ namespace trace_processor {
 // from there to the end.
 class TraceSorter {
  public:
-  struct TimestampedTracePiece {
-    TimestampedTracePiece(int64_t ts, uint64_t idx, TraceBlobView tbv)
-        : timestamp(ts), packet_idx_(idx), blob_view(std::move(tbv)) {}
-
-    TimestampedTracePiece(TimestampedTracePiece&&) noexcept = default;
-    TimestampedTracePiece& operator=(TimestampedTracePiece&&) = default;
-
-    // For std::lower_bound().
-    static inline bool Compare(const TimestampedTracePiece& x, int64_t ts) {
-      return x.timestamp < ts;
-    }
-
-    // For std::sort().
-    inline bool operator<(const TimestampedTracePiece& o) const {
-      return timestamp < o.timestamp ||
-             (timestamp == o.timestamp && packet_idx_ < o.packet_idx_);
-    }
-
-    int64_t timestamp;
-    uint64_t packet_idx_;
-    TraceBlobView blob_view;
-  };
-
   TraceSorter(TraceProcessorContext*, int64_t window_size_ns);
 
   inline void PushTracePacket(int64_t timestamp, TraceBlobView packet) {
     DCHECK_ftrace_batch_cpu(kNoBatch);
-    auto* queue = GetQueue(0);
-    queue->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(packet)));
-    MaybeExtractEvents(queue);
+    MaybeExtractEvents(AppendToQueue(0, timestamp, std::move(packet)));
   }
 
   inline void PushFtraceEvent(uint32_t cpu,
                               int64_t timestamp,
                               TraceBlobView event) {
     set_ftrace_batch_cpu_for_DCHECK(cpu);
-    GetQueue(cpu + 1)->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(event)));
+    AppendToQueue(cpu + 1, timestamp, std::move(event));
 
     // The caller must call FinalizeFtraceEventBatch() after having pushed a
     // batch of ftrace events. This is to amortize the overhead of handling
@@ -111,7 +87,29 @@ class TraceSorter {
 
   // Extract all events ignoring the window.
   void ExtractEventsForced() {
-    SortAndExtractEventsBeyondWindow(/*window_size_ns=*/0);
+    SortAndExtractEvents(std::numeric_limits<int64_t>::max());
+  }
+
+  // In streaming mode, events are extracted as soon as all the queues have
+  // received events past them (their "watermark"), instead of waiting for the
+  // window to elapse. This relies on each queue being almost sorted, as it is
+  // the case for the per-cpu ftrace events. The watermark is moved back by the
+  // largest lateness seen so far, so that the sorter adapts to queues which
+  // lag behind the others. The watermarks are only used after the first
+  // kWatermarkWarmupNs of the trace, so that all the cpus get a chance to
+  // show up before any event is extracted.
+  void EnableStreaming() {
+    streaming_ = true;
+    bounded_ = true;
+  }
+
+  // Forces the extraction of the oldest events, regardless of the window and
+  // of the watermarks, when the events in the queues add up to more than
+  // |max_bytes|. 0 means no limit.
+  void SetMaxBufferedBytes(uint64_t max_bytes) {
+    max_buffered_bytes_ =
+        max_bytes ? max_bytes : std::numeric_limits<uint64_t>::max();
+    bounded_ |= max_bytes > 0;
   }
 
   void set_window_ns_for_testing(int64_t window_size_ns) {
@@ -120,6 +118,28 @@ class TraceSorter {
 
  private:
   static constexpr uint32_t kNoBatch = std::numeric_limits<uint32_t>::max();
+  static constexpr uint32_t kNotInHeap = std::numeric_limits<uint32_t>::max();
+  static constexpr int64_t kNoWatermark = std::numeric_limits<int64_t>::min();
+  static constexpr int64_t kWatermarkWarmupNs = 1000 * 1000 * 1000;  // 1s.
+
+  // An event waiting to be extracted. The TraceBlobView of the event is kept
+  // aside in |blob_views_|, so that the queues hold (and sort) small trivially
+  // copyable entries.
+  struct TimestampedTracePiece {
+    // For std::lower_bound().
+    static inline bool Compare(const TimestampedTracePiece& x, int64_t ts) {
+      return x.timestamp < ts;
+    }
+
+    // For std::stable_sort(). Events with the same timestamp are kept in the
+    // order they were pushed.
+    inline bool operator<(const TimestampedTracePiece& o) const {
+      return timestamp < o.timestamp;
+    }
+
+    int64_t timestamp;
+    uint32_t blob_view_idx;
+  };
 
   struct Queue {
     inline void Append(TimestampedTracePiece ttp) {
@@ -156,11 +176,29 @@ class TraceSorter {
     int64_t max_ts_ = 0;
     size_t sort_start_idx_ = 0;
     int64_t sort_min_ts_ = 0;
+
+    // The position of this queue in |heap_|, if it has any events.
+    uint32_t heap_pos_ = kNotInHeap;
+
+    // The latest timestamp pushed to this queue. Only tracked in streaming
+    // mode.
+    int64_t watermark_ = kNoWatermark;
   };
 
-  // This method passes any events older than window_size_ns to the
-  // parser to be parsed and then stored.
-  void SortAndExtractEventsBeyondWindow(int64_t windows_size_ns);
+  // This method passes any events not later than |extract_end_ts| to the
+  // parser to be parsed and then stored, plus the oldest events beyond it
+  // while the queues hold more than |max_buffered_bytes_|.
+  void SortAndExtractEvents(int64_t extract_end_ts);
+
+  // Only called when |bounded_|. Returns false if the event pushed to the
+  // queue at |index| must be dropped, as later events have already been
+  // extracted. Otherwise, updates the watermark of the queue.
+  bool AdmitEvent(size_t index, int64_t timestamp);
+
+  // Recomputes |low_watermark_| after the watermark of the queue which held it
+  // moved forward or a new queue was seen. Clears |low_watermark_dirty_| once
+  // done.
+  void UpdateLowWatermark();
 
   inline Queue* GetQueue(size_t index) {
     if (PERFETTO_UNLIKELY(index >= queues_.size()))
@@ -168,15 +206,73 @@ class TraceSorter {
     return &queues_[index];
   }
 
+  inline Queue* AppendToQueue(size_t index,
+                              int64_t timestamp,
+                              TraceBlobView tbv) {
+    Queue* queue = GetQueue(index);
+    if (PERFETTO_UNLIKELY(bounded_) && !AdmitEvent(index, timestamp))
+      return queue;
+    buffered_bytes_ += tbv.length();
+    const int64_t prev_min_ts = queue->min_ts_;
+    uint32_t blob_view_idx = AddBlobView(std::move(tbv));
+    queue->Append(TimestampedTracePiece{timestamp, blob_view_idx});
+
+    // Only events earlier than all the others in the queue (including the
+    // first event of an empty queue) change the position of the queue in the
+    // heap.
+    if (PERFETTO_UNLIKELY(queue->min_ts_ < prev_min_ts))
+      HeapUpdate(static_cast<uint32_t>(index));
+    return queue;
+  }
+
+  inline uint32_t AddBlobView(TraceBlobView tbv) {
+    if (PERFETTO_LIKELY(!free_blob_views_.empty())) {
+      uint32_t idx = free_blob_views_.back();
+      free_blob_views_.pop_back();
+      blob_views_[idx] = std::move(tbv);
+      return idx;
+    }
+    blob_views_.emplace_back(std::move(tbv));
+    return static_cast<uint32_t>(blob_views_.size() - 1);
+  }
+
+  inline TraceBlobView TakeBlobView(uint32_t idx) {
+    buffered_bytes_ -= blob_views_[idx].length();
+    free_blob_views_.emplace_back(idx);
+    return std::move(blob_views_[idx]);
+  }
+
+  // Min-heap operations on |heap_|.
+  inline bool HeapLess(uint32_t a, uint32_t b) const {
+    int64_t a_ts = queues_[a].min_ts_;
+    int64_t b_ts = queues_[b].min_ts_;
+    return a_ts < b_ts || (a_ts == b_ts && a < b);
+  }
+  void HeapUpdate(uint32_t queue_idx);
+  void HeapSiftUp(uint32_t pos);
+  void HeapSiftDown(uint32_t pos);
+  void HeapPop();
+
   inline void MaybeExtractEvents(Queue* queue) {
     DCHECK_ftrace_batch_cpu(kNoBatch);
     global_max_ts_ = std::max(global_max_ts_, queue->max_ts_);
     global_min_ts_ = std::min(global_min_ts_, queue->min_ts_);
 
-    if (global_max_ts_ - global_min_ts_ < window_size_ns_)
+    int64_t extract_end_ts = global_max_ts_ - window_size_ns_;
+    if (streaming_) {
+      if (low_watermark_dirty_)
+        UpdateLowWatermark();
+      if (global_max_ts_ >= watermarks_start_ts_) {
+        extract_end_ts =
+            std::max(extract_end_ts, low_watermark_ - max_lateness_ns_);
+      }
+    }
+    if (global_min_ts_ > extract_end_ts &&
+        buffered_bytes_ <= max_buffered_bytes_) {
       return;
+    }
 
-    SortAndExtractEventsBeyondWindow(window_size_ns_);
+    SortAndExtractEvents(extract_end_ts);
   }
 
   TraceProcessorContext* const context_;
@@ -196,8 +292,39 @@ class TraceSorter {
   // min(e.timestamp for e in queues_).
   int64_t global_min_ts_ = std::numeric_limits<int64_t>::max();
 
-  // Monotonic increasing value used to index timestamped trace pieces.
-  uint64_t packet_idx_ = 0;
+  // The indices in |queues_| of the non-empty queues, as a binary min-heap
+  // ordered by (min_ts_, index).
+  std::vector<uint32_t> heap_;
+
+  // The TraceBlobViews of the events in the queues, referenced by
+  // TimestampedTracePiece::blob_view_idx. Slots are recycled through
+  // |free_blob_views_| once their event has been extracted.
+  std::vector<TraceBlobView> blob_views_;
+  std::vector<uint32_t> free_blob_views_;
+
+  // The sum of the sizes of the TraceBlobViews in |blob_views_| waiting to be
+  // extracted, its cap (see SetMaxBufferedBytes()) and its peak so far.
+  uint64_t buffered_bytes_ = 0;
+  uint64_t max_buffered_bytes_ = std::numeric_limits<uint64_t>::max();
+  uint64_t peak_buffered_bytes_ = 0;
+
+  // True in streaming mode or with a cap on the buffered bytes, that is when
+  // events can be extracted before all the earlier ones have been pushed.
+  // Such late events are then dropped.
+  bool bounded_ = false;
+  int64_t last_extracted_ts_ = std::numeric_limits<int64_t>::min();
+
+  // Streaming mode state: the timestamp from which the watermarks are used,
+  // min(q.watermark_ for q in queues_), the index of the queue holding it and
+  // the largest amount of time an event was pushed behind it.
+  bool streaming_ = false;
+  int64_t watermarks_start_ts_ = std::numeric_limits<int64_t>::max();
+  bool low_watermark_dirty_ = false;
+  bool low_watermark_new_queue_ = false;
+  size_t low_watermark_skipped_updates_ = 0;
+  int64_t low_watermark_ = kNoWatermark;
+  size_t low_watermark_queue_ = 0;
+  int64_t max_lateness_ns_ = 0;
 
   // Used for performance tests. True when setting TRACE_PROCESSOR_SORT_ONLY=1.
   bool bypass_next_stage_for_testing_ = false;
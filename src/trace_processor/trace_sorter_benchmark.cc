@@ -0,0 +1,118 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+
+#include "benchmark/benchmark.h"
+
+#include "src/trace_processor/proto_trace_parser.h"
+#include "src/trace_processor/trace_processor_context.h"
+#include "src/trace_processor/trace_sorter.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace {
+
+using perfetto::trace_processor::Config;
+using perfetto::trace_processor::ProtoTraceParser;
+using perfetto::trace_processor::TraceBlob;
+using perfetto::trace_processor::TraceBlobView;
+using perfetto::trace_processor::TraceProcessorContext;
+using perfetto::trace_processor::TraceSorter;
+using perfetto::trace_processor::TraceStorage;
+
+// Pushes 1M ftrace events through the sorter, in bundles of 16 events per cpu
+// written round-robin by |state.range(0)| cpus, and measures the time to get
+// them out in order. The events of each cpu are mostly in order, like the
+// ones of a real trace. The "Streaming" variant uses a window small enough for
+// the events to be extracted as they are pushed, the "Buffered" one the
+// default window of the trace processor, which holds the whole trace until
+// the end, and the "Watermarks" one the default window in streaming mode.
+
+constexpr uint32_t kNumEvents = 1 << 20;
+constexpr uint32_t kEventsPerBundle = 16;
+
+class NullTraceParser : public ProtoTraceParser {
+ public:
+  explicit NullTraceParser(TraceProcessorContext* context)
+      : ProtoTraceParser(context) {}
+
+  void ParseTracePacket(int64_t, TraceBlobView) override {}
+  void ParseFtracePacket(uint32_t, int64_t, TraceBlobView) override {}
+};
+
+void RunSorter(benchmark::State& state,
+               int64_t window_size_ns,
+               bool streaming = false) {
+  const auto num_cpus = static_cast<uint32_t>(state.range(0));
+
+  // All the events point to the same small buffer: only the sorting is
+  // measured here.
+  TraceBlobView buf(TraceBlob::FromHeapBuffer(
+                        std::unique_ptr<uint8_t[]>(new uint8_t[8]), 8),
+                    0, 8);
+
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    TraceProcessorContext context;
+    context.storage.reset(new TraceStorage());
+    context.proto_parser.reset(new NullTraceParser(&context));
+    context.sorter.reset(new TraceSorter(&context, window_size_ns));
+    TraceSorter* sorter = context.sorter.get();
+    if (streaming)
+      sorter->EnableStreaming();
+    std::minstd_rand0 rnd(0);
+    std::vector<int64_t> cpu_ts(num_cpus, 1);
+    state.ResumeTiming();
+
+    for (uint32_t i = 0; i < kNumEvents / kEventsPerBundle; i++) {
+      uint32_t cpu = i % num_cpus;
+      for (uint32_t j = 0; j < kEventsPerBundle; j++) {
+        // Each cpu produces an event every ~5us * num_cpus on average (i.e.
+        // the trace spans ~5s), with some of them slightly out of order.
+        cpu_ts[cpu] += rnd() % (10000 * num_cpus);
+        int64_t ts = cpu_ts[cpu] - (rnd() % 64 == 0 ? 100 : 0);
+        sorter->PushFtraceEvent(cpu, ts, buf.slice(0, 8));
+      }
+      sorter->FinalizeFtraceEventBatch(cpu);
+    }
+    sorter->ExtractEventsForced();
+
+    state.PauseTiming();
+    context.sorter.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * kNumEvents);
+}
+
+void CpuCounts(benchmark::internal::Benchmark* b) {
+  b->RangeMultiplier(2)->Range(8, 256)->Unit(benchmark::kMillisecond);
+}
+
+}  // namespace
+
+static void BM_TraceSorterFtraceStreaming(benchmark::State& state) {
+  RunSorter(state, 1000 * 1000);
+}
+BENCHMARK(BM_TraceSorterFtraceStreaming)->Apply(CpuCounts);
+
+static void BM_TraceSorterFtraceBuffered(benchmark::State& state) {
+  RunSorter(state, static_cast<int64_t>(Config().window_size_ns));
+}
+BENCHMARK(BM_TraceSorterFtraceBuffered)->Apply(CpuCounts);
+
+static void BM_TraceSorterFtraceWatermarks(benchmark::State& state) {
+  RunSorter(state, static_cast<int64_t>(Config().window_size_ns),
+            true /* streaming */);
+}
+BENCHMARK(BM_TraceSorterFtraceWatermarks)->Apply(CpuCounts);
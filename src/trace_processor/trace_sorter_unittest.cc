@@ -23,6 +23,7 @@
 #include "gtest/gtest.h"
 
 #include "perfetto/trace_processor/basic_types.h"
+#include "src/trace_processor/stats.h"
 #include "src/trace_processor/trace_processor_context.h"
 #include "src/trace_processor/trace_sorter.h"
 
@@ -127,6 +128,69 @@ TEST_F(TraceSorterTest, Ordering) {
   context_.sorter->ExtractEventsForced();
 }
 
+TEST_F(TraceSorterTest, StreamingWatermarks) {
+  context_.sorter->set_window_ns_for_testing(
+      static_cast<int64_t>(Config().window_size_ns));
+  context_.sorter->EnableStreaming();
+
+  auto push = [this](uint32_t cpu, int64_t ts) {
+    context_.sorter->PushFtraceEvent(cpu, ts, test_buffer_.slice(0, 1));
+    context_.sorter->FinalizeFtraceEventBatch(cpu);
+  };
+
+  // Nothing is extracted in the first second of the trace.
+  constexpr int64_t kSec = 1000 * 1000 * 1000;
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(_, _, _, _)).Times(0);
+  push(0, 0);
+  push(1, 10);
+  ::testing::Mock::VerifyAndClearExpectations(parser_);
+
+  InSequence s;
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(0, 0, _, _));
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(1, 10, _, _));
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(0, kSec + 100, _, _));
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(1, kSec + 200, _, _));
+
+  // Then the events are extracted as soon as both cpus went past them.
+  push(0, kSec + 100);
+  push(1, kSec + 200);
+
+  // An event earlier than the ones already extracted is dropped, and the
+  // next events are held back by as much.
+  push(1, kSec + 50);
+  push(0, kSec + 300);
+  push(1, kSec + 400);
+  ASSERT_EQ(storage_->stats()[stats::sorter_out_of_order_dropped].value, 1);
+  ::testing::Mock::VerifyAndClearExpectations(parser_);
+
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(0, kSec + 300, _, _));
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(1, kSec + 400, _, _));
+  context_.sorter->ExtractEventsForced();
+}
+
+TEST_F(TraceSorterTest, MaxBufferedBytes) {
+  context_.sorter->set_window_ns_for_testing(
+      static_cast<int64_t>(Config().window_size_ns));
+  context_.sorter->SetMaxBufferedBytes(4);
+
+  InSequence s;
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(1, _, _));
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(2, _, _));
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(3, _, _));
+
+  // Going over 4 bytes extracts the oldest events until down to 2 bytes.
+  for (int64_t ts = 1; ts <= 5; ts++)
+    context_.sorter->PushTracePacket(ts, test_buffer_.slice(0, 1));
+  context_.sorter->PushTracePacket(2, test_buffer_.slice(0, 1));
+  ASSERT_EQ(storage_->stats()[stats::sorter_out_of_order_dropped].value, 1);
+  ::testing::Mock::VerifyAndClearExpectations(parser_);
+
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(4, _, _));
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(5, _, _));
+  context_.sorter->ExtractEventsForced();
+  ASSERT_EQ(storage_->stats()[stats::sorter_peak_buffered_bytes].value, 5);
+}
+
 // Simulates a random stream of ftrace events happening on random CPUs.
 // Tests that the output of the TraceSorter matches the timestamp order
 // (% events happening at the same time on different CPUs).
@@ -158,7 +222,8 @@ TEST_F(TraceSorterTest, MultiQueueSorting) {
     for (int j = 0; j < num_cpus; j++) {
       uint32_t cpu = static_cast<uint32_t>(rnd_engine() % 32);
       expectations[ts].push_back(cpu);
-      context_.sorter->PushFtraceEvent(cpu, ts, TraceBlobView(nullptr, 0, 0));
+      TraceBlobView tbv(TraceBlob::FromHeapBuffer(nullptr, 0), 0, 0);
+      context_.sorter->PushFtraceEvent(cpu, ts, std::move(tbv));
       context_.sorter->FinalizeFtraceEventBatch(cpu);
     }
   }
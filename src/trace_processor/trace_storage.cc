@@ -42,49 +42,101 @@ TraceStorage::TraceStorage() {
   // Upid/utid 0 is reserved for idle processes/threads.
   unique_processes_.emplace_back(0);
   unique_threads_.emplace_back(0);
-
-  // Reserve string ID 0 for the empty string.
-  InternString("");
 }
 
 TraceStorage::~TraceStorage() {}
 
+// static
+constexpr int64_t TraceStorage::HeapProfileCallsites::kNoParent;
+
 StringId TraceStorage::InternString(base::StringView str) {
-  auto hash = str.Hash();
-  auto id_it = string_index_.find(hash);
-  if (id_it != string_index_.end()) {
-    PERFETTO_DCHECK(base::StringView(string_pool_[id_it->second]) == str);
-    return id_it->second;
-  }
-  string_pool_.emplace_back(str.ToStdString());
-  StringId string_id = static_cast<uint32_t>(string_pool_.size() - 1);
-  string_index_.emplace(hash, string_id);
-  return string_id;
+  // Map the empty string to id 0 (which is otherwise the null string in the
+  // pool) so that callers can use id 0 to mean "no string".
+  if (str.empty())
+    return 0;
+  return string_pool_.InternString(str);
 }
 
 void TraceStorage::ResetStorage() {
   *this = TraceStorage();
 }
 
-void TraceStorage::SqlStats::RecordQueryBegin(const std::string& query,
-                                              int64_t time_queued,
-                                              int64_t time_started) {
-  if (queries_.size() >= kMaxLogEntries) {
-    queries_.pop_front();
-    times_queued_.pop_front();
-    times_started_.pop_front();
-    times_ended_.pop_front();
+void TraceStorage::AddToCounterPyramid(uint32_t row) {
+  CounterDefinitions::Id counter_id = counter_values_.counter_ids()[row];
+  if (counter_id >= counter_pyramids_.size())
+    counter_pyramids_.resize(counter_id + 1);
+  counter_pyramids_[counter_id].AddValue(row, counter_values_.values()[row]);
+}
+
+void TraceStorage::RebuildCounterPyramids() {
+  counter_pyramids_.clear();
+  for (uint32_t row = 0; row < counter_values_.size(); row++)
+    AddToCounterPyramid(row);
+}
+
+TraceStorage::SqlStats::SqlStats(SqlStats&& other) noexcept {
+  std::lock_guard<std::mutex> lock(other.mutex_);
+  entries_ = std::move(other.entries_);
+  next_id_ = other.next_id_;
+}
+
+TraceStorage::SqlStats& TraceStorage::SqlStats::operator=(SqlStats&& other) {
+  if (this == &other)
+    return *this;
+  std::lock(mutex_, other.mutex_);
+  std::lock_guard<std::mutex> lock(mutex_, std::adopt_lock);
+  std::lock_guard<std::mutex> other_lock(other.mutex_, std::adopt_lock);
+  entries_ = std::move(other.entries_);
+  next_id_ = other.next_id_;
+  return *this;
+}
+
+int64_t TraceStorage::SqlStats::RecordQueryBegin(const std::string& query,
+                                                 int64_t time_queued,
+                                                 int64_t time_started) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.queries.size() >= kMaxLogEntries) {
+    entries_.ids.pop_front();
+    entries_.queries.pop_front();
+    entries_.times_queued.pop_front();
+    entries_.times_started.pop_front();
+    entries_.times_prepared.pop_front();
+    entries_.times_ended.pop_front();
+    entries_.profiles.pop_front();
   }
-  queries_.push_back(query);
-  times_queued_.push_back(time_queued);
-  times_started_.push_back(time_started);
-  times_ended_.push_back(0);
+  entries_.ids.push_back(next_id_);
+  entries_.queries.push_back(query);
+  entries_.times_queued.push_back(time_queued);
+  entries_.times_started.push_back(time_started);
+  entries_.times_prepared.push_back(0);
+  entries_.times_ended.push_back(0);
+  entries_.profiles.emplace_back();
+  return next_id_++;
+}
+
+void TraceStorage::SqlStats::RecordQueryPrepared(int64_t time_prepared) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PERFETTO_DCHECK(!entries_.times_prepared.empty());
+  PERFETTO_DCHECK(entries_.times_prepared.back() == 0);
+  entries_.times_prepared.back() = time_prepared;
+}
+
+void TraceStorage::SqlStats::RecordQueryProfile(QueryProfile profile) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PERFETTO_DCHECK(!entries_.profiles.empty());
+  entries_.profiles.back() = std::move(profile);
 }
 
 void TraceStorage::SqlStats::RecordQueryEnd(int64_t time_ended) {
-  PERFETTO_DCHECK(!times_ended_.empty());
-  PERFETTO_DCHECK(times_ended_.back() == 0);
-  times_ended_.back() = time_ended;
+  std::lock_guard<std::mutex> lock(mutex_);
+  PERFETTO_DCHECK(!entries_.times_ended.empty());
+  PERFETTO_DCHECK(entries_.times_ended.back() == 0);
+  entries_.times_ended.back() = time_ended;
+}
+
+TraceStorage::SqlStats::Entries TraceStorage::SqlStats::CopyEntries() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_;
 }
 
 std::pair<int64_t, int64_t> TraceStorage::GetTraceTimestampBoundsNs() const {
@@ -100,6 +152,9 @@ std::pair<int64_t, int64_t> TraceStorage::GetTraceTimestampBoundsNs() const {
                     nestable_slices_.start_ns().end(), &start_ns, &end_ns);
   MaybeUpdateMinMax(android_log_.timestamps().begin(),
                     android_log_.timestamps().end(), &start_ns, &end_ns);
+  MaybeUpdateMinMax(heap_profile_allocations_.timestamps().begin(),
+                    heap_profile_allocations_.timestamps().end(), &start_ns,
+                    &end_ns);
 
   if (start_ns == std::numeric_limits<int64_t>::max()) {
     return std::make_pair(0, 0);
@@ -17,9 +17,11 @@
 #ifndef SRC_TRACE_PROCESSOR_TRACE_STORAGE_H_
 #define SRC_TRACE_PROCESSOR_TRACE_STORAGE_H_
 
+#include <algorithm>
 #include <array>
 #include <deque>
 #include <map>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -30,8 +32,12 @@
 #include "perfetto/base/optional.h"
 #include "perfetto/base/string_view.h"
 #include "perfetto/base/utils.h"
+#include "src/trace_processor/chunked_vector.h"
+#include "src/trace_processor/counter_pyramid.h"
 #include "src/trace_processor/ftrace_utils.h"
+#include "src/trace_processor/query_profile.h"
 #include "src/trace_processor/stats.h"
+#include "src/trace_processor/string_pool.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -46,7 +52,7 @@ using UniquePid = uint32_t;
 using UniqueTid = uint32_t;
 
 // StringId is an offset into |string_pool_|.
-using StringId = uint32_t;
+using StringId = StringPool::Id;
 
 // Identifiers for all the tables in the database.
 enum TableId : uint8_t {
@@ -170,10 +176,10 @@ class TraceStorage {
       }
     };
 
-    const std::deque<ArgSetId>& set_ids() const { return set_ids_; }
-    const std::deque<StringId>& flat_keys() const { return flat_keys_; }
-    const std::deque<StringId>& keys() const { return keys_; }
-    const std::deque<Variadic>& arg_values() const { return arg_values_; }
+    const ChunkedVector<ArgSetId>& set_ids() const { return set_ids_; }
+    const ChunkedVector<StringId>& flat_keys() const { return flat_keys_; }
+    const ChunkedVector<StringId>& keys() const { return keys_; }
+    const ChunkedVector<Variadic>& arg_values() const { return arg_values_; }
     uint32_t args_count() const {
       return static_cast<uint32_t>(set_ids_.size());
     }
@@ -205,13 +211,22 @@ class TraceStorage {
       return id;
     }
 
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&set_ids_);
+      v->Column(&flat_keys_);
+      v->Column(&keys_);
+      v->Column(&arg_values_);
+      v->Map(&arg_row_for_hash_);
+    }
+
    private:
     using ArgSetHash = uint64_t;
 
-    std::deque<ArgSetId> set_ids_;
-    std::deque<StringId> flat_keys_;
-    std::deque<StringId> keys_;
-    std::deque<Variadic> arg_values_;
+    ChunkedVector<ArgSetId> set_ids_;
+    ChunkedVector<StringId> flat_keys_;
+    ChunkedVector<StringId> keys_;
+    ChunkedVector<Variadic> arg_values_;
 
     std::unordered_map<ArgSetHash, uint32_t> arg_row_for_hash_;
   };
@@ -230,15 +245,13 @@ class TraceStorage {
       utids_.emplace_back(utid);
       end_states_.emplace_back(end_state);
       priorities_.emplace_back(priority);
-
-      if (utid >= rows_for_utids_.size())
-        rows_for_utids_.resize(utid + 1);
-      rows_for_utids_[utid].emplace_back(slice_count() - 1);
+      mutation_count_++;
       return slice_count() - 1;
     }
 
     void set_duration(size_t index, int64_t duration_ns) {
       durations_[index] = duration_ns;
+      mutation_count_++;
     }
 
     void set_end_state(size_t index, ftrace_utils::TaskState end_state) {
@@ -247,36 +260,45 @@ class TraceStorage {
 
     size_t slice_count() const { return start_ns_.size(); }
 
-    const std::deque<uint32_t>& cpus() const { return cpus_; }
+    const ChunkedVector<uint32_t>& cpus() const { return cpus_; }
 
-    const std::deque<int64_t>& start_ns() const { return start_ns_; }
+    const ChunkedVector<int64_t>& start_ns() const { return start_ns_; }
 
-    const std::deque<int64_t>& durations() const { return durations_; }
+    const ChunkedVector<int64_t>& durations() const { return durations_; }
 
-    const std::deque<UniqueTid>& utids() const { return utids_; }
+    const ChunkedVector<UniqueTid>& utids() const { return utids_; }
 
-    const std::deque<ftrace_utils::TaskState>& end_state() const {
+    const ChunkedVector<ftrace_utils::TaskState>& end_state() const {
       return end_states_;
     }
 
-    const std::deque<int32_t>& priorities() const { return priorities_; }
+    const ChunkedVector<int32_t>& priorities() const { return priorities_; }
+
+    // Incremented whenever a slice is added or its duration is updated, so
+    // that the caches built from the slices can tell when they are stale.
+    uint64_t mutation_count() const { return mutation_count_; }
 
-    const std::deque<std::vector<uint32_t>>& rows_for_utids() const {
-      return rows_for_utids_;
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&cpus_);
+      v->Column(&start_ns_);
+      v->Column(&durations_);
+      v->Column(&utids_);
+      v->Column(&end_states_);
+      v->Column(&priorities_);
     }
 
    private:
-    // Each deque below has the same number of entries (the number of slices
+    // Each column below has the same number of entries (the number of slices
     // in the trace for the CPU).
-    std::deque<uint32_t> cpus_;
-    std::deque<int64_t> start_ns_;
-    std::deque<int64_t> durations_;
-    std::deque<UniqueTid> utids_;
-    std::deque<ftrace_utils::TaskState> end_states_;
-    std::deque<int32_t> priorities_;
-
-    // One row per utid.
-    std::deque<std::vector<uint32_t>> rows_for_utids_;
+    ChunkedVector<uint32_t> cpus_;
+    ChunkedVector<int64_t> start_ns_;
+    ChunkedVector<int64_t> durations_;
+    ChunkedVector<UniqueTid> utids_;
+    ChunkedVector<ftrace_utils::TaskState> end_states_;
+    ChunkedVector<int32_t> priorities_;
+
+    uint64_t mutation_count_ = 0;
   };
 
   class NestableSlices {
@@ -309,26 +331,38 @@ class TraceStorage {
     }
 
     size_t slice_count() const { return start_ns_.size(); }
-    const std::deque<int64_t>& start_ns() const { return start_ns_; }
-    const std::deque<int64_t>& durations() const { return durations_; }
-    const std::deque<UniqueTid>& utids() const { return utids_; }
-    const std::deque<StringId>& cats() const { return cats_; }
-    const std::deque<StringId>& names() const { return names_; }
-    const std::deque<uint8_t>& depths() const { return depths_; }
-    const std::deque<int64_t>& stack_ids() const { return stack_ids_; }
-    const std::deque<int64_t>& parent_stack_ids() const {
+    const ChunkedVector<int64_t>& start_ns() const { return start_ns_; }
+    const ChunkedVector<int64_t>& durations() const { return durations_; }
+    const ChunkedVector<UniqueTid>& utids() const { return utids_; }
+    const ChunkedVector<StringId>& cats() const { return cats_; }
+    const ChunkedVector<StringId>& names() const { return names_; }
+    const ChunkedVector<uint8_t>& depths() const { return depths_; }
+    const ChunkedVector<int64_t>& stack_ids() const { return stack_ids_; }
+    const ChunkedVector<int64_t>& parent_stack_ids() const {
       return parent_stack_ids_;
     }
 
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&start_ns_);
+      v->Column(&durations_);
+      v->Column(&utids_);
+      v->Column(&cats_);
+      v->Column(&names_);
+      v->Column(&depths_);
+      v->Column(&stack_ids_);
+      v->Column(&parent_stack_ids_);
+    }
+
    private:
-    std::deque<int64_t> start_ns_;
-    std::deque<int64_t> durations_;
-    std::deque<UniqueTid> utids_;
-    std::deque<StringId> cats_;
-    std::deque<StringId> names_;
-    std::deque<uint8_t> depths_;
-    std::deque<int64_t> stack_ids_;
-    std::deque<int64_t> parent_stack_ids_;
+    ChunkedVector<int64_t> start_ns_;
+    ChunkedVector<int64_t> durations_;
+    ChunkedVector<UniqueTid> utids_;
+    ChunkedVector<StringId> cats_;
+    ChunkedVector<StringId> names_;
+    ChunkedVector<uint8_t> depths_;
+    ChunkedVector<int64_t> stack_ids_;
+    ChunkedVector<int64_t> parent_stack_ids_;
   };
 
   class CounterDefinitions {
@@ -359,16 +393,24 @@ class TraceStorage {
 
     uint32_t size() const { return static_cast<uint32_t>(name_ids_.size()); }
 
-    const std::deque<StringId>& name_ids() const { return name_ids_; }
+    const ChunkedVector<StringId>& name_ids() const { return name_ids_; }
 
-    const std::deque<int64_t>& refs() const { return refs_; }
+    const ChunkedVector<int64_t>& refs() const { return refs_; }
 
-    const std::deque<RefType>& types() const { return types_; }
+    const ChunkedVector<RefType>& types() const { return types_; }
+
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&name_ids_);
+      v->Column(&refs_);
+      v->Column(&types_);
+      v->Map(&hash_to_row_idx_);
+    }
 
    private:
-    std::deque<StringId> name_ids_;
-    std::deque<int64_t> refs_;
-    std::deque<RefType> types_;
+    ChunkedVector<StringId> name_ids_;
+    ChunkedVector<int64_t> refs_;
+    ChunkedVector<RefType> types_;
 
     std::unordered_map<uint64_t, uint32_t> hash_to_row_idx_;
   };
@@ -389,41 +431,75 @@ class TraceStorage {
 
     uint32_t size() const { return static_cast<uint32_t>(counter_ids_.size()); }
 
-    const std::deque<CounterDefinitions::Id>& counter_ids() const {
+    const ChunkedVector<CounterDefinitions::Id>& counter_ids() const {
       return counter_ids_;
     }
 
-    const std::deque<int64_t>& timestamps() const { return timestamps_; }
+    const ChunkedVector<int64_t>& timestamps() const { return timestamps_; }
+
+    const ChunkedVector<double>& values() const { return values_; }
 
-    const std::deque<double>& values() const { return values_; }
+    const ChunkedVector<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
 
-    const std::deque<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&counter_ids_);
+      v->Column(&timestamps_);
+      v->Column(&values_);
+      v->Column(&arg_set_ids_);
+    }
 
    private:
-    std::deque<CounterDefinitions::Id> counter_ids_;
-    std::deque<int64_t> timestamps_;
-    std::deque<double> values_;
-    std::deque<ArgSetId> arg_set_ids_;
+    ChunkedVector<CounterDefinitions::Id> counter_ids_;
+    ChunkedVector<int64_t> timestamps_;
+    ChunkedVector<double> values_;
+    ChunkedVector<ArgSetId> arg_set_ids_;
   };
 
+  // The queries are recorded by the TraceProcessor owning the storage while
+  // its read-only connections can read them on other threads, so the entries
+  // are guarded by a mutex and readers get a copy of them.
   class SqlStats {
    public:
     static constexpr size_t kMaxLogEntries = 100;
-    void RecordQueryBegin(const std::string& query,
-                          int64_t time_queued,
-                          int64_t time_started);
+
+    // The logged queries, oldest first.
+    struct Entries {
+      size_t size() const { return queries.size(); }
+
+      std::deque<int64_t> ids;
+      std::deque<std::string> queries;
+      std::deque<int64_t> times_queued;
+      std::deque<int64_t> times_started;
+      std::deque<int64_t> times_prepared;
+      std::deque<int64_t> times_ended;
+      std::deque<QueryProfile> profiles;
+    };
+
+    SqlStats() = default;
+
+    // Moving (only done by ResetStorage() and ReplaceContents()) moves the
+    // entries but not the mutex.
+    SqlStats(SqlStats&&) noexcept;
+    SqlStats& operator=(SqlStats&&);
+
+    // Returns the id of the query, which identifies its rows in the sqlstats
+    // and sql_profile tables.
+    int64_t RecordQueryBegin(const std::string& query,
+                             int64_t time_queued,
+                             int64_t time_started);
+    // Records the end of the preparation of the last query, which can take
+    // most of the time of short queries as it plans the vtable accesses.
+    void RecordQueryPrepared(int64_t time_prepared);
     void RecordQueryEnd(int64_t time_ended);
-    size_t size() const { return queries_.size(); }
-    const std::deque<std::string>& queries() const { return queries_; }
-    const std::deque<int64_t>& times_queued() const { return times_queued_; }
-    const std::deque<int64_t>& times_started() const { return times_started_; }
-    const std::deque<int64_t>& times_ended() const { return times_ended_; }
+    void RecordQueryProfile(QueryProfile profile);
+
+    Entries CopyEntries() const;
 
    private:
-    std::deque<std::string> queries_;
-    std::deque<int64_t> times_queued_;
-    std::deque<int64_t> times_started_;
-    std::deque<int64_t> times_ended_;
+    mutable std::mutex mutex_;
+    Entries entries_;
+    int64_t next_id_ = 1;
   };
 
   class Instants {
@@ -446,25 +522,35 @@ class TraceStorage {
 
     size_t instant_count() const { return timestamps_.size(); }
 
-    const std::deque<int64_t>& timestamps() const { return timestamps_; }
+    const ChunkedVector<int64_t>& timestamps() const { return timestamps_; }
+
+    const ChunkedVector<StringId>& name_ids() const { return name_ids_; }
 
-    const std::deque<StringId>& name_ids() const { return name_ids_; }
+    const ChunkedVector<double>& values() const { return values_; }
 
-    const std::deque<double>& values() const { return values_; }
+    const ChunkedVector<int64_t>& refs() const { return refs_; }
 
-    const std::deque<int64_t>& refs() const { return refs_; }
+    const ChunkedVector<RefType>& types() const { return types_; }
 
-    const std::deque<RefType>& types() const { return types_; }
+    const ChunkedVector<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
 
-    const std::deque<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&timestamps_);
+      v->Column(&name_ids_);
+      v->Column(&values_);
+      v->Column(&refs_);
+      v->Column(&types_);
+      v->Column(&arg_set_ids_);
+    }
 
    private:
-    std::deque<int64_t> timestamps_;
-    std::deque<StringId> name_ids_;
-    std::deque<double> values_;
-    std::deque<int64_t> refs_;
-    std::deque<RefType> types_;
-    std::deque<ArgSetId> arg_set_ids_;
+    ChunkedVector<int64_t> timestamps_;
+    ChunkedVector<StringId> name_ids_;
+    ChunkedVector<double> values_;
+    ChunkedVector<int64_t> refs_;
+    ChunkedVector<RefType> types_;
+    ChunkedVector<ArgSetId> arg_set_ids_;
   };
 
   class RawEvents {
@@ -486,22 +572,31 @@ class TraceStorage {
 
     size_t raw_event_count() const { return timestamps_.size(); }
 
-    const std::deque<int64_t>& timestamps() const { return timestamps_; }
+    const ChunkedVector<int64_t>& timestamps() const { return timestamps_; }
 
-    const std::deque<StringId>& name_ids() const { return name_ids_; }
+    const ChunkedVector<StringId>& name_ids() const { return name_ids_; }
 
-    const std::deque<uint32_t>& cpus() const { return cpus_; }
+    const ChunkedVector<uint32_t>& cpus() const { return cpus_; }
 
-    const std::deque<UniqueTid>& utids() const { return utids_; }
+    const ChunkedVector<UniqueTid>& utids() const { return utids_; }
 
-    const std::deque<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
+    const ChunkedVector<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
+
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&timestamps_);
+      v->Column(&name_ids_);
+      v->Column(&cpus_);
+      v->Column(&utids_);
+      v->Column(&arg_set_ids_);
+    }
 
    private:
-    std::deque<int64_t> timestamps_;
-    std::deque<StringId> name_ids_;
-    std::deque<uint32_t> cpus_;
-    std::deque<UniqueTid> utids_;
-    std::deque<ArgSetId> arg_set_ids_;
+    ChunkedVector<int64_t> timestamps_;
+    ChunkedVector<StringId> name_ids_;
+    ChunkedVector<uint32_t> cpus_;
+    ChunkedVector<UniqueTid> utids_;
+    ChunkedVector<ArgSetId> arg_set_ids_;
   };
 
   class AndroidLogs {
@@ -521,18 +616,189 @@ class TraceStorage {
 
     size_t size() const { return timestamps_.size(); }
 
-    const std::deque<int64_t>& timestamps() const { return timestamps_; }
-    const std::deque<UniqueTid>& utids() const { return utids_; }
-    const std::deque<uint8_t>& prios() const { return prios_; }
-    const std::deque<StringId>& tag_ids() const { return tag_ids_; }
-    const std::deque<StringId>& msg_ids() const { return msg_ids_; }
+    const ChunkedVector<int64_t>& timestamps() const { return timestamps_; }
+    const ChunkedVector<UniqueTid>& utids() const { return utids_; }
+    const ChunkedVector<uint8_t>& prios() const { return prios_; }
+    const ChunkedVector<StringId>& tag_ids() const { return tag_ids_; }
+    const ChunkedVector<StringId>& msg_ids() const { return msg_ids_; }
+
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&timestamps_);
+      v->Column(&utids_);
+      v->Column(&prios_);
+      v->Column(&tag_ids_);
+      v->Column(&msg_ids_);
+    }
+
+   private:
+    ChunkedVector<int64_t> timestamps_;
+    ChunkedVector<UniqueTid> utids_;
+    ChunkedVector<uint8_t> prios_;
+    ChunkedVector<StringId> tag_ids_;
+    ChunkedVector<StringId> msg_ids_;
+  };
+
+  // The binaries mapped into the profiled processes, deduplicated across
+  // heap profile dumps.
+  class HeapProfileMappings {
+   public:
+    uint32_t AddMapping(StringId build_id,
+                        int64_t offset,
+                        int64_t start,
+                        int64_t end,
+                        int64_t load_bias,
+                        StringId name_id) {
+      build_ids_.emplace_back(build_id);
+      offsets_.emplace_back(offset);
+      starts_.emplace_back(start);
+      ends_.emplace_back(end);
+      load_biases_.emplace_back(load_bias);
+      name_ids_.emplace_back(name_id);
+      return size() - 1;
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(name_ids_.size()); }
+
+    const ChunkedVector<StringId>& build_ids() const { return build_ids_; }
+    const ChunkedVector<int64_t>& offsets() const { return offsets_; }
+    const ChunkedVector<int64_t>& starts() const { return starts_; }
+    const ChunkedVector<int64_t>& ends() const { return ends_; }
+    const ChunkedVector<int64_t>& load_biases() const { return load_biases_; }
+    const ChunkedVector<StringId>& name_ids() const { return name_ids_; }
+
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&build_ids_);
+      v->Column(&offsets_);
+      v->Column(&starts_);
+      v->Column(&ends_);
+      v->Column(&load_biases_);
+      v->Column(&name_ids_);
+    }
 
    private:
-    std::deque<int64_t> timestamps_;
-    std::deque<UniqueTid> utids_;
-    std::deque<uint8_t> prios_;
-    std::deque<StringId> tag_ids_;
-    std::deque<StringId> msg_ids_;
+    ChunkedVector<StringId> build_ids_;
+    ChunkedVector<int64_t> offsets_;
+    ChunkedVector<int64_t> starts_;
+    ChunkedVector<int64_t> ends_;
+    ChunkedVector<int64_t> load_biases_;
+    ChunkedVector<StringId> name_ids_;
+  };
+
+  // The frames of the heap profile callstacks: a function and the row of its
+  // mapping in HeapProfileMappings.
+  class HeapProfileFrames {
+   public:
+    uint32_t AddFrame(StringId name_id, uint32_t mapping_row, int64_t rel_pc) {
+      name_ids_.emplace_back(name_id);
+      mapping_rows_.emplace_back(mapping_row);
+      rel_pcs_.emplace_back(rel_pc);
+      return size() - 1;
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(name_ids_.size()); }
+
+    const ChunkedVector<StringId>& name_ids() const { return name_ids_; }
+    const ChunkedVector<uint32_t>& mapping_rows() const {
+      return mapping_rows_;
+    }
+    const ChunkedVector<int64_t>& rel_pcs() const { return rel_pcs_; }
+
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&name_ids_);
+      v->Column(&mapping_rows_);
+      v->Column(&rel_pcs_);
+    }
+
+   private:
+    ChunkedVector<StringId> name_ids_;
+    ChunkedVector<uint32_t> mapping_rows_;
+    ChunkedVector<int64_t> rel_pcs_;
+  };
+
+  // The tree of the callstacks of all the heap profiles: each callsite is a
+  // frame called from its parent callsite. A callsite is always added after
+  // its parent, so walking the rows backwards visits children before parents.
+  class HeapProfileCallsites {
+   public:
+    // Parent of the root callsites.
+    static constexpr int64_t kNoParent = -1;
+
+    uint32_t AddCallsite(uint32_t depth,
+                         int64_t parent_id,
+                         uint32_t frame_row) {
+      PERFETTO_DCHECK(parent_id < static_cast<int64_t>(size()));
+      depths_.emplace_back(depth);
+      parent_ids_.emplace_back(parent_id);
+      frame_rows_.emplace_back(frame_row);
+      return size() - 1;
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(depths_.size()); }
+
+    const ChunkedVector<uint32_t>& depths() const { return depths_; }
+    const ChunkedVector<int64_t>& parent_ids() const { return parent_ids_; }
+    const ChunkedVector<uint32_t>& frame_rows() const { return frame_rows_; }
+
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&depths_);
+      v->Column(&parent_ids_);
+      v->Column(&frame_rows_);
+    }
+
+   private:
+    ChunkedVector<uint32_t> depths_;
+    ChunkedVector<int64_t> parent_ids_;
+    ChunkedVector<uint32_t> frame_rows_;
+  };
+
+  // The samples of each heap profile dump. Allocations and frees are separate
+  // rows, the latter with negative count and size, so that summing the rows of
+  // a dump gives the memory not yet freed. The counts of each dump are totals
+  // since the start of the profile, not deltas from the previous dump.
+  class HeapProfileAllocations {
+   public:
+    uint32_t AddAllocation(int64_t timestamp,
+                           UniquePid upid,
+                           uint32_t callsite_id,
+                           int64_t count,
+                           int64_t size) {
+      timestamps_.emplace_back(timestamp);
+      upids_.emplace_back(upid);
+      callsite_ids_.emplace_back(callsite_id);
+      counts_.emplace_back(count);
+      sizes_.emplace_back(size);
+      return this->size() - 1;
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(timestamps_.size()); }
+
+    const ChunkedVector<int64_t>& timestamps() const { return timestamps_; }
+    const ChunkedVector<UniquePid>& upids() const { return upids_; }
+    const ChunkedVector<uint32_t>& callsite_ids() const {
+      return callsite_ids_;
+    }
+    const ChunkedVector<int64_t>& counts() const { return counts_; }
+    const ChunkedVector<int64_t>& sizes() const { return sizes_; }
+
+    template <typename Visitor>
+    void Snapshot(Visitor* v) {
+      v->Column(&timestamps_);
+      v->Column(&upids_);
+      v->Column(&callsite_ids_);
+      v->Column(&counts_);
+      v->Column(&sizes_);
+    }
+
+   private:
+    ChunkedVector<int64_t> timestamps_;
+    ChunkedVector<UniquePid> upids_;
+    ChunkedVector<uint32_t> callsite_ids_;
+    ChunkedVector<int64_t> counts_;
+    ChunkedVector<int64_t> sizes_;
   };
 
   struct Stats {
@@ -544,6 +810,9 @@ class TraceStorage {
 
   void ResetStorage();
 
+  // Replaces all the contents of this storage with the ones of |other|.
+  void ReplaceContents(TraceStorage&& other) { *this = std::move(other); }
+
   UniqueTid AddEmptyThread(uint32_t tid) {
     unique_threads_.emplace_back(tid);
     return static_cast<UniqueTid>(unique_threads_.size() - 1);
@@ -591,9 +860,20 @@ class TraceStorage {
   }
 
   // Reading methods.
-  const std::string& GetString(StringId id) const {
-    PERFETTO_DCHECK(id < string_pool_.size());
-    return string_pool_[id];
+  NullTermStringView GetString(StringId id) const {
+    // The empty string is always mapped to id 0 by InternString(), which the
+    // pool otherwise reserves for the null string.
+    if (id == 0)
+      return NullTermStringView("");
+    return string_pool_.Get(id);
+  }
+
+  // Returns the id of |str| if it was previously interned or nullopt
+  // otherwise.
+  base::Optional<StringId> GetStringId(base::StringView str) const {
+    if (str.empty())
+      return StringId(0);
+    return string_pool_.GetId(str);
   }
 
   const Process& GetProcess(UniquePid upid) const {
@@ -634,6 +914,19 @@ class TraceStorage {
   const CounterValues& counter_values() const { return counter_values_; }
   CounterValues* mutable_counter_values() { return &counter_values_; }
 
+  // Indexed by counter id. Counters without values may have no pyramid.
+  const std::vector<CounterPyramid>& counter_pyramids() const {
+    return counter_pyramids_;
+  }
+
+  // Adds the value at |row| of counter_values() to the pyramid of its
+  // counter. Must be called for the rows of each counter in timestamp order.
+  void AddToCounterPyramid(uint32_t row);
+
+  // Rebuilds the pyramids of all the counters, which are not part of the
+  // snapshots.
+  void RebuildCounterPyramids();
+
   const SqlStats& sql_stats() const { return sql_stats_; }
   SqlStats* mutable_sql_stats() { return &sql_stats_; }
 
@@ -651,7 +944,35 @@ class TraceStorage {
   const RawEvents& raw_events() const { return raw_events_; }
   RawEvents* mutable_raw_events() { return &raw_events_; }
 
-  const std::vector<std::string>& string_pool() const { return string_pool_; }
+  const HeapProfileMappings& heap_profile_mappings() const {
+    return heap_profile_mappings_;
+  }
+  HeapProfileMappings* mutable_heap_profile_mappings() {
+    return &heap_profile_mappings_;
+  }
+
+  const HeapProfileFrames& heap_profile_frames() const {
+    return heap_profile_frames_;
+  }
+  HeapProfileFrames* mutable_heap_profile_frames() {
+    return &heap_profile_frames_;
+  }
+
+  const HeapProfileCallsites& heap_profile_callsites() const {
+    return heap_profile_callsites_;
+  }
+  HeapProfileCallsites* mutable_heap_profile_callsites() {
+    return &heap_profile_callsites_;
+  }
+
+  const HeapProfileAllocations& heap_profile_allocations() const {
+    return heap_profile_allocations_;
+  }
+  HeapProfileAllocations* mutable_heap_profile_allocations() {
+    return &heap_profile_allocations_;
+  }
+
+  const StringPool& string_pool() const { return string_pool_; }
 
   // |unique_processes_| always contains at least 1 element becuase the 0th ID
   // is reserved to indicate an invalid process.
@@ -662,18 +983,58 @@ class TraceStorage {
   size_t thread_count() const { return unique_threads_.size(); }
 
   // Number of interned strings in the pool. Includes the empty string w/ ID=0.
-  size_t string_count() const { return string_pool_.size(); }
+  size_t string_count() const { return string_pool_.size() + 1; }
 
   // Start / end ts (in nanoseconds) across the parsed trace events.
   // Returns (0, 0) if the trace is empty.
   std::pair<int64_t, int64_t> GetTraceTimestampBoundsNs() const;
 
+  // Saves the storage to, or loads it from, a snapshot file depending on the
+  // visitor (see storage_snapshot.h). The SQL stats, which are about the
+  // queries run on this instance, are not part of the snapshot.
+  // kSnapshotVersion in storage_snapshot.cc must be bumped when changing the
+  // order or the types of the fields visited here.
+  template <typename Visitor>
+  void Snapshot(Visitor* v) {
+    for (auto& stats : stats_) {
+      v->Value(&stats.value);
+      v->Map(&stats.indexed_values);
+    }
+    slices_.Snapshot(v);
+    args_.Snapshot(v);
+    string_pool_.Snapshot(v);
+
+    v->Resize(&unique_processes_, Process(0));
+    for (auto& process : unique_processes_) {
+      v->Value(&process.start_ns);
+      v->Value(&process.name_id);
+      v->Value(&process.pid);
+      v->Optional(&process.pupid);
+    }
+    v->Resize(&unique_threads_, Thread(0));
+    for (auto& thread : unique_threads_) {
+      v->Value(&thread.start_ns);
+      v->Value(&thread.name_id);
+      v->Optional(&thread.upid);
+      v->Value(&thread.tid);
+    }
+
+    nestable_slices_.Snapshot(v);
+    counter_definitions_.Snapshot(v);
+    counter_values_.Snapshot(v);
+    instants_.Snapshot(v);
+    raw_events_.Snapshot(v);
+    android_log_.Snapshot(v);
+    heap_profile_mappings_.Snapshot(v);
+    heap_profile_frames_.Snapshot(v);
+    heap_profile_callsites_.Snapshot(v);
+    heap_profile_allocations_.Snapshot(v);
+  }
+
  private:
   static constexpr uint8_t kRowIdTableShift = 32;
 
-  using StringHash = uint64_t;
-
-  TraceStorage& operator=(const TraceStorage&) = default;
+  TraceStorage& operator=(TraceStorage&&) = default;
 
   // Stats about parsing the trace.
   StatsMap stats_{};
@@ -685,10 +1046,7 @@ class TraceStorage {
   Args args_;
 
   // One entry for each unique string in the trace.
-  std::vector<std::string> string_pool_;
-
-  // One entry for each unique string in the trace.
-  std::unordered_map<StringHash, StringId> string_index_;
+  StringPool string_pool_;
 
   // One entry for each UniquePid, with UniquePid as the index.
   // Never hold on to pointers to Process, as vector resize will
@@ -708,6 +1066,9 @@ class TraceStorage {
   // frequency events as well systrace trace_marker counter events.
   CounterValues counter_values_;
 
+  // Multi-resolution aggregates of counter_values_, for each counter.
+  std::vector<CounterPyramid> counter_pyramids_;
+
   SqlStats sql_stats_;
 
   // These are instantaneous events in the trace. They have no duration
@@ -721,6 +1082,12 @@ class TraceStorage {
   // trace.
   RawEvents raw_events_;
   AndroidLogs android_log_;
+
+  // The contents of the heapprofd profiles.
+  HeapProfileMappings heap_profile_mappings_;
+  HeapProfileFrames heap_profile_frames_;
+  HeapProfileCallsites heap_profile_callsites_;
+  HeapProfileAllocations heap_profile_allocations_;
 };
 
 }  // namespace trace_processor
@@ -20,6 +20,7 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/query_result_encoder.h"
 
 #include "perfetto/trace_processor/raw_query.pb.h"
 #include "perfetto/trace_processor/sched.pb.h"
@@ -109,6 +110,21 @@ void trace_processor_rawQuery(RequestID id,
   g_trace_processor->ExecuteQuery(query, callback);
 }
 
+// Same as rawQuery() but takes the SQL query as a UTF-8 string and replies
+// with the result in the binary format of EncodeQueryResult(), which is much
+// faster to produce and to decode than a RawQueryResult for large results.
+void EMSCRIPTEN_KEEPALIVE trace_processor_query(RequestID,
+                                                const uint8_t*,
+                                                int);
+void trace_processor_query(RequestID id, const uint8_t* query_data, int len) {
+  base::StringView sql(reinterpret_cast<const char*>(query_data),
+                       static_cast<size_t>(len));
+  auto it = g_trace_processor->ExecuteQuery(sql);
+  std::string encoded;
+  EncodeQueryResult(&it, &encoded);
+  g_reply(id, true, encoded.data(), static_cast<uint32_t>(encoded.size()));
+}
+
 }  // extern "C"
 
 }  // namespace trace_processor
@@ -28,8 +28,9 @@ using namespace sqlite_utils;
 WindowOperatorTable::WindowOperatorTable(sqlite3*, const TraceStorage*) {}
 
 void WindowOperatorTable::RegisterTable(sqlite3* db,
-                                        const TraceStorage* storage) {
-  Table::Register<WindowOperatorTable>(db, storage, "window", true);
+                                        const TraceStorage* storage,
+                                        const QueryContext* context) {
+  Table::Register<WindowOperatorTable>(db, storage, context, "window", true);
 }
 
 base::Optional<Table::Schema> WindowOperatorTable::Init(int,
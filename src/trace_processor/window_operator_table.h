@@ -39,7 +39,9 @@ class WindowOperatorTable : public Table {
     kQuantumTs = 6
   };
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db,
+                            const TraceStorage* storage,
+                            const QueryContext* context);
 
   WindowOperatorTable(sqlite3*, const TraceStorage*);
 
@@ -14,6 +14,12 @@
  * limitations under the License.
  */
 
+#include <getopt.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <thread>
+
 #include "perfetto/base/unix_task_runner.h"
 #include "perfetto/base/watchdog.h"
 #include "perfetto/traced/traced.h"
@@ -22,8 +28,58 @@
 #include "src/tracing/ipc/default_socket.h"
 
 namespace perfetto {
+namespace {
+
+void PrintUsage(const char* argv0) {
+  PERFETTO_ELOG("Usage: %s [--data-path-threads=N]", argv0);
+}
+
+// Parses the --data-path-threads value, which must be a number between 1 and
+// the number of cores.
+bool ParseDataPathThreads(const char* arg, uint32_t* data_path_threads) {
+  char* end;
+  long value = strtol(arg, &end, 10);
+  if (*arg == '\0' || *end != '\0' || value <= 0)
+    return false;
+  long max_threads =
+      static_cast<long>(std::max(1u, std::thread::hardware_concurrency()));
+  if (value > max_threads) {
+    PERFETTO_ELOG("--data-path-threads can't exceed the %ld cores",
+                  max_threads);
+    return false;
+  }
+  *data_path_threads = static_cast<uint32_t>(value);
+  return true;
+}
+
+}  // namespace
+
+int __attribute__((visibility("default"))) ServiceMain(int argc, char** argv) {
+  // The chunks committed by the producers are copied on the main thread unless
+  // --data-path-threads is set, in which case they are copied on that many
+  // worker threads, keeping the main thread free for IPC and control
+  // operations. This is off by default until it is shown to be a win on
+  // devices.
+  uint32_t data_path_threads = 0;
+  static struct option long_options[] = {
+      {"data-path-threads", required_argument, nullptr, 'j'},
+      {nullptr, 0, nullptr, 0}};
+  int option_index;
+  int c;
+  while ((c = getopt_long(argc, argv, "", long_options, &option_index)) != -1) {
+    switch (c) {
+      case 'j':
+        if (!ParseDataPathThreads(optarg, &data_path_threads)) {
+          PrintUsage(argv[0]);
+          return 1;
+        }
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
 
-int __attribute__((visibility("default"))) ServiceMain(int, char**) {
   base::UnixTaskRunner task_runner;
   std::unique_ptr<ServiceIPCHost> svc;
   svc = ServiceIPCHost::CreateInstance(&task_runner);
@@ -50,6 +106,9 @@ int __attribute__((visibility("default"))) ServiceMain(int, char**) {
     return 1;
   }
 
+  if (data_path_threads)
+    svc->service()->SetDataPathThreads(data_path_threads);
+
   LazyProducer lazy_heapprofd(&task_runner, /*delay_ms=*/30000,
                               "android.heapprofd", "traced.lazy.heapprofd");
   lazy_heapprofd.ConnectInProcess(svc->service());
@@ -106,6 +106,17 @@ TEST(PacketStreamValidatorTest, ComplexPacketWithUid) {
   EXPECT_FALSE(PacketStreamValidator::Validate(seq));
 }
 
+TEST(PacketStreamValidatorTest, CompressedPacketsFromProducer) {
+  protos::TracePacket proto;
+  proto.mutable_compressed_packets()->set_uncompressed_size(1);
+  proto.mutable_compressed_packets()->set_data(std::string("\x10\x00", 2));
+  std::string ser_buf = proto.SerializeAsString();
+
+  Slices seq;
+  seq.emplace_back(&ser_buf[0], ser_buf.size());
+  EXPECT_FALSE(PacketStreamValidator::Validate(seq));
+}
+
 TEST(PacketStreamValidatorTest, FragmentedPacket) {
   protos::TracePacket proto;
   proto.mutable_for_testing()->set_str("string field");
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/tracing/core/sharded_worker_pool.h"
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+
+ShardedWorkerPool::ShardedWorkerPool(size_t num_shards) {
+  PERFETTO_CHECK(num_shards > 0);
+  for (size_t i = 0; i < num_shards; i++) {
+    shards_.emplace_back(new Shard());
+    Shard* shard = shards_.back().get();
+    shard->thread = std::thread(&ShardedWorkerPool::RunShard, shard);
+  }
+}
+
+ShardedWorkerPool::~ShardedWorkerPool() {
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    shard->quit = true;
+    shard->task_posted.notify_one();
+  }
+  for (auto& shard : shards_)
+    shard->thread.join();
+}
+
+void ShardedWorkerPool::PostTask(size_t shard_idx, std::function<void()> task) {
+  PERFETTO_DCHECK(shard_idx < shards_.size());
+  Shard* shard = shards_[shard_idx].get();
+  std::lock_guard<std::mutex> lock(shard->mutex);
+  shard->tasks.emplace_back(std::move(task));
+  shard->task_posted.notify_one();
+}
+
+void ShardedWorkerPool::WaitForIdle() {
+  for (auto& shard : shards_) {
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    shard->idle.wait(lock, [&shard] {
+      return shard->tasks.empty() && !shard->running_task;
+    });
+  }
+}
+
+// static
+void ShardedWorkerPool::RunShard(Shard* shard) {
+  std::unique_lock<std::mutex> lock(shard->mutex);
+  for (;;) {
+    shard->task_posted.wait(
+        lock, [shard] { return shard->quit || !shard->tasks.empty(); });
+    if (shard->tasks.empty())
+      return;  // |quit| is set and all the tasks have run.
+    std::function<void()> task = std::move(shard->tasks.front());
+    shard->tasks.pop_front();
+    shard->running_task = true;
+    lock.unlock();
+    task();
+    lock.lock();
+    shard->running_task = false;
+    if (shard->tasks.empty())
+      shard->idle.notify_all();
+  }
+}
+
+}  // namespace perfetto
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACING_CORE_SHARDED_WORKER_POOL_H_
+#define SRC_TRACING_CORE_SHARDED_WORKER_POOL_H_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace perfetto {
+
+// A fixed set of worker threads (shards), each running the tasks posted to it
+// in order. Used by the TracingServiceImpl to copy the chunks committed by the
+// producers into the trace buffers off its main thread: all the tasks touching
+// a buffer are posted to the same shard, so they don't need any locking.
+// This class is thread-safe, but tasks must not call WaitForIdle().
+class ShardedWorkerPool {
+ public:
+  explicit ShardedWorkerPool(size_t num_shards);
+
+  // Runs the tasks posted so far, then joins the threads.
+  ~ShardedWorkerPool();
+
+  size_t num_shards() const { return shards_.size(); }
+
+  // Runs |task| on the thread of |shard|, after the tasks posted to it before.
+  void PostTask(size_t shard, std::function<void()> task);
+
+  // Blocks until all the tasks posted so far, on any shard, have run.
+  void WaitForIdle();
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    std::condition_variable task_posted;
+    std::condition_variable idle;
+    std::deque<std::function<void()>> tasks;  // Guarded by |mutex|.
+    bool running_task = false;                // Guarded by |mutex|.
+    bool quit = false;                        // Guarded by |mutex|.
+    std::thread thread;
+  };
+
+  ShardedWorkerPool(const ShardedWorkerPool&) = delete;
+  ShardedWorkerPool& operator=(const ShardedWorkerPool&) = delete;
+
+  static void RunShard(Shard*);
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_CORE_SHARDED_WORKER_POOL_H_
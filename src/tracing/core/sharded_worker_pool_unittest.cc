@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/tracing/core/sharded_worker_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace {
+
+TEST(ShardedWorkerPoolTest, TasksRunInOrderOnTheirShard) {
+  static constexpr size_t kNumShards = 4;
+  static constexpr size_t kTasksPerShard = 1000;
+  ShardedWorkerPool pool(kNumShards);
+  std::vector<size_t> ran[kNumShards];
+  std::thread::id thread_ids[kNumShards];
+  bool same_thread[kNumShards] = {};
+  for (size_t i = 0; i < kTasksPerShard; i++) {
+    for (size_t shard = 0; shard < kNumShards; shard++) {
+      pool.PostTask(shard, [i, shard, &ran, &thread_ids, &same_thread] {
+        if (i == 0) {
+          thread_ids[shard] = std::this_thread::get_id();
+          same_thread[shard] = true;
+        } else if (thread_ids[shard] != std::this_thread::get_id()) {
+          same_thread[shard] = false;
+        }
+        ran[shard].push_back(i);
+      });
+    }
+  }
+  pool.WaitForIdle();
+
+  for (size_t shard = 0; shard < kNumShards; shard++) {
+    ASSERT_TRUE(same_thread[shard]);
+    ASSERT_NE(std::this_thread::get_id(), thread_ids[shard]);
+    ASSERT_EQ(kTasksPerShard, ran[shard].size());
+    for (size_t i = 0; i < kTasksPerShard; i++)
+      ASSERT_EQ(i, ran[shard][i]);
+  }
+}
+
+TEST(ShardedWorkerPoolTest, WaitForIdleWaitsForRunningTasks) {
+  ShardedWorkerPool pool(2);
+  std::atomic<bool> started{false};
+  bool done = false;
+  pool.PostTask(1, [&started, &done] {
+    started = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    done = true;
+  });
+  while (!started)
+    std::this_thread::yield();
+  pool.WaitForIdle();
+  ASSERT_TRUE(done);
+}
+
+TEST(ShardedWorkerPoolTest, DestructorRunsPendingTasks) {
+  size_t num_ran = 0;
+  {
+    ShardedWorkerPool pool(1);
+    for (size_t i = 0; i < 100; i++)
+      pool.PostTask(0, [&num_ran] { num_ran++; });
+  }
+  ASSERT_EQ(100u, num_ran);
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "perfetto/base/paged_memory.h"
+#include "perfetto/tracing/core/commit_data_request.h"
+#include "perfetto/tracing/core/shared_memory_abi.h"
+#include "perfetto/tracing/core/trace_writer.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/tracing/core/shared_memory_arbiter_impl.h"
+
+namespace perfetto {
+namespace {
+
+// |state.range(0)| threads, each with its own writer, acquire kChunksPerThread
+// chunks of a 1MB SMB with 4KB pages. As the chunks are freed straight away,
+// without going through the service, this measures the chunk acquisition.
+
+constexpr size_t kSmbSize = 1024 * 1024;
+constexpr size_t kPageSize = 4096;
+constexpr size_t kChunksPerThread = 10000;
+
+class NullProducerEndpoint : public TracingService::ProducerEndpoint {
+ public:
+  void RegisterDataSource(const DataSourceDescriptor&) override {}
+  void UnregisterDataSource(const std::string&) override {}
+  void RegisterTraceWriter(uint32_t, uint32_t) override {}
+  void UnregisterTraceWriter(uint32_t) override {}
+  void CommitData(const CommitDataRequest&, CommitDataCallback) override {}
+  SharedMemory* shared_memory() const override { return nullptr; }
+  size_t shared_buffer_page_size_kb() const override { return 0; }
+  std::unique_ptr<TraceWriter> CreateTraceWriter(BufferID) override {
+    return nullptr;
+  }
+  void NotifyFlushComplete(FlushRequestID) override {}
+  void NotifyDataSourceStarted(DataSourceInstanceID) override {}
+  void NotifyDataSourceStopped(DataSourceInstanceID) override {}
+  void ActivateTriggers(const std::vector<std::string>&) override {}
+};
+
+void AcquireChunks(SharedMemoryArbiterImpl* arbiter, WriterID writer_id) {
+  SharedMemoryABI* abi = arbiter->shmem_abi_for_testing();
+  SharedMemoryABI::ChunkHeader header = {};
+  header.writer_id.store(writer_id, std::memory_order_relaxed);
+  for (size_t i = 0; i < kChunksPerThread; i++) {
+    SharedMemoryABI::Chunk chunk = arbiter->GetNewChunk(header);
+    size_t page_idx;
+    size_t chunk_idx;
+    std::tie(page_idx, chunk_idx) = abi->GetPageAndChunkIndex(chunk);
+
+    // Do what the writer and then the service do with the chunk.
+    abi->ReleaseChunkAsComplete(std::move(chunk));
+    abi->ReleaseChunkAsFree(
+        abi->TryAcquireChunkForReading(page_idx, chunk_idx));
+  }
+}
+
+void BM_SharedMemoryArbiter_GetNewChunk(benchmark::State& state) {
+  const size_t num_threads = static_cast<size_t>(state.range(0));
+  base::PagedMemory smb = base::PagedMemory::Allocate(kSmbSize);
+  NullProducerEndpoint producer_endpoint;
+  base::TestTaskRunner task_runner;
+  SharedMemoryArbiterImpl arbiter(smb.Get(), kSmbSize, kPageSize,
+                                  &producer_endpoint, &task_runner);
+
+  while (state.KeepRunning()) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; i++) {
+      threads.emplace_back(AcquireChunks, &arbiter,
+                           static_cast<WriterID>(i + 1));
+    }
+    for (auto& thread : threads)
+      thread.join();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(
+      state.iterations() * num_threads * kChunksPerThread));
+}
+BENCHMARK(BM_SharedMemoryArbiter_GetNewChunk)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace perfetto
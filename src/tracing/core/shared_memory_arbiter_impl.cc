@@ -25,6 +25,7 @@
 #include "src/tracing/core/null_trace_writer.h"
 #include "src/tracing/core/trace_writer_impl.h"
 
+#include <algorithm>
 #include <limits>
 #include <utility>
 
@@ -32,6 +33,10 @@ namespace perfetto {
 
 using Chunk = SharedMemoryABI::Chunk;
 
+namespace {
+constexpr size_t kBitsPerHintWord = 64;
+}  // namespace
+
 // static
 SharedMemoryABI::PageLayout SharedMemoryArbiterImpl::default_page_layout =
     SharedMemoryABI::PageLayout::kPageDiv1;
@@ -56,8 +61,27 @@ SharedMemoryArbiterImpl::SharedMemoryArbiterImpl(
     : task_runner_(task_runner),
       producer_endpoint_(producer_endpoint),
       shmem_abi_(reinterpret_cast<uint8_t*>(start), size, page_size),
+      free_pages_hint_words_((shmem_abi_.num_pages() + kBitsPerHintWord - 1) /
+                             kBitsPerHintWord),
       active_writer_ids_(kMaxWriterID),
-      weak_ptr_factory_(this) {}
+      weak_ptr_factory_(this) {
+  const size_t num_pages = shmem_abi_.num_pages();
+  free_pages_hint_.reset(new std::atomic<uint64_t>[free_pages_hint_words_]);
+  for (size_t i = 0; i < free_pages_hint_words_; i++) {
+    size_t bits = std::min(kBitsPerHintWord, num_pages - i * kBitsPerHintWord);
+    free_pages_hint_[i].store(
+        bits == kBitsPerHintWord ? ~0ull : (1ull << bits) - 1,
+        std::memory_order_relaxed);
+  }
+
+  // Spread the writers over the SMB, the first one starting from page 0.
+  writer_pages_.reset(new std::atomic<uint32_t>[kMaxWriterID + 1]);
+  for (size_t i = 0; i <= kMaxWriterID; i++) {
+    size_t page_idx = i ? (i - 1) * num_pages / kMaxWriterID : 0;
+    writer_pages_[i].store(static_cast<uint32_t>(page_idx),
+                           std::memory_order_relaxed);
+  }
+}
 
 Chunk SharedMemoryArbiterImpl::GetNewChunk(
     const SharedMemoryABI::ChunkHeader& header,
@@ -68,48 +92,23 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
   static const unsigned kMaxStallIntervalUs = 100000;
   static const int kLogAfterNStalls = 3;
 
-  for (;;) {
-    // TODO(primiano): Probably this lock is not really required and this code
-    // could be rewritten leveraging only the Try* atomic operations in
-    // SharedMemoryABI. But let's not be too adventurous for the moment.
-    {
-      std::lock_guard<std::mutex> scoped_lock(lock_);
-      const size_t initial_page_idx = page_idx_;
-      for (size_t i = 0; i < shmem_abi_.num_pages(); i++) {
-        page_idx_ = (initial_page_idx + i) % shmem_abi_.num_pages();
-        bool is_new_page = false;
+  WriterID writer_id = header.writer_id.load(std::memory_order_relaxed);
+  PERFETTO_DCHECK(writer_id <= kMaxWriterID);
+  std::atomic<uint32_t>* writer_page = &writer_pages_[writer_id];
 
-        // TODO(primiano): make the page layout dynamic.
-        auto layout = SharedMemoryArbiterImpl::default_page_layout;
-
-        if (shmem_abi_.is_page_free(page_idx_)) {
-          // TODO(primiano): Use the |size_hint| here to decide the layout.
-          is_new_page = shmem_abi_.TryPartitionPage(page_idx_, layout);
-        }
-        uint32_t free_chunks;
-        if (is_new_page) {
-          free_chunks = (1 << SharedMemoryABI::kNumChunksForLayout[layout]) - 1;
-        } else {
-          free_chunks = shmem_abi_.GetFreeChunks(page_idx_);
-        }
-
-        for (uint32_t chunk_idx = 0; free_chunks;
-             chunk_idx++, free_chunks >>= 1) {
-          if (!(free_chunks & 1))
-            continue;
-          // We found a free chunk.
-          Chunk chunk = shmem_abi_.TryAcquireChunkForWriting(
-              page_idx_, chunk_idx, &header);
-          if (!chunk.is_valid())
-            continue;
-          if (stall_count > kLogAfterNStalls) {
-            PERFETTO_LOG("Recovered from stall after %d iterations",
-                         stall_count);
-          }
-          return chunk;
-        }
+  for (;;) {
+    size_t page_idx = writer_page->load(std::memory_order_relaxed);
+    Chunk chunk = TryAcquireChunkFromHintedPages(header, &page_idx);
+    if (!chunk.is_valid() && RefreshFreePagesHint())
+      chunk = TryAcquireChunkFromHintedPages(header, &page_idx);
+    if (chunk.is_valid()) {
+      writer_page->store(static_cast<uint32_t>(page_idx),
+                         std::memory_order_relaxed);
+      if (stall_count > kLogAfterNStalls) {
+        PERFETTO_LOG("Recovered from stall after %d iterations", stall_count);
       }
-    }  // std::lock_guard<std::mutex>
+      return chunk;
+    }
 
     // All chunks are taken (either kBeingWritten by us or kBeingRead by the
     // Service). TODO: at this point we should return a bankrupcy chunk, not
@@ -134,6 +133,92 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
   }
 }
 
+Chunk SharedMemoryArbiterImpl::TryAcquireChunkFromHintedPages(
+    const SharedMemoryABI::ChunkHeader& header,
+    size_t* page_idx) {
+  // Visits the pages from |page_idx| to the end of the SMB, then the ones
+  // before it. The word of |page_idx| is visited twice for this reason.
+  const size_t start_word = *page_idx / kBitsPerHintWord;
+  const uint64_t start_bit = 1ull << (*page_idx % kBitsPerHintWord);
+  for (size_t i = 0; i <= free_pages_hint_words_; i++) {
+    const size_t word = (start_word + i) % free_pages_hint_words_;
+    uint64_t hint = free_pages_hint_[word].load(std::memory_order_relaxed);
+    if (i == 0) {
+      hint &= ~(start_bit - 1);
+    } else if (i == free_pages_hint_words_) {
+      hint &= start_bit - 1;
+    }
+    while (hint) {
+      const size_t bit = static_cast<size_t>(__builtin_ctzll(hint));
+      hint &= hint - 1;
+      Chunk chunk =
+          TryAcquireChunkInPage(word * kBitsPerHintWord + bit, header);
+      if (chunk.is_valid()) {
+        *page_idx = word * kBitsPerHintWord + bit;
+        return chunk;
+      }
+    }
+  }
+  return Chunk();
+}
+
+Chunk SharedMemoryArbiterImpl::TryAcquireChunkInPage(
+    size_t page_idx,
+    const SharedMemoryABI::ChunkHeader& header) {
+  bool is_new_page = false;
+
+  // TODO(primiano): make the page layout dynamic.
+  auto layout = SharedMemoryArbiterImpl::default_page_layout;
+
+  if (shmem_abi_.is_page_free(page_idx)) {
+    // TODO(primiano): Use the |size_hint| here to decide the layout.
+    is_new_page = shmem_abi_.TryPartitionPage(page_idx, layout);
+  }
+  uint32_t free_chunks;
+  if (is_new_page) {
+    free_chunks = (1 << SharedMemoryABI::kNumChunksForLayout[layout]) - 1;
+  } else {
+    free_chunks = shmem_abi_.GetFreeChunks(page_idx);
+  }
+
+  for (uint32_t chunk_idx = 0; free_chunks; chunk_idx++, free_chunks >>= 1) {
+    if (!(free_chunks & 1))
+      continue;
+    // We found a free chunk. Another writer can still take it first.
+    Chunk chunk =
+        shmem_abi_.TryAcquireChunkForWriting(page_idx, chunk_idx, &header);
+    if (chunk.is_valid())
+      return chunk;
+  }
+
+  // The page could have been freed in the meantime, in which case the hint
+  // will be set again by the next RefreshFreePagesHint().
+  free_pages_hint_[page_idx / kBitsPerHintWord].fetch_and(
+      ~(1ull << (page_idx % kBitsPerHintWord)), std::memory_order_relaxed);
+  return Chunk();
+}
+
+bool SharedMemoryArbiterImpl::RefreshFreePagesHint() {
+  bool has_free_pages = false;
+  for (size_t word = 0; word < free_pages_hint_words_; word++) {
+    uint64_t hint = 0;
+    size_t end = std::min(shmem_abi_.num_pages(),
+                          (word + 1) * kBitsPerHintWord);
+    for (size_t page_idx = word * kBitsPerHintWord; page_idx < end;
+         page_idx++) {
+      if (shmem_abi_.is_page_free(page_idx) ||
+          shmem_abi_.GetFreeChunks(page_idx)) {
+        hint |= 1ull << (page_idx % kBitsPerHintWord);
+      }
+    }
+    if (hint) {
+      free_pages_hint_[word].fetch_or(hint, std::memory_order_relaxed);
+      has_free_pages = true;
+    }
+  }
+  return has_free_pages;
+}
+
 void SharedMemoryArbiterImpl::ReturnCompletedChunk(Chunk chunk,
                                                    BufferID target_buffer,
                                                    PatchList* patch_list) {
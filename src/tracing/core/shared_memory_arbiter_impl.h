@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -45,9 +46,11 @@ class TaskRunner;
 // This class handles the shared memory buffer on the producer side. It is used
 // to obtain thread-local chunks and to partition pages from several threads.
 // There is one arbiter instance per Producer.
-// This class is thread-safe and uses locks to do so. Data sources are supposed
-// to interact with this sporadically, only when they run out of space on their
-// current thread-local chunk.
+// This class is thread-safe. Chunks are acquired without locks, using only the
+// atomic page and chunk states of the SharedMemoryABI, as many writer threads
+// can run out of space on their current thread-local chunk at the same time.
+// Completed chunks and patches are batched into the next CommitDataRequest
+// under a lock, which data sources are supposed to take sporadically.
 class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
  public:
   // Args:
@@ -120,6 +123,23 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   SharedMemoryArbiterImpl(const SharedMemoryArbiterImpl&) = delete;
   SharedMemoryArbiterImpl& operator=(const SharedMemoryArbiterImpl&) = delete;
 
+  // Tries to acquire a free chunk in the pages hinted as free, starting from
+  // |*page_idx|, which is set to the page of the chunk. Returns an invalid
+  // chunk if there is none.
+  SharedMemoryABI::Chunk TryAcquireChunkFromHintedPages(
+      const SharedMemoryABI::ChunkHeader&,
+      size_t* page_idx);
+
+  // Tries to acquire a free chunk in |page_idx|, partitioning the page if it is
+  // free. Clears the hint of the page if it has no free chunk.
+  SharedMemoryABI::Chunk TryAcquireChunkInPage(
+      size_t page_idx,
+      const SharedMemoryABI::ChunkHeader&);
+
+  // Sets the hint of all the pages which have free chunks. Returns false if
+  // there is no such page.
+  bool RefreshFreePagesHint();
+
   void UpdateCommitDataRequest(SharedMemoryABI::Chunk chunk,
                                WriterID writer_id,
                                BufferID target_buffer,
@@ -130,11 +150,24 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
 
   base::TaskRunner* const task_runner_;
   TracingService::ProducerEndpoint* const producer_endpoint_;
+  SharedMemoryABI shmem_abi_;
+
+  // One bit per page, set if the page may have free chunks. Bits are cleared
+  // when the page is found to be full and are only set again, by looking at the
+  // pages, once none of the hinted pages has a free chunk: the service frees
+  // chunks without telling the producer. Saves looking at the header of every
+  // page, each in its own cache line, when the SMB is mostly in use.
+  std::unique_ptr<std::atomic<uint64_t>[]> free_pages_hint_;
+  const size_t free_pages_hint_words_;
+
+  // The page each writer got its last chunk from, indexed by WriterID. The
+  // next chunk is looked for from there first: as TraceWriters are used by a
+  // single thread, this keeps the threads writing on different pages rather
+  // than all competing for the first free chunk.
+  std::unique_ptr<std::atomic<uint32_t>[]> writer_pages_;
 
   // --- Begin lock-protected members ---
   std::mutex lock_;
-  SharedMemoryABI shmem_abi_;
-  size_t page_idx_ = 0;
   std::unique_ptr<CommitDataRequest> commit_data_req_;
   size_t bytes_pending_commit_ = 0;  // SUM(chunk.size() : commit_data_req_).
   IdAllocator<WriterID> active_writer_ids_;
@@ -16,6 +16,10 @@
 
 #include "src/tracing/core/shared_memory_arbiter_impl.h"
 
+#include <atomic>
+#include <set>
+#include <thread>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "perfetto/base/utils.h"
@@ -133,6 +137,69 @@ TEST_P(SharedMemoryArbiterImplTest, GetAndReturnChunks) {
   task_runner_->RunUntilCheckpoint("on_commit_2");
 }
 
+// Several threads acquire chunks at the same time until the SMB is full. Each
+// chunk must be handed out exactly once.
+TEST_P(SharedMemoryArbiterImplTest, ConcurrentGetNewChunk) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv14);
+  static constexpr size_t kTotChunks = kNumPages * 14;
+  static constexpr size_t kNumThreads = 8;
+  std::atomic<size_t> num_acquired{0};
+  std::vector<std::pair<size_t, size_t>> acquired[kNumThreads];
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([this, t, &num_acquired, &acquired] {
+      SharedMemoryABI::ChunkHeader header = {};
+      header.writer_id.store(static_cast<WriterID>(t + 1));
+      while (num_acquired.fetch_add(1) < kTotChunks) {
+        SharedMemoryABI::Chunk chunk = arbiter_->GetNewChunk(header);
+        ASSERT_TRUE(chunk.is_valid());
+        acquired[t].push_back(
+            arbiter_->shmem_abi_for_testing()->GetPageAndChunkIndex(chunk));
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  std::set<std::pair<size_t, size_t>> chunks;
+  for (const auto& thread_chunks : acquired)
+    chunks.insert(thread_chunks.begin(), thread_chunks.end());
+  ASSERT_EQ(kTotChunks, chunks.size());
+}
+
+// The service frees chunks without notifying the producer. Check that they are
+// reused once all the other chunks are taken.
+TEST_P(SharedMemoryArbiterImplTest, ReuseChunksFreedByService) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv2);
+  static constexpr size_t kTotChunks = kNumPages * 2;
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+  SharedMemoryABI::Chunk chunks[kTotChunks];
+  for (size_t i = 0; i < kTotChunks; i++) {
+    chunks[i] = arbiter_->GetNewChunk({});
+    ASSERT_TRUE(chunks[i].is_valid());
+  }
+
+  // Do what the service does after the chunks are committed.
+  for (size_t i : {size_t{5}, size_t{20}}) {
+    size_t page_idx;
+    size_t chunk_idx;
+    std::tie(page_idx, chunk_idx) = abi->GetPageAndChunkIndex(chunks[i]);
+    abi->ReleaseChunkAsComplete(std::move(chunks[i]));
+    abi->ReleaseChunkAsFree(
+        abi->TryAcquireChunkForReading(page_idx, chunk_idx));
+  }
+
+  std::set<std::pair<size_t, size_t>> reused;
+  for (size_t i = 0; i < 2; i++) {
+    SharedMemoryABI::Chunk chunk = arbiter_->GetNewChunk({});
+    ASSERT_TRUE(chunk.is_valid());
+    reused.insert(abi->GetPageAndChunkIndex(chunk));
+  }
+  ASSERT_EQ(reused, (std::set<std::pair<size_t, size_t>>{{2, 1}, {10, 0}}));
+}
+
 // Check that we can actually create up to kMaxWriterID TraceWriter(s).
 TEST_P(SharedMemoryArbiterImplTest, WriterIDsAllocation) {
   auto checkpoint = task_runner_->CreateCheckpoint("last_unregistered");
@@ -16,7 +16,9 @@
 
 #include "src/tracing/core/trace_buffer.h"
 
+#include <algorithm>
 #include <limits>
+#include <tuple>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_utils.h"
@@ -77,7 +79,10 @@ TraceBuffer::TraceBuffer(OverwritePolicy pol) : overwrite_policy_(pol) {
                 "ChunkRecord out of sync with the layout of SharedMemoryABI");
 }
 
-TraceBuffer::~TraceBuffer() = default;
+TraceBuffer::~TraceBuffer() {
+  if (max_pin_ && unpin_callback_)
+    unpin_callback_(max_pin_, begin(), end());
+}
 
 bool TraceBuffer::Initialize(size_t size) {
   static_assert(
@@ -95,8 +100,7 @@ bool TraceBuffer::Initialize(size_t size) {
   max_chunk_size_ = std::min(size, ChunkRecord::kMaxSize);
   wptr_ = begin();
   index_.clear();
-  last_chunk_id_written_.clear();
-  read_iter_ = GetReadIterForSequence(index_.end());
+  read_iter_ = GetReadIterForSequence(0);
   return true;
 }
 
@@ -151,9 +155,8 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // before receiving commit requests for them from the producer. Note that the
   // service may scrape and thus override chunks in arbitrary order since the
   // chunks aren't ordered in the SMB.
-  const auto it = index_.find(key);
-  if (PERFETTO_UNLIKELY(it != index_.end())) {
-    ChunkMeta* record_meta = &it->second;
+  ChunkMeta* record_meta = FindChunkMeta(key);
+  if (PERFETTO_UNLIKELY(record_meta)) {
     ChunkRecord* prev = record_meta->chunk_record;
 
     // Verify that the old chunk's metadata corresponds to the new one.
@@ -178,9 +181,8 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
     static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                   "ChunkID wraps");
     subsequent_key.chunk_id++;
-    const auto subsequent_it = index_.find(subsequent_key);
-    if (subsequent_it != index_.end() &&
-        subsequent_it->second.num_fragments_read > 0) {
+    const ChunkMeta* subsequent_meta = FindChunkMeta(subsequent_key);
+    if (subsequent_meta && subsequent_meta->num_fragments_read > 0) {
       stats_.set_abi_violations(stats_.abi_violations() + 1);
       PERFETTO_DCHECK(suppress_sanity_dchecks_for_testing_);
       return;
@@ -213,6 +215,7 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
     record_meta->num_fragments = num_fragments;
     record_meta->flags = chunk_flags;
     record_meta->set_complete(chunk_complete);
+    Unpin(record_meta);
 
     // Override the ChunkRecord contents at the original |wptr|.
     TRACE_BUFFER_DLOG("  copying @ [%lu - %lu] %zu", wptr - begin(),
@@ -268,10 +271,25 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // Now first insert the new chunk. At the end, if necessary, add the padding.
   stats_.set_chunks_written(stats_.chunks_written() + 1);
   stats_.set_bytes_written(stats_.bytes_written() + record_size);
-  auto it_and_inserted = index_.emplace(
-      key, ChunkMeta(GetChunkRecordAt(wptr_), num_fragments, chunk_complete,
-                     chunk_flags, producer_uid_trusted));
-  PERFETTO_DCHECK(it_and_inserted.second);
+  // Chunks are usually copied in ChunkID order, so are appended to their
+  // sequence.
+  Sequence* sequence = FindSequence(producer_id_trusted, writer_id, true);
+  std::deque<ChunkMeta>& chunks = sequence->chunks;
+
+  // Sequences are removed from the index with their last chunk, so the
+  // ChunkIDs written before are lost: start again from this one.
+  if (chunks.empty())
+    sequence->last_chunk_id_written = chunk_id;
+  auto insert_pos = chunks.end();
+  if (PERFETTO_UNLIKELY(!chunks.empty() && chunks.back().chunk_id > chunk_id)) {
+    insert_pos = std::lower_bound(
+        chunks.begin(), chunks.end(), chunk_id,
+        [](const ChunkMeta& meta, ChunkID id) { return meta.chunk_id < id; });
+  }
+  PERFETTO_DCHECK(insert_pos == chunks.end() ||
+                  insert_pos->chunk_id != chunk_id);
+  chunks.emplace(insert_pos, GetChunkRecordAt(wptr_), chunk_id, num_fragments,
+                 chunk_complete, chunk_flags, producer_uid_trusted);
   TRACE_BUFFER_DLOG("  copying @ [%lu - %lu] %zu", wptr_ - begin(),
                     uintptr_t(wptr_ - begin()) + record_size, record_size);
   WriteChunkRecord(wptr_, record, src, size);
@@ -296,8 +314,7 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // last_chunk_id shouldn't be updated even though it's larger (e.g. |chunk_id|
   // = kMaxChunkId and |last_chunk_id| = 1; chunk_id - last_chunk_id =
   // kMaxChunkId - 1).
-  auto producer_and_writer_id = std::make_pair(producer_id_trusted, writer_id);
-  ChunkID& last_chunk_id = last_chunk_id_written_[producer_and_writer_id];
+  ChunkID& last_chunk_id = sequence->last_chunk_id_written;
   static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                 "This code assumes that ChunkID wraps at kMaxChunkID");
   if (chunk_id - last_chunk_id < kMaxChunkID / 2) {
@@ -322,7 +339,7 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
   TRACE_BUFFER_DLOG("Delete [%zu %zu]", wptr_ - begin(), search_end - begin());
   DcheckIsAlignedAndWithinBounds(wptr_);
   PERFETTO_DCHECK(search_end <= end());
-  std::vector<ChunkMap::iterator> index_delete;
+  chunks_to_delete_.clear();
   uint64_t chunks_overwritten = stats_.chunks_overwritten();
   uint64_t bytes_overwritten = stats_.bytes_overwritten();
   uint64_t padding_bytes_cleared = stats_.padding_bytes_cleared();
@@ -348,17 +365,17 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
     // records are not part of the index).
     if (PERFETTO_LIKELY(!next_chunk.is_padding)) {
       ChunkMeta::Key key(next_chunk);
-      auto it = index_.find(key);
+      ChunkMeta* meta = FindChunkMeta(key);
       bool will_remove = false;
-      if (PERFETTO_LIKELY(it != index_.end())) {
-        const ChunkMeta& meta = it->second;
-        if (PERFETTO_UNLIKELY(meta.num_fragments_read < meta.num_fragments)) {
+      if (PERFETTO_LIKELY(meta)) {
+        if (PERFETTO_UNLIKELY(meta->num_fragments_read < meta->num_fragments)) {
           if (overwrite_policy_ == kDiscard)
             return -1;
           chunks_overwritten++;
           bytes_overwritten += next_chunk.size;
         }
-        index_delete.push_back(it);
+        Unpin(meta);
+        chunks_to_delete_.push_back(key);
         will_remove = true;
       }
       TRACE_BUFFER_DLOG("  del index {%" PRIu32 ",%" PRIu32
@@ -380,9 +397,19 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
     PERFETTO_CHECK(next_chunk_ptr <= end());
   }
 
-  // Remove from the index.
-  for (auto it : index_delete) {
-    index_.erase(it);
+  // Remove from the index. The oldest chunks of each sequence are usually the
+  // ones overwritten, so they are removed from the front of the sequence. The
+  // sequences left without chunks are removed too, so that the index doesn't
+  // grow with each writer ever seen.
+  for (const ChunkMeta::Key& key : chunks_to_delete_) {
+    Sequence* sequence = FindSequence(key.producer_id, key.writer_id, false);
+    PERFETTO_DCHECK(sequence);
+    size_t pos = FindChunk(*sequence, key.chunk_id);
+    PERFETTO_DCHECK(pos < sequence->chunks.size());
+    sequence->chunks.erase(sequence->chunks.begin() +
+                           static_cast<std::ptrdiff_t>(pos));
+    if (sequence->chunks.empty())
+      index_.erase(index_.begin() + (sequence - index_.data()));
   }
   stats_.set_chunks_overwritten(chunks_overwritten);
   stats_.set_bytes_overwritten(bytes_overwritten);
@@ -410,12 +437,12 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
                                         size_t patches_size,
                                         bool other_patches_pending) {
   ChunkMeta::Key key(producer_id, writer_id, chunk_id);
-  auto it = index_.find(key);
-  if (it == index_.end()) {
+  ChunkMeta* meta = FindChunkMeta(key);
+  if (!meta) {
     stats_.set_patches_failed(stats_.patches_failed() + 1);
     return false;
   }
-  ChunkMeta& chunk_meta = it->second;
+  ChunkMeta& chunk_meta = *meta;
 
   // Check that the index is consistent with the actual ProducerID/WriterID
   // stored in the ChunkRecord.
@@ -428,6 +455,9 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
   static_assert(Patch::kSize == SharedMemoryABI::kPacketHeaderSize,
                 "Patch::kSize out of sync with SharedMemoryABI");
 
+  // The patches are untrusted and could target the fragments read already.
+  Unpin(&chunk_meta);
+
   for (size_t i = 0; i < patches_size; i++) {
     uint8_t* ptr =
         chunk_begin + sizeof(ChunkRecord) + patches[i].offset_untrusted;
@@ -467,78 +497,107 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
 }
 
 void TraceBuffer::BeginRead() {
-  read_iter_ = GetReadIterForSequence(index_.begin());
+  read_iter_ = GetReadIterForSequence(0);
 #if PERFETTO_DCHECK_IS_ON()
   changed_since_last_read_ = false;
 #endif
 }
 
+TraceBuffer::Sequence* TraceBuffer::FindSequence(ProducerID producer_id,
+                                                 WriterID writer_id,
+                                                 bool create) {
+  auto it = std::lower_bound(
+      index_.begin(), index_.end(), std::make_pair(producer_id, writer_id),
+      [](const Sequence& seq, const std::pair<ProducerID, WriterID>& key) {
+        return std::tie(seq.producer_id, seq.writer_id) <
+               std::tie(key.first, key.second);
+      });
+  if (it != index_.end() && it->producer_id == producer_id &&
+      it->writer_id == writer_id) {
+    return &*it;
+  }
+  if (!create)
+    return nullptr;
+  return &*index_.emplace(it, producer_id, writer_id);
+}
+
+size_t TraceBuffer::FindChunk(const Sequence& sequence,
+                              ChunkID chunk_id) const {
+  const std::deque<ChunkMeta>& chunks = sequence.chunks;
+  if (chunks.empty())
+    return 0;
+
+  // The ChunkIDs of a sequence are usually contiguous, in which case the
+  // position of a chunk is its distance from the first one.
+  ChunkID offset = chunk_id - chunks.front().chunk_id;
+  if (offset < chunks.size() && chunks[offset].chunk_id == chunk_id)
+    return offset;
+
+  auto it = std::lower_bound(
+      chunks.begin(), chunks.end(), chunk_id,
+      [](const ChunkMeta& meta, ChunkID id) { return meta.chunk_id < id; });
+  if (it == chunks.end() || it->chunk_id != chunk_id)
+    return chunks.size();
+  return static_cast<size_t>(it - chunks.begin());
+}
+
+TraceBuffer::ChunkMeta* TraceBuffer::FindChunkMeta(const ChunkMeta::Key& key) {
+  Sequence* sequence = FindSequence(key.producer_id, key.writer_id, false);
+  if (!sequence)
+    return nullptr;
+  size_t pos = FindChunk(*sequence, key.chunk_id);
+  if (pos == sequence->chunks.size())
+    return nullptr;
+  return &sequence->chunks[pos];
+}
+
 TraceBuffer::SequenceIterator TraceBuffer::GetReadIterForSequence(
-    ChunkMap::iterator seq_begin) {
+    size_t sequence_index) {
   SequenceIterator iter;
-  iter.seq_begin = seq_begin;
-  if (seq_begin == index_.end()) {
-    iter.cur = iter.seq_end = index_.end();
+  iter.sequence_index = sequence_index;
+  if (sequence_index >= index_.size())
     return iter;
-  }
 
-#if PERFETTO_DCHECK_IS_ON()
-  // Either |seq_begin| is == index_.begin() or the item immediately before must
-  // belong to a different {ProducerID, WriterID} sequence.
-  if (seq_begin != index_.begin() && seq_begin != index_.end()) {
-    auto prev_it = seq_begin;
-    prev_it--;
-    PERFETTO_DCHECK(
-        seq_begin == index_.begin() ||
-        std::tie(prev_it->first.producer_id, prev_it->first.writer_id) <
-            std::tie(seq_begin->first.producer_id, seq_begin->first.writer_id));
-  }
-#endif
-
-  // Find the first entry that has a greater {ProducerID, WriterID} (or just
-  // index_.end() if we reached the end).
-  ChunkMeta::Key key = seq_begin->first;  // Deliberate copy.
-  key.chunk_id = kMaxChunkID;
-  iter.seq_end = index_.upper_bound(key);
-  PERFETTO_DCHECK(iter.seq_begin != iter.seq_end);
-
-  // Now find the first entry between [seq_begin, seq_end) that is
-  // > last_chunk_id_written_. This is where we the sequence will start (see
-  // notes about wrapping of IDs in the header).
-  auto producer_and_writer_id = std::make_pair(key.producer_id, key.writer_id);
-  PERFETTO_DCHECK(last_chunk_id_written_.count(producer_and_writer_id));
-  iter.wrapping_id = last_chunk_id_written_[producer_and_writer_id];
-  key.chunk_id = iter.wrapping_id;
-  iter.cur = index_.upper_bound(key);
-  if (iter.cur == iter.seq_end)
-    iter.cur = iter.seq_begin;
+  Sequence* sequence = &index_[sequence_index];
+  iter.sequence = sequence;
+  iter.end = sequence->chunks.size();
+
+  // Now find the first chunk that is > last_chunk_id_written. This is where
+  // the sequence will start (see notes about wrapping of IDs in the header).
+  iter.wrapping_id = sequence->last_chunk_id_written;
+  auto it = std::upper_bound(
+      sequence->chunks.begin(), sequence->chunks.end(), iter.wrapping_id,
+      [](ChunkID id, const ChunkMeta& meta) { return id < meta.chunk_id; });
+  iter.cur = static_cast<size_t>(it - sequence->chunks.begin());
+  if (iter.cur == iter.end)
+    iter.cur = 0;
   return iter;
 }
 
 void TraceBuffer::SequenceIterator::MoveNext() {
   // Stop iterating when we reach the end of the sequence.
-  // Note: |seq_begin| might be == |seq_end|.
-  if (cur == seq_end || cur->first.chunk_id == wrapping_id) {
-    cur = seq_end;
+  // Note: the sequence might be empty.
+  if (cur == end || sequence->chunks[cur].chunk_id == wrapping_id) {
+    cur = end;
     return;
   }
 
   // If the current chunk wasn't completed yet, we shouldn't advance past it as
   // it may be rewritten with additional packets.
-  if (!cur->second.is_complete()) {
-    cur = seq_end;
+  if (!sequence->chunks[cur].is_complete()) {
+    cur = end;
     return;
   }
 
-  ChunkID last_chunk_id = cur->first.chunk_id;
-  if (++cur == seq_end)
-    cur = seq_begin;
+  ChunkID last_chunk_id = sequence->chunks[cur].chunk_id;
+  if (++cur == end)
+    cur = 0;
 
   // There may be a missing chunk in the sequence of chunks, in which case the
   // next chunk's ID won't follow the last one's. If so, skip the rest of the
   // sequence. We'll return to it later once the hole is filled.
-  if (last_chunk_id + 1 != cur->first.chunk_id)
-    cur = seq_end;
+  if (last_chunk_id + 1 != sequence->chunks[cur].chunk_id)
+    cur = end;
 }
 
 bool TraceBuffer::ReadNextTracePacket(
@@ -568,17 +627,19 @@ bool TraceBuffer::ReadNextTracePacket(
   for (;; read_iter_.MoveNext()) {
     if (PERFETTO_UNLIKELY(!read_iter_.is_valid())) {
       // We ran out of chunks in the current {ProducerID, WriterID} sequence or
-      // we just reached the index_.end().
+      // we just reached the end of the index.
 
-      if (PERFETTO_UNLIKELY(read_iter_.seq_end == index_.end()))
+      if (PERFETTO_UNLIKELY(read_iter_.sequence_index + 1 >= index_.size()))
         return false;
 
       // We reached the end of sequence, move to the next one.
-      // Note: ++read_iter_.seq_end might become index_.end(), but
-      // GetReadIterForSequence() knows how to deal with that.
-      read_iter_ = GetReadIterForSequence(read_iter_.seq_end);
-      PERFETTO_DCHECK(read_iter_.is_valid() && read_iter_.cur != index_.end());
+      read_iter_ = GetReadIterForSequence(read_iter_.sequence_index + 1);
       previous_packet_dropped = true;
+
+      // All the chunks of the sequence might have been overwritten. MoveNext()
+      // is a no-op on the empty sequence.
+      if (!read_iter_.is_valid())
+        continue;
     }
 
     ChunkMeta* chunk_meta = &*read_iter_;
@@ -703,7 +764,7 @@ bool TraceBuffer::ReadNextTracePacket(
 
         // TODO(primiano): optimization: this MoveToEnd() is the reason why
         // MoveNext() (that is called in the outer for(;;MoveNext)) needs to
-        // deal gracefully with the case of |cur|==|seq_end|. Maybe we can do
+        // deal gracefully with the case of |cur|==|end|. Maybe we can do
         // something to avoid that check by reshuffling the code here?
         read_iter_.MoveToEnd();
 
@@ -871,8 +932,13 @@ TraceBuffer::ReadPacketResult TraceBuffer::ReadNextPacketInChunk(
   if (PERFETTO_UNLIKELY(packet_size == 0))
     return ReadPacketResult::kFailedEmptyPacket;
 
-  if (PERFETTO_LIKELY(packet))
+  if (PERFETTO_LIKELY(packet)) {
     packet->AddSlice(packet_data, static_cast<size_t>(packet_size));
+    if (read_pin_) {
+      chunk_meta->pin = read_pin_;
+      max_pin_ = std::max(max_pin_, read_pin_);
+    }
+  }
 
   return ReadPacketResult::kSucceeded;
 }
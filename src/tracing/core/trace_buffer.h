@@ -21,9 +21,11 @@
 #include <string.h>
 
 #include <array>
+#include <deque>
+#include <functional>
 #include <limits>
-#include <map>
 #include <tuple>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/base/paged_memory.h"
@@ -109,7 +111,12 @@ class TracePacket;
 //
 // However, in order to keep some operations (patching and reading) fast, a
 // lookaside index is maintained (in |index_|), keeping each chunk in the buffer
-// indexed by their {ProducerID, WriterID, ChunkID} tuple.
+// indexed by their {ProducerID, WriterID, ChunkID} tuple. The index is flat:
+// a sorted vector of sequences, each holding the metadata of its chunks sorted
+// by ChunkID in a contiguous run. As each writer mostly copies its chunks in
+// ChunkID order and they are overwritten in the same order, chunks are
+// appended to and removed from the ends of the runs, and are found in O(1) in
+// the common case of contiguous ChunkIDs.
 //
 // Patching data out-of-band
 // -------------------------
@@ -152,6 +159,10 @@ class TraceBuffer {
     std::array<uint8_t, kSize> data;
   };
 
+  // See set_unpin_callback().
+  using UnpinCallback = std::function<
+      void(uint64_t pin, const uint8_t* begin, const uint8_t* end)>;
+
   // Identifiers that are constant for a packet sequence.
   struct PacketSequenceProperties {
     ProducerID producer_id_trusted;
@@ -249,6 +260,23 @@ class TraceBuffer {
                            PacketSequenceProperties* sequence_properties,
                            bool* previous_packet_on_sequence_dropped);
 
+  // The slices of the packets returned by ReadNextTracePacket() point into the
+  // buffer and are normally valid only until the buffer is modified. If |pin|
+  // is not 0, the chunks read by the following ReadNextTracePacket() calls are
+  // pinned instead: before a pinned chunk is overwritten, patched or freed, the
+  // unpin callback is called with its memory range and the highest pin it was
+  // read with. This allows to hand the packets to another thread without
+  // copying them, as long as the callback stops that thread from accessing the
+  // range before returning.
+  void set_read_pin(uint64_t pin) { read_pin_ = pin; }
+
+  // The callback is invoked on the thread calling CopyChunkUntrusted(),
+  // TryPatchChunkContents() or the destructor. Without a callback the pins are
+  // ignored.
+  void set_unpin_callback(UnpinCallback callback) {
+    unpin_callback_ = std::move(callback);
+  }
+
   const TraceStats::BufferStats& stats() const { return stats_; }
   size_t size() const { return size_; }
 
@@ -323,7 +351,7 @@ class TraceBuffer {
   // This struct should not have any field that is essential for reconstructing
   // the contents of the buffer from a crash dump.
   struct ChunkMeta {
-    // Key used for sorting in the map.
+    // The ID of a chunk in the index.
     struct Key {
       Key(ProducerID p, WriterID w, ChunkID c)
           : producer_id{p}, writer_id{w}, chunk_id{c} {}
@@ -367,8 +395,17 @@ class TraceBuffer {
       kLastReadPacketSkipped = 1 << 1
     };
 
-    ChunkMeta(ChunkRecord* r, uint16_t p, bool complete, uint8_t f, uid_t u)
-        : chunk_record{r}, trusted_uid{u}, flags{f}, num_fragments{p} {
+    ChunkMeta(ChunkRecord* r,
+              ChunkID c,
+              uint16_t p,
+              bool complete,
+              uint8_t f,
+              uid_t u)
+        : chunk_record{r},
+          trusted_uid{u},
+          chunk_id{c},
+          flags{f},
+          num_fragments{p} {
       if (complete)
         index_flags = kComplete;
     }
@@ -395,8 +432,13 @@ class TraceBuffer {
       }
     }
 
-    ChunkRecord* const chunk_record;  // Addr of ChunkRecord within |data_|.
-    const uid_t trusted_uid;          // uid of the producer.
+    // Not const so that the index can move the entries of a sequence around.
+    ChunkRecord* chunk_record;  // Addr of ChunkRecord within |data_|.
+    uid_t trusted_uid;          // uid of the producer.
+
+    // Corresponds to |chunk_record->chunk_id|. The ProducerID and WriterID are
+    // the ones of the Sequence holding the entry.
+    ChunkID chunk_id;
 
     // Flags set by TraceBuffer to track the state of the chunk in the index.
     uint8_t index_flags = 0;
@@ -415,64 +457,86 @@ class TraceBuffer {
     // payload (the 1st fragment starts at |chunk_record| +
     // sizeof(ChunkRecord)).
     uint16_t cur_fragment_offset = 0;
+
+    // The highest pin the chunk was read with, 0 if it isn't pinned. See
+    // set_read_pin().
+    uint64_t pin = 0;
   };
 
-  using ChunkMap = std::map<ChunkMeta::Key, ChunkMeta>;
+  // The chunks of a {ProducerID, WriterID} sequence, sorted by ChunkID (not
+  // taking into account the wrapping of ChunkID, see SequenceIterator).
+  struct Sequence {
+    Sequence(ProducerID p, WriterID w) : producer_id{p}, writer_id{w} {}
+
+    ProducerID producer_id;
+    WriterID writer_id;
+
+    // The highest ChunkID written for the sequence, taking into account a
+    // potential overflow of ChunkIDs. In the case of overflow, stores the
+    // highest ChunkID written since the overflow.
+    ChunkID last_chunk_id_written = 0;
+
+    // A deque rather than a vector as chunks are removed from the front when
+    // overwritten.
+    std::deque<ChunkMeta> chunks;
+  };
 
-  // Allows to iterate over a sub-sequence of |index_| for all keys belonging to
-  // the same {ProducerID,WriterID}. Furthermore takes into account the wrapping
-  // of ChunkID. Instances are valid only as long as the |index_| is not altered
-  // (can be used safely only between adjacent ReadNextTracePacket() calls).
+  // Allows to iterate over the chunks of a Sequence of |index_|, taking into
+  // account the wrapping of ChunkID. Instances are valid only as long as the
+  // |index_| is not altered (can be used safely only between adjacent
+  // ReadNextTracePacket() calls).
   // The order of the iteration will proceed in the following order:
-  // |wrapping_id| + 1 -> |seq_end|, |seq_begin| -> |wrapping_id|.
+  // |wrapping_id| + 1 -> last chunk, first chunk -> |wrapping_id|.
   // Practical example:
   // - Assume that kMaxChunkID == 7
   // - Assume that we have all 8 chunks in the range (0..7).
-  // - Hence, |seq_begin| == c0, |seq_end| == c7
+  // - Hence, the first chunk is c0 and the last one c7.
   // - Assume |wrapping_id| = 4 (c4 is the last chunk copied over
   //   through a CopyChunkUntrusted()).
   // The resulting iteration order will be: c5, c6, c7, c0, c1, c2, c3, c4.
   struct SequenceIterator {
-    // Points to the 1st key (the one with the numerically min ChunkID).
-    ChunkMap::iterator seq_begin;
+    // The position of the sequence in |index_|. Can be == index_.size() (in
+    // which case |sequence| is nullptr) if the index is empty.
+    size_t sequence_index = 0;
+    Sequence* sequence = nullptr;
 
-    // Points one past the last key (the one with the numerically max ChunkID).
-    ChunkMap::iterator seq_end;
+    // Current position in |sequence->chunks|, always <= |end|.
+    size_t cur = 0;
 
-    // Current iterator, always >= seq_begin && <= seq_end.
-    ChunkMap::iterator cur;
+    // Number of chunks in the sequence.
+    size_t end = 0;
 
     // The latest ChunkID written. Determines the start/end of the sequence.
-    ChunkID wrapping_id;
+    ChunkID wrapping_id = 0;
 
-    bool is_valid() const { return cur != seq_end; }
+    bool is_valid() const { return cur != end; }
 
     ProducerID producer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.producer_id;
+      return sequence->producer_id;
     }
 
     WriterID writer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.writer_id;
+      return sequence->writer_id;
     }
 
     ChunkID chunk_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.chunk_id;
+      return sequence->chunks[cur].chunk_id;
     }
 
     ChunkMeta& operator*() {
       PERFETTO_DCHECK(is_valid());
-      return cur->second;
+      return sequence->chunks[cur];
     }
 
-    // Moves |cur| to the next chunk in the index.
+    // Moves |cur| to the next chunk in the sequence.
     // is_valid() will become false after calling this, if this was the last
     // entry of the sequence.
     void MoveNext();
 
-    void MoveToEnd() { cur = seq_end; }
+    void MoveToEnd() { cur = end; }
   };
 
   enum class ReadAheadResult {
@@ -493,14 +557,22 @@ class TraceBuffer {
 
   bool Initialize(size_t size);
 
-  // Returns an object that allows to iterate over chunks in the |index_| that
-  // have the same {ProducerID, WriterID} of
-  // |seq_begin.first.{producer,writer}_id|. |seq_begin| must be an iterator to
-  // the first entry in the |index_| that has a different {ProducerID, WriterID}
-  // from the previous one. It is valid for |seq_begin| to be == index_.end()
-  // (i.e. if the index is empty). The iteration takes care of ChunkID wrapping,
-  // by using |last_chunk_id_|.
-  SequenceIterator GetReadIterForSequence(ChunkMap::iterator seq_begin);
+  // Returns an object that allows to iterate over the chunks of the sequence
+  // at |sequence_index| in |index_|. It is valid for |sequence_index| to be
+  // == index_.size() (i.e. if the index is empty). The iteration takes care of
+  // ChunkID wrapping, by using |Sequence::last_chunk_id_written|.
+  SequenceIterator GetReadIterForSequence(size_t sequence_index);
+
+  // Returns the sequence {ProducerID, WriterID} in |index_|, inserting it if
+  // |create| is true, or nullptr if it doesn't exist.
+  Sequence* FindSequence(ProducerID, WriterID, bool create);
+
+  // Returns the position of the chunk |chunk_id| in |sequence->chunks|, or
+  // |sequence->chunks.size()| if it isn't in the sequence.
+  size_t FindChunk(const Sequence& sequence, ChunkID chunk_id) const;
+
+  // Returns the entry of the chunk |key| in the index, or nullptr.
+  ChunkMeta* FindChunkMeta(const ChunkMeta::Key& key);
 
   // Used as a last resort when a buffer corruption is detected.
   void ClearContentsAndResetRWCursors();
@@ -561,6 +633,19 @@ class TraceBuffer {
 
   void DiscardWrite();
 
+  // Calls the unpin callback if |chunk_meta| is pinned.
+  void Unpin(ChunkMeta* chunk_meta) {
+    if (PERFETTO_LIKELY(!chunk_meta->pin))
+      return;
+    if (unpin_callback_) {
+      const uint8_t* chunk_begin =
+          reinterpret_cast<const uint8_t*>(chunk_meta->chunk_record);
+      unpin_callback_(chunk_meta->pin, chunk_begin,
+                      chunk_begin + chunk_meta->chunk_record->size);
+    }
+    chunk_meta->pin = 0;
+  }
+
   // |src| can be nullptr (in which case |size| must be ==
   // record.size - sizeof(ChunkRecord)), for the case of writing a padding
   // record. |wptr_| is NOT advanced by this function, the caller must do that.
@@ -604,8 +689,19 @@ class TraceBuffer {
   uint8_t* wptr_ = nullptr;    // Write pointer.
 
   // An index that keeps track of the positions and metadata of each
-  // ChunkRecord.
-  ChunkMap index_;
+  // ChunkRecord, sorted by {ProducerID, WriterID}. Only holds the sequences
+  // with at least one chunk in the buffer.
+  std::vector<Sequence> index_;
+
+  // The chunks being removed from the index by DeleteNextChunksFor(), kept
+  // across calls to avoid reallocating it for each chunk copied.
+  std::vector<ChunkMeta::Key> chunks_to_delete_;
+
+  // See set_read_pin() and set_unpin_callback(). |max_pin_| is the highest pin
+  // any chunk has been read with.
+  uint64_t read_pin_ = 0;
+  uint64_t max_pin_ = 0;
+  UnpinCallback unpin_callback_;
 
   // Read iterator used for ReadNext(). It is reset by calling BeginRead().
   // It becomes invalid after any call to methods that alters the |index_|.
@@ -618,15 +714,6 @@ class TraceBuffer {
   // a write fails because it would overwrite unread chunks.
   bool discard_writes_ = false;
 
-  // Keeps track of the highest ChunkID written for a given sequence, taking
-  // into account a potential overflow of ChunkIDs. In the case of overflow,
-  // stores the highest ChunkID written since the overflow.
-  //
-  // TODO(primiano): should clean up keys from this map. Right now it grows
-  // without bounds (although realistically is not a problem unless we have too
-  // many producers/writers within the same trace session).
-  std::map<std::pair<ProducerID, WriterID>, ChunkID> last_chunk_id_written_;
-
   // Statistics about buffer usage.
   TraceStats::BufferStats stats_;
 
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "perfetto/protozero/proto_utils.h"
+#include "perfetto/tracing/core/trace_packet.h"
+#include "src/tracing/core/trace_buffer.h"
+
+namespace perfetto {
+namespace {
+
+// Copies, patches and reads back 4KB chunks, each holding kPacketsPerChunk
+// packets, written round robin by |state.range(0)| writers of one producer
+// into a 64MB buffer (i.e. 16K chunks). The copies and patches are measured
+// once the buffer has wrapped, so that each copy also evicts the oldest chunk
+// from the index.
+
+constexpr size_t kBufferSize = 64 * 1024 * 1024;
+constexpr size_t kPacketsPerChunk = 16;
+constexpr size_t kPacketSize = 250;
+constexpr size_t kChunkPayloadSize = kPacketsPerChunk * kPacketSize;
+
+class ChunkWriter {
+ public:
+  explicit ChunkWriter(uint16_t num_writers)
+      : buffer_(TraceBuffer::Create(kBufferSize)),
+        next_chunk_ids_(num_writers),
+        payload_(kChunkPayloadSize) {
+    // Each packet is a redundant varint size followed by zeroes.
+    using protozero::proto_utils::kMessageLengthFieldSize;
+    for (size_t i = 0; i < kPacketsPerChunk; i++) {
+      protozero::proto_utils::WriteRedundantVarInt(
+          kPacketSize - kMessageLengthFieldSize, &payload_[i * kPacketSize]);
+    }
+  }
+
+  // Copies the next chunk of the next writer, returning its id.
+  ChunkID CopyNextChunk() {
+    WriterID writer_id = next_writer_id_;
+    next_writer_id_ = (next_writer_id_ + 1) % next_chunk_ids_.size();
+    ChunkID chunk_id = next_chunk_ids_[writer_id]++;
+    buffer_->CopyChunkUntrusted(1 /* producer_id */, 0 /* uid */,
+                                writer_id + 1, chunk_id, kPacketsPerChunk,
+                                0 /* flags */, true /* complete */,
+                                payload_.data(), payload_.size());
+    return chunk_id;
+  }
+
+  // Copies as many chunks as fit in the buffer.
+  void Fill() {
+    for (size_t i = 0; i < kBufferSize / (kChunkPayloadSize + 16); i++)
+      CopyNextChunk();
+  }
+
+  uint16_t num_writers() const {
+    return static_cast<uint16_t>(next_chunk_ids_.size());
+  }
+
+  const std::vector<ChunkID>& next_chunk_ids() const {
+    return next_chunk_ids_;
+  }
+
+  TraceBuffer* buffer() { return buffer_.get(); }
+
+ private:
+  std::unique_ptr<TraceBuffer> buffer_;
+  uint16_t next_writer_id_ = 0;
+  std::vector<ChunkID> next_chunk_ids_;
+  std::vector<uint8_t> payload_;
+};
+
+void BM_TraceBufferCopyChunk(benchmark::State& state) {
+  ChunkWriter writer(static_cast<uint16_t>(state.range(0)));
+  writer.Fill();
+  writer.Fill();
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(writer.CopyNextChunk());
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(kChunkPayloadSize));
+}
+BENCHMARK(BM_TraceBufferCopyChunk)->Arg(1)->Arg(64)->Arg(1024);
+
+void BM_TraceBufferPatchChunk(benchmark::State& state) {
+  ChunkWriter writer(static_cast<uint16_t>(state.range(0)));
+  writer.Fill();
+
+  // Patches one of the last 1000 chunks of a random writer with zeroes, which
+  // leaves the chunk valid for the next patches.
+  std::minstd_rand0 rnd(0);
+  TraceBuffer::Patch patch{};
+  patch.offset_untrusted = protozero::proto_utils::kMessageLengthFieldSize;
+  while (state.KeepRunning()) {
+    auto writer_id = static_cast<WriterID>(rnd() % writer.num_writers());
+    ChunkID next_chunk_id = writer.next_chunk_ids()[writer_id];
+    ChunkID age = static_cast<ChunkID>(rnd() % std::min(1000u, next_chunk_id));
+    ChunkID chunk_id = next_chunk_id - 1 - age;
+    benchmark::DoNotOptimize(writer.buffer()->TryPatchChunkContents(
+        1, writer_id + 1, chunk_id, &patch, 1, false));
+  }
+}
+BENCHMARK(BM_TraceBufferPatchChunk)->Arg(1)->Arg(64)->Arg(1024);
+
+void BM_TraceBufferRead(benchmark::State& state) {
+  ChunkWriter writer(static_cast<uint16_t>(state.range(0)));
+  int64_t num_packets = 0;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    writer.Fill();
+    state.ResumeTiming();
+
+    writer.buffer()->BeginRead();
+    TracePacket packet;
+    TraceBuffer::PacketSequenceProperties sequence_properties;
+    bool previous_packet_dropped;
+    while (writer.buffer()->ReadNextTracePacket(
+        &packet, &sequence_properties, &previous_packet_dropped)) {
+      num_packets++;
+      packet = TracePacket();
+    }
+  }
+  state.SetItemsProcessed(num_packets);
+}
+BENCHMARK(BM_TraceBufferRead)
+    ->Arg(1)
+    ->Arg(64)
+    ->Arg(1024)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace perfetto
@@ -19,6 +19,7 @@
 #include <initializer_list>
 #include <random>
 #include <sstream>
+#include <tuple>
 #include <vector>
 
 #include "perfetto/protozero/proto_utils.h"
@@ -120,9 +121,19 @@ class TraceBufferTest : public testing::Test {
   }
 
   SequenceIterator GetReadIterForSequence(ProducerID p, WriterID w) {
-    TraceBuffer::ChunkMeta::Key key(p, w, 0);
-    return trace_buffer_->GetReadIterForSequence(
-        trace_buffer_->index_.lower_bound(key));
+    const auto& index = trace_buffer_->index_;
+    size_t i = 0;
+    while (i < index.size() &&
+           std::tie(index[i].producer_id, index[i].writer_id) <
+               std::tie(p, w)) {
+      i++;
+    }
+    // A sequence without chunks isn't in the index: iterate over nothing.
+    if (i < index.size() &&
+        (index[i].producer_id != p || index[i].writer_id != w)) {
+      i = index.size();
+    }
+    return trace_buffer_->GetReadIterForSequence(i);
   }
 
   void SuppressSanityDchecksForTesting() {
@@ -131,14 +142,18 @@ class TraceBufferTest : public testing::Test {
 
   std::vector<ChunkMetaKey> GetIndex() {
     std::vector<ChunkMetaKey> keys;
-    keys.reserve(trace_buffer_->index_.size());
-    for (const auto& it : trace_buffer_->index_)
-      keys.push_back(it.first);
+    for (const auto& sequence : trace_buffer_->index_) {
+      for (const auto& meta : sequence.chunks) {
+        keys.emplace_back(sequence.producer_id, sequence.writer_id,
+                          meta.chunk_id);
+      }
+    }
     return keys;
   }
 
   TraceBuffer* trace_buffer() { return trace_buffer_.get(); }
   size_t size_to_end() { return trace_buffer_->size_to_end(); }
+  size_t num_sequences() { return trace_buffer_->index_.size(); }
 
  private:
   std::unique_ptr<TraceBuffer> trace_buffer_;
@@ -427,6 +442,43 @@ TEST_F(TraceBufferTest, ReadWrite_PaddingAtEndUpdatesIndex) {
   ASSERT_THAT(ReadPacket(), IsEmpty());
 }
 
+// Tests that reading skips over the sequences whose chunks have all been
+// overwritten. The chunks of the writer 2 are the oldest in the buffer:
+// Initial condition: [ w2c0: 1024 ][ w2c1: 1024 ][ w1c0: 1024 ][ w3c0: 1024 ]
+// Final situation:   [ w1c1: 2048              ][ w1c0: 1024 ][ w3c0: 1024 ]
+TEST_F(TraceBufferTest, ReadWrite_OverwrittenSequence) {
+  ResetBuffer(4096);
+  ASSERT_EQ(1024u, CreateChunk(ProducerID(1), WriterID(2), ChunkID(0))
+                       .AddPacket(1024 - 16, 'a')
+                       .CopyIntoTraceBuffer());
+  ASSERT_EQ(1024u, CreateChunk(ProducerID(1), WriterID(2), ChunkID(1))
+                       .AddPacket(1024 - 16, 'b')
+                       .CopyIntoTraceBuffer());
+  ASSERT_EQ(1024u, CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+                       .AddPacket(1024 - 16, 'c')
+                       .CopyIntoTraceBuffer());
+  ASSERT_EQ(1024u, CreateChunk(ProducerID(1), WriterID(3), ChunkID(0))
+                       .AddPacket(1024 - 16, 'd')
+                       .CopyIntoTraceBuffer());
+  ASSERT_THAT(GetIndex(),
+              ElementsAre(ChunkMetaKey(1, 1, 0), ChunkMetaKey(1, 2, 0),
+                          ChunkMetaKey(1, 2, 1), ChunkMetaKey(1, 3, 0)));
+
+  ASSERT_EQ(2048u, CreateChunk(ProducerID(1), WriterID(1), ChunkID(1))
+                       .AddPacket(2048 - 16, 'e')
+                       .CopyIntoTraceBuffer());
+  ASSERT_THAT(GetIndex(),
+              ElementsAre(ChunkMetaKey(1, 1, 0), ChunkMetaKey(1, 1, 1),
+                          ChunkMetaKey(1, 3, 0)));
+  ASSERT_TRUE(IteratorSeqEq(ProducerID(1), WriterID(2), {}));
+
+  trace_buffer()->BeginRead();
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(1024 - 16, 'c')));
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(2048 - 16, 'e')));
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(1024 - 16, 'd')));
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+}
+
 // Similar to ReadWrite_PaddingAtEndUpdatesIndex but makes it so that the
 // various chunks don't perfectly align when wrapping.
 TEST_F(TraceBufferTest, ReadWrite_PaddingAtEndUpdatesIndexMisaligned) {
@@ -1332,6 +1384,31 @@ TEST_F(TraceBufferTest, Iterator_ManyStreamsWrapping) {
   ASSERT_TRUE(IteratorSeqEq(ProducerID(3), WriterID(1), {Neg(-1), 0, 1}));
 }
 
+// The sequences whose chunks were all overwritten are removed from the index.
+TEST_F(TraceBufferTest, Iterator_OverwrittenSequencesAreRemoved) {
+  ResetBuffer(4096);
+  for (WriterID w = 1; w <= 100; w++) {
+    CreateChunk(ProducerID(1), w, ChunkID(0))
+        .AddPacket(1024 - 16, static_cast<char>(w))
+        .CopyIntoTraceBuffer();
+  }
+  ASSERT_EQ(num_sequences(), 4u);
+  trace_buffer()->BeginRead();
+  for (WriterID w = 97; w <= 100; w++) {
+    ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(
+                                  1024 - 16, static_cast<char>(w))));
+  }
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+
+  // A removed sequence is added back by its next chunk.
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(1))
+      .AddPacket(1024 - 16, 'x')
+      .CopyIntoTraceBuffer();
+  ASSERT_EQ(num_sequences(), 4u);
+  ASSERT_TRUE(IteratorSeqEq(ProducerID(1), WriterID(1), {1}));
+  ASSERT_EQ(trace_buffer()->stats().chunks_committed_out_of_order(), 0u);
+}
+
 // -------------------
 // Re-writing same chunk id
 // -------------------
@@ -1797,6 +1874,67 @@ TEST_F(TraceBufferTest, MissingPacketsOnSequence) {
   ASSERT_TRUE(previous_packet_dropped);
 }
 
+TEST_F(TraceBufferTest, PinnedChunks) {
+  ResetBuffer(4096);
+  std::vector<std::pair<uint64_t, size_t>> unpinned;
+  trace_buffer()->set_unpin_callback(
+      [&unpinned](uint64_t pin, const uint8_t* begin, const uint8_t* end) {
+        unpinned.emplace_back(pin, static_cast<size_t>(end - begin));
+      });
+
+  // Re-committing a chunk read with a pin unpins it first.
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket(20, 'a')
+      .AddPacket(30, 'b')
+      .PadTo(512)
+      .CopyIntoTraceBuffer(/*chunk_complete=*/false);
+  trace_buffer()->BeginRead();
+  trace_buffer()->set_read_pin(1);
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(20, 'a')));
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket(20, 'a')
+      .AddPacket(30, 'b')
+      .PadTo(512)
+      .CopyIntoTraceBuffer();
+  ASSERT_THAT(unpinned, ElementsAre(std::make_pair(1u, 512u)));
+
+  // Chunks read without a pin are not pinned.
+  trace_buffer()->BeginRead();
+  trace_buffer()->set_read_pin(0);
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(30, 'b')));
+
+  for (ChunkID chunk_id = 1; chunk_id < 8; chunk_id++) {
+    CreateChunk(ProducerID(1), WriterID(1), chunk_id)
+        .AddPacket(40, static_cast<char>('c' + chunk_id))
+        .PadTo(512)
+        .CopyIntoTraceBuffer();
+  }
+  trace_buffer()->BeginRead();
+  trace_buffer()->set_read_pin(2);
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(40, 'd')));
+  trace_buffer()->set_read_pin(3);
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(40, 'e')));
+
+  // Overwriting the unpinned chunk 0 and then the pinned chunk 1.
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(8))
+      .AddPacket(40, 'x')
+      .PadTo(512)
+      .CopyIntoTraceBuffer();
+  ASSERT_EQ(1u, unpinned.size());
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(9))
+      .AddPacket(40, 'y')
+      .PadTo(512)
+      .CopyIntoTraceBuffer();
+  ASSERT_THAT(unpinned, ElementsAre(std::make_pair(1u, 512u),
+                                    std::make_pair(2u, 512u)));
+
+  // Destroying the buffer unpins all of it, with the highest pin.
+  ResetBuffer(4096);
+  ASSERT_THAT(unpinned, ElementsAre(std::make_pair(1u, 512u),
+                                    std::make_pair(2u, 512u),
+                                    std::make_pair(3u, 4096u)));
+}
+
 // TODO(primiano): test stats().
 // TODO(primiano): test multiple streams interleaved.
 // TODO(primiano): more testing on packet merging.
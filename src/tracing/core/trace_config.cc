@@ -58,7 +58,8 @@ bool TraceConfig::operator==(const TraceConfig& other) const {
          (flush_timeout_ms_ == other.flush_timeout_ms_) &&
          (disable_clock_snapshotting_ == other.disable_clock_snapshotting_) &&
          (notify_traceur_ == other.notify_traceur_) &&
-         (trigger_config_ == other.trigger_config_);
+         (trigger_config_ == other.trigger_config_) &&
+         (compression_type_ == other.compression_type_);
 }
 #pragma GCC diagnostic pop
 
@@ -144,6 +145,11 @@ void TraceConfig::FromProto(const perfetto::protos::TraceConfig& proto) {
       static_cast<decltype(notify_traceur_)>(proto.notify_traceur());
 
   trigger_config_.FromProto(proto.trigger_config());
+
+  static_assert(sizeof(compression_type_) == sizeof(proto.compression_type()),
+                "size mismatch");
+  compression_type_ =
+      static_cast<decltype(compression_type_)>(proto.compression_type());
   unknown_fields_ = proto.unknown_fields();
 }
 
@@ -233,6 +239,12 @@ void TraceConfig::ToProto(perfetto::protos::TraceConfig* proto) const {
       static_cast<decltype(proto->notify_traceur())>(notify_traceur_));
 
   trigger_config_.ToProto(proto->mutable_trigger_config());
+
+  static_assert(
+      sizeof(compression_type_) == sizeof(proto->compression_type()),
+      "size mismatch");
+  proto->set_compression_type(
+      static_cast<decltype(proto->compression_type())>(compression_type_));
   *(proto->mutable_unknown_fields()) = unknown_fields_;
 }
 
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/tracing/core/trace_file_writer.h"
+
+#include <tuple>
+
+#include "perfetto/base/file_utils.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/base/task_runner.h"
+#include "perfetto/base/utils.h"
+
+namespace perfetto {
+
+namespace {
+
+// Upper bound for the packets copied into the staging buffer and written with a
+// single write(). A packet larger than this is written on its own.
+constexpr size_t kMaxBytesPerWrite = 256 * 1024;
+
+size_t GetSizeWithPreamble(TracePacket* packet) {
+  return std::get<1>(packet->GetProtoPreamble()) + packet->size();
+}
+
+}  // namespace
+
+constexpr size_t TraceFileWriter::kDefaultMaxPendingBytes;
+
+TraceFileWriter::TraceFileWriter(base::ScopedFile fd,
+                                 base::TaskRunner* task_runner,
+                                 size_t max_pending_bytes)
+    : fd_(std::move(fd)),
+      task_runner_(task_runner),
+      max_pending_bytes_(max_pending_bytes),
+      thread_(&TraceFileWriter::RunWriterThread, this) {
+  PERFETTO_DCHECK(fd_);
+}
+
+TraceFileWriter::~TraceFileWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+    on_not_full_ = nullptr;
+    batch_appended_.notify_one();
+  }
+  thread_.join();
+  base::FlushFile(*fd_);
+}
+
+void TraceFileWriter::Append(std::vector<TracePacket> packets) {
+  // Even an empty batch is queued, so that its pin is marked as written.
+  const uint64_t pin = next_pin_++;
+  size_t size = 0;
+  for (TracePacket& packet : packets)
+    size += GetSizeWithPreamble(&packet);
+  pending_bytes_.fetch_add(size, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  batches_.emplace_back();
+  batches_.back().pin = pin;
+  batches_.back().packets = std::move(packets);
+  batch_appended_.notify_one();
+}
+
+void TraceFileWriter::Unpin(uint64_t pin,
+                            const uint8_t* begin,
+                            const uint8_t* end) {
+  // Fast path: all the packets that could point into the range are staged.
+  if (pin <= staged_pin_.load(std::memory_order_acquire))
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Batch& batch : batches_) {
+    if (batch.pin > pin)
+      break;
+    size_t first = &batch == &batches_.front() ? staged_end_ : 0;
+    for (size_t i = first; i < batch.packets.size(); i++)
+      batch.packets[i].CopySlicesInRange(begin, end);
+  }
+}
+
+void TraceFileWriter::NotifyWhenNotFull(std::function<void()> callback) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_bytes() < max_pending_bytes_ / 2) {
+    task_runner_->PostTask(std::move(callback));
+    return;
+  }
+  on_not_full_ = std::move(callback);
+}
+
+void TraceFileWriter::RunWriterThread() {
+  std::vector<char> staging;
+  for (;;) {
+    // Copy the next packets to write into |staging|, while holding the lock so
+    // that Unpin() can't race with the copy. Past this point the packets are
+    // not accessed anymore and the write below doesn't block Unpin().
+    staging.clear();
+    size_t size = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      batch_appended_.wait(lock, [this] { return quit_ || !batches_.empty(); });
+      if (batches_.empty())
+        return;  // |quit_| is set and all the batches have been written.
+      Batch& batch = batches_.front();
+      size_t i = staged_end_;
+      for (; i < batch.packets.size(); i++) {
+        TracePacket& packet = batch.packets[i];
+        char* preamble;
+        size_t preamble_size;
+        std::tie(preamble, preamble_size) = packet.GetProtoPreamble();
+        size_t packet_size = preamble_size + packet.size();
+        if (size > 0 && size + packet_size > kMaxBytesPerWrite)
+          break;
+        staging.insert(staging.end(), preamble, preamble + preamble_size);
+        for (const Slice& slice : packet.slices()) {
+          const char* start = static_cast<const char*>(slice.start);
+          staging.insert(staging.end(), start, start + slice.size);
+        }
+        size += packet_size;
+      }
+      staged_end_ = i;
+      if (staged_end_ == batch.packets.size()) {
+        staged_pin_.store(batch.pin, std::memory_order_release);
+        batches_.pop_front();
+        staged_end_ = 0;
+      }
+    }
+
+    if (!has_failed() && size > 0 &&
+        base::WriteAll(*fd_, staging.data(), size) !=
+            static_cast<ssize_t>(size)) {
+      PERFETTO_PLOG("Failed to write the trace into the file");
+      failed_.store(true, std::memory_order_relaxed);
+    }
+
+    size_t pending =
+        pending_bytes_.fetch_sub(size, std::memory_order_relaxed) - size;
+    std::function<void()> callback;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!on_not_full_ || pending >= max_pending_bytes_ / 2)
+        continue;
+      callback = std::move(on_not_full_);
+      on_not_full_ = nullptr;
+    }
+    task_runner_->PostTask(std::move(callback));
+  }
+}
+
+}  // namespace perfetto
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACING_CORE_TRACE_FILE_WRITER_H_
+#define SRC_TRACING_CORE_TRACE_FILE_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "perfetto/base/scoped_file.h"
+#include "perfetto/tracing/core/trace_packet.h"
+
+namespace perfetto {
+
+namespace base {
+class TaskRunner;
+}  // namespace base
+
+// Writes the trace into the file passed with |write_into_file| on a dedicated
+// thread, so that the service's task runner doesn't block on the file I/O when
+// draining large buffers.
+// The packets appended are handed to the writer thread without copying their
+// payload. Their slices can point into a TraceBuffer, which keeps the chunks
+// read with next_pin() pinned and calls Unpin() before reusing their memory.
+// The writer thread copies the packets into its own staging buffer right before
+// writing them, so Unpin() never waits for the file I/O.
+// The bytes appended but not written yet (the pending bytes) are bounded by the
+// caller, which stops appending when is_full() and resumes from the callback
+// passed to NotifyWhenNotFull().
+// All the methods but Unpin() must be called on the thread of |task_runner|.
+class TraceFileWriter {
+ public:
+  static constexpr size_t kDefaultMaxPendingBytes = 8 * 1024 * 1024;
+
+  TraceFileWriter(base::ScopedFile,
+                  base::TaskRunner*,
+                  size_t max_pending_bytes = kDefaultMaxPendingBytes);
+
+  // Writes all the packets appended, flushes and closes the file.
+  ~TraceFileWriter();
+
+  // The pin the buffers should be read with (see TraceBuffer::set_read_pin())
+  // for the packets passed to the next Append() call.
+  uint64_t next_pin() const { return next_pin_; }
+
+  // Queues |packets| for writing at the end of the file, each one prepended
+  // with its proto preamble.
+  void Append(std::vector<TracePacket> packets);
+
+  // Stops the packets appended with a pin <= |pin| from accessing the memory
+  // in [|begin|, |end|) by copying their slices pointing into it. The packets
+  // already copied into the staging buffer of the writer thread are skipped, so
+  // this never waits for a write to complete. Can be called on any thread.
+  void Unpin(uint64_t pin, const uint8_t* begin, const uint8_t* end);
+
+  size_t pending_bytes() const {
+    return pending_bytes_.load(std::memory_order_relaxed);
+  }
+
+  // Returns how many bytes can be appended before is_full().
+  size_t free_bytes() const {
+    size_t pending = pending_bytes();
+    return pending < max_pending_bytes_ ? max_pending_bytes_ - pending : 0;
+  }
+
+  bool is_full() const { return free_bytes() == 0; }
+
+  // Posts |callback| on the task runner once the pending bytes drop below half
+  // of |max_pending_bytes|. Replaces the callback of any previous call.
+  void NotifyWhenNotFull(std::function<void()> callback);
+
+  // Returns true if writing into the file failed. The packets appended after
+  // the failure are dropped.
+  bool has_failed() const { return failed_.load(std::memory_order_relaxed); }
+
+ private:
+  // The packets passed to an Append() call.
+  struct Batch {
+    uint64_t pin = 0;
+    std::vector<TracePacket> packets;
+  };
+
+  TraceFileWriter(const TraceFileWriter&) = delete;
+  TraceFileWriter& operator=(const TraceFileWriter&) = delete;
+
+  void RunWriterThread();
+
+  base::ScopedFile fd_;
+  base::TaskRunner* const task_runner_;
+  const size_t max_pending_bytes_;
+
+  uint64_t next_pin_ = 1;  // Only accessed on the task runner.
+
+  // The pin of the last batch copied into the staging buffer. The batches are
+  // copied in order.
+  std::atomic<uint64_t> staged_pin_{0};
+
+  std::atomic<size_t> pending_bytes_{0};
+  std::atomic<bool> failed_{false};
+
+  std::mutex mutex_;
+  std::condition_variable batch_appended_;
+  std::deque<Batch> batches_;  // Guarded by |mutex_|.
+
+  // The packets of |batches_.front()| before |staged_end_| have been copied
+  // into the staging buffer of the writer thread.
+  size_t staged_end_ = 0;  // Guarded by |mutex_|.
+
+  std::function<void()> on_not_full_;  // Guarded by |mutex_|.
+  bool quit_ = false;                  // Guarded by |mutex_|.
+
+  std::thread thread_;  // Keep last, it accesses all the members above.
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_CORE_TRACE_FILE_WRITER_H_
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/tracing/core/trace_file_writer.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "perfetto/base/file_utils.h"
+#include "perfetto/base/pipe.h"
+#include "perfetto/base/temp_file.h"
+#include "perfetto/base/utils.h"
+#include "perfetto/tracing/core/trace_packet.h"
+#include "src/base/test/test_task_runner.h"
+
+namespace perfetto {
+namespace {
+
+std::string GetPattern(size_t size, char seed) {
+  std::string data(size, 0);
+  for (size_t i = 0; i < size; i++)
+    data[i] = static_cast<char>(seed + i % 251);
+  return data;
+}
+
+// Returns a packet with a slice pointing into |data| and a slice owning a copy
+// of |suffix|, and appends its preamble and payload to |expected|.
+TracePacket CreatePacket(const std::string& data,
+                         const std::string& suffix,
+                         std::string* expected) {
+  TracePacket packet;
+  packet.AddSlice(data.data(), data.size());
+  Slice slice = Slice::Allocate(suffix.size());
+  memcpy(slice.own_data(), suffix.data(), suffix.size());
+  packet.AddSlice(std::move(slice));
+  char* preamble;
+  size_t preamble_size;
+  std::tie(preamble, preamble_size) = packet.GetProtoPreamble();
+  expected->append(preamble, preamble_size);
+  expected->append(data);
+  expected->append(suffix);
+  return packet;
+}
+
+TEST(TraceFileWriterTest, Append) {
+  base::TestTaskRunner task_runner;
+  base::TempFile tmp_file = base::TempFile::Create();
+  std::vector<std::string> data;
+  for (size_t i = 0; i < 3000; i++)
+    data.push_back(GetPattern(i % 300 + 1, 'a'));
+  std::string large_data = GetPattern(1024 * 1024 + 123, 'b');
+  std::string expected;
+  {
+    TraceFileWriter writer(base::ScopedFile(dup(tmp_file.fd())), &task_runner);
+
+    // Many small packets split across several writes, a packet larger than a
+    // write and an empty batch.
+    std::vector<TracePacket> packets;
+    for (const std::string& d : data)
+      packets.emplace_back(CreatePacket(d, "s", &expected));
+    writer.Append(std::move(packets));
+
+    packets.clear();
+    packets.emplace_back(CreatePacket(large_data, "t", &expected));
+    writer.Append(std::move(packets));
+    writer.Append(std::vector<TracePacket>());
+    EXPECT_FALSE(writer.has_failed());
+  }
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path(), &contents));
+  EXPECT_EQ(expected, contents);
+}
+
+TEST(TraceFileWriterTest, Unpin) {
+  base::TestTaskRunner task_runner;
+  base::TempFile tmp_file = base::TempFile::Create();
+  std::string buffer = GetPattern(64 * 1024, 'a');
+  std::string expected;
+  {
+    TraceFileWriter writer(base::ScopedFile(dup(tmp_file.fd())), &task_runner);
+    std::vector<TracePacket> packets;
+    for (size_t i = 0; i < buffer.size(); i += 1024) {
+      TracePacket packet;
+      packet.AddSlice(&buffer[i], 1024);
+      char* preamble;
+      size_t preamble_size;
+      std::tie(preamble, preamble_size) = packet.GetProtoPreamble();
+      expected.append(preamble, preamble_size);
+      expected.append(buffer, i, 1024);
+      packets.emplace_back(std::move(packet));
+    }
+    const uint64_t pin = writer.next_pin();
+    writer.Append(std::move(packets));
+
+    // Once unpinned, the memory can be reused while the packets are pending.
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(&buffer[0]);
+    writer.Unpin(pin, begin, begin + buffer.size());
+    memset(&buffer[0], 0, buffer.size());
+  }
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path(), &contents));
+  EXPECT_EQ(expected, contents);
+}
+
+TEST(TraceFileWriterTest, UnpinDoesntWaitForStalledWrite) {
+  base::TestTaskRunner task_runner;
+  base::Pipe pipe = base::Pipe::Create();
+  // Larger than a single write, which is larger than what the pipe can hold.
+  std::string buffer = GetPattern(1024 * 1024, 'a');
+  std::string expected;
+  std::string contents;
+  std::thread reader;
+  {
+    TraceFileWriter writer(std::move(pipe.wr), &task_runner);
+    std::vector<TracePacket> packets;
+    for (size_t i = 0; i < buffer.size(); i += 1024) {
+      TracePacket packet;
+      packet.AddSlice(&buffer[i], 1024);
+      char* preamble;
+      size_t preamble_size;
+      std::tie(preamble, preamble_size) = packet.GetProtoPreamble();
+      expected.append(preamble, preamble_size);
+      expected.append(buffer, i, 1024);
+      packets.emplace_back(std::move(packet));
+    }
+    const uint64_t pin = writer.next_pin();
+    writer.Append(std::move(packets));
+
+    // Nothing reads from the pipe yet, so once the writer thread has started
+    // writing into it, the write stalls when the pipe is full.
+    int available = 0;
+    while (available == 0) {
+      ASSERT_EQ(0, ioctl(*pipe.rd, FIONREAD, &available));
+      usleep(1000);
+    }
+
+    // Unpin() must return without waiting for the stalled write, and the
+    // memory can be reused straight away.
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(&buffer[0]);
+    writer.Unpin(pin, begin, begin + buffer.size());
+    memset(&buffer[0], 0, buffer.size());
+
+    reader = std::thread([&pipe, &contents] {
+      char buf[4096];
+      for (;;) {
+        ssize_t rsize = PERFETTO_EINTR(read(*pipe.rd, buf, sizeof(buf)));
+        if (rsize <= 0)
+          break;
+        contents.append(buf, static_cast<size_t>(rsize));
+      }
+    });
+  }
+  reader.join();
+  EXPECT_EQ(expected, contents);
+}
+
+TEST(TraceFileWriterTest, NotifyWhenNotFull) {
+  static constexpr size_t kMaxPendingBytes = 2 * 1024 * 1024;
+  base::TestTaskRunner task_runner;
+  base::TempFile tmp_file = base::TempFile::Create();
+  TraceFileWriter writer(base::ScopedFile(dup(tmp_file.fd())), &task_runner,
+                         kMaxPendingBytes);
+  EXPECT_EQ(kMaxPendingBytes, writer.free_bytes());
+
+  std::string data = GetPattern(kMaxPendingBytes, 'a');
+  std::string expected;
+  std::vector<TracePacket> packets;
+  packets.emplace_back(CreatePacket(data, "s", &expected));
+  writer.Append(std::move(packets));
+
+  auto not_full = task_runner.CreateCheckpoint("not_full");
+  writer.NotifyWhenNotFull(not_full);
+  task_runner.RunUntilCheckpoint("not_full");
+  EXPECT_LT(writer.pending_bytes(), kMaxPendingBytes / 2);
+  EXPECT_FALSE(writer.is_full());
+
+  // When the writer isn't full the callback is posted straight away.
+  auto not_full_again = task_runner.CreateCheckpoint("not_full_again");
+  writer.NotifyWhenNotFull(not_full_again);
+  task_runner.RunUntilCheckpoint("not_full_again");
+}
+
+TEST(TraceFileWriterTest, WriteFailure) {
+  static constexpr size_t kMaxPendingBytes = 1024 * 1024;
+  base::TestTaskRunner task_runner;
+  base::TempFile tmp_file = base::TempFile::Create();
+  TraceFileWriter writer(base::OpenFile(tmp_file.path(), O_RDONLY),
+                         &task_runner, kMaxPendingBytes);
+
+  std::string data = GetPattern(kMaxPendingBytes, 'a');
+  std::string expected;
+  std::vector<TracePacket> packets;
+  packets.emplace_back(CreatePacket(data, "s", &expected));
+  writer.Append(std::move(packets));
+
+  auto not_full = task_runner.CreateCheckpoint("not_full");
+  writer.NotifyWhenNotFull(not_full);
+  task_runner.RunUntilCheckpoint("not_full");
+  EXPECT_TRUE(writer.has_failed());
+}
+
+}  // namespace
+}  // namespace perfetto
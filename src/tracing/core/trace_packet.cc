@@ -16,6 +16,8 @@
 
 #include "perfetto/tracing/core/trace_packet.h"
 
+#include <string.h>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "src/tracing/core/sliced_protobuf_input_stream.h"
@@ -47,6 +49,16 @@ void TracePacket::AddSlice(const void* start, size_t size) {
   slices_.emplace_back(start, size);
 }
 
+void TracePacket::CopySlicesInRange(const void* begin, const void* end) {
+  for (Slice& slice : slices_) {
+    if (slice.start < begin || slice.start >= end)
+      continue;
+    Slice copy = Slice::Allocate(slice.size);
+    memcpy(copy.own_data(), slice.start, slice.size);
+    slice = std::move(copy);
+  }
+}
+
 std::tuple<char*, size_t> TracePacket::GetProtoPreamble() {
   using protozero::proto_utils::MakeTagLengthDelimited;
   using protozero::proto_utils::WriteVarInt;
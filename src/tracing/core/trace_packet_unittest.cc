@@ -16,6 +16,8 @@
 
 #include "perfetto/tracing/core/trace_packet.h"
 
+#include <string.h>
+
 #include <string>
 
 #include "gtest/gtest.h"
@@ -166,5 +168,25 @@ TEST(TracePacketTest, MoveOperators) {
   ASSERT_EQ(5u + 7u + 11u + 6u, moved_tp_2.size());
 }
 
+TEST(TracePacketTest, CopySlicesInRange) {
+  char buf[12] = "hello world";
+  TracePacket tp;
+  tp.AddSlice(&buf[0], 5);
+  tp.AddSlice(&buf[6], 5);
+  tp.AddSlice(Slice(std::unique_ptr<std::string>(new std::string("!"))));
+
+  tp.CopySlicesInRange(&buf[6], &buf[sizeof(buf)]);
+  ASSERT_EQ(3u, tp.slices().size());
+  EXPECT_EQ(11u, tp.size());
+  EXPECT_EQ(&buf[0], tp.slices()[0].start);
+  EXPECT_NE(&buf[6], tp.slices()[1].start);
+  memset(buf, 'x', sizeof(buf));
+
+  std::string contents;
+  for (const Slice& slice : tp.slices())
+    contents.append(static_cast<const char*>(slice.start), slice.size);
+  EXPECT_EQ("xxxxxworld!", contents);
+}
+
 }  // namespace
 }  // namespace perfetto
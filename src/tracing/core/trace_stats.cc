@@ -49,7 +49,10 @@ bool TraceStats::operator==(const TraceStats& other) const {
          (tracing_sessions_ == other.tracing_sessions_) &&
          (total_buffers_ == other.total_buffers_) &&
          (chunks_discarded_ == other.chunks_discarded_) &&
-         (patches_discarded_ == other.patches_discarded_);
+         (patches_discarded_ == other.patches_discarded_) &&
+         (compression_input_bytes_ == other.compression_input_bytes_) &&
+         (compression_output_bytes_ == other.compression_output_bytes_) &&
+         (compression_cpu_time_ns_ == other.compression_cpu_time_ns_);
 }
 #pragma GCC diagnostic pop
 
@@ -100,6 +103,24 @@ void TraceStats::FromProto(const perfetto::protos::TraceStats& proto) {
                 "size mismatch");
   patches_discarded_ =
       static_cast<decltype(patches_discarded_)>(proto.patches_discarded());
+
+  static_assert(sizeof(compression_input_bytes_) ==
+                    sizeof(proto.compression_input_bytes()),
+                "size mismatch");
+  compression_input_bytes_ = static_cast<decltype(compression_input_bytes_)>(
+      proto.compression_input_bytes());
+
+  static_assert(sizeof(compression_output_bytes_) ==
+                    sizeof(proto.compression_output_bytes()),
+                "size mismatch");
+  compression_output_bytes_ = static_cast<decltype(compression_output_bytes_)>(
+      proto.compression_output_bytes());
+
+  static_assert(sizeof(compression_cpu_time_ns_) ==
+                    sizeof(proto.compression_cpu_time_ns()),
+                "size mismatch");
+  compression_cpu_time_ns_ = static_cast<decltype(compression_cpu_time_ns_)>(
+      proto.compression_cpu_time_ns());
   unknown_fields_ = proto.unknown_fields();
 }
 
@@ -156,6 +177,27 @@ void TraceStats::ToProto(perfetto::protos::TraceStats* proto) const {
       "size mismatch");
   proto->set_patches_discarded(
       static_cast<decltype(proto->patches_discarded())>(patches_discarded_));
+
+  static_assert(sizeof(compression_input_bytes_) ==
+                    sizeof(proto->compression_input_bytes()),
+                "size mismatch");
+  proto->set_compression_input_bytes(
+      static_cast<decltype(proto->compression_input_bytes())>(
+          compression_input_bytes_));
+
+  static_assert(sizeof(compression_output_bytes_) ==
+                    sizeof(proto->compression_output_bytes()),
+                "size mismatch");
+  proto->set_compression_output_bytes(
+      static_cast<decltype(proto->compression_output_bytes())>(
+          compression_output_bytes_));
+
+  static_assert(sizeof(compression_cpu_time_ns_) ==
+                    sizeof(proto->compression_cpu_time_ns()),
+                "size mismatch");
+  proto->set_compression_cpu_time_ns(
+      static_cast<decltype(proto->compression_cpu_time_ns())>(
+          compression_cpu_time_ns_));
   *(proto->mutable_unknown_fields()) = unknown_fields_;
 }
 
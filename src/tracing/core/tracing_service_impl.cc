@@ -26,7 +26,6 @@
 #include <unordered_set>
 
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
-#include <sys/uio.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 #endif
@@ -39,8 +38,10 @@
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/base/file_utils.h"
+#include "perfetto/base/lz4.h"
 #include "perfetto/base/task_runner.h"
 #include "perfetto/base/utils.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "perfetto/tracing/core/consumer.h"
 #include "perfetto/tracing/core/data_source_config.h"
 #include "perfetto/tracing/core/producer.h"
@@ -77,28 +78,20 @@ constexpr uint32_t kMaxTracingDurationMillis = 7 * 24 * kMillisPerHour;
 constexpr uint32_t kGuardrailsMaxTracingBufferSizeKb = 32 * 1024;
 constexpr uint32_t kGuardrailsMaxTracingDurationMillis = 24 * kMillisPerHour;
 
-#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
-struct iovec {
-  void* iov_base;  // Address
-  size_t iov_len;  // Block size
-};
-
-// Simple implementation of writev. Note that this does not give the atomicity
-// guarantees of a real writev, but we don't depend on these (we aren't writing
-// to the same file from another thread).
-ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
-  ssize_t total_size = 0;
-  for (int i = 0; i < iovcnt; ++i) {
-    ssize_t current_size = base::WriteAll(fd, iov[i].iov_base, iov[i].iov_len);
-    if (current_size != static_cast<ssize_t>(iov[i].iov_len))
-      return -1;
-    total_size += current_size;
-  }
-  return total_size;
-}
+// When compressing the packets, they are compressed in batches of up to this
+// many bytes, each emitted as a single TracePacket. The packets read by a
+// ReadBuffers() task are compressed on their own, so only write_into_file
+// sessions, which read up to the free space of the TraceFileWriter per task,
+// fill whole batches. Sessions read over IPC compress the ~kApproxBytesPerTask
+// read by each task: LZ4 only matches within 64KB, so that costs little ratio
+// (2.83x vs 2.92x on a 100MB ftrace-heavy trace).
+constexpr size_t kCompressionBatchSize = 512 * 1024;
 
-#define IOV_MAX 1024  // Linux compatible limit.
+// Field ids of TracePacket.CompressedPackets.
+constexpr uint32_t kUncompressedSizeFieldNumber = 1;
+constexpr uint32_t kCompressedDataFieldNumber = 2;
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
 // uid checking is a NOP on Windows.
 uid_t getuid() {
   return 0;
@@ -174,6 +167,10 @@ void TracingServiceImpl::DisconnectProducer(ProducerID id) {
   PERFETTO_DLOG("Producer %" PRIu16 " disconnected", id);
   PERFETTO_DCHECK(producers_.count(id));
 
+  // The data path shards can be copying chunks from the SMB of the producer,
+  // which is unmapped once it's disconnected.
+  WaitForDataPathIdle();
+
   // Scrape remaining chunks for this producer to ensure we don't lose data.
   if (auto* producer = GetProducer(id)) {
     for (auto& session_id_and_session : tracing_sessions_)
@@ -383,7 +380,8 @@ bool TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
       tracing_sessions_.erase(tsid);
       return false;
     }
-    tracing_session->write_into_file = std::move(fd);
+    tracing_session->write_into_file.reset(new TraceFileWriter(
+        std::move(fd), task_runner_, max_file_writer_pending_bytes_));
     uint32_t write_period_ms = cfg.file_write_period_ms();
     if (write_period_ms == 0)
       write_period_ms = kDefaultWriteIntoFilePeriodMs;
@@ -426,6 +424,17 @@ bool TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
       did_allocate_all_buffers = false;
       break;
     }
+
+    // The packets handed to the file writer point into the buffer. The writer
+    // outlives the buffer, unless it's closed first in ReadBuffers().
+    if (tracing_session->write_into_file) {
+      TraceFileWriter* file_writer = tracing_session->write_into_file.get();
+      trace_buffer->set_unpin_callback([file_writer](uint64_t pin,
+                                                     const uint8_t* begin,
+                                                     const uint8_t* end) {
+        file_writer->Unpin(pin, begin, end);
+      });
+    }
   }
 
   UpdateMemoryGuardrail();
@@ -996,6 +1005,10 @@ void TracingServiceImpl::DisableTracingNotifyConsumerAndFlushFile(
   if (tracing_session->write_into_file) {
     tracing_session->write_period_ms = 0;
     ReadBuffers(tracing_session->id, nullptr);
+
+    // The buffers were too large to be drained into the file in one task.
+    if (tracing_session->notify_disabled_on_file_close)
+      return;
   }
 
   if (tracing_session->consumer_maybe_null)
@@ -1147,6 +1160,7 @@ void TracingServiceImpl::ScrapeSharedMemoryBuffers(
     return;
 
   PERFETTO_DLOG("Scraping SMB for producer %" PRIu16, producer->id_);
+  WaitForDataPathIdle();
 
   // Find and copy any uncommitted chunks from the SMB.
   //
@@ -1304,6 +1318,7 @@ void TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
       PERFETTO_DLOG("Cannot ReadBuffers(): no tracing session is active");
     return;  // TODO(primiano): signal failure?
   }
+  WaitForDataPathIdle();
 
   // When a tracing session is waiting for a trigger it is considered empty. If
   // a tracing session finishes and moves into DISABLED without ever receiving a
@@ -1348,13 +1363,10 @@ void TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
   MaybeEmitSystemInfo(tracing_session, &packets);
 
   size_t packets_bytes = 0;  // SUM(slice.size() for each slice in |packets|).
-  size_t total_slices = 0;   // SUM(#slices in |packets|).
 
   // Add up size for packets added by the Maybe* calls above.
-  for (const TracePacket& packet : packets) {
+  for (const TracePacket& packet : packets)
     packets_bytes += packet.size();
-    total_slices += packet.slices().size();
-  }
 
   // This is a rough threshold to determine how much to read from the buffer in
   // each task. This is to avoid executing a single huge sending task for too
@@ -1367,9 +1379,25 @@ void TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
   // buffer in one large task, will hit the blocking send() once the socket
   // buffers are full and hang the service for a bit (until the consumer
   // catches up).
+  // When writing into a file the threshold is instead the room left in the
+  // TraceFileWriter, which writes the file on its own thread.
   static constexpr size_t kApproxBytesPerTask = 32768;
+  const size_t bytes_per_task =
+      tracing_session->write_into_file
+          ? tracing_session->write_into_file->free_bytes()
+          : kApproxBytesPerTask;
   bool did_hit_threshold = false;
 
+  // The packets written into the file are not copied, so the chunks they are
+  // read from are pinned until the file writer is done with them. Compressed
+  // packets own their data and don't need that.
+  uint64_t read_pin = 0;
+  if (tracing_session->write_into_file &&
+      tracing_session->config.compression_type() !=
+          TraceConfig::COMPRESSION_TYPE_LZ4) {
+    read_pin = tracing_session->write_into_file->next_pin();
+  }
+
   // TODO(primiano): Extend the ReadBuffers API to allow reading only some
   // buffers, not all of them in one go.
   for (size_t buf_idx = 0;
@@ -1382,6 +1410,7 @@ void TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
     }
     TraceBuffer& tbuf = *tbuf_iter->second;
     tbuf.BeginRead();
+    tbuf.set_read_pin(read_pin);
     while (!did_hit_threshold) {
       TracePacket packet;
       TraceBuffer::PacketSequenceProperties sequence_properties{};
@@ -1426,94 +1455,97 @@ void TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
 
       // Append the packet (inclusive of the trusted uid) to |packets|.
       packets_bytes += packet.size();
-      total_slices += packet.slices().size();
-      did_hit_threshold = packets_bytes >= kApproxBytesPerTask &&
-                          !tracing_session->write_into_file;
+      did_hit_threshold = packets_bytes >= bytes_per_task;
       packets.emplace_back(std::move(packet));
     }  // for(packets...)
   }    // for(buffers...)
 
+  if (tracing_session->config.compression_type() ==
+          TraceConfig::COMPRESSION_TYPE_LZ4 &&
+      !packets.empty()) {
+    CompressPackets(tracing_session, &packets);
+  }
+
   // If the caller asked us to write into a file by setting
   // |write_into_file| == true in the trace config, drain the packets read
   // (if any) into the given file descriptor.
   if (tracing_session->write_into_file) {
+    TraceFileWriter* file_writer = tracing_session->write_into_file.get();
     const uint64_t max_size = tracing_session->max_file_size_bytes
                                   ? tracing_session->max_file_size_bytes
                                   : std::numeric_limits<size_t>::max();
 
+    // Once tracing is disabled, keep draining until the buffers are empty.
+    bool stop_writing_into_file =
+        file_writer->has_failed() ||
+        (tracing_session->write_period_ms == 0 && !did_hit_threshold);
+
     // When writing into a file, the file should look like a root trace.proto
     // message. Each packet should be prepended with a proto preamble stating
-    // its field id (within trace.proto) and size. Hence the addition below.
-    const size_t max_iovecs = total_slices + packets.size();
-
-    size_t num_iovecs = 0;
-    bool stop_writing_into_file = tracing_session->write_period_ms == 0;
-    std::unique_ptr<struct iovec[]> iovecs(new struct iovec[max_iovecs]);
-    size_t num_iovecs_at_last_packet = 0;
-    uint64_t bytes_about_to_be_written = 0;
+    // its field id (within trace.proto) and size. The |file_writer| does that
+    // on its thread. The packets are moved to it without copying their slices,
+    // which stay valid as the chunks they point into were read with |read_pin|.
+    uint64_t total_wr_size = 0;
+    size_t num_packets_to_write = 0;
     for (TracePacket& packet : packets) {
-      std::tie(iovecs[num_iovecs].iov_base, iovecs[num_iovecs].iov_len) =
-          packet.GetProtoPreamble();
-      bytes_about_to_be_written += iovecs[num_iovecs].iov_len;
-      num_iovecs++;
-      for (const Slice& slice : packet.slices()) {
-        // writev() doesn't change the passed pointer. However, struct iovec
-        // take a non-const ptr because it's the same struct used by readv().
-        // Hence the const_cast here.
-        char* start = static_cast<char*>(const_cast<void*>(slice.start));
-        bytes_about_to_be_written += slice.size;
-        iovecs[num_iovecs++] = {start, slice.size};
-      }
-
-      if (tracing_session->bytes_written_into_file +
-              bytes_about_to_be_written >=
+      const uint64_t packet_size =
+          std::get<1>(packet.GetProtoPreamble()) + packet.size();
+      if (tracing_session->bytes_written_into_file + total_wr_size +
+              packet_size >=
           max_size) {
         stop_writing_into_file = true;
-        num_iovecs = num_iovecs_at_last_packet;
         break;
       }
-
-      num_iovecs_at_last_packet = num_iovecs;
-    }
-    PERFETTO_DCHECK(num_iovecs <= max_iovecs);
-    int fd = *tracing_session->write_into_file;
-
-    uint64_t total_wr_size = 0;
-
-    // writev() can take at most IOV_MAX entries per call. Batch them.
-    constexpr size_t kIOVMax = IOV_MAX;
-    for (size_t i = 0; i < num_iovecs; i += kIOVMax) {
-      int iov_batch_size = static_cast<int>(std::min(num_iovecs - i, kIOVMax));
-      ssize_t wr_size = PERFETTO_EINTR(writev(fd, &iovecs[i], iov_batch_size));
-      if (wr_size <= 0) {
-        PERFETTO_PLOG("writev() failed");
-        stop_writing_into_file = true;
-        break;
-      }
-      total_wr_size += static_cast<size_t>(wr_size);
+      total_wr_size += packet_size;
+      num_packets_to_write++;
     }
+    packets.erase(
+        packets.begin() + static_cast<std::ptrdiff_t>(num_packets_to_write),
+        packets.end());
+    file_writer->Append(std::move(packets));
 
     tracing_session->bytes_written_into_file += total_wr_size;
 
     PERFETTO_DLOG("Draining into file, written: %" PRIu64 " KB, stop: %d",
                   (total_wr_size + 1023) / 1024, stop_writing_into_file);
     if (stop_writing_into_file) {
-      // Ensure all data was written to the file before we close it.
-      base::FlushFile(fd);
+      // Destroying the writer blocks until all the data appended is written,
+      // which is bounded by its |max_pending_bytes|, then closes the file.
+      // Past that point the buffers don't need to be unpinned anymore.
       tracing_session->write_into_file.reset();
+      for (BufferID buffer_id : tracing_session->buffers_index) {
+        auto tbuf_iter = buffers_.find(buffer_id);
+        if (tbuf_iter != buffers_.end())
+          tbuf_iter->second->set_unpin_callback(nullptr);
+      }
       tracing_session->write_period_ms = 0;
-      if (tracing_session->state == TracingSession::STARTED)
+      if (tracing_session->state == TracingSession::STARTED) {
         DisableTracing(tsid);
+      } else if (tracing_session->notify_disabled_on_file_close) {
+        tracing_session->notify_disabled_on_file_close = false;
+        if (tracing_session->consumer_maybe_null)
+          tracing_session->consumer_maybe_null->NotifyOnTracingDisabled();
+      }
       return;
     }
 
     auto weak_this = weak_ptr_factory_.GetWeakPtr();
+    auto read_buffers = [weak_this, tsid] {
+      if (weak_this)
+        weak_this->ReadBuffers(tsid, nullptr);
+    };
+
+    // If the writer is full, resume draining the buffers as soon as it has
+    // written part of the data, rather than on the next write period. If
+    // tracing is disabled, the consumer is notified once the file is closed.
+    if (did_hit_threshold) {
+      if (tracing_session->write_period_ms == 0)
+        tracing_session->notify_disabled_on_file_close = true;
+      file_writer->NotifyWhenNotFull(read_buffers);
+      return;
+    }
     task_runner_->PostDelayedTask(
-        [weak_this, tsid] {
-          if (weak_this)
-            weak_this->ReadBuffers(tsid, nullptr);
-        },
-        tracing_session->delay_to_next_write_period_ms());
+        read_buffers, tracing_session->delay_to_next_write_period_ms());
     return;
   }  // if (tracing_session->write_into_file)
 
@@ -1550,6 +1582,7 @@ void TracingServiceImpl::FreeBuffers(TracingSessionID tsid) {
     producer->OnFreeBuffers(tracing_session->buffers_index);
   }
 
+  WaitForDataPathIdle();
   for (BufferID buffer_id : tracing_session->buffers_index) {
     buffer_ids_.Free(buffer_id);
     PERFETTO_DCHECK(buffers_.count(buffer_id) == 1);
@@ -1777,12 +1810,28 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
     const uint8_t* src,
     size_t size) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
+  TraceBuffer* buf =
+      GetTargetBufferForChunk(producer_id_trusted, writer_id, buffer_id);
+  if (!buf)
+    return;
+  buf->CopyChunkUntrusted(producer_id_trusted, producer_uid_trusted, writer_id,
+                          chunk_id, num_fragments, chunk_flags, chunk_complete,
+                          src, size);
+}
+
+// Returns the buffer |buffer_id| if the producer is allowed to write into it,
+// otherwise counts the chunk as discarded and returns nullptr.
+TraceBuffer* TracingServiceImpl::GetTargetBufferForChunk(
+    ProducerID producer_id_trusted,
+    WriterID writer_id,
+    BufferID buffer_id) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
 
   ProducerEndpointImpl* producer = GetProducer(producer_id_trusted);
   if (!producer) {
     PERFETTO_DFATAL("Producer not found.");
     chunks_discarded_++;
-    return;
+    return nullptr;
   }
 
   TraceBuffer* buf = GetBufferByID(buffer_id);
@@ -1791,7 +1840,7 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
                   " for producer %" PRIu16,
                   buffer_id, producer_id_trusted);
     chunks_discarded_++;
-    return;
+    return nullptr;
   }
 
   // Verify that the producer is actually allowed to write into the target
@@ -1804,7 +1853,7 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
                   producer_id_trusted, buffer_id);
     PERFETTO_DFATAL("Forbidden target buffer");
     chunks_discarded_++;
-    return;
+    return nullptr;
   }
 
   // If the writer was registered by the producer, it should only write into the
@@ -1819,12 +1868,9 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
                   buffer_id);
     PERFETTO_DFATAL("Wrong target buffer");
     chunks_discarded_++;
-    return;
+    return nullptr;
   }
-
-  buf->CopyChunkUntrusted(producer_id_trusted, producer_uid_trusted, writer_id,
-                          chunk_id, num_fragments, chunk_flags, chunk_complete,
-                          src, size);
+  return buf;
 }
 
 void TracingServiceImpl::ApplyChunkPatches(
@@ -1881,6 +1927,22 @@ void TracingServiceImpl::ApplyChunkPatches(
       memcpy(&patches[i].data[0], patch_data.data(), patches[i].data.size());
       i++;
     }
+
+    // The patches must be applied after the chunk is copied, on the same shard.
+    if (data_path_shards_) {
+      std::vector<TraceBuffer::Patch> shard_patches(&patches[0],
+                                                    &patches[0] + i);
+      bool has_more_patches = chunk.has_more_patches();
+      data_path_shards_->PostTask(
+          GetDataPathShard(static_cast<BufferID>(chunk.target_buffer())),
+          [buf, producer_id_trusted, writer_id, chunk_id, shard_patches,
+           has_more_patches] {
+            buf->TryPatchChunkContents(producer_id_trusted, writer_id,
+                                       chunk_id, shard_patches.data(),
+                                       shard_patches.size(), has_more_patches);
+          });
+      continue;
+    }
     buf->TryPatchChunkContents(producer_id_trusted, writer_id, chunk_id,
                                &patches[0], i, chunk.has_more_patches());
   }
@@ -1926,6 +1988,19 @@ TraceBuffer* TracingServiceImpl::GetBufferByID(BufferID buffer_id) {
   return &*buf_iter->second;
 }
 
+void TracingServiceImpl::SetDataPathThreads(uint32_t num_threads) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  // Destroying the current shards runs their pending tasks first.
+  data_path_shards_.reset(num_threads ? new ShardedWorkerPool(num_threads)
+                                      : nullptr);
+}
+
+void TracingServiceImpl::WaitForDataPathIdle() {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  if (data_path_shards_)
+    data_path_shards_->WaitForIdle();
+}
+
 void TracingServiceImpl::OnStartTriggersTimeout(TracingSessionID tsid) {
   // Skip entirely the flush if the trace session doesn't exist anymore.
   // This is to prevent misleading error messages to be logged.
@@ -2069,6 +2144,7 @@ void TracingServiceImpl::SnapshotStats(TracingSession* tracing_session,
 }
 
 TraceStats TracingServiceImpl::GetTraceStats(TracingSession* tracing_session) {
+  WaitForDataPathIdle();
   TraceStats trace_stats;
   trace_stats.set_producers_connected(static_cast<uint32_t>(producers_.size()));
   trace_stats.set_producers_seen(last_producer_id_);
@@ -2081,6 +2157,16 @@ TraceStats TracingServiceImpl::GetTraceStats(TracingSession* tracing_session) {
   trace_stats.set_chunks_discarded(chunks_discarded_);
   trace_stats.set_patches_discarded(patches_discarded_);
 
+  if (tracing_session->config.compression_type() !=
+      TraceConfig::COMPRESSION_TYPE_UNSPECIFIED) {
+    trace_stats.set_compression_input_bytes(
+        tracing_session->compression_input_bytes);
+    trace_stats.set_compression_output_bytes(
+        tracing_session->compression_output_bytes);
+    trace_stats.set_compression_cpu_time_ns(
+        tracing_session->compression_cpu_time_ns);
+  }
+
   for (BufferID buf_id : tracing_session->buffers_index) {
     TraceBuffer* buf = GetBufferByID(buf_id);
     if (!buf) {
@@ -2092,6 +2178,73 @@ TraceStats TracingServiceImpl::GetTraceStats(TracingSession* tracing_session) {
   return trace_stats;
 }
 
+// Replaces |packets| with TracePackets holding them, encoded as a Trace
+// message, in their compressed_packets field.
+void TracingServiceImpl::CompressPackets(TracingSession* tracing_session,
+                                         std::vector<TracePacket>* packets) {
+  using protozero::proto_utils::kMaxTagEncodedSize;
+  using protozero::proto_utils::kMessageLengthFieldSize;
+  using protozero::proto_utils::MakeTagLengthDelimited;
+  using protozero::proto_utils::MakeTagVarInt;
+  using protozero::proto_utils::WriteRedundantVarInt;
+  using protozero::proto_utils::WriteVarInt;
+
+  // The sizes of the nested messages precede the compressed data, so they are
+  // written as redundant varints once it is known.
+  constexpr size_t kMaxHeaderSize =
+      3 * kMaxTagEncodedSize + 2 * kMessageLengthFieldSize + 10;
+
+  base::TimeNanos cpu_time_start = base::GetThreadCPUTimeNs();
+  std::vector<TracePacket> compressed_packets;
+  std::vector<uint8_t> batch;
+  std::vector<uint8_t> buf;
+  for (auto it = packets->begin(); it != packets->end();) {
+    batch.clear();
+    for (; it != packets->end() && batch.size() < kCompressionBatchSize;
+         ++it) {
+      char* preamble;
+      size_t preamble_size;
+      std::tie(preamble, preamble_size) = it->GetProtoPreamble();
+      batch.insert(batch.end(), preamble, preamble + preamble_size);
+      for (const Slice& slice : it->slices()) {
+        const uint8_t* start = static_cast<const uint8_t*>(slice.start);
+        batch.insert(batch.end(), start, start + slice.size);
+      }
+    }
+
+    buf.resize(kMaxHeaderSize + base::Lz4CompressBound(batch.size()));
+    uint8_t* ptr = buf.data();
+    ptr = WriteVarInt(MakeTagLengthDelimited(
+                          protos::TrustedPacket::kCompressedPacketsFieldNumber),
+                      ptr);
+    uint8_t* message_size_field = ptr;
+    ptr += kMessageLengthFieldSize;
+    uint8_t* message_start = ptr;
+    ptr = WriteVarInt(MakeTagVarInt(kUncompressedSizeFieldNumber), ptr);
+    ptr = WriteVarInt(batch.size(), ptr);
+    ptr = WriteVarInt(MakeTagLengthDelimited(kCompressedDataFieldNumber), ptr);
+    uint8_t* data_size_field = ptr;
+    ptr += kMessageLengthFieldSize;
+    size_t data_size = base::Lz4Compress(batch.data(), batch.size(), ptr);
+    ptr += data_size;
+    WriteRedundantVarInt(static_cast<uint32_t>(data_size), data_size_field);
+    WriteRedundantVarInt(static_cast<uint32_t>(ptr - message_start),
+                         message_size_field);
+
+    Slice slice = Slice::Allocate(static_cast<size_t>(ptr - buf.data()));
+    memcpy(slice.own_data(), buf.data(), slice.size);
+    compressed_packets.emplace_back();
+    compressed_packets.back().AddSlice(std::move(slice));
+
+    tracing_session->compression_input_bytes += batch.size();
+    tracing_session->compression_output_bytes +=
+        compressed_packets.back().size();
+  }
+  *packets = std::move(compressed_packets);
+  tracing_session->compression_cpu_time_ns += static_cast<uint64_t>(
+      (base::GetThreadCPUTimeNs() - cpu_time_start).count());
+}
+
 void TracingServiceImpl::MaybeEmitTraceConfig(
     TracingSession* tracing_session,
     std::vector<TracePacket>* packets) {
@@ -2415,6 +2568,13 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     return;
   }
   PERFETTO_DCHECK(shmem_abi_.is_valid());
+
+  // With data path shards, the chunks are copied and freed by the shard of
+  // their target buffer, in one task per shard.
+  ShardedWorkerPool* shards = service_->data_path_shards_.get();
+  std::vector<std::shared_ptr<std::vector<ChunkToCopy>>> shard_chunks(
+      shards ? shards->num_shards() : 0);
+
   for (const auto& entry : req_untrusted.chunks_to_move()) {
     const uint32_t page_idx = entry.page();
     if (page_idx >= shmem_abi_.num_pages())
@@ -2441,6 +2601,21 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     uint16_t num_fragments = packets.count;
     uint8_t chunk_flags = packets.flags;
 
+    if (shards) {
+      TraceBuffer* buf =
+          service_->GetTargetBufferForChunk(id_, writer_id, buffer_id);
+      if (!buf) {
+        shmem_abi_.ReleaseChunkAsFree(std::move(chunk));
+        continue;
+      }
+      auto& chunks = shard_chunks[service_->GetDataPathShard(buffer_id)];
+      if (!chunks)
+        chunks.reset(new std::vector<ChunkToCopy>());
+      chunks->emplace_back(ChunkToCopy{buf, writer_id, chunk_id, num_fragments,
+                                       chunk_flags, std::move(chunk)});
+      continue;
+    }
+
     service_->CopyProducerPageIntoLogBuffer(
         id_, uid_, writer_id, chunk_id, buffer_id, num_fragments, chunk_flags,
         /*chunk_complete=*/true, chunk.payload_begin(), chunk.payload_size());
@@ -2449,6 +2624,25 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     shmem_abi_.ReleaseChunkAsFree(std::move(chunk));
   }  // for(chunks_to_move)
 
+  for (size_t shard = 0; shard < shard_chunks.size(); shard++) {
+    if (!shard_chunks[shard])
+      continue;
+    std::shared_ptr<std::vector<ChunkToCopy>> chunks =
+        std::move(shard_chunks[shard]);
+    SharedMemoryABI* shmem_abi = &shmem_abi_;
+    ProducerID producer_id = id_;
+    uid_t uid = uid_;
+    shards->PostTask(shard, [chunks, shmem_abi, producer_id, uid] {
+      for (ChunkToCopy& c : *chunks) {
+        c.buffer->CopyChunkUntrusted(
+            producer_id, uid, c.writer_id, c.chunk_id, c.num_fragments,
+            c.chunk_flags, /*chunk_complete=*/true, c.chunk.payload_begin(),
+            c.chunk.payload_size());
+        shmem_abi->ReleaseChunkAsFree(std::move(c.chunk));
+      }
+    });
+  }
+
   service_->ApplyChunkPatches(id_, req_untrusted.chunks_to_patch());
 
   if (req_untrusted.flush_request_id()) {
@@ -38,6 +38,8 @@
 #include "perfetto/tracing/core/trace_stats.h"
 #include "perfetto/tracing/core/tracing_service.h"
 #include "src/tracing/core/id_allocator.h"
+#include "src/tracing/core/sharded_worker_pool.h"
+#include "src/tracing/core/trace_file_writer.h"
 
 namespace perfetto {
 
@@ -115,6 +117,17 @@ class TracingServiceImpl : public TracingService {
    private:
     friend class TracingServiceImpl;
     friend class TracingServiceImplTest;
+
+    // A committed chunk waiting to be copied by a data path shard.
+    struct ChunkToCopy {
+      TraceBuffer* buffer;
+      WriterID writer_id;
+      ChunkID chunk_id;
+      uint16_t num_fragments;
+      uint8_t chunk_flags;
+      SharedMemoryABI::Chunk chunk;
+    };
+
     ProducerEndpointImpl(const ProducerEndpointImpl&) = delete;
     ProducerEndpointImpl& operator=(const ProducerEndpointImpl&) = delete;
     SharedMemoryArbiterImpl* GetOrCreateShmemArbiter();
@@ -268,6 +281,8 @@ class TracingServiceImpl : public TracingService {
     smb_scraping_enabled_ = enabled;
   }
 
+  void SetDataPathThreads(uint32_t num_threads) override;
+
   // Exposed mainly for testing.
   size_t num_producers() const { return producers_.size(); }
   ProducerEndpointImpl* GetProducer(ProducerID) const;
@@ -438,13 +453,24 @@ class TracingServiceImpl : public TracingService {
     std::string detach_key;
 
     // This is set when the Consumer calls sets |write_into_file| == true in the
-    // TraceConfig. In this case this represents the file we should stream the
-    // trace packets into, rather than returning it to the consumer via
+    // TraceConfig. In this case this writes the trace packets into the file
+    // passed by the consumer, rather than returning them to the consumer via
     // OnTraceData().
-    base::ScopedFile write_into_file;
+    std::unique_ptr<TraceFileWriter> write_into_file;
     uint32_t write_period_ms = 0;
     uint64_t max_file_size_bytes = 0;
     uint64_t bytes_written_into_file = 0;
+
+    // Set when the buffers couldn't be drained into the file in one task after
+    // tracing was disabled. OnTracingDisabled() is then sent to the consumer
+    // once they are drained and the file is closed.
+    bool notify_disabled_on_file_close = false;
+
+    // Stats of the compression of the packets read from the buffers, when the
+    // TraceConfig sets a |compression_type|. See TraceStats.
+    uint64_t compression_input_bytes = 0;
+    uint64_t compression_output_bytes = 0;
+    uint64_t compression_cpu_time_ns = 0;
   };
 
   TracingServiceImpl(const TracingServiceImpl&) = delete;
@@ -479,6 +505,7 @@ class TracingServiceImpl : public TracingService {
   TraceStats GetTraceStats(TracingSession* tracing_session);
   void MaybeEmitTraceConfig(TracingSession*, std::vector<TracePacket>*);
   void MaybeEmitSystemInfo(TracingSession*, std::vector<TracePacket>*);
+  void CompressPackets(TracingSession*, std::vector<TracePacket>*);
   void OnFlushTimeout(TracingSessionID, FlushRequestID);
   void OnDisableTracingTimeout(TracingSessionID);
   void DisableTracingNotifyConsumerAndFlushFile(TracingSession*);
@@ -489,8 +516,18 @@ class TracingServiceImpl : public TracingService {
   void ScrapeSharedMemoryBuffers(TracingSession* tracing_session,
                                  ProducerEndpointImpl* producer);
   TraceBuffer* GetBufferByID(BufferID);
+  TraceBuffer* GetTargetBufferForChunk(ProducerID, WriterID, BufferID);
   void OnStartTriggersTimeout(TracingSessionID tsid);
 
+  // Returns the data path shard copying the chunks into |buffer_id|.
+  size_t GetDataPathShard(BufferID buffer_id) const {
+    return buffer_id % data_path_shards_->num_shards();
+  }
+
+  // Blocks until the data path shards, if any, have copied all the chunks
+  // committed so far. Must be called before accessing the trace buffers.
+  void WaitForDataPathIdle();
+
   base::TaskRunner* const task_runner_;
   std::unique_ptr<SharedMemory::Factory> shm_factory_;
   ProducerID last_producer_id_ = 0;
@@ -507,11 +544,25 @@ class TracingServiceImpl : public TracingService {
   std::map<ProducerID, ProducerEndpointImpl*> producers_;
   std::set<ConsumerEndpointImpl*> consumers_;
   std::map<TracingSessionID, TracingSession> tracing_sessions_;
+
+  // Declared after |tracing_sessions_|, so that the buffers are destroyed, and
+  // unpinned from the file writers of the sessions, before the writers.
   std::map<BufferID, std::unique_ptr<TraceBuffer>> buffers_;
 
+  // The threads copying the committed chunks into |buffers_|, if enabled with
+  // SetDataPathThreads(). All the chunks and patches of a buffer are handled
+  // by the same shard, in the order they are committed. The tasks of the
+  // shards only access the trace buffers and the producers' SMBs: the service
+  // waits for them to be idle before accessing a buffer itself, freeing a
+  // buffer or disconnecting a producer. Declared after |buffers_| so that the
+  // threads are joined before the buffers are destroyed.
+  std::unique_ptr<ShardedWorkerPool> data_path_shards_;
+
   bool smb_scraping_enabled_ = false;
   bool lockdown_mode_ = false;
   uint32_t min_write_period_ms_ = 100;  // Overridable for testing.
+  size_t max_file_writer_pending_bytes_ =
+      TraceFileWriter::kDefaultMaxPendingBytes;  // Overridable for testing.
 
   uint8_t sync_marker_packet_[32];  // Lazily initialized.
   size_t sync_marker_packet_size_ = 0;
@@ -21,6 +21,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "perfetto/base/file_utils.h"
+#include "perfetto/base/lz4.h"
 #include "perfetto/base/temp_file.h"
 #include "perfetto/base/utils.h"
 #include "perfetto/tracing/core/consumer.h"
@@ -109,6 +110,10 @@ class TracingServiceImplTest : public testing::Test {
 
   ProducerID* last_producer_id() { return &svc->last_producer_id_; }
 
+  void SetMaxFileWriterPendingBytes(size_t bytes) {
+    svc->max_file_writer_pending_bytes_ = bytes;
+  }
+
   uid_t GetProducerUid(ProducerID producer_id) {
     return svc->GetProducer(producer_id)->uid_;
   }
@@ -1148,6 +1153,183 @@ TEST_F(TracingServiceImplTest, WriteIntoFileAndStopOnMaxSize) {
   }
 }
 
+// When the buffers don't fit in the file writer at stop time, they are drained
+// over several tasks and the consumer is notified only once the writer thread
+// has written and closed the file.
+TEST_F(TracingServiceImplTest, WriteIntoFileNotifiesDisabledOnFileClose) {
+  SetMaxFileWriterPendingBytes(16 * 1024);
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(1024);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(100000);  // 100s
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  // About 100 KB, several times the bytes the file writer can have pending.
+  static constexpr int kNumPackets = 100;
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  for (int i = 0; i < kNumPackets; i++) {
+    std::string payload(1000, 'A' + (i % 26));
+    writer->NewTracePacket()->set_for_testing()->set_str(payload.c_str());
+  }
+  writer->Flush();
+  writer.reset();
+
+  auto on_tracing_disabled =
+      task_runner.CreateCheckpoint("on_tracing_disabled");
+  EXPECT_CALL(*consumer, OnTracingDisabled()).WillOnce(Invoke([&] {
+    EXPECT_FALSE(tracing_session()->write_into_file);
+    std::string trace_raw;
+    ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+    protos::Trace trace;
+    ASSERT_TRUE(trace.ParseFromString(trace_raw));
+    int num_test_packets = 0;
+    for (const protos::TracePacket& packet : trace.packet())
+      num_test_packets += packet.has_for_testing();
+    EXPECT_EQ(kNumPackets, num_test_packets);
+    on_tracing_disabled();
+  }));
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  task_runner.RunUntilCheckpoint("on_tracing_disabled");
+}
+
+// The packets handed to the file writer point into the trace buffer. Check
+// that they are not corrupted when the buffer wraps over them before they are
+// written.
+TEST_F(TracingServiceImplTest, WriteIntoFileWhileOverwritingBuffer) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(32);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(1);
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  // Each round fills most of the buffer, overwriting the chunks read in the
+  // previous round.
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  for (int round = 0; round < 20; round++) {
+    for (int i = 0; i < 50; i++) {
+      std::string payload(500, 'A' + ((round + i) % 26));
+      writer->NewTracePacket()->set_for_testing()->set_str(payload.c_str());
+    }
+    writer->Flush();
+    WaitForNextSyncMarker();
+  }
+  writer.reset();
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  protos::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+  int num_test_packets = 0;
+  for (const protos::TracePacket& packet : trace.packet()) {
+    if (!packet.has_for_testing())
+      continue;
+    num_test_packets++;
+    const std::string& payload = packet.for_testing().str();
+    ASSERT_EQ(500u, payload.size());
+    EXPECT_EQ(std::string(500, payload[0]), payload);
+  }
+  EXPECT_GT(num_test_packets, 0);
+}
+
+TEST_F(TracingServiceImplTest, CompressedPackets) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_compression_type(TraceConfig::COMPRESSION_TYPE_LZ4);
+  consumer->EnableTracing(trace_config);
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  static const int kNumTestPackets = 1000;
+  static const char kPayload[] = "1234567890abcdef-";
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  for (int i = 0; i < kNumTestPackets; i++) {
+    auto tp = writer->NewTracePacket();
+    std::string payload(kPayload);
+    payload.append(std::to_string(i));
+    tp->set_for_testing()->set_str(payload.c_str(), payload.size());
+  }
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  // All the packets are returned compressed, and the test packets follow the
+  // ones emitted by the service once decompressed.
+  std::vector<std::string> payloads;
+  for (const protos::TracePacket& packet : consumer->ReadBuffers()) {
+    ASSERT_TRUE(packet.has_compressed_packets());
+    const auto& compressed = packet.compressed_packets();
+    std::string data(compressed.uncompressed_size(), '\0');
+    ASSERT_TRUE(base::Lz4Decompress(compressed.data().data(),
+                                    compressed.data().size(), &data[0],
+                                    data.size()));
+    protos::Trace trace;
+    ASSERT_TRUE(trace.ParseFromString(data));
+    for (const protos::TracePacket& tp : trace.packet()) {
+      if (tp.has_for_testing())
+        payloads.push_back(tp.for_testing().str());
+    }
+  }
+  ASSERT_EQ(payloads.size(), static_cast<size_t>(kNumTestPackets));
+  for (int i = 0; i < kNumTestPackets; i++)
+    ASSERT_EQ(kPayload + std::to_string(i), payloads[static_cast<size_t>(i)]);
+
+  consumer->GetTraceStats();
+  TraceStats stats = consumer->WaitForTraceStats(true);
+  EXPECT_GT(stats.compression_output_bytes(), 0u);
+  EXPECT_GT(stats.compression_input_bytes(),
+            2 * stats.compression_output_bytes());
+}
+
 // Test the logic that allows the trace config to set the shm total size and
 // page size from the trace config. Also check that, if the config doesn't
 // specify a value we fall back on the hint provided by the producer.
@@ -1248,6 +1430,69 @@ TEST_F(TracingServiceImplTest, ExplicitFlush) {
                         Property(&protos::TestEvent::str, Eq("payload")))));
 }
 
+// Tests that the chunks and patches committed by several producers into
+// several buffers are copied correctly by the data path shards.
+TEST_F(TracingServiceImplTest, DataPathThreads) {
+  svc->SetDataPathThreads(2);
+
+  // Each producer writes into the buffer of its own tracing session.
+  static constexpr size_t kNumProducers = 3;
+  std::unique_ptr<MockConsumer> consumers[kNumProducers];
+  std::unique_ptr<MockProducer> producers[kNumProducers];
+  std::unique_ptr<TraceWriter> writers[kNumProducers];
+  for (size_t i = 0; i < kNumProducers; i++) {
+    std::string ds_name = "data_source_" + std::to_string(i);
+    consumers[i] = CreateMockConsumer();
+    consumers[i]->Connect(svc.get());
+    producers[i] = CreateMockProducer();
+    producers[i]->Connect(svc.get(), "mock_producer_" + std::to_string(i));
+    producers[i]->RegisterDataSource(ds_name);
+
+    TraceConfig trace_config;
+    trace_config.add_buffers()->set_size_kb(128);
+    trace_config.add_data_sources()->mutable_config()->set_name(ds_name);
+    consumers[i]->EnableTracing(trace_config);
+    producers[i]->WaitForTracingSetup();
+    producers[i]->WaitForDataSourceSetup(ds_name);
+    producers[i]->WaitForDataSourceStart(ds_name);
+    writers[i] = producers[i]->CreateTraceWriter(ds_name);
+  }
+
+  // The large packets span several chunks, which requires patching their
+  // size fields after the chunks have been committed.
+  const std::string large_payload(10000, 'x');
+  for (int j = 0; j < 10; j++) {
+    for (size_t i = 0; i < kNumProducers; i++) {
+      auto tp = writers[i]->NewTracePacket();
+      std::string payload =
+          j % 2 ? large_payload : "payload_" + std::to_string(i);
+      tp->set_for_testing()->set_str(payload.c_str(), payload.size());
+    }
+  }
+
+  for (size_t i = 0; i < kNumProducers; i++) {
+    auto flush_request = consumers[i]->Flush();
+    producers[i]->WaitForFlush(writers[i].get());
+    ASSERT_TRUE(flush_request.WaitForReply());
+
+    consumers[i]->DisableTracing();
+    producers[i]->WaitForDataSourceStop("data_source_" + std::to_string(i));
+    consumers[i]->WaitForTracingDisabled();
+
+    auto packets = consumers[i]->ReadBuffers();
+    EXPECT_THAT(packets, Contains(Property(
+                             &protos::TracePacket::for_testing,
+                             Property(&protos::TestEvent::str,
+                                      Eq("payload_" + std::to_string(i))))));
+    size_t num_large_packets = 0;
+    for (const auto& packet : packets) {
+      if (packet.for_testing().str() == large_payload)
+        num_large_packets++;
+    }
+    EXPECT_EQ(num_large_packets, 5u);
+  }
+}
+
 TEST_F(TracingServiceImplTest, ImplicitFlushOnTimedTraces) {
   std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
   consumer->Connect(svc.get());
@@ -22,6 +22,7 @@
 #include "gmock/gmock.h"
 #include "perfetto/tracing/core/consumer.h"
 #include "perfetto/tracing/core/trace_packet.h"
+#include "perfetto/tracing/core/trace_stats.h"
 #include "perfetto/tracing/core/tracing_service.h"
 
 #include "perfetto/trace/trace_packet.pb.h"
@@ -56,7 +57,7 @@ class MockConsumer : public Consumer {
   FlushRequest Flush(uint32_t timeout_ms = 10000);
   std::vector<protos::TracePacket> ReadBuffers();
   void GetTraceStats();
-  void WaitForTraceStats(bool success);
+  TraceStats WaitForTraceStats(bool success);
   void ObserveEvents(uint32_t enabled_event_types);
   ObservableEvents WaitForObservableEvents();
 
@@ -14,6 +14,8 @@
 
 #include <gtest/gtest.h>
 #include <random>
+#include <string>
+#include <vector>
 
 #include "benchmark/benchmark.h"
 #include "perfetto/base/time.h"
@@ -207,6 +209,81 @@ static void BenchmarkConsumer(benchmark::State& state) {
                          read_time_taken_ns);
 }
 
+// Measures the throughput of the service when many producers, each writing
+// into its own buffer, saturate the CPU at the same time. The chunks are copied
+// into the buffers by |data_path_threads| threads, or by the main thread of the
+// service if 0.
+void BenchmarkManyProducers(benchmark::State& state) {
+  base::TestTaskRunner task_runner;
+
+  uint32_t num_producers = static_cast<uint32_t>(state.range(0));
+  uint32_t data_path_threads = static_cast<uint32_t>(state.range(1));
+
+  TestHelper helper(&task_runner);
+  helper.StartServiceIfRequired(data_path_threads);
+
+  static constexpr uint32_t kRandomSeed = 42;
+  static constexpr uint32_t kMessageBytes = 256;
+  uint32_t message_count = IsBenchmarkFunctionalOnly() ? 64 : 16 * 1024;
+
+  TraceConfig trace_config;
+  std::vector<std::string> ds_names;
+  std::vector<FakeProducer*> producers;
+  for (uint32_t i = 0; i < num_producers; i++) {
+    ds_names.push_back("android.perfetto.FakeProducer." + std::to_string(i));
+    producers.push_back(helper.ConnectFakeProducer(ds_names.back()));
+
+    trace_config.add_buffers()->set_size_kb(512);
+    auto* ds_config = trace_config.add_data_sources()->mutable_config();
+    ds_config->set_name(ds_names.back());
+    ds_config->set_target_buffer(i);
+    ds_config->mutable_for_testing()->set_seed(kRandomSeed);
+    ds_config->mutable_for_testing()->set_message_count(message_count);
+    ds_config->mutable_for_testing()->set_message_size(kMessageBytes);
+  }
+  helper.ConnectConsumer();
+  helper.WaitForConsumerConnect();
+
+  helper.StartTracing(trace_config);
+  for (const std::string& ds_name : ds_names)
+    helper.WaitForProducerEnabled(ds_name);
+
+  uint64_t wall_start_ns = static_cast<uint64_t>(base::GetWallTimeNs().count());
+  uint64_t service_start_ns = helper.service_thread()->GetThreadCPUTimeNs();
+  uint32_t iterations = 0;
+  uint32_t num_batches = 0;
+  for (auto _ : state) {
+    std::vector<std::string> cnames;
+    for (FakeProducer* producer : producers) {
+      cnames.push_back("produced.and.committed." +
+                       std::to_string(num_batches++));
+      auto on_produced_and_committed =
+          task_runner.CreateCheckpoint(cnames.back());
+      producer->ProduceEventBatch(helper.WrapTask(on_produced_and_committed));
+    }
+    for (const std::string& cname : cnames)
+      task_runner.RunUntilCheckpoint(cname, 30000);
+    iterations++;
+  }
+  // Only accounts for the main thread of the service, not the data path ones.
+  uint64_t service_ns =
+      helper.service_thread()->GetThreadCPUTimeNs() - service_start_ns;
+  uint64_t wall_ns =
+      static_cast<uint64_t>(base::GetWallTimeNs().count()) - wall_start_ns;
+
+  state.counters["Ser CPU"] = benchmark::Counter(100.0 * service_ns / wall_ns);
+  state.counters["Ser ns/m"] = benchmark::Counter(
+      1.0 * service_ns / (iterations * message_count * num_producers));
+  state.SetBytesProcessed(iterations * num_producers * kMessageBytes *
+                          message_count);
+
+  // Read back the buffers just to check correctness.
+  helper.ReadData();
+  helper.WaitForReadData();
+  for (const auto& packet : helper.trace())
+    ASSERT_TRUE(packet.has_for_testing());
+}
+
 void SaturateCpuProducerArgs(benchmark::internal::Benchmark* b) {
   int min_message_count = 16;
   int max_message_count = IsBenchmarkFunctionalOnly() ? 1024 : 1024 * 1024;
@@ -229,6 +306,14 @@ void ConstantRateProducerArgs(benchmark::internal::Benchmark* b) {
   }
 }
 
+void ManyProducersArgs(benchmark::internal::Benchmark* b) {
+  int max_producers = IsBenchmarkFunctionalOnly() ? 4 : 32;
+  for (int producers = 1; producers <= max_producers; producers *= 2) {
+    for (int threads : {0, 1, 4})
+      b->Args({producers, threads});
+  }
+}
+
 void SaturateCpuConsumerArgs(benchmark::internal::Benchmark* b) {
   int min_payload = 8;
   int max_payload = IsBenchmarkFunctionalOnly() ? 16 : 64 * 1024;
@@ -266,6 +351,15 @@ BENCHMARK(BM_EndToEnd_Producer_ConstantRate)
     ->UseRealTime()
     ->Apply(ConstantRateProducerArgs);
 
+static void BM_EndToEnd_ManyProducers(benchmark::State& state) {
+  BenchmarkManyProducers(state);
+}
+
+BENCHMARK(BM_EndToEnd_ManyProducers)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Apply(ManyProducersArgs);
+
 static void BM_EndToEnd_Consumer_SaturateCpu(benchmark::State& state) {
   BenchmarkConsumer(state);
 }
@@ -27,8 +27,11 @@ namespace perfetto {
 class ServiceDelegate : public ThreadDelegate {
  public:
   ServiceDelegate(const std::string& producer_socket,
-                  const std::string& consumer_socket)
-      : producer_socket_(producer_socket), consumer_socket_(consumer_socket) {}
+                  const std::string& consumer_socket,
+                  uint32_t data_path_threads = 0)
+      : producer_socket_(producer_socket),
+        consumer_socket_(consumer_socket),
+        data_path_threads_(data_path_threads) {}
   ~ServiceDelegate() override = default;
 
   void Initialize(base::TaskRunner* task_runner) override {
@@ -36,11 +39,13 @@ class ServiceDelegate : public ThreadDelegate {
     unlink(producer_socket_.c_str());
     unlink(consumer_socket_.c_str());
     svc_->Start(producer_socket_.c_str(), consumer_socket_.c_str());
+    svc_->service()->SetDataPathThreads(data_path_threads_);
   }
 
  private:
   std::string producer_socket_;
   std::string consumer_socket_;
+  uint32_t data_path_threads_;
   std::unique_ptr<ServiceIPCHost> svc_;
 };
 
@@ -63,14 +68,17 @@ class ProbesProducerDelegate : public ThreadDelegate {
 
 class FakeProducerDelegate : public ThreadDelegate {
  public:
-  FakeProducerDelegate(const std::string& producer_socket,
-                       std::function<void()> connect_callback)
+  FakeProducerDelegate(
+      const std::string& producer_socket,
+      std::function<void()> connect_callback,
+      const std::string& data_source_name = "android.perfetto.FakeProducer")
       : producer_socket_(producer_socket),
-        connect_callback_(std::move(connect_callback)) {}
+        connect_callback_(std::move(connect_callback)),
+        data_source_name_(data_source_name) {}
   ~FakeProducerDelegate() override = default;
 
   void Initialize(base::TaskRunner* task_runner) override {
-    producer_.reset(new FakeProducer("android.perfetto.FakeProducer"));
+    producer_.reset(new FakeProducer(data_source_name_));
     producer_->Connect(producer_socket_.c_str(), task_runner,
                        std::move(connect_callback_));
   }
@@ -81,6 +89,7 @@ class FakeProducerDelegate : public ThreadDelegate {
   std::string producer_socket_;
   std::unique_ptr<FakeProducer> producer_;
   std::function<void()> connect_callback_;
+  std::string data_source_name_;
 };
 }  // namespace perfetto
 
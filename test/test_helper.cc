@@ -17,6 +17,7 @@
 #include "test/test_helper.h"
 
 #include "gtest/gtest.h"
+#include "perfetto/base/utils.h"
 #include "perfetto/traced/traced.h"
 #include "perfetto/tracing/core/trace_packet.h"
 #include "test/task_runner_thread_delegates.h"
@@ -78,10 +79,13 @@ void TestHelper::OnTraceData(std::vector<TracePacket> packets, bool has_more) {
   }
 }
 
-void TestHelper::StartServiceIfRequired() {
+void TestHelper::StartServiceIfRequired(uint32_t data_path_threads) {
 #if PERFETTO_BUILDFLAG(PERFETTO_START_DAEMONS)
   service_thread_.Start(std::unique_ptr<ServiceDelegate>(
-      new ServiceDelegate(TEST_PRODUCER_SOCK_NAME, TEST_CONSUMER_SOCK_NAME)));
+      new ServiceDelegate(TEST_PRODUCER_SOCK_NAME, TEST_CONSUMER_SOCK_NAME,
+                          data_path_threads)));
+#else
+  base::ignore_result(data_path_threads);
 #endif
 }
 
@@ -94,6 +98,20 @@ FakeProducer* TestHelper::ConnectFakeProducer() {
   return producer_delegate_cached->producer();
 }
 
+FakeProducer* TestHelper::ConnectFakeProducer(
+    const std::string& data_source_name) {
+  std::unique_ptr<FakeProducerDelegate> producer_delegate(
+      new FakeProducerDelegate(
+          TEST_PRODUCER_SOCK_NAME,
+          WrapTask(CreateCheckpoint("producer.enabled." + data_source_name)),
+          data_source_name));
+  FakeProducerDelegate* producer_delegate_cached = producer_delegate.get();
+  extra_producer_threads_.emplace_back(
+      new TaskRunnerThread("perfetto.prd.extra"));
+  extra_producer_threads_.back()->Start(std::move(producer_delegate));
+  return producer_delegate_cached->producer();
+}
+
 void TestHelper::ConnectConsumer() {
   cur_consumer_num_++;
   on_connect_callback_ = CreateCheckpoint("consumer.connected." +
@@ -154,6 +172,10 @@ void TestHelper::WaitForProducerEnabled() {
   RunUntilCheckpoint("producer.enabled");
 }
 
+void TestHelper::WaitForProducerEnabled(const std::string& data_source_name) {
+  RunUntilCheckpoint("producer.enabled." + data_source_name);
+}
+
 void TestHelper::WaitForTracingDisabled(uint32_t timeout_ms) {
   RunUntilCheckpoint("stop.tracing", timeout_ms);
 }
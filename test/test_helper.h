@@ -46,8 +46,13 @@ class TestHelper : public Consumer {
   void OnTraceStats(bool, const TraceStats&) override;
   void OnObservableEvents(const ObservableEvents&) override;
 
-  void StartServiceIfRequired();
+  // |data_path_threads| is passed to TracingService::SetDataPathThreads().
+  void StartServiceIfRequired(uint32_t data_path_threads = 0);
   FakeProducer* ConnectFakeProducer();
+
+  // Connects an additional FakeProducer, running on its own thread and
+  // registering the data source |data_source_name|.
+  FakeProducer* ConnectFakeProducer(const std::string& data_source_name);
   void ConnectConsumer();
   void StartTracing(const TraceConfig& config,
                     base::ScopedFile = base::ScopedFile());
@@ -59,6 +64,7 @@ class TestHelper : public Consumer {
 
   void WaitForConsumerConnect();
   void WaitForProducerEnabled();
+  void WaitForProducerEnabled(const std::string& data_source_name);
   void WaitForTracingDisabled(uint32_t timeout_ms = 5000);
   void WaitForReadData(uint32_t read_count = 0);
 
@@ -97,6 +103,7 @@ class TestHelper : public Consumer {
 
   TaskRunnerThread service_thread_;
   TaskRunnerThread producer_thread_;
+  std::vector<std::unique_ptr<TaskRunnerThread>> extra_producer_threads_;
   std::unique_ptr<TracingService::ConsumerEndpoint> endpoint_;  // Keep last.
 };
 
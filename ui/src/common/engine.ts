@@ -12,7 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-import {RawQueryResult, TraceProcessor} from './protos';
+import {RawQueryArgs, RawQueryResult, TraceProcessor} from './protos';
 import {TimeSpan} from './time';
 
 /**
@@ -49,10 +49,15 @@ export abstract class Engine {
   /**
    * Shorthand for sending a SQL query to the engine.
    * Exactly the same as engine.rpc.rawQuery({rawQuery});
+   * |args| are bound in order to the parameters ('?') of the query. Queries
+   * run often (e.g. by tracks) should pass their changing values as args so
+   * that the engine can reuse the prepared query.
    */
-  query(sqlQuery: string): Promise<RawQueryResult> {
+  query(sqlQuery: string, args: Array<number|string> = []):
+      Promise<RawQueryResult> {
     const timeQueuedNs = Math.floor(performance.now() * 1e6);
-    return this.rpc.rawQuery({sqlQuery, timeQueuedNs});
+    return this.rpc.rawQuery(
+        {sqlQuery, timeQueuedNs, args: args.map(toQueryArg)});
   }
 
   async queryOneRow(query: string): Promise<number[]> {
@@ -85,3 +90,9 @@ export abstract class Engine {
     return new TimeSpan(res[0] / 1e9, res[1] / 1e9);
   }
 }
+
+function toQueryArg(arg: number|string): RawQueryArgs.IArg {
+  if (typeof arg === 'string') return {stringValue: arg};
+  if (Number.isInteger(arg)) return {longValue: arg};
+  return {doubleValue: arg};
+}
@@ -507,29 +507,31 @@ export class TraceController extends Controller<States> {
     const engine = assertExists<Engine>(this.engine);
     const numSteps = 100;
     const stepSec = traceTime.duration / numSteps;
-    let hasSchedOverview = false;
+    const stepNs = Math.ceil(stepSec * 1e9);
+    const traceStartNs = Math.floor(traceTime.start * 1e9);
+    const traceEndNs = traceStartNs + stepNs * numSteps;
+
+    // Sched overview.
+    this.updateStatus('Loading overview');
+    const schedRows = await engine.query(
+        `select (ts - ${traceStartNs}) / ${stepNs} as step, cpu, ` +
+        `busy_dur / cast(${stepNs} as float) ` +
+        `from sched_overview(${traceStartNs}, ${traceEndNs}, ${stepNs})`);
+    const schedData: Array<{[key: string]: QuantizedLoad}> = [];
     for (let step = 0; step < numSteps; step++) {
-      this.updateStatus(
-          'Loading overview ' +
-          `${Math.round((step + 1) / numSteps * 1000) / 10}%`);
+      schedData.push({});
+    }
+    const hasSchedOverview = schedRows.numRecords > 0;
+    for (let i = 0; i < schedRows.numRecords; i++) {
+      const step = schedRows.columns[0].longValues![i] as number;
+      const cpu = schedRows.columns[1].longValues![i] as number;
+      const load = schedRows.columns[2].doubleValues![i];
       const startSec = traceTime.start + step * stepSec;
-      const startNs = Math.floor(startSec * 1e9);
       const endSec = startSec + stepSec;
-      const endNs = Math.ceil(endSec * 1e9);
-
-      // Sched overview.
-      const schedRows = await engine.query(
-          `select sum(dur)/${stepSec}/1e9, cpu from sched ` +
-          `where ts >= ${startNs} and ts < ${endNs} and utid != 0 ` +
-          'group by cpu order by cpu');
-      const schedData: {[key: string]: QuantizedLoad} = {};
-      for (let i = 0; i < schedRows.numRecords; i++) {
-        const load = schedRows.columns[0].doubleValues![i];
-        const cpu = schedRows.columns[1].longValues![i] as number;
-        schedData[cpu] = {startSec, endSec, load};
-        hasSchedOverview = true;
-      }  // for (record ...)
-      globals.publish('OverviewData', schedData);
+      schedData[step][cpu] = {startSec, endSec, load};
+    }  // for (record ...)
+    for (let step = 0; step < numSteps; step++) {
+      globals.publish('OverviewData', schedData[step]);
     }  // for (step ...)
 
     if (hasSchedOverview) {
@@ -537,7 +539,6 @@ export class TraceController extends Controller<States> {
     }
 
     // Slices overview.
-    const traceStartNs = traceTime.start * 1e9;
     const stepSecNs = stepSec * 1e9;
     const sliceSummaryQuery = await engine.query(
         `select bucket, upid, sum(utid_sum) / cast(${stepSecNs} as float) ` +
@@ -33,15 +33,21 @@ class ChromeSliceTrackController extends TrackController<Config, Data> {
     // any index. We need to introduce ts_lower_bound also for the slices table
     // (see sched table).
     const query = `select ts,dur,depth,cat,name from slices ` +
-        `where utid = ${this.config.utid} ` +
-        `and ts >= ${Math.round(start * 1e9)} - dur ` +
-        `and ts <= ${Math.round(end * 1e9)} ` +
-        `and dur >= ${Math.round(resolution * 1e9)} ` +
+        `where utid = ? ` +
+        `and ts >= ? - dur ` +
+        `and ts <= ? ` +
+        `and dur >= ? ` +
         `order by ts ` +
         `limit ${LIMIT};`;
+    const args = [
+      this.config.utid,
+      Math.round(start * 1e9),
+      Math.round(end * 1e9),
+      Math.round(resolution * 1e9),
+    ];
 
     this.busy = true;
-    this.engine.query(query).then(rawResult => {
+    this.engine.query(query, args).then(rawResult => {
       this.busy = false;
       if (rawResult.error) {
         throw new Error(`Query error "${query}": ${rawResult.error}`);
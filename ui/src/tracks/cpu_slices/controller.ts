@@ -86,14 +86,13 @@ class CpuSliceTrackController extends TrackController<Config, Data> {
     const numBuckets = Math.ceil((endNs - startNs) / bucketSizeNs);
 
     const query = `select
-        quantum_ts as bucket,
-        sum(dur)/cast(${bucketSizeNs} as float) as utilization
-        from ${this.tableName('span')}
-        where cpu = ${this.config.cpu}
-        and utid != 0
-        group by quantum_ts`;
+        (ts - ?1) / ?3 as bucket,
+        busy_dur / cast(?3 as float) as utilization
+        from sched_overview(?1, ?2, ?3)
+        where cpu = ?4`;
 
-    const rawResult = await this.query(query);
+    const rawResult = await this.query(
+        query, [startNs, endNs, bucketSizeNs, this.config.cpu]);
     const numRows = +rawResult.numRecords;
 
     const summary: Data = {
@@ -149,8 +148,8 @@ class CpuSliceTrackController extends TrackController<Config, Data> {
     return slices;
   }
 
-  private async query(query: string) {
-    const result = await this.engine.query(query);
+  private async query(query: string, args: number[] = []) {
+    const result = await this.engine.query(query, args);
     if (result.error) {
       console.error(`Query error "${query}": ${result.error}`);
       throw new Error(`Query error "${query}": ${result.error}`);